@@ -14,6 +14,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <errno.h>
 
 #include "names.h"
@@ -23,6 +24,8 @@ struct nl_entry {
   unsigned short id1, id2, id3, id4;
   int cat;
   char *name;
+  char *block;				/* vendor's lines, until parsed */
+  int lino;				/* of the first of them */
 };
 
 #define NL_VENDOR 0
@@ -32,41 +35,164 @@ struct nl_entry {
 #define NL_SUBCLASS 4
 #define NL_PROGIF 5
 
+/*
+ * parse_name_list() either parses everything, or just the vendors and
+ * classes, leaving each vendor's devices and subsystems to be parsed by
+ * the first lookup that needs them. That's one vendor or two for most
+ * machines out of the thousands there are.
+ */
+#define NL_PARSE_ALL 0
+#define NL_PARSE_LAZY 1
+#define NL_PARSE_VENDOR 2			/* one vendor's lines */
+
+/* to start with, doubled whenever there are two entries a bucket */
 #define HASH_SIZE 1024
 
+/*
+ * Compiled name list, kept in the user's cache directory as
+ * "$XDG_CACHE_HOME/sysfsutils/<pci.ids>.bin" ($XDG_CACHE_HOME defaulting
+ * to ~/.cache), so nothing is ever written next to the system's copy.
+ * It is written the first time the text file is parsed and is mmap()ed
+ * from then on for as long as the text file has the size and mtime it
+ * was compiled from. Entries are sorted by category and ids for
+ * bsearch(), and are followed by their names.
+ */
+#define NL_BIN_DIR "sysfsutils"
+#define NL_BIN_MAGIC "PCIIDS\0\1"
+#define NL_BIN_ORDER 0x01020304
+
+struct nl_bin_header {
+  char magic[8];
+  unsigned int order;			/* NL_BIN_ORDER, as written */
+  unsigned int count;			/* entries */
+  unsigned int strings_size;
+  unsigned int pad;
+  long long src_size;			/* of the text file compiled */
+  long long src_mtime;
+};
+
+struct nl_bin_entry {
+  unsigned short id1, id2, id3, id4;
+  unsigned int cat;
+  unsigned int name;			/* offset into the names */
+};
+
 static inline unsigned int nl_calc_hash(int cat, int id1, int id2, int id3, int id4)
 {
   unsigned int h;
 
-  h = id1 ^ id2 ^ id3 ^ id4 ^ (cat << 5);
-  h += (h >> 6);
-  return h & (HASH_SIZE-1);
+  /* subsystem ids mostly repeat their device's, so don't just xor them */
+  h = (cat << 16) | id1;
+  h = h * 0x9e3779b1 + id2;
+  h = h * 0x9e3779b1 + ((id3 << 16) | id4);
+  h *= 0x9e3779b1;
+  return h ^ (h >> 15);
 }
 
-static struct nl_entry *nl_lookup(struct pci_access *a, int num, int cat, int id1, int id2, int id3, int id4)
+static int nl_bin_compare(const void *key, const void *elem)
 {
-  unsigned int h;
-  struct nl_entry *n;
+  const struct nl_bin_entry *k = key, *e = elem;
 
-  if (num)
+  if (k->cat != e->cat)
+    return k->cat < e->cat ? -1 : 1;
+  if (k->id1 != e->id1)
+    return k->id1 < e->id1 ? -1 : 1;
+  if (k->id2 != e->id2)
+    return k->id2 < e->id2 ? -1 : 1;
+  if (k->id3 != e->id3)
+    return k->id3 < e->id3 ? -1 : 1;
+  if (k->id4 != e->id4)
+    return k->id4 < e->id4 ? -1 : 1;
+  return 0;
+}
+
+static char *nl_bin_lookup(struct pci_access *a, int cat, int id1, int id2, int id3, int id4)
+{
+  struct nl_bin_entry key;
+  const struct nl_bin_entry *e;
+
+  key.cat = cat;
+  key.id1 = id1;
+  key.id2 = id2;
+  key.id3 = id3;
+  key.id4 = id4;
+  e = bsearch(&key, a->nl_index, a->nl_count, sizeof(struct nl_bin_entry), nl_bin_compare);
+  if (!e || a->nl_strings + e->name >= (const char *)a->nl_map + a->nl_map_size)
     return NULL;
-  h = nl_calc_hash(cat, id1, id2, id3, id4);
-  n = a->nl_hash[h];
-  while (n && (n->id1 != id1 || n->id2 != id2 || n->id3 != id3 || n->id4 != id4 || n->cat != cat)) 
-	 n = n->next;
-  
-  return n;
+  return (char *)a->nl_strings + e->name;
 }
 
-static int nl_add(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, char *text)
+static struct nl_entry *nl_find(struct pci_access *a, int cat, int id1, int id2, int id3, int id4)
 {
   unsigned int h = nl_calc_hash(cat, id1, id2, id3, id4);
-  struct nl_entry *n = a->nl_hash[h];
+  struct nl_entry *n = a->nl_hash[h & (a->nl_hash_size-1)];
 
   while (n && (n->id1 != id1 || n->id2 != id2 || n->id3 != id3 || n->id4 != id4 || n->cat != cat))
     n = n->next;
-  if (n)
+  return n;
+}
+
+static void parse_name_list(struct pci_access *a, char *p, int lino, int id1, int mode);
+
+/* returns the name of the entry looked up, or NULL if there's none */
+static char *nl_lookup(struct pci_access *a, int num, int cat, int id1, int id2, int id3, int id4)
+{
+  struct nl_entry *n;
+  char *block;
+
+  if (num)
+    return NULL;
+  if (a->nl_index)
+    return nl_bin_lookup(a, cat, id1, id2, id3, id4);
+  if (cat == NL_DEVICE || cat == NL_SUBSYSTEM)
+    {
+      /* the vendor's devices may not have been parsed yet */
+      n = nl_find(a, NL_VENDOR, id1, 0, 0, 0);
+      if (n && n->block)
+	{
+	  block = n->block;
+	  n->block = NULL;
+	  parse_name_list(a, block, n->lino, id1, NL_PARSE_VENDOR);
+	}
+    }
+  n = nl_find(a, cat, id1, id2, id3, id4);
+  return n ? n->name : NULL;
+}
+
+/* doubles the hash table once it averages two entries a bucket */
+static void nl_grow(struct pci_access *a)
+{
+  struct nl_entry **hash, *n, *next;
+  unsigned int size, i, h;
+
+  if (a->nl_hash_count < a->nl_hash_size * 2)
+    return;
+  size = a->nl_hash_size * 2;
+  hash = calloc(size, sizeof(struct nl_entry *));
+  if (!hash)
+    return;
+  for (i = 0; i < a->nl_hash_size; i++)
+    for (n = a->nl_hash[i]; n; n = next)
+      {
+	next = n->next;
+	h = nl_calc_hash(n->cat, n->id1, n->id2, n->id3, n->id4) & (size-1);
+	n->next = hash[h];
+	hash[h] = n;
+      }
+  free(a->nl_hash);
+  a->nl_hash = hash;
+  a->nl_hash_size = size;
+}
+
+static int nl_add(struct pci_access *a, int cat, int id1, int id2, int id3, int id4, char *text)
+{
+  unsigned int h;
+  struct nl_entry *n;
+
+  if (nl_find(a, cat, id1, id2, id3, id4))
     return 1;
+  nl_grow(a);
+  h = nl_calc_hash(cat, id1, id2, id3, id4) & (a->nl_hash_size-1);
   n = malloc(sizeof(struct nl_entry));
   bzero(n, sizeof(struct nl_entry));
   n->id1 = id1;
@@ -77,6 +203,7 @@ static int nl_add(struct pci_access *a, int cat, int id1, int id2, int id3, int
   n->name = text;
   n->next = a->nl_hash[h];
   a->nl_hash[h] = n;
+  a->nl_hash_count++;
   return 0;
 }
 
@@ -86,17 +213,29 @@ err_name_list(struct pci_access *a, char *msg)
   fprintf(stderr, "%s: %s: %s\n", a->pci_id_file_name, msg, strerror(errno));
 }
 
+/* is the line at p one of a vendor's or class's, or blank */
+static inline int
+nl_inner_line(const char *p)
+{
+  return *p == '\t' || *p == '#' || *p == '\n';
+}
+
 static void
-parse_name_list(struct pci_access *a)
+parse_name_list(struct pci_access *a, char *p, int lino, int vendor, int mode)
 {
-  char *p = (char *)a->nl_list;
   char *q, *r;
-  int lino = 0;
   unsigned int id1=0, id2=0, id3=0, id4=0;
   int cat = -1;
 
+  if (mode == NL_PARSE_VENDOR)
+    {
+      cat = NL_VENDOR;
+      id1 = vendor;
+    }
   while (*p)
     {
+      if (mode == NL_PARSE_VENDOR && !nl_inner_line(p))
+	break;
       lino++;
       q = p;
       while (*p && *p != '\n')
@@ -186,6 +325,21 @@ parse_name_list(struct pci_access *a)
 	goto parserr;
       if (nl_add(a, cat, id1, id2, id3, id4, q))
 	fprintf(stderr, "%s, line %d: duplicate entry", a->pci_id_file_name, lino);
+      else if (mode == NL_PARSE_LAZY && cat == NL_VENDOR && nl_inner_line(p))
+	{
+	  /* skip the vendor's lines, without touching them */
+	  struct nl_entry *n = nl_find(a, NL_VENDOR, id1, 0, 0, 0);
+
+	  n->block = p;
+	  n->lino = lino;
+	  while (nl_inner_line(p))
+	    {
+	      lino++;
+	      if (!(p = strchr(p, '\n')))
+		return;
+	      p++;
+	    }
+	}
     }
   return;
 
@@ -193,40 +347,245 @@ parserr:
   fprintf(stderr, "%s, line %d: parse error", a->pci_id_file_name, lino);
 }
 
+/*
+ * Returns the compiled list's name, or NULL without a cache directory.
+ * With mkdirs set, the directories leading to it are made as needed.
+ */
+static char *
+bin_name(struct pci_access *a, int mkdirs)
+{
+  const char *cache = getenv("XDG_CACHE_HOME"), *home = getenv("HOME");
+  const char *base = strrchr(a->pci_id_file_name, '/');
+  char *name;
+
+  base = base ? base + 1 : a->pci_id_file_name;
+  if (cache && *cache != '/')
+    cache = NULL;
+  if (!cache && (!home || *home != '/'))
+    return NULL;
+  name = malloc((cache ? strlen(cache) : strlen(home) + 7) +
+		sizeof(NL_BIN_DIR) + strlen(base) + 6);
+  if (!name)
+    return NULL;
+  if (cache)
+    strcpy(name, cache);
+  else
+    {
+      strcpy(name, home);
+      strcat(name, "/.cache");
+    }
+  if (mkdirs)
+    mkdir(name, 0700);
+  strcat(name, "/" NL_BIN_DIR);
+  if (mkdirs)
+    mkdir(name, 0700);
+  strcat(name, "/");
+  strcat(name, base);
+  strcat(name, ".bin");
+  return name;
+}
+
+/*
+ * Maps the compiled name list if it was compiled from the text file as
+ * it is now (src is NULL if that's gone). Returns 0 when mapped.
+ */
+static int
+map_name_list(struct pci_access *a, struct stat *src)
+{
+  const struct nl_bin_header *h;
+  struct stat st;
+  char *name;
+  void *map;
+  int fd;
+
+  if (!(name = bin_name(a, 0)))
+    return -1;
+  fd = open(name, O_RDONLY);
+  free(name);
+  if (fd < 0)
+    return -1;
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(struct nl_bin_header))
+    {
+      close(fd);
+      return -1;
+    }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return -1;
+  h = map;
+  if (memcmp(h->magic, NL_BIN_MAGIC, sizeof(h->magic)) ||
+      h->order != NL_BIN_ORDER ||
+      (src && (h->src_size != (long long)src->st_size ||
+	       h->src_mtime != (long long)src->st_mtime)) ||
+      (size_t)st.st_size != sizeof(struct nl_bin_header) +
+	(size_t)h->count * sizeof(struct nl_bin_entry) + h->strings_size ||
+      !h->strings_size ||
+      ((const char *)map)[st.st_size - 1])
+    {
+      munmap(map, st.st_size);
+      return -1;
+    }
+  a->nl_map = map;
+  a->nl_map_size = st.st_size;
+  a->nl_count = h->count;
+  a->nl_index = (const struct nl_bin_entry *)(h + 1);
+  a->nl_strings = (const char *)(a->nl_index + h->count);
+  return 0;
+}
+
+/*
+ * Opens a temporary file to compile the name list into, for the next run
+ * to map. That is the one time it's all parsed at once, so it's only done
+ * when there is a cache directory to write to. The file has to be a new
+ * one: nothing left there, a link included, is written through.
+ */
+static FILE *
+open_compiled(struct pci_access *a, char **tmp)
+{
+  char *name;
+  FILE *f = NULL;
+  int fd;
+
+  *tmp = NULL;
+  if (!(name = bin_name(a, 1)))
+    return NULL;
+  if ((*tmp = malloc(strlen(name) + 24)))
+    {
+      sprintf(*tmp, "%s.%d", name, (int)getpid());
+      fd = open(*tmp, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0644);
+      if (fd >= 0 && !(f = fdopen(fd, "w")))
+	{
+	  close(fd);
+	  unlink(*tmp);
+	}
+      if (!f)
+	{
+	  free(*tmp);
+	  *tmp = NULL;
+	}
+    }
+  free(name);
+  return f;
+}
+
+/* writes the parsed name list out compiled, into f opened as tmp */
+static void
+compile_name_list(struct pci_access *a, struct stat *src, FILE *f, char *tmp)
+{
+  struct nl_bin_header h;
+  struct nl_bin_entry *index = NULL;
+  struct nl_entry *n, **entries = NULL;
+  char **names = NULL;
+  unsigned int count = a->nl_hash_count, i, j;
+  size_t strings = 0;
+  char *name;
+  int failed = 1;
+
+  name = bin_name(a, 0);
+  if (!count || !name)
+    goto out;
+  entries = malloc(count * sizeof(struct nl_entry *));
+  names = malloc(count * sizeof(char *));
+  index = malloc(count * sizeof(struct nl_bin_entry));
+  if (!entries || !names || !index)
+    goto out;
+
+  /* sorted with the entry's slot standing in for its name */
+  for (i = j = 0; i < a->nl_hash_size; i++)
+    for (n = a->nl_hash[i]; n; n = n->next, j++)
+      {
+	entries[j] = n;
+	index[j].id1 = n->id1;
+	index[j].id2 = n->id2;
+	index[j].id3 = n->id3;
+	index[j].id4 = n->id4;
+	index[j].cat = n->cat;
+	index[j].name = j;
+      }
+  qsort(index, count, sizeof(struct nl_bin_entry), nl_bin_compare);
+  for (i = 0; i < count; i++)
+    {
+      names[i] = entries[index[i].name]->name;
+      index[i].name = strings;
+      strings += strlen(names[i]) + 1;
+    }
+
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, NL_BIN_MAGIC, sizeof(h.magic));
+  h.order = NL_BIN_ORDER;
+  h.count = count;
+  h.strings_size = strings;
+  h.src_size = src->st_size;
+  h.src_mtime = src->st_mtime;
+  fwrite(&h, sizeof(h), 1, f);
+  fwrite(index, sizeof(struct nl_bin_entry), count, f);
+  for (i = 0; i < count; i++)
+    fwrite(names[i], 1, strlen(names[i]) + 1, f);
+  failed = ferror(f);
+out:
+  if (fclose(f) || failed || rename(tmp, name))
+    unlink(tmp);
+  free(name);
+  free(index);
+  free(names);
+  free(entries);
+}
+
 static void
 load_name_list(struct pci_access *a)
 {
   int fd;
   struct stat st;
+  FILE *f = NULL;
+  char *tmp = NULL;
 
   fd = open(a->pci_id_file_name, O_RDONLY);
   if (fd < 0)
     {
+      /* the compiled list will do by itself */
+      if (!map_name_list(a, NULL))
+	return;
       a->numeric_ids = 1;
       return;
     }
   if (fstat(fd, &st) < 0)
-    err_name_list(a, "stat");
+    {
+      err_name_list(a, "stat");
+      st.st_size = 0;
+    }
+  else if (!map_name_list(a, &st))
+    {
+      close(fd);
+      return;
+    }
   a->nl_list = malloc(st.st_size + 1);
   if (read(fd, a->nl_list, st.st_size) != st.st_size)
     err_name_list(a, "read");
   a->nl_list[st.st_size] = 0;
-  a->nl_hash = malloc(sizeof(struct nl_entry *) * HASH_SIZE);
-  bzero(a->nl_hash, sizeof(struct nl_entry *) * HASH_SIZE);
-  parse_name_list(a);
   close(fd);
+  a->nl_hash_size = HASH_SIZE;
+  a->nl_hash_count = 0;
+  a->nl_hash = malloc(sizeof(struct nl_entry *) * a->nl_hash_size);
+  bzero(a->nl_hash, sizeof(struct nl_entry *) * a->nl_hash_size);
+  if (st.st_size)
+    f = open_compiled(a, &tmp);
+  parse_name_list(a, a->nl_list, 0, 0, f ? NL_PARSE_ALL : NL_PARSE_LAZY);
+  if (f)
+    compile_name_list(a, &st, f, tmp);
+  free(tmp);
 }
 
 void
 pci_free_name_list(struct pci_access *a)
 {
-  int i = 0;
+  unsigned int i = 0;
   struct nl_entry *n = NULL, *temp = NULL;
 	
   free(a->nl_list);
   a->nl_list = NULL;
   if (a->nl_hash != NULL) {
-    for (i = 0; i < HASH_SIZE; i++) {
+    for (i = 0; i < a->nl_hash_size; i++) {
       if (a->nl_hash[i] != NULL) {
         n = a->nl_hash[i];
         do {
@@ -239,6 +598,10 @@ pci_free_name_list(struct pci_access *a)
   }
   free(a->nl_hash);
   a->nl_hash = NULL;
+  if (a->nl_map)
+    munmap(a->nl_map, a->nl_map_size);
+  a->nl_map = NULL;
+  a->nl_index = NULL;
 }
 
 char *
@@ -246,14 +609,14 @@ pci_lookup_name(struct pci_access *a, char *buf, int size, int flags, unsigned i
 {
   int num = a->numeric_ids;
   int res;
-  struct nl_entry *n;
+  char *n;
 
   if (flags & PCI_LOOKUP_NUMERIC)
     {
       flags &= PCI_LOOKUP_NUMERIC;
       num = 1;
     }
-  if (!a->nl_hash && !num)
+  if (!a->nl_hash && !a->nl_index && !num)
     {
       load_name_list(a);
       num = a->numeric_ids;
@@ -262,50 +625,50 @@ pci_lookup_name(struct pci_access *a, char *buf, int size, int flags, unsigned i
     {
     case PCI_LOOKUP_VENDOR:
       if ((n = nl_lookup(a, num, NL_VENDOR, arg1, 0, 0, 0)))
-	return n->name;
+	return n;
       else
 	res = snprintf(buf, size, "%04x", arg1);
       break;
     case PCI_LOOKUP_DEVICE:
       if ((n = nl_lookup(a, num, NL_DEVICE, arg1, arg2, 0, 0)))
-	return n->name;
+	return n;
       else
 	res = snprintf(buf, size, "%04x", arg2);
       break;
     case PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE:
       if (!num)
 	{
-	  struct nl_entry *e, *e2;
+	  char *e, *e2;
 	  e = nl_lookup(a, 0, NL_VENDOR, arg1, 0, 0, 0);
 	  e2 = nl_lookup(a, 0, NL_DEVICE, arg1, arg2, 0, 0);
 	  if (!e)
 	    res = snprintf(buf, size, "Unknown device %04x:%04x", arg1, arg2);
 	  else if (!e2)
-	    res = snprintf(buf, size, "%s: Unknown device %04x", e->name, arg2);
+	    res = snprintf(buf, size, "%s: Unknown device %04x", e, arg2);
 	  else
-	    res = snprintf(buf, size, "%s %s", e->name, e2->name);
+	    res = snprintf(buf, size, "%s %s", e, e2);
 	}
       else
 	res = snprintf(buf, size, "%04x:%04x", arg1, arg2);
       break;
     case PCI_LOOKUP_VENDOR | PCI_LOOKUP_SUBSYSTEM:
       if ((n = nl_lookup(a, num, NL_VENDOR, arg3, 0, 0, 0)))
-	return n->name;
+	return n;
       else
 	res = snprintf(buf, size, "%04x", arg2);
       break;
     case PCI_LOOKUP_DEVICE | PCI_LOOKUP_SUBSYSTEM:
       if ((n = nl_lookup(a, num, NL_SUBSYSTEM, arg1, arg2, arg3, arg4)))
-	return n->name;
+	return n;
       else if (arg1 == arg3 && arg2 == arg4 && (n = nl_lookup(a, num, NL_DEVICE, arg1, arg2, 0, 0)))
-	return n->name;
+	return n;
       else
 	res = snprintf(buf, size, "%04x", arg4);
       break;
     case PCI_LOOKUP_VENDOR | PCI_LOOKUP_DEVICE | PCI_LOOKUP_SUBSYSTEM:
       if (!num)
 	{
-	  struct nl_entry *e, *e2;
+	  char *e, *e2;
 	  e = nl_lookup(a, 0, NL_VENDOR, arg3, 0, 0, 0);
 	  e2 = nl_lookup(a, 0, NL_SUBSYSTEM, arg1, arg2, arg3, arg4);
 	  if (!e2 && arg1 == arg3 && arg2 == arg4)
@@ -314,24 +677,24 @@ pci_lookup_name(struct pci_access *a, char *buf, int size, int flags, unsigned i
 	  if (!e)
 	    res = snprintf(buf, size, "Unknown device %04x:%04x", arg3, arg4);
 	  else if (!e2)
-	    res = snprintf(buf, size, "%s: Unknown device %04x", e->name, arg4);
+	    res = snprintf(buf, size, "%s: Unknown device %04x", e, arg4);
 	  else
-	    res = snprintf(buf, size, "%s %s", e->name, e2->name);
+	    res = snprintf(buf, size, "%s %s", e, e2);
 	}
       else
 	res = snprintf(buf, size, "%04x:%04x", arg3, arg4);
       break;
     case PCI_LOOKUP_CLASS:
       if ((n = nl_lookup(a, num, NL_SUBCLASS, arg1 >> 8, arg1 & 0xff, 0, 0)))
-	return n->name;
+	return n;
       else if ((n = nl_lookup(a, num, NL_CLASS, arg1, 0, 0, 0)))
-	res = snprintf(buf, size, "%s [%04x]", n->name, arg1);
+	res = snprintf(buf, size, "%s [%04x]", n, arg1);
       else
 	res = snprintf(buf, size, "Class %04x", arg1);
       break;
     case PCI_LOOKUP_PROGIF:
       if ((n = nl_lookup(a, num, NL_PROGIF, arg1 >> 8, arg1 & 0xff, arg2, 0)))
-	return n->name;
+	return n;
       if (arg1 == 0x0101)
 	{
 	  /* IDE controllers have complex prog-if semantics */
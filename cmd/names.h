@@ -26,6 +26,14 @@ struct pci_access {
         char *pci_id_file_name;
         char *nl_list;
         struct nl_entry **nl_hash;
+        unsigned int nl_hash_size;	/* buckets, a power of two */
+        unsigned int nl_hash_count;	/* entries */
+        /* compiled name list, mmap()ed instead of parsing nl_list */
+        void *nl_map;
+        size_t nl_map_size;
+        const struct nl_bin_entry *nl_index;
+        unsigned int nl_count;
+        const char *nl_strings;
 };
 
 extern char *pci_lookup_name(struct pci_access *a, char *buf,
@@ -0,0 +1,366 @@
+/*
+ * output.c
+ *
+ * Buffered output for systool
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *	This program is free software; you can redistribute it and/or modify it
+ *	under the terms of the GNU General Public License as published by the
+ *	Free Software Foundation version 2 of the License.
+ *
+ *	This program is distributed in the hope that it will be useful, but
+ *	WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *	General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License along
+ *	with this program; if not, write to the Free Software Foundation, Inc.,
+ *	675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "output.h"
+
+/* its buffer is allocated by the first thing printed */
+struct output output_stdout = { NULL, 0, 0, 1, 0 };
+__thread struct output *output = &output_stdout;
+
+static const char spaces[] = "                                "
+			     "                                ";
+
+static const char hexdigits[] = "0123456789abcdef";
+
+static int write_all(int fd, const char *s, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, s, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		s += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/**
+ * out_open: sets up an output
+ * @out: output to set up
+ * @fd: where it's flushed to, -1 for it to grow instead
+ * @size: initial size of its buffer
+ * returns 0 with success and -1 with error.
+ */
+int out_open(struct output *out, int fd, size_t size)
+{
+	memset(out, 0, sizeof(struct output));
+	out->fd = fd;
+	out->buf = (char *)malloc(size);
+	if (!out->buf)
+		return -1;
+	out->size = size;
+	return 0;
+}
+
+/**
+ * out_close: flushes an output and frees its buffer
+ */
+void out_close(struct output *out)
+{
+	out_flush(out);
+	free(out->buf);
+	out->buf = NULL;
+	out->len = out->size = 0;
+}
+
+/**
+ * out_flush: writes out what's buffered, if out has an fd
+ * returns 0 with success and -1 if this or any earlier write failed, in
+ *	which case what's buffered is dropped.
+ */
+int out_flush(struct output *out)
+{
+	if (out->fd < 0)
+		return 0;
+	if (!out->error && out->len > 0 &&
+	    write_all(out->fd, out->buf, out->len))
+		out->error = errno;
+	out->len = 0;
+	if (out->error) {
+		errno = out->error;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * out_reserve: makes room for len more bytes in the current output
+ * returns where they go, to be accounted for in output->len once
+ *	written, or NULL with error.
+ */
+char *out_reserve(size_t len)
+{
+	struct output *out = output;
+	size_t size;
+	char *buf;
+
+	if (out->size - out->len >= len)
+		return out->buf + out->len;
+	if (out->fd >= 0) {
+		out_flush(out);
+		if (out->size >= len)
+			return out->buf;
+	}
+	size = out->size ? out->size : OUTPUT_BUFSIZE;
+	while (size - out->len < len)
+		size *= 2;
+	buf = (char *)realloc(out->buf, size);
+	if (!buf) {
+		out->error = ENOMEM;
+		return NULL;
+	}
+	out->buf = buf;
+	out->size = size;
+	return out->buf + out->len;
+}
+
+/**
+ * out_write: prints len bytes of s
+ */
+void out_write(const char *s, size_t len)
+{
+	struct output *out = output;
+	char *p;
+
+	if (out->fd >= 0 &&
+	    len > (out->size ? out->size : OUTPUT_BUFSIZE)) {
+		/* too big to be worth buffering */
+		if (!out_flush(out) && write_all(out->fd, s, len))
+			out->error = errno;
+		return;
+	}
+	p = out_reserve(len);
+	if (p) {
+		memcpy(p, s, len);
+		out->len += len;
+	}
+}
+
+/**
+ * out_puts: prints s, without adding a newline
+ */
+void out_puts(const char *s)
+{
+	out_write(s, strlen(s));
+}
+
+/**
+ * out_printf: prints as printf() does, formatting straight into the
+ *	buffer whenever it fits
+ */
+void out_printf(const char *fmt, ...)
+{
+	struct output *out = output;
+	size_t room = out->size - out->len;
+	va_list ap;
+	char *p;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(out->buf ? out->buf + out->len : NULL, room, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return;
+	if ((size_t)n < room) {
+		out->len += n;
+		return;
+	}
+	p = out_reserve(n + 1);
+	if (!p)
+		return;
+	va_start(ap, fmt);
+	vsnprintf(p, n + 1, fmt, ap);
+	va_end(ap);
+	out->len += n;
+}
+
+/**
+ * out_indent: prints level spaces
+ */
+void out_indent(int level)
+{
+	int n;
+
+	while (level > 0) {
+		n = level < (int)sizeof(spaces) - 1 ?
+				level : (int)sizeof(spaces) - 1;
+		out_write(spaces, n);
+		level -= n;
+	}
+}
+
+/**
+ * out_hex: prints data as 16 hex bytes a line, split in two halves of 8,
+ *	each byte after a space
+ * @level: indent of any lines after the first
+ */
+void out_hex(const unsigned char *data, size_t len, int level)
+{
+	size_t i, j, n;
+	char *p;
+
+	for (i = 0; i < len; i += n) {
+		if (i) {
+			out_putc('\n');
+			out_indent(level);
+		}
+		n = len - i < 16 ? len - i : 16;
+		p = out_reserve(16 * 3 + 1);
+		if (!p)
+			return;
+		for (j = 0; j < n; j++) {
+			if (j == 8)
+				*p++ = ' ';
+			*p++ = ' ';
+			*p++ = hexdigits[data[i + j] >> 4];
+			*p++ = hexdigits[data[i + j] & 0xf];
+		}
+		output->len = p - output->buf;
+	}
+}
+
+/**
+ * out_append: prints everything from has kept, and empties it
+ */
+void out_append(struct output *from)
+{
+	out_write(from->buf, from->len);
+	if (from->error && !output->error)
+		output->error = from->error;
+	from->len = 0;
+	from->error = 0;
+}
+
+/**
+ * utf8_char: tells the bytes of a UTF-8 character from others
+ * @s: where the character starts, at a byte of 0x80 or more
+ * @left: bytes from s to the end of the string
+ * returns the length of the character s starts, 0 if it isn't valid
+ *	UTF-8: overlong, a surrogate, past U+10FFFF or cut short.
+ */
+static size_t utf8_char(const unsigned char *s, size_t left)
+{
+	unsigned char lo = 0x80, hi = 0xbf;
+	size_t len, i;
+
+	if (s[0] >= 0xc2 && s[0] <= 0xdf)
+		len = 2;
+	else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+		len = 3;
+		if (s[0] == 0xe0)
+			lo = 0xa0;
+		else if (s[0] == 0xed)
+			hi = 0x9f;
+	} else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+		len = 4;
+		if (s[0] == 0xf0)
+			lo = 0x90;
+		else if (s[0] == 0xf4)
+			hi = 0x8f;
+	} else
+		return 0;
+	if (len > left || s[1] < lo || s[1] > hi)
+		return 0;
+	for (i = 2; i < len; i++)
+		if (s[i] < 0x80 || s[i] > 0xbf)
+			return 0;
+	return len;
+}
+
+/**
+ * out_json_string: prints len bytes of s as a quoted JSON string. Bytes
+ *	that aren't part of valid UTF-8 are escaped as the code point of
+ *	the same number, so the output stays valid JSON whatever s holds.
+ */
+void out_json_string(const char *s, size_t len)
+{
+	const char *end = s + len, *run;
+	const unsigned char *u;
+	unsigned char c;
+	size_t n;
+	char *p;
+
+	out_putc('"');
+	while (s < end) {
+		/* runs that need no escaping are copied as they are */
+		for (run = s; s < end; s += n) {
+			u = (const unsigned char *)s;
+			c = *u;
+			n = 1;
+			if (c < 0x20 || c == '"' || c == '\\')
+				break;
+			if (c >= 0x80 && !(n = utf8_char(u, end - s)))
+				break;
+		}
+		if (s > run)
+			out_write(run, s - run);
+		if (s == end)
+			break;
+		c = (unsigned char)*s++;
+		p = out_reserve(6);
+		if (!p)
+			return;
+		*p++ = '\\';
+		switch (c) {
+		case '"':
+		case '\\':
+			*p++ = c;
+			break;
+		case '\n':
+			*p++ = 'n';
+			break;
+		case '\t':
+			*p++ = 't';
+			break;
+		default:
+			*p++ = 'u';
+			*p++ = '0';
+			*p++ = '0';
+			*p++ = hexdigits[c >> 4];
+			*p++ = hexdigits[c & 0xf];
+			break;
+		}
+		output->len = p - output->buf;
+	}
+	out_putc('"');
+}
+
+/**
+ * out_json_hex: prints data as a JSON string of hex digits, two a byte
+ */
+void out_json_hex(const unsigned char *data, size_t len)
+{
+	size_t i;
+	char *p;
+
+	p = out_reserve(len * 2 + 2);
+	if (!p)
+		return;
+	*p++ = '"';
+	for (i = 0; i < len; i++) {
+		*p++ = hexdigits[data[i] >> 4];
+		*p++ = hexdigits[data[i] & 0xf];
+	}
+	*p++ = '"';
+	output->len = p - output->buf;
+}
@@ -0,0 +1,66 @@
+/*
+ * output.h
+ *
+ * Buffered output for systool
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *	This program is free software; you can redistribute it and/or modify it
+ *	under the terms of the GNU General Public License as published by the
+ *	Free Software Foundation version 2 of the License.
+ *
+ *	This program is distributed in the hope that it will be useful, but
+ *	WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *	General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License along
+ *	with this program; if not, write to the Free Software Foundation, Inc.,
+ *	675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#include <stddef.h>
+
+#define OUTPUT_BUFSIZE		(256 * 1024)
+
+/*
+ * Everything systool prints goes through one of these, which only calls
+ * write() when its buffer fills up or it's flushed. Outputs without an
+ * fd keep growing instead, to be copied out later with out_append().
+ */
+struct output {
+	char *buf;
+	size_t len;
+	size_t size;
+	int fd;			/* -1 to just keep it all */
+	int error;		/* errno of a failed write, once there's one */
+};
+
+extern struct output output_stdout;
+/* where out_*() print to, &output_stdout unless the thread changes it */
+extern __thread struct output *output;
+
+extern int out_open(struct output *out, int fd, size_t size);
+extern void out_close(struct output *out);
+extern int out_flush(struct output *out);
+extern char *out_reserve(size_t len);
+extern void out_write(const char *s, size_t len);
+extern void out_puts(const char *s);
+extern void out_printf(const char *fmt, ...)
+	__attribute__ ((format (printf, 1, 2)));
+extern void out_indent(int level);
+extern void out_hex(const unsigned char *data, size_t len, int level);
+extern void out_append(struct output *from);
+extern void out_json_string(const char *s, size_t len);
+extern void out_json_hex(const unsigned char *data, size_t len);
+
+static inline void out_putc(char c)
+{
+	if (output->len < output->size || out_reserve(1))
+		output->buf[output->len++] = c;
+}
+
+#endif /* _OUTPUT_H_ */
@@ -0,0 +1,236 @@
+/*
+ * sysfsd.c
+ *
+ * Daemon publishing a view of sysfs for libsysfs programs to read
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *	This program is free software; you can redistribute it and/or modify it
+ *	under the terms of the GNU General Public License as published by the
+ *	Free Software Foundation version 2 of the License.
+ *
+ *	This program is distributed in the hope that it will be useful, but
+ *	WITHOUT ANY WARRANTY; without even the implied warranty of
+ *	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *	General Public License for more details.
+ *
+ *	You should have received a copy of the GNU General Public License along
+ *	with this program; if not, write to the Free Software Foundation, Inc.,
+ *	675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "libsysfs.h"
+
+/* how long uevents have to stop coming before a new view is published */
+#define DEFAULT_SETTLE_MS	200
+/* how long a view may go unpublished while uevents keep coming */
+#define DEFAULT_MAX_DELAY_MS	2000
+
+static volatile sig_atomic_t stopping;
+
+static void stop(int sig)
+{
+	(void)sig;
+	stopping = 1;
+}
+
+static void usage(void)
+{
+	fprintf(stdout, "Usage: sysfsd [<options>] [directory ...]\n"
+		"\tPublishes the sysfs directories given, or the usual ones,\n"
+		"\tfor programs that name the view in SYSFS_PATH to read.\n");
+	fprintf(stdout, "[<options>]\n");
+	fprintf(stdout, "\t-f <view>\tPublish to <view>, default %s\n",
+			SYSFS_VIEW_PATH);
+	fprintf(stdout, "\t-d <msec>\tWait for uevents to settle this long, "
+			"default %d\n", DEFAULT_SETTLE_MS);
+	fprintf(stdout, "\t-m <msec>\tBut publish at most this long after "
+			"the first, default %d\n", DEFAULT_MAX_DELAY_MS);
+	fprintf(stdout, "\t-i <sec>\tRepublish at least this often\n");
+	fprintf(stdout, "\t-h\t\tShow usage\n");
+}
+
+/**
+ * msec_now: a monotonic clock in milliseconds
+ */
+static long long msec_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * make_view_dir: creates the directory views are published to by default,
+ *	or makes sure the one there can be written to by no one but us
+ * returns 0 with success and -1 with error.
+ */
+static int make_view_dir(const char *dir)
+{
+	struct stat stats;
+
+	if (mkdir(dir, 0755) && errno != EEXIST)
+		return -1;
+	if (lstat(dir, &stats))
+		return -1;
+	if (!S_ISDIR(stats.st_mode) ||
+	    (stats.st_uid != 0 && stats.st_uid != geteuid()) ||
+	    (stats.st_mode & (S_IWGRP | S_IWOTH))) {
+		errno = EPERM;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * wait_events: waits up to timeout milliseconds for uevents, or without a
+ *	watch just waits
+ * returns the number of events read, 0 if none came, and -1 with error.
+ */
+static int wait_events(struct sysfs_watch *watch, int timeout)
+{
+	if (watch)
+		return sysfs_read_watch(watch, timeout);
+	return poll(NULL, 0, timeout);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *file = SYSFS_VIEW_PATH;
+	const char **dirs = NULL;
+	struct sysfs_watch *watch;
+	struct sysfs_view *view;
+	struct sigaction action;
+	long long published, first = 0, now;
+	int settle = DEFAULT_SETTLE_MS, max_delay = DEFAULT_MAX_DELAY_MS;
+	int interval = 0, opt, timeout, left, pending = 0, ret;
+
+	while ((opt = getopt(argc, argv, "d:f:hi:m:")) != EOF) {
+		switch (opt) {
+		case 'd':
+			settle = atoi(optarg);
+			if (settle < 0) {
+				usage();
+				exit(1);
+			}
+			break;
+		case 'f':
+			file = optarg;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		case 'i':
+			interval = atoi(optarg);
+			if (interval < 0) {
+				usage();
+				exit(1);
+			}
+			break;
+		case 'm':
+			max_delay = atoi(optarg);
+			if (max_delay < 0) {
+				usage();
+				exit(1);
+			}
+			break;
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (optind < argc)
+		dirs = (const char **)&argv[optind];
+
+	watch = sysfs_open_watch();
+	if (!watch) {
+		if (!interval) {
+			fprintf(stderr, "sysfsd: can't watch uevents: %s\n",
+					strerror(errno));
+			exit(1);
+		}
+		fprintf(stderr, "sysfsd: can't watch uevents, republishing "
+				"every %d seconds only\n", interval);
+	}
+
+	memset(&action, 0, sizeof(struct sigaction));
+	action.sa_handler = stop;
+	sigemptyset(&action.sa_mask);
+	/* no SA_RESTART, so waiting for uevents ends with the signal */
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+
+	if (!strcmp(file, SYSFS_VIEW_PATH) && make_view_dir(SYSFS_VIEW_DIR)) {
+		fprintf(stderr, "sysfsd: can't publish to %s: %s\n",
+				SYSFS_VIEW_DIR, strerror(errno));
+		sysfs_close_watch(watch);
+		exit(1);
+	}
+	view = sysfs_open_view(file, dirs);
+	if (!view) {
+		fprintf(stderr, "sysfsd: can't publish to %s: %s\n", file,
+				strerror(errno));
+		sysfs_close_watch(watch);
+		exit(1);
+	}
+	published = msec_now();
+
+	while (!stopping) {
+		if (pending) {
+			timeout = settle;
+			left = max_delay - (int)(msec_now() - first);
+			if (left < timeout)
+				timeout = left < 0 ? 0 : left;
+		} else if (interval) {
+			timeout = interval * 1000 -
+				(int)(msec_now() - published);
+			if (timeout < 0)
+				timeout = 0;
+		} else
+			timeout = -1;
+
+		ret = wait_events(watch, timeout);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0 && errno != ENOBUFS) {
+			fprintf(stderr, "sysfsd: error reading uevents: %s\n",
+					strerror(errno));
+			break;
+		}
+		now = msec_now();
+		/* lost events still mean something changed */
+		if (ret != 0) {
+			if (!pending)
+				first = now;
+			pending = 1;
+			/* uevents that never stop coming don't hold it back */
+			if (now - first < max_delay)
+				continue;
+		} else if (!pending &&
+			   !(interval && now - published >= interval * 1000LL))
+			continue;
+		if (sysfs_publish_view(view))
+			fprintf(stderr, "sysfsd: error publishing to %s: %s\n",
+					file, strerror(errno));
+		pending = 0;
+		published = now;
+	}
+
+	sysfs_close_view(view);
+	sysfs_close_watch(watch);
+	exit(stopping ? 0 : 1);
+}
@@ -19,6 +19,9 @@
  *	675 Mass Ave, Cambridge, MA 02139, USA.
  *
  */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -28,9 +31,15 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#include <getopt.h>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 #include "libsysfs.h"
 #include "names.h"
+#include "output.h"
 
 extern char *my_strncpy(char *to, const char *from, size_t max);
 #define safestrcpy(to, from)		my_strncpy(to, from, sizeof(to))
@@ -45,13 +54,26 @@ do { \
 	strncat(to, from, max - strlen(to)-1); \
 } while (0)
 
-/* Command Options */
-static int show_options = 0;		/* bitmask of show options */
+/*
+ * Command Options. Those kept per thread are set afresh for each bus,
+ * class or module shown, in whichever thread shows it.
+ */
+static __thread int show_options = 0;	/* bitmask of show options */
 static char *attribute_to_show = NULL;	/* show value for this attribute */
 static char *device_to_show = NULL;	/* show only this bus device */
 static char sysfs_mnt_path[SYSFS_PATH_MAX]; /* sysfs mount point */
-struct pci_access *pacc = NULL;
-char *show_bus = NULL;
+static __thread struct pci_access *pacc = NULL;
+static __thread char *show_bus = NULL;
+
+/*
+ * The device and attribute asked for are handed to libsysfs to pick out
+ * as it reads each directory, so that what's skipped is never opened.
+ * attribute_filter is NULL when every attribute is shown.
+ */
+static struct sysfs_filter device_filter = { NULL, NULL };
+static const char *attribute_names[] = { NULL, NULL };
+static struct sysfs_filter attribute_names_filter = { NULL, attribute_names };
+static const struct sysfs_filter *attribute_filter = NULL;
 
 static void show_device(struct sysfs_device *device, int level);
 static void show_class_device(struct sysfs_class_device *dev, int level);
@@ -67,7 +89,26 @@ static void show_class_device(struct sysfs_class_device *dev, int level);
                                                                                 
 #define SHOW_ALL		0xff
 
-static char cmd_options[] = "aA:b:c:dDhm:pP:v";
+#define FORMAT_TEXT		0	/* indented, for people */
+#define FORMAT_JSON		1	/* one array of records */
+#define FORMAT_NDJSON		2	/* one record a line */
+
+#define OPT_STATS		0x100	/* --stats, which has no short option */
+
+static int output_format = FORMAT_TEXT;
+static __thread unsigned long records = 0;	/* printed so far */
+static int show_stats = 0;
+
+static char cmd_options[] = "aA:b:c:dDf:hj:m:pP:S:Tv";
+
+static struct option long_options[] = {
+	{ "format", required_argument, NULL, 'f' },
+	{ "help", no_argument, NULL, 'h' },
+	{ "jobs", required_argument, NULL, 'j' },
+	{ "snapshot", required_argument, NULL, 'S' },
+	{ "stats", no_argument, NULL, OPT_STATS },
+	{ NULL, 0, NULL, 0 }
+};
 
 /*
  * binary_files - defines existing sysfs binary files. These files will be
@@ -92,43 +133,37 @@ static unsigned int get_pciconfig_word(int offset, unsigned char *buf)
  */
 static void usage(void)
 {
-	fprintf(stdout, "Usage: systool [<options> [device]]\n");
-	fprintf(stdout, "\t-a\t\t\tShow attributes\n");
-	fprintf(stdout, "\t-b <bus_name>\t\tShow a specific bus\n");
-	fprintf(stdout, "\t-c <class_name>\t\tShow a specific class\n");
-	fprintf(stdout, "\t-d\t\t\tShow only devices\n");
-	fprintf(stdout, "\t-h\t\t\tShow usage\n");
-	fprintf(stdout, "\t-m <module_name>\tShow a specific module\n");
-	fprintf(stdout, "\t-p\t\t\tShow path to device/driver\n");
-	fprintf(stdout, "\t-v\t\t\tShow all attributes with values\n");
-	fprintf(stdout, "\t-A <attribute_name>\tShow attribute value\n");
-	fprintf(stdout, "\t-D\t\t\tShow only drivers\n");
-	fprintf(stdout, "\t-P\t\t\tShow device's parent\n");
+	out_puts("Usage: systool [<options> [device]]\n");
+	out_puts("\t-a\t\t\tShow attributes\n");
+	out_puts("\t-b <bus_name>\t\tShow a specific bus, or all\n");
+	out_puts("\t-c <class_name>\t\tShow a specific class, or all\n");
+	out_puts("\t-d\t\t\tShow only devices\n");
+	out_puts("\t-f <format>\t\tPrint as text (default), json or ndjson\n");
+	out_puts("\t-h\t\t\tShow usage\n");
+	out_puts("\t-j <jobs>\t\tRead up to jobs buses, classes and modules "
+			"at once\n");
+	out_puts("\t-m <module_name>\tShow a specific module, or all\n");
+	out_puts("\t-p\t\t\tShow path to device/driver\n");
+	out_puts("\t-v\t\t\tShow all attributes with values\n");
+	out_puts("\t-A <attribute_name>\tShow attribute value\n");
+	out_puts("\t-D\t\t\tShow only drivers\n");
+	out_puts("\t-P\t\t\tShow device's parent\n");
+	out_puts("\t-S <file>\t\tWrite a snapshot of sysfs to file\n");
+	out_puts("\t-T\t\t\tShow the device tree\n");
+	out_puts("\t--stats\t\t\tShow the work done on stderr\n");
 }
 
 /**
- * indent: called before printing a line, it adds indent to the line up to
- *	level passed in.
- * @level: number of spaces to indent.
+ * show_attribute_name: prints an attribute's name padded out to 20
+ * @name: name to print.
  */
-static void indent(int level)
+static void show_attribute_name(const char *name)
 {
-	int i;
+	size_t len = strlen(name);
 
-	for (i = 0; i < level; i++)
-		fprintf(stdout, " ");
-}
-
-/**
- * remove_end_newline: removes newline on the end of an attribute value
- * @value: string to remove newline from
- */
-static void remove_end_newline(char *value)
-{
-	char *p = value + (strlen(value) - 1);
-
-	if (p && *p == '\n')
-		*p = '\0';
+	out_write(name, len);
+	if (len < 20)
+		out_indent(20 - len);
 }
 
 /**
@@ -156,30 +191,27 @@ static int isbinaryvalue(struct sysfs_attribute *attr)
  */
 static void show_attribute_value(struct sysfs_attribute *attr, int level)
 {
+	size_t len;
+
 	if (!attr)
 		return;
 
 	if (attr->method & SYSFS_METHOD_SHOW) {
 		if (isbinaryvalue(attr)) {
-			int i;
-			for (i = 0; i < attr->len; i++) {
-				if (!(i % 16) && (i != 0)) {
-					fprintf(stdout, "\n");
-					indent(level+22);
-				} else if (!(i % 8) && (i != 0))
-					fprintf(stdout, " ");
-				fprintf(stdout, " %02x", 
-					(unsigned char)attr->value[i]);
-			}
-			fprintf(stdout, "\n");
-
-		} else if (attr->value && strlen(attr->value) > 0) {
-			remove_end_newline(attr->value);
-			fprintf(stdout, "\"%s\"\n", attr->value);
+			out_hex((unsigned char *)attr->value, attr->len,
+					level+22);
+			out_putc('\n');
+		} else if (attr->value && (len = strlen(attr->value)) > 0) {
+			/* the value stays as read, newline and all */
+			if (attr->value[len-1] == '\n')
+				len--;
+			out_putc('"');
+			out_write(attr->value, len);
+			out_puts("\"\n");
 		} else
-			fprintf(stdout, "\n");
+			out_putc('\n');
 	} else {
-		fprintf(stdout, "<store method only>\n");
+		out_puts("<store method only>\n");
 	}
 }
 
@@ -192,21 +224,33 @@ static void show_attribute(struct sysfs_attribute *attr, int level)
 	if (!attr) 
 		return;
 
+	/*
+	 * attributes are listed without values; read the value only when
+	 * it is going to be shown and skip the attribute if that fails
+	 */
+	if ((attr->method & SYSFS_METHOD_SHOW) &&
+	    ((show_options & SHOW_ALL_ATTRIB_VALUES) ||
+	    ((show_options & SHOW_ATTRIBUTE_VALUE) &&
+	    (strcmp(attr->name, attribute_to_show)) == 0)) &&
+	    sysfs_get_attribute_value(attr) == NULL)
+		return;
+
 	if (show_options & SHOW_ALL_ATTRIB_VALUES) {
-		indent(level);
-		fprintf(stdout, "%-20s= ", attr->name);
+		out_indent(level);
+		show_attribute_name(attr->name);
+		out_puts("= ");
 		show_attribute_value(attr, level);
 	} else if ((show_options & SHOW_ATTRIBUTES) || ((show_options 
 	    & SHOW_ATTRIBUTE_VALUE) && (strcmp(attr->name, attribute_to_show) 
 	    == 0))) {
-		indent(level);
-		fprintf (stdout, "%-20s", attr->name);
+		out_indent(level);
+		show_attribute_name(attr->name);
 		if (show_options & SHOW_ATTRIBUTE_VALUE && attr->value 
 		    != NULL && (strcmp(attr->name, attribute_to_show)) == 0) {
-			fprintf(stdout, "= ");
+			out_puts("= ");
 			show_attribute_value(attr, level);
 		} else 
-			fprintf(stdout, "\n");
+			out_putc('\n');
 	}
 }
 
@@ -226,6 +270,247 @@ static void show_attributes(struct dlist *attributes, int level)
 	}
 }
 
+/*
+ * With --format=json or ndjson, each device, driver, class device and
+ * module is printed as a record as soon as it's come to, with the same
+ * attributes the text would have shown. Attribute values are strings,
+ * binary ones in hex, or null where no value would have been shown.
+ */
+
+/**
+ * json_begin_record: starts a record of type
+ */
+static void json_begin_record(const char *type)
+{
+	if (output_format == FORMAT_JSON)
+		out_puts(records ? ",\n" : "\n");
+	records++;
+	out_puts("{\"type\":");
+	out_json_string(type, strlen(type));
+}
+
+/**
+ * json_end_record: ends a record
+ */
+static void json_end_record(void)
+{
+	out_putc('}');
+	if (output_format == FORMAT_NDJSON)
+		out_putc('\n');
+}
+
+/**
+ * json_field: adds a string field to the current record, unless it's NULL
+ */
+static void json_field(const char *name, const char *value)
+{
+	if (!value)
+		return;
+	out_putc(',');
+	out_json_string(name, strlen(name));
+	out_putc(':');
+	out_json_string(value, strlen(value));
+}
+
+/**
+ * json_attributes: adds an object of the attributes that would be shown
+ *	to the current record
+ * @name: field name for the object.
+ * @attributes: dlist of attributes, may be NULL.
+ */
+static void json_attributes(const char *name, struct dlist *attributes)
+{
+	struct sysfs_attribute *attr;
+	int first = 1, wanted, value;
+	size_t len;
+
+	if (!(show_options & (SHOW_ATTRIBUTES | SHOW_ATTRIBUTE_VALUE |
+				SHOW_ALL_ATTRIB_VALUES)))
+		return;
+	out_putc(',');
+	out_json_string(name, strlen(name));
+	out_puts(":{");
+	if (attributes) {
+		dlist_for_each_data(attributes, attr, struct sysfs_attribute) {
+			/* as show_attribute() decides */
+			wanted = (show_options & SHOW_ATTRIBUTE_VALUE) &&
+				!strcmp(attr->name, attribute_to_show);
+			if (!wanted && !(show_options &
+					(SHOW_ATTRIBUTES | SHOW_ALL_ATTRIB_VALUES)))
+				continue;
+			value = (attr->method & SYSFS_METHOD_SHOW) &&
+				(wanted || (show_options & SHOW_ALL_ATTRIB_VALUES));
+			if (value && !sysfs_get_attribute_value(attr))
+				continue;
+
+			if (!first)
+				out_putc(',');
+			first = 0;
+			out_json_string(attr->name, strlen(attr->name));
+			out_putc(':');
+			if (!value || !attr->value)
+				out_puts("null");
+			else if (isbinaryvalue(attr))
+				out_json_hex((unsigned char *)attr->value,
+						attr->len);
+			else {
+				/* all of it, nuls and all */
+				len = attr->len;
+				if (len && attr->value[len-1] == '\n')
+					len--;
+				out_json_string(attr->value, len);
+			}
+		}
+	}
+	out_putc('}');
+}
+
+/**
+ * json_pci_name: adds the name pci.ids has for a PCI device
+ */
+static void json_pci_name(struct sysfs_device *device)
+{
+	struct sysfs_attribute *attr;
+	char path[SYSFS_PATH_MAX], buf[128];
+	unsigned int vendor_id, device_id;
+
+	safestrcpy(path, device->path);
+	safestrcat(path, "/config");
+	attr = sysfs_open_attribute(path);
+	if (!attr)
+		return;
+	if (!sysfs_read_attribute(attr) && attr->len >= 4) {
+		vendor_id = get_pciconfig_word(PCI_VENDOR_ID,
+				(unsigned char *)attr->value);
+		device_id = get_pciconfig_word(PCI_DEVICE_ID,
+				(unsigned char *)attr->value);
+		json_field("description", pci_lookup_name(pacc, buf,
+				sizeof(buf), PCI_LOOKUP_VENDOR |
+				PCI_LOOKUP_DEVICE, vendor_id, device_id, 0, 0));
+	}
+	sysfs_close_attribute(attr);
+}
+
+/**
+ * json_device: prints a device record
+ */
+static void json_device(struct sysfs_device *device)
+{
+	struct sysfs_device *parent;
+
+	json_begin_record("device");
+	json_field("name", device->bus_id);
+	json_field("path", device->path);
+	if (device->bus[0] && strcmp(device->bus, SYSFS_UNKNOWN))
+		json_field("bus", device->bus);
+	else
+		json_field("bus", show_bus);
+	if (device->driver_name[0] &&
+	    strcmp(device->driver_name, SYSFS_UNKNOWN))
+		json_field("driver", device->driver_name);
+	if (pacc)
+		json_pci_name(device);
+	if (device_to_show && (show_options & SHOW_PARENT)) {
+		parent = sysfs_get_device_parent(device);
+		if (parent)
+			json_field("parent", parent->path);
+	}
+	json_attributes("attributes", sysfs_get_device_attributes_matching(
+				device, attribute_filter));
+	json_end_record();
+}
+
+/**
+ * json_driver: prints a driver record, naming the devices it drives
+ */
+static void json_driver(struct sysfs_driver *driver)
+{
+	struct sysfs_device *cur;
+	struct dlist *devlist;
+	int first = 1;
+
+	json_begin_record("driver");
+	json_field("name", driver->name);
+	json_field("path", driver->path);
+	if (driver->bus[0])
+		json_field("bus", driver->bus);
+	json_attributes("attributes", sysfs_get_driver_attributes_matching(
+				driver, attribute_filter));
+	devlist = sysfs_get_driver_devices(driver);
+	out_puts(",\"devices\":[");
+	if (devlist) {
+		dlist_for_each_data(devlist, cur, struct sysfs_device) {
+			if (!first)
+				out_putc(',');
+			first = 0;
+			out_json_string(cur->name, strlen(cur->name));
+		}
+	}
+	out_putc(']');
+	json_end_record();
+}
+
+/**
+ * json_class_device: prints a class device record
+ */
+static void json_class_device(struct sysfs_class_device *dev)
+{
+	struct sysfs_class_device *parent;
+	struct sysfs_device *device;
+
+	json_begin_record("class_device");
+	json_field("name", dev->name);
+	json_field("path", dev->path);
+	if (dev->classname[0])
+		json_field("class", dev->classname);
+	device = sysfs_get_classdev_device(dev);
+	if (device)
+		json_field("device", device->path);
+	if (device_to_show && (show_options & SHOW_PARENT)) {
+		parent = sysfs_get_classdev_parent(dev);
+		if (parent)
+			json_field("parent", parent->path);
+	}
+	json_attributes("attributes", sysfs_get_classdev_attributes_matching(
+				dev, attribute_filter));
+	json_end_record();
+}
+
+/**
+ * json_module: prints a module record
+ */
+static void json_module(struct sysfs_module *mod)
+{
+	json_begin_record("module");
+	json_field("name", mod->name);
+	json_field("path", mod->path);
+	json_attributes("attributes", sysfs_get_module_attributes_matching(
+				mod, attribute_filter));
+	json_attributes("parameters", sysfs_get_module_parms(mod));
+	json_attributes("sections", sysfs_get_module_sections(mod));
+	json_end_record();
+}
+
+/**
+ * json_list: prints a record naming what's in a sysfs directory
+ */
+static void json_list(const char *type, struct dlist *list)
+{
+	char *cur;
+	int first = 1;
+
+	json_begin_record(type);
+	out_puts(",\"names\":[");
+	dlist_for_each_data(list, cur, char) {
+		if (!first)
+			out_putc(',');
+		first = 0;
+		out_json_string(cur, strlen(cur));
+	}
+	out_puts("]");
+	json_end_record();
+}
+
 /**
  * show_device_parent: prints device's parent (if present)
  * @device: sysfs_device whose parent information is needed
@@ -236,9 +521,9 @@ static void show_device_parent(struct sysfs_device *device, int level)
 
 	parent = sysfs_get_device_parent(device);
 	if (parent) {
-		fprintf(stdout, "\n");
-		indent(level);
-		fprintf(stdout, "Device \"%s\"'s parent\n", device->name);
+		out_putc('\n');
+		out_indent(level);
+		out_printf("Device \"%s\"'s parent\n", device->name);
 		show_device(parent, (level+2));
 	}
 }
@@ -253,10 +538,14 @@ static void show_device(struct sysfs_device *device, int level)
         unsigned int vendor_id, device_id;
         char buf[128], value[256], path[SYSFS_PATH_MAX];
 	
+	if (device && output_format != FORMAT_TEXT) {
+		json_device(device);
+		return;
+	}
 	if (device) {
-		indent(level);
+		out_indent(level);
 		if (show_bus && (!(strcmp(show_bus, "pci")))) {
-			fprintf(stdout, "%s ", device->bus_id);
+			out_printf("%s ", device->bus_id);
 			memset(path, 0, SYSFS_PATH_MAX);
 			memset(value, 0, SYSFS_PATH_MAX);
 			safestrcpy(path, device->path);
@@ -269,7 +558,7 @@ static void show_device(struct sysfs_device *device, int level)
 						       	(unsigned char *)attr->value);
 					device_id = get_pciconfig_word(PCI_DEVICE_ID,
 						       	(unsigned char *)attr->value);
-					fprintf(stdout, "%s\n",
+					out_printf("%s\n",
 						pci_lookup_name(pacc,
 						buf, 128,
 						PCI_LOOKUP_VENDOR | 
@@ -278,19 +567,20 @@ static void show_device(struct sysfs_device *device, int level)
 				}
 				sysfs_close_attribute(attr);
 			} else 
-				fprintf(stdout, "\n");
+				out_putc('\n');
 		} else 
-			fprintf(stdout, "Device = \"%s\"\n", device->bus_id);
+			out_printf("Device = \"%s\"\n", device->bus_id);
 
 		if (show_options & (SHOW_PATH | SHOW_ALL_ATTRIB_VALUES)) {
-			indent(level);
-			fprintf(stdout, "Device path = \"%s\"\n", 
+			out_indent(level);
+			out_printf("Device path = \"%s\"\n", 
 							device->path);
 		}
 
 		if (show_options & (SHOW_ATTRIBUTES | SHOW_ATTRIBUTE_VALUE |
 					SHOW_ALL_ATTRIB_VALUES)) {
-			attributes = sysfs_get_device_attributes(device);
+			attributes = sysfs_get_device_attributes_matching(
+					device, attribute_filter);
 			if (attributes) 
 				show_attributes(attributes, (level+2));
 		}
@@ -301,7 +591,7 @@ static void show_device(struct sysfs_device *device, int level)
 		}
 		if (show_options ^ SHOW_DEVICES)
 			if (!(show_options & SHOW_DRIVERS))
-				fprintf(stdout, "\n");
+				out_putc('\n');
 	}
 }
 
@@ -314,7 +604,8 @@ static void show_driver_attributes(struct sysfs_driver *driver, int level)
 	if (driver) {
 		struct dlist *attributes;
 	
-		attributes = sysfs_get_driver_attributes(driver);
+		attributes = sysfs_get_driver_attributes_matching(driver,
+				attribute_filter);
 		if (attributes) {
 			struct sysfs_attribute *cur;
 
@@ -322,8 +613,10 @@ static void show_driver_attributes(struct sysfs_driver *driver, int level)
 					struct sysfs_attribute) {
 				show_attribute(cur, (level));
 			}
-			fprintf(stdout, "\n");
 		}
+		/* a driver has attributes even if none were let through */
+		if (attributes || attribute_filter)
+			out_putc('\n');
 	}
 }
 
@@ -335,12 +628,16 @@ static void show_driver(struct sysfs_driver *driver, int level)
 {
 	struct dlist *devlist;
 	
+	if (driver && output_format != FORMAT_TEXT) {
+		json_driver(driver);
+		return;
+	}
 	if (driver) {
-		indent(level);
-		fprintf(stdout, "Driver = \"%s\"\n", driver->name);
+		out_indent(level);
+		out_printf("Driver = \"%s\"\n", driver->name);
 		if (show_options & (SHOW_PATH | SHOW_ALL_ATTRIB_VALUES)) {
-			indent(level);
-			fprintf(stdout, "Driver path = \"%s\"\n", 
+			out_indent(level);
+			out_printf("Driver path = \"%s\"\n", 
 							driver->path);
 		}
 		if (show_options & (SHOW_ATTRIBUTES | SHOW_ATTRIBUTE_VALUE
@@ -350,21 +647,21 @@ static void show_driver(struct sysfs_driver *driver, int level)
 		if (devlist) {
 			struct sysfs_device *cur;
 			
-			indent(level+2);
-			fprintf(stdout, "Devices using \"%s\" are:\n", 
+			out_indent(level+2);
+			out_printf("Devices using \"%s\" are:\n", 
 								driver->name);
 			dlist_for_each_data(devlist, cur, 
 					struct sysfs_device) {
 				if (show_options & SHOW_DRIVERS) {
 					show_device(cur, (level+4));
-					fprintf(stdout, "\n");
+					out_putc('\n');
 				} else {
-					indent(level+4);
-					fprintf(stdout, "\"%s\"\n", cur->name);
+					out_indent(level+4);
+					out_printf("\"%s\"\n", cur->name);
 				}
 			}
 		} 
-		fprintf(stdout, "\n");
+		out_putc('\n');
 	}
 }
 
@@ -378,8 +675,9 @@ static int show_sysfs_bus(char *busname)
 	struct sysfs_bus *bus;
 	struct sysfs_device *curdev;
 	struct sysfs_driver *curdrv;
-	struct dlist *devlist;
-	struct dlist *drvlist;
+	struct sysfs_vector *devices;
+	struct sysfs_vector *drivers;
+	unsigned int i;
 
 	if (!busname) {
 		errno = EINVAL;
@@ -391,27 +689,29 @@ static int show_sysfs_bus(char *busname)
 		return 1;
 	}
 
-	fprintf(stdout, "Bus = \"%s\"\n", busname);
-	if (show_options ^ (SHOW_DEVICES | SHOW_DRIVERS))
-		fprintf(stdout, "\n");
+	if (output_format == FORMAT_TEXT) {
+		out_printf("Bus = \"%s\"\n", busname);
+		if (show_options ^ (SHOW_DEVICES | SHOW_DRIVERS))
+			out_putc('\n');
+	}
 	if (show_options & SHOW_DEVICES) {
-		devlist = sysfs_get_bus_devices(bus);
-		if (devlist) {
-			dlist_for_each_data(devlist, curdev, 
-						struct sysfs_device) {
-				if (!device_to_show || (strcmp(device_to_show,
-							curdev->bus_id) == 0)) 
+		devices = sysfs_open_vector(sysfs_get_bus_devices_matching(bus,
+					&device_filter));
+		if (devices) {
+			/* a device's name is its bus_id */
+			sysfs_vector_for_each(devices, i, curdev)
+				if (!sysfs_filter_match(&device_filter,
+							curdev->bus_id))
 					show_device(curdev, 2);
-			}
+			sysfs_close_vector(devices);
 		}
 	}
 	if (show_options & SHOW_DRIVERS) {
-		drvlist = sysfs_get_bus_drivers(bus);
-		if (drvlist) {
-			dlist_for_each_data(drvlist, curdrv, 
-					struct sysfs_driver) {
+		drivers = sysfs_open_bus_driver_vector(bus);
+		if (drivers) {
+			sysfs_vector_for_each(drivers, i, curdrv)
 				show_driver(curdrv, 2);
-			}
+			sysfs_close_vector(drivers);
 		}
 	}
 	sysfs_close_bus(bus);
@@ -428,9 +728,9 @@ static void show_classdev_parent(struct sysfs_class_device *dev, int level)
 
 	parent = sysfs_get_classdev_parent(dev);
 	if (parent) {
-		fprintf(stdout, "\n");
-		indent(level);
-		fprintf(stdout, "Class device \"%s\"'s parent is\n", 
+		out_putc('\n');
+		out_indent(level);
+		out_printf("Class device \"%s\"'s parent is\n", 
 								dev->name);
 		show_class_device(parent, level+2);
 	}
@@ -445,20 +745,25 @@ static void show_class_device(struct sysfs_class_device *dev, int level)
 	struct dlist *attributes;
 	struct sysfs_device *device;
 	
+	if (dev && output_format != FORMAT_TEXT) {
+		json_class_device(dev);
+		return;
+	}
 	if (dev) {
-		indent(level);
-		fprintf(stdout, "Class Device = \"%s\"\n", dev->name);
+		out_indent(level);
+		out_printf("Class Device = \"%s\"\n", dev->name);
 		if (show_options & (SHOW_PATH | SHOW_ALL_ATTRIB_VALUES)) {
-			indent(level);
-			fprintf(stdout, "Class Device path = \"%s\"\n",
+			out_indent(level);
+			out_printf("Class Device path = \"%s\"\n",
 								dev->path);
 		}
 		if (show_options & (SHOW_ATTRIBUTES | SHOW_ATTRIBUTE_VALUE
 		    | SHOW_ALL_ATTRIB_VALUES)) {
-			attributes = sysfs_get_classdev_attributes(dev);
+			attributes = sysfs_get_classdev_attributes_matching(dev,
+					attribute_filter);
 			if (attributes)
 				show_attributes(attributes, (level+2));
-			fprintf(stdout, "\n");
+			out_putc('\n');
 		}
 		if (show_options & (SHOW_DEVICES | SHOW_ALL_ATTRIB_VALUES)) {
 			device = sysfs_get_classdev_device(dev);
@@ -472,7 +777,7 @@ static void show_class_device(struct sysfs_class_device *dev, int level)
 		}
 		if (show_options & ~(SHOW_ATTRIBUTES | SHOW_ATTRIBUTE_VALUE
 		    | SHOW_ALL_ATTRIB_VALUES))
-			fprintf(stdout, "\n");
+			out_putc('\n');
 	}
 }
 
@@ -485,7 +790,8 @@ static int show_sysfs_class(char *classname)
 {
 	struct sysfs_class *cls;
 	struct sysfs_class_device *cur;
-	struct dlist *clsdevlist;
+	struct sysfs_vector *clsdevs;
+	unsigned int i;
 
 	if (!classname) {
 		errno = EINVAL;
@@ -496,15 +802,15 @@ static int show_sysfs_class(char *classname)
 		fprintf(stderr, "Error opening class %s\n", classname);
 		return 1;
 	}
-	fprintf(stdout, "Class = \"%s\"\n\n", classname);
-	clsdevlist = sysfs_get_class_devices(cls);
-	if (clsdevlist) {
-		dlist_for_each_data(clsdevlist, cur, 
-				struct sysfs_class_device) {
-			if (device_to_show == NULL || (strcmp(device_to_show,
-			    cur->name) == 0))
+	if (output_format == FORMAT_TEXT)
+		out_printf("Class = \"%s\"\n\n", classname);
+	clsdevs = sysfs_open_vector(sysfs_get_class_devices_matching(cls,
+				&device_filter));
+	if (clsdevs) {
+		sysfs_vector_for_each(clsdevs, i, cur)
+			if (!sysfs_filter_match(&device_filter, cur->name))
 				show_class_device(cur, 2);
-		}
+		sysfs_close_vector(clsdevs);
 	}
 
 	sysfs_close_class(cls);
@@ -525,18 +831,24 @@ static int show_sysfs_module(char *module)
 		fprintf(stderr, "Error opening module %s\n", module);
 		return 1;
 	}
-	fprintf(stdout, "Module = \"%s\"\n\n", module);
+	if (output_format != FORMAT_TEXT) {
+		json_module(mod);
+		sysfs_close_module(mod);
+		return 0;
+	}
+	out_printf("Module = \"%s\"\n\n", module);
 	if (show_options & (SHOW_ATTRIBUTES | SHOW_ATTRIBUTE_VALUE
 	    | SHOW_ALL_ATTRIB_VALUES)) {
 		struct dlist *attributes = NULL;
 		struct sysfs_attribute *cur;
 
-		attributes = sysfs_get_module_attributes(mod);
+		attributes = sysfs_get_module_attributes_matching(mod,
+				attribute_filter);
 		if (attributes) {
 			if (show_options & (SHOW_ATTRIBUTES
 			    | SHOW_ALL_ATTRIB_VALUES)) {
-				indent(2);
-				fprintf(stdout, "Attributes:\n");
+				out_indent(2);
+				out_puts("Attributes:\n");
 			}
 			dlist_for_each_data(attributes, cur,
 					struct sysfs_attribute) {
@@ -547,9 +859,9 @@ static int show_sysfs_module(char *module)
 		if (attributes) {
 			if (show_options & (SHOW_ATTRIBUTES 
 			    | SHOW_ALL_ATTRIB_VALUES)) {
-				fprintf(stdout, "\n");
-				indent(2);
-				fprintf(stdout, "Parameters:\n");
+				out_putc('\n');
+				out_indent(2);
+				out_puts("Parameters:\n");
 			}
 			dlist_for_each_data(attributes, cur,
 					struct sysfs_attribute) {
@@ -560,15 +872,15 @@ static int show_sysfs_module(char *module)
 		if (attributes) {
 			if (show_options & (SHOW_ATTRIBUTES
 			    | SHOW_ALL_ATTRIB_VALUES)) {
-				fprintf(stdout, "\n");
-				indent(2);
-				fprintf(stdout, "Sections:\n");
+				out_putc('\n');
+				out_indent(2);
+				out_puts("Sections:\n");
 			}
 			dlist_for_each_data(attributes, cur,
 					struct sysfs_attribute) {
 				show_attribute(cur, (4));
 			}
-			fprintf(stdout, "\n");
+			out_putc('\n');
 		}
 	}
 
@@ -576,6 +888,447 @@ static int show_sysfs_module(char *module)
 	return 0;
 }
 
+/*
+ * Any number of buses, classes and modules can be asked for, each with
+ * "all" for every one there is. They're shown in sorted order, buses
+ * first, then classes, then modules. With more than one job, each is
+ * read in whichever worker thread gets to it first, printing to a buffer
+ * of its own, and the buffers are copied out in that same order as soon
+ * as everything before them has been, so the output doesn't depend on
+ * how many jobs read it.
+ */
+
+#define TARGET_BUS		0
+#define TARGET_CLASS		1
+#define TARGET_MODULE		2
+
+#define TARGET_BUFSIZE		(16 * 1024)
+
+struct target {
+	int kind;			/* TARGET_* */
+	char *name;
+	struct pci_access *pacc;	/* for the pci bus */
+	struct output out;		/* kept here, with more than one job */
+	unsigned long records;
+	int options;			/* show_options once shown */
+	int retval;
+	int done;
+};
+
+struct target_pool {
+	struct target *targets;
+	unsigned int count;
+	unsigned int next;		/* next target to take */
+	int options;			/* show_options to show each with */
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t lock;
+	pthread_cond_t done;		/* signalled as each is done */
+#endif
+};
+
+static struct target *targets = NULL;
+static unsigned int ntargets = 0;
+static unsigned int targets_size = 0;
+/* where the names of those asked for with "all" come from */
+static struct dlist *target_lists[3] = { NULL, NULL, NULL };
+
+/**
+ * add_target: adds one bus, class or module to those to show
+ * returns 0 with success and 1 with error.
+ */
+static int add_target(int kind, char *name)
+{
+	struct target *grown;
+
+	if (strlen(name) >= SYSFS_NAME_LEN) {
+		fprintf(stderr, "Invalid argument - name %s too long\n", name);
+		return 1;
+	}
+	if (ntargets == targets_size) {
+		targets_size = targets_size ? targets_size * 2 : 8;
+		grown = (struct target *)realloc(targets,
+				targets_size * sizeof(struct target));
+		if (!grown) {
+			fprintf(stderr, "Out of memory\n");
+			return 1;
+		}
+		targets = grown;
+	}
+	memset(&targets[ntargets], 0, sizeof(struct target));
+	targets[ntargets].kind = kind;
+	targets[ntargets++].name = name;
+	return 0;
+}
+
+/**
+ * add_targets: adds what an option names to those to show
+ * @kind: TARGET_* the names are of
+ * @arg: option argument, names separated by commas, changed in place
+ * returns 0 with success and 1 with error.
+ */
+static int add_targets(int kind, char *arg)
+{
+	char *name, *next;
+
+	for (name = strtok_r(arg, ",", &next); name;
+			name = strtok_r(NULL, ",", &next))
+		if (add_target(kind, name))
+			return 1;
+	return 0;
+}
+
+static int compare_targets(const void *a, const void *b)
+{
+	const struct target *ta = (const struct target *)a;
+	const struct target *tb = (const struct target *)b;
+
+	if (ta->kind != tb->kind)
+		return ta->kind - tb->kind;
+	return strcmp(ta->name, tb->name);
+}
+
+/**
+ * expand_targets: puts in every bus, class or module wherever "all" was
+ *	asked for, then sorts what's to be shown, once each
+ * returns 0 with success and 1 with error.
+ */
+static int expand_targets(void)
+{
+	static const char *dirs[] = {
+		SYSFS_BUS_NAME, SYSFS_CLASS_NAME, SYSFS_MODULE_NAME
+	};
+	char path[SYSFS_PATH_MAX];
+	char *cur;
+	unsigned int i, j, given = ntargets;
+	int all[3] = { 0, 0, 0 };
+
+	for (i = 0; i < given; i++)
+		if (!strcmp(targets[i].name, "all"))
+			all[targets[i].kind] = 1;
+	for (i = 0; i < 3; i++) {
+		if (!all[i])
+			continue;
+		safestrcpy(path, sysfs_mnt_path);
+		safestrcat(path, "/");
+		safestrcat(path, dirs[i]);
+		target_lists[i] = sysfs_open_directory_list(path);
+		if (!target_lists[i])
+			continue;
+		dlist_for_each_data(target_lists[i], cur, char)
+			if (add_target(i, cur))
+				return 1;
+	}
+	for (i = 0, j = 0; i < ntargets; i++)
+		if (!all[targets[i].kind] || strcmp(targets[i].name, "all"))
+			targets[j++] = targets[i];
+	ntargets = j;
+	if (ntargets > 1)
+		qsort(targets, ntargets, sizeof(struct target),
+				compare_targets);
+	for (i = 0, j = 0; i < ntargets; i++)
+		if (!j || compare_targets(&targets[j - 1], &targets[i]))
+			targets[j++] = targets[i];
+	ntargets = j;
+	return 0;
+}
+
+/**
+ * show_target: prints out a bus, class or module to the current output
+ * @options: show_options to show it with
+ */
+static void show_target(struct target *target, int options)
+{
+	show_options = options;
+	pacc = target->pacc;
+	switch (target->kind) {
+	case TARGET_BUS:
+		show_bus = target->name;
+		target->retval = show_sysfs_bus(target->name);
+		show_bus = NULL;
+		break;
+	case TARGET_CLASS:
+		target->retval = show_sysfs_class(target->name);
+		break;
+	case TARGET_MODULE:
+		target->retval = show_sysfs_module(target->name);
+		break;
+	}
+	pacc = NULL;
+	target->options = show_options;
+}
+
+#ifdef HAVE_PTHREAD_H
+static void *target_worker_run(void *arg)
+{
+	struct target_pool *pool = (struct target_pool *)arg;
+	struct target *target;
+	unsigned int i;
+
+	while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED))
+			< pool->count) {
+		target = &pool->targets[i];
+		out_open(&target->out, -1, TARGET_BUFSIZE);
+		output = &target->out;
+		records = 0;
+		show_target(target, pool->options);
+		target->records = records;
+		output = &output_stdout;
+		pthread_mutex_lock(&pool->lock);
+		target->done = 1;
+		pthread_cond_broadcast(&pool->done);
+		pthread_mutex_unlock(&pool->lock);
+	}
+	return NULL;
+}
+
+/**
+ * show_targets_parallel: shows the targets on up to jobs worker threads,
+ *	copying out what each printed in order
+ * returns 0 with success and -1 if no worker could be started.
+ */
+static int show_targets_parallel(unsigned int jobs)
+{
+	struct target_pool pool;
+	struct target *target;
+	pthread_t *workers;
+	unsigned int i, started;
+
+	workers = (pthread_t *)calloc(jobs, sizeof(pthread_t));
+	if (!workers)
+		return -1;
+	memset(&pool, 0, sizeof(struct target_pool));
+	pool.targets = targets;
+	pool.count = ntargets;
+	pool.options = show_options;
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.done, NULL);
+	for (started = 0; started < jobs; started++)
+		if (pthread_create(&workers[started], NULL, target_worker_run,
+					&pool))
+			break;
+	if (!started) {
+		pthread_mutex_destroy(&pool.lock);
+		pthread_cond_destroy(&pool.done);
+		free(workers);
+		return -1;
+	}
+
+	for (i = 0; i < ntargets; i++) {
+		target = &targets[i];
+		pthread_mutex_lock(&pool.lock);
+		while (!target->done)
+			pthread_cond_wait(&pool.done, &pool.lock);
+		pthread_mutex_unlock(&pool.lock);
+		/* the target's records went without the comma before them */
+		if (output_format == FORMAT_JSON && records && target->records)
+			out_putc(',');
+		out_append(&target->out);
+		out_close(&target->out);
+		records += target->records;
+		show_options = target->options;
+	}
+
+	for (i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+	pthread_mutex_destroy(&pool.lock);
+	pthread_cond_destroy(&pool.done);
+	free(workers);
+	return 0;
+}
+#endif
+
+/**
+ * show_targets: prints out the buses, classes and modules asked for
+ * @jobs: how many to read at once, 0 for one per online CPU
+ * @pci_id_file: where to look up the names of PCI devices
+ * returns 0 with success and 1 if any couldn't be shown.
+ */
+static int show_targets(unsigned int jobs, char *pci_id_file)
+{
+	int options = show_options;
+	int retval = 0;
+	unsigned int i;
+	long cpus;
+
+	for (i = 0; i < ntargets; i++) {
+		if (targets[i].kind != TARGET_BUS ||
+		    strcmp(targets[i].name, "pci"))
+			continue;
+		targets[i].pacc = (struct pci_access *)
+			calloc(1, sizeof(struct pci_access));
+		if (targets[i].pacc) {
+			targets[i].pacc->pci_id_file_name = pci_id_file;
+			targets[i].pacc->numeric_ids = 0;
+		}
+	}
+
+	if (jobs == 0) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = cpus > 0 ? (unsigned int)cpus : 1;
+	}
+	if (jobs > ntargets)
+		jobs = ntargets;
+#ifdef HAVE_PTHREAD_H
+	if (jobs < 2 || show_targets_parallel(jobs))
+#endif
+		for (i = 0; i < ntargets; i++)
+			show_target(&targets[i], options);
+
+	for (i = 0; i < ntargets; i++) {
+		if (targets[i].retval)
+			retval = 1;
+		if (targets[i].pacc) {
+			pci_free_name_list(targets[i].pacc);
+			free(targets[i].pacc);
+			targets[i].pacc = NULL;
+		}
+	}
+	return retval;
+}
+
+/**
+ * close_targets: frees what's kept of the buses, classes and modules
+ */
+static void close_targets(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < 3; i++)
+		if (target_lists[i])
+			sysfs_close_list(target_lists[i]);
+	free(targets);
+	targets = NULL;
+	ntargets = targets_size = 0;
+}
+
+/*
+ * The tree view goes down the directories under devices/, printing the
+ * ones with a uevent file, which are the devices and class devices, and
+ * going through the rest for those below them. Who drives each device,
+ * and which are class devices, is looked up in a topology read up front.
+ */
+struct tree_walk {
+	struct sysfs_topology *topo;
+	char path[SYSFS_PATH_MAX];	/* of the directory being looked at */
+	const char *parent;		/* path of the entry printed above */
+	int level;
+};
+
+/**
+ * show_tree_entry: prints the device or class device at walk->path
+ * @name: its directory's name
+ */
+static void show_tree_entry(struct tree_walk *walk, const char *name)
+{
+	const char *cdev, *driver, *device;
+
+	cdev = sysfs_topology_class_device(walk->topo, walk->path);
+	driver = sysfs_topology_driver(walk->topo, walk->path);
+	if (driver)
+		driver = strrchr(driver, '/') + 1;
+	if (output_format != FORMAT_TEXT) {
+		json_begin_record(cdev ? "class_device" : "device");
+		json_field("name", name);
+		json_field("path", cdev ? cdev : walk->path);
+		if (cdev) {
+			device = sysfs_topology_device(walk->topo, cdev);
+			json_field("device", device);
+		}
+		json_field("parent", walk->parent);
+		json_field("driver", driver);
+		json_end_record();
+		return;
+	}
+	out_indent(walk->level);
+	if (cdev) {
+		/* named as under class/, as in "net/eth0" */
+		device = cdev + strlen(cdev) - strlen(name) - 1;
+		while (device > cdev && *(device - 1) != '/')
+			device--;
+		out_puts(device);
+	} else
+		out_puts(name);
+	if (driver)
+		out_printf(" (%s)", driver);
+	if (show_options & SHOW_PATH)
+		out_printf("  %s", walk->path);
+	out_putc('\n');
+}
+
+static void show_tree_dirs(struct tree_walk *walk);
+
+/**
+ * show_tree_dir: goes down the tree from the directory name under
+ *	walk->path
+ */
+static void show_tree_dir(struct tree_walk *walk, const char *name)
+{
+	char uevent[SYSFS_PATH_MAX], parent[SYSFS_PATH_MAX];
+	const char *prev_parent = walk->parent;
+	size_t len = strlen(walk->path);
+
+	safestrcat(walk->path, "/");
+	safestrcat(walk->path, name);
+	safestrcpy(uevent, walk->path);
+	safestrcat(uevent, "/uevent");
+	/* every top level directory is shown, to hang the rest under */
+	if (!walk->parent || !sysfs_path_is_file(uevent)) {
+		show_tree_entry(walk, name);
+		safestrcpy(parent, walk->path);
+		walk->parent = parent;
+		walk->level += 2;
+	}
+	show_tree_dirs(walk);
+	if (walk->parent != prev_parent) {
+		walk->parent = prev_parent;
+		walk->level -= 2;
+	}
+	walk->path[len] = '\0';
+}
+
+/**
+ * show_tree_dirs: goes down the tree from each directory under
+ *	walk->path, in name order
+ */
+static void show_tree_dirs(struct tree_walk *walk)
+{
+	struct dlist *list;
+	char *cur;
+
+	list = sysfs_open_directory_list(walk->path);
+	if (!list)
+		return;
+	dlist_for_each_data(list, cur, char)
+		show_tree_dir(walk, cur);
+	sysfs_close_list(list);
+}
+
+/**
+ * show_sysfs_tree: prints every device as a tree, with its driver and
+ *	class devices
+ * returns 0 with success or 1 with error.
+ */
+static int show_sysfs_tree(void)
+{
+	struct tree_walk walk;
+
+	memset(&walk, 0, sizeof(struct tree_walk));
+	walk.topo = sysfs_open_topology();
+	if (!walk.topo) {
+		fprintf(stderr, "Error reading the device topology\n");
+		return 1;
+	}
+	safestrcpy(walk.path, sysfs_mnt_path);
+	safestrcat(walk.path, "/");
+	safestrcat(walk.path, SYSFS_DEVICES_NAME);
+	if (output_format == FORMAT_TEXT)
+		out_puts("Device tree:\n");
+	walk.level = 2;
+	show_tree_dirs(&walk);
+	sysfs_close_topology(walk.topo);
+	return 0;
+}
+
 /**
  * show_default_info: prints current buses, classes, and root devices
  *	supported by sysfs.
@@ -592,10 +1345,13 @@ static int show_default_info(void)
 	safestrcat(subsys, "/");
 	safestrcat(subsys, SYSFS_BUS_NAME);
 	list = sysfs_open_directory_list(subsys);
-	if (list) {
-		fprintf(stdout, "Supported sysfs buses:\n");
+	if (list && output_format != FORMAT_TEXT) {
+		json_list("buses", list);
+		sysfs_close_list(list);
+	} else if (list) {
+		out_puts("Supported sysfs buses:\n");
 		dlist_for_each_data(list, cur, char)
-			fprintf(stdout, "\t%s\n", cur);
+			out_printf("\t%s\n", cur);
 		sysfs_close_list(list);
 	}
 
@@ -603,10 +1359,13 @@ static int show_default_info(void)
 	safestrcat(subsys, "/");
 	safestrcat(subsys, SYSFS_CLASS_NAME);
 	list = sysfs_open_directory_list(subsys);
-	if (list) {
-		fprintf(stdout, "Supported sysfs classes:\n");
+	if (list && output_format != FORMAT_TEXT) {
+		json_list("classes", list);
+		sysfs_close_list(list);
+	} else if (list) {
+		out_puts("Supported sysfs classes:\n");
 		dlist_for_each_data(list, cur, char)
-			fprintf(stdout, "\t%s\n", cur);
+			out_printf("\t%s\n", cur);
 		sysfs_close_list(list);
 	}
 
@@ -614,10 +1373,13 @@ static int show_default_info(void)
 	safestrcat(subsys, "/");
 	safestrcat(subsys, SYSFS_DEVICES_NAME);
 	list = sysfs_open_directory_list(subsys);
-	if (list) {
-		fprintf(stdout, "Supported sysfs devices:\n");
+	if (list && output_format != FORMAT_TEXT) {
+		json_list("devices", list);
+		sysfs_close_list(list);
+	} else if (list) {
+		out_puts("Supported sysfs devices:\n");
 		dlist_for_each_data(list, cur, char)
-			fprintf(stdout, "\t%s\n", cur);
+			out_printf("\t%s\n", cur);
 		sysfs_close_list(list);
 	}
 			
@@ -625,10 +1387,13 @@ static int show_default_info(void)
 	safestrcat(subsys, "/");
 	safestrcat(subsys, SYSFS_MODULE_NAME);
 	list = sysfs_open_directory_list(subsys);
-	if (list) {
-		fprintf(stdout, "Supported sysfs modules:\n");
+	if (list && output_format != FORMAT_TEXT) {
+		json_list("modules", list);
+		sysfs_close_list(list);
+	} else if (list) {
+		out_puts("Supported sysfs modules:\n");
 		dlist_for_each_data(list, cur, char)
-			fprintf(stdout, "\t%s\n", cur);
+			out_printf("\t%s\n", cur);
 		sysfs_close_list(list);
 	}
 
@@ -646,17 +1411,57 @@ static int check_sysfs_is_mounted(void)
 	return 1;
 }
 
+/**
+ * print_stats: prints what libsysfs counted to stderr, leaving the
+ *	output itself as it would be without --stats
+ */
+static void print_stats(void)
+{
+	struct sysfs_stats stats;
+	unsigned int i, j;
+
+	sysfs_get_stats(&stats);
+	fprintf(stderr, "Statistics:\n");
+	for (i = 0; i < SYSFS_STAT_MAX; i++)
+		fprintf(stderr, "\t%-20s= %llu\n",
+				sysfs_stat_name((enum sysfs_stat)i),
+				stats.count[i]);
+	for (i = 0; i < SYSFS_STAT_SYSCALLS; i++) {
+		if (!stats.count[i])
+			continue;
+		fprintf(stderr, "Latency of %s (ns):\n",
+				sysfs_stat_name((enum sysfs_stat)i));
+		for (j = 0; j < SYSFS_STAT_BUCKETS; j++)
+			if (stats.latency[i][j])
+				fprintf(stderr, "\t%-20llu= %llu\n",
+						1ULL << j,
+						stats.latency[i][j]);
+	}
+}
+
+/**
+ * flush_output: writes out whatever is left buffered, on any exit
+ */
+static void flush_output(void)
+{
+	out_flush(&output_stdout);
+}
+
 /* MAIN */
 int main(int argc, char *argv[])
 {
-	char *show_class = NULL;
-	char *show_module = NULL;
 	char *show_root = NULL;
+	char *snapshot_file = NULL;
+	int show_tree = 0;
 	int retval = 0;
 	int opt;
+	unsigned int jobs = 0;
+	char *end;
         char *pci_id_file = "/usr/local/share/pci.ids";
-	
-	while((opt = getopt(argc, argv, cmd_options)) != EOF) {
+
+	atexit(flush_output);
+	while((opt = getopt_long(argc, argv, cmd_options, long_options,
+					NULL)) != EOF) {
 		switch(opt) {
 		case 'a':
 			show_options |= SHOW_ATTRIBUTES;
@@ -672,10 +1477,12 @@ int main(int argc, char *argv[])
 			show_options |= SHOW_ATTRIBUTE_VALUE;
 			break;	
 		case 'b':
-			show_bus = optarg;	
+			if (add_targets(TARGET_BUS, optarg))
+				exit(1);
 			break;
 		case 'c':
-			show_class = optarg;	
+			if (add_targets(TARGET_CLASS, optarg))
+				exit(1);
 			break;
 		case 'd':
 			show_options |= SHOW_DEVICES;
@@ -683,12 +1490,35 @@ int main(int argc, char *argv[])
 		case 'D':
 			show_options |= SHOW_DRIVERS;
 			break;
+		case 'f':
+			if (!strcmp(optarg, "text"))
+				output_format = FORMAT_TEXT;
+			else if (!strcmp(optarg, "json"))
+				output_format = FORMAT_JSON;
+			else if (!strcmp(optarg, "ndjson"))
+				output_format = FORMAT_NDJSON;
+			else {
+				fprintf(stderr, "Unknown format %s\n", optarg);
+				usage();
+				exit(1);
+			}
+			break;
 		case 'h':
 			usage();
 			exit(0);
 			break;
+		case 'j':
+			jobs = strtoul(optarg, &end, 10);
+			if (!*optarg || *end) {
+				fprintf(stderr, "Invalid job count %s\n",
+						optarg);
+				usage();
+				exit(1);
+			}
+			break;
 		case 'm':
-			show_module = optarg;
+			if (add_targets(TARGET_MODULE, optarg))
+				exit(1);
 			/* FALLTHRU */
 		case 'p':
 			show_options |= SHOW_PATH;
@@ -696,9 +1526,18 @@ int main(int argc, char *argv[])
 		case 'P':
 			show_options |= SHOW_PARENT;
 			break;
+		case 'S':
+			snapshot_file = optarg;
+			break;
+		case 'T':
+			show_tree = 1;
+			break;
 		case 'v':
 			show_options |= SHOW_ALL_ATTRIB_VALUES;
 			break;
+		case OPT_STATS:
+			show_stats = 1;
+			break;
 		default:
 			usage();
 			exit(1);
@@ -726,12 +1565,33 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	/*
+	 * values are only read for the attributes that get printed, and each
+	 * bus or class is torn down in one go when done with. systool exits
+	 * long before sysfs changes much, so links are resolved only once.
+	 */
+	sysfs_set_options(SYSFS_OPT_LAZY_ATTRS | SYSFS_OPT_ARENA |
+			SYSFS_OPT_LINK_CACHE |
+			(show_stats ? SYSFS_OPT_STATS | SYSFS_OPT_LATENCY : 0));
+
 	if (check_sysfs_is_mounted() == 0) {
 		fprintf(stderr, "Unable to find sysfs mount point!\n");
 		exit(1);
 	}
 
-	if ((!show_bus && !show_class && !show_module && !show_root) && 
+	if (snapshot_file) {
+		if (sysfs_write_snapshot(snapshot_file, NULL)) {
+			fprintf(stderr, "Error writing snapshot %s: %s\n",
+					snapshot_file, strerror(errno));
+			exit(1);
+		}
+		exit(0);
+	}
+
+	if (expand_targets())
+		exit(1);
+
+	if ((!ntargets && !show_root && !show_tree) && 
 			(show_options & (SHOW_ATTRIBUTES | 
 				SHOW_ATTRIBUTE_VALUE | SHOW_DEVICES | 
 				SHOW_DRIVERS | SHOW_ALL_ATTRIB_VALUES))) {
@@ -744,33 +1604,36 @@ int main(int argc, char *argv[])
 	if (!(show_options & (SHOW_DEVICES | SHOW_DRIVERS)))
 		show_options |= SHOW_DEVICES;
 
-	if (show_bus) {
-		if ((!(strcmp(show_bus, "pci"))))  {
-			pacc = (struct pci_access *)
-				calloc(1, sizeof(struct pci_access));
-			pacc->pci_id_file_name = pci_id_file;
-			pacc->numeric_ids = 0;
-		}
-		retval = show_sysfs_bus(show_bus);
+	device_filter.glob = device_to_show;
+	if ((show_options & SHOW_ATTRIBUTE_VALUE) && !(show_options &
+				(SHOW_ATTRIBUTES | SHOW_ALL_ATTRIB_VALUES))) {
+		attribute_names[0] = attribute_to_show;
+		attribute_filter = &attribute_names_filter;
 	}
-	if (show_class)
-		retval = show_sysfs_class(show_class);
 
-	if (show_module)
-		retval = show_sysfs_module(show_module);
+	if (output_format == FORMAT_JSON)
+		out_putc('[');
+	if (ntargets && show_targets(jobs, pci_id_file))
+		retval = 1;
 
-	if (!show_bus && !show_class && !show_module && !show_root) 
+	if (show_tree)
+		retval = show_sysfs_tree();
+
+	if (!ntargets && !show_root && !show_tree)
 		retval = show_default_info();
+	close_targets();
 
-	if (show_bus) {
-		if ((!(strcmp(show_bus, "pci"))))  {
-			pci_free_name_list(pacc);
-			free (pacc);
-			pacc = NULL;
-		}
-	}
-	if (!(show_options ^ SHOW_DEVICES))
-		fprintf(stdout, "\n");
+	if (output_format == FORMAT_JSON)
+		out_puts(records ? "\n]\n" : "]\n");
+	else if (output_format == FORMAT_TEXT && !(show_options ^ SHOW_DEVICES))
+		out_putc('\n');
 
+	if (out_flush(&output_stdout)) {
+		fprintf(stderr, "Error writing output: %s\n",
+				strerror(errno));
+		retval = 1;
+	}
+	if (show_stats)
+		print_stats();
 	exit(retval);
 }
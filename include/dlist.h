@@ -55,6 +55,8 @@
 
 #include <stddef.h>
 
+struct sysfs_arena;
+
 typedef struct dl_node {
   struct dl_node *prev;
   struct dl_node *next;
@@ -68,6 +70,7 @@ typedef struct dlist {
   void (*del_func)(void *);
   DL_node headnode;
   DL_node *head;
+  struct sysfs_arena *arena; /* nodes come from here, NULL for the heap */
 } Dlist;
 
 #ifdef __cplusplus
@@ -104,6 +107,9 @@ void *dlist_find_custom(struct dlist *list, void *target, int (*comp)(void *, vo
 
 void dlist_sort_custom(struct dlist *list, int (*compare)(void *, void *));
 
+void dlist_merge_sorted(struct dlist *list, struct dlist *batch,
+				int (*compare)(void *, void *));
+
 void dlist_filter_sort(struct dlist *list, int (*filter) (void *),
 				int (*compare) (void *, void *));
 
@@ -144,6 +150,13 @@ void *_dlist_insert_dlnode(struct dlist *list,struct dl_node *new_node,int direc
 	for(dlist_end(list),dlist_prev(list); \
 		(list)->marker!=(list)->head;dlist_prev(list))
 
+/*
+ * The _nomark loops keep their place in the iterator passed to them rather
+ * than in the list's mark, and write nothing to the list. So any number of
+ * threads can go through one list at once with them, with no locking, for
+ * as long as no thread changes the list.
+ */
+
 /**
  * provide for loop header which iterates through the list without moving mark
  * list: the dlist_pointer
@@ -196,7 +209,7 @@ void *_dlist_insert_dlnode(struct dlist *list,struct dl_node *new_node,int direc
 
 #define dlist_for_each_data_nomark(list,iterator,data_iterator,datatype) \
 	for((iterator)=(list)->head->next, (data_iterator)=(datatype *) (iterator)->data; \
-	(iterator)!=(list)->head;(iterator)=(iterator)->next,(data_iterator)=(datatype *) (iterator))
+	(iterator)!=(list)->head;(iterator)=(iterator)->next,(data_iterator)=(datatype *) (iterator)->data)
 
 /**
  * provide for loop header which iterates through the list providing a
@@ -208,7 +221,7 @@ void *_dlist_insert_dlnode(struct dlist *list,struct dl_node *new_node,int direc
  */
 #define dlist_for_each_data_nomark_rev(list,iterator, data_iterator,datatype) \
 	for((iterator)=(list)->head->prev, (data_iterator)=(datatype *) (iterator)->data; \
-	(iterator)!=(list)->head;(iterator)=(iterator)->prev,(data_iterator)=(datatype *) (iterator))
+	(iterator)!=(list)->head;(iterator)=(iterator)->prev,(data_iterator)=(datatype *) (iterator)->data)
 
 
 #ifdef __cplusplus
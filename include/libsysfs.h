@@ -48,6 +48,75 @@
 /* mount path for sysfs, can be overridden by exporting SYSFS_PATH */
 #define SYSFS_MNT_PATH		"/sys"
 
+/* where sysfsd publishes its view unless told otherwise, a directory only
+ * root can write to, on a tmpfs */
+#define SYSFS_VIEW_DIR		"/run/sysfsd"
+#define SYSFS_VIEW_PATH		SYSFS_VIEW_DIR "/sysfs.view"
+
+/* per context options, see sysfs_set_options() */
+#define SYSFS_OPT_LAZY_ATTRS	0x01	/* list attributes without values */
+#define SYSFS_OPT_ARENA		0x02	/* tree/bus/class opens share one pool */
+#define SYSFS_OPT_LINK_CACHE	0x04	/* remember resolved links */
+#define SYSFS_OPT_STATS		0x08	/* count work done, see sysfs_get_stats() */
+#define SYSFS_OPT_LATENCY	0x10	/* with SYSFS_OPT_STATS, time calls too */
+
+/* what sysfs_*_foreach_*() visitors return, -1 stopping with an error */
+#define SYSFS_VISIT_NEXT	0x00	/* go on, closing the entry visited */
+#define SYSFS_VISIT_KEEP	0x01	/* the visitor closes the entry itself */
+#define SYSFS_VISIT_STOP	0x02	/* go no further */
+
+/* how sysfs_write_attributes() stores each value */
+#define SYSFS_WRITE_REREAD	0x01	/* read first, skip if already there */
+#define SYSFS_WRITE_CACHED	0x02	/* skip if the value held is the same */
+#define SYSFS_WRITE_NO_RESTORE	0x04	/* leave short writes as they are */
+#define SYSFS_WRITE_PARALLEL	0x08	/* devices at once, see sysfs_set_threads() */
+
+/* what sysfs_write_attributes() did with a request */
+#define SYSFS_WRITE_DONE	0	/* written */
+#define SYSFS_WRITE_SAME	1	/* already had the value, not written */
+#define SYSFS_WRITE_FAILED	-1	/* see the request's error */
+
+/* opaque name -> attribute lookup table kept alongside attrlist */
+struct sysfs_attr_index;
+
+/* opaque allocation pool owned by an SYSFS_OPT_ARENA root object */
+struct sysfs_arena;
+
+/* opaque sysfs root, options and caches a thread works with */
+struct sysfs_context;
+
+/*
+ * What a context has done with SYSFS_OPT_STATS set, see sysfs_get_stats().
+ * The calls up to SYSFS_STAT_SYSCALLS are system calls, and are timed
+ * into latency[] with SYSFS_OPT_LATENCY set too: latency[call][i] counts
+ * those that took from 2^i to 2^(i+1) - 1 nanoseconds.
+ */
+enum sysfs_stat {
+	SYSFS_STAT_OPEN,		/* files and directories opened */
+	SYSFS_STAT_READ,		/* read()s and pread()s */
+	SYSFS_STAT_WRITE,
+	SYSFS_STAT_STAT,		/* stat()s of any kind */
+	SYSFS_STAT_READLINK,
+	SYSFS_STAT_BYTES_READ,
+	SYSFS_STAT_DIRENTS,		/* directory entries gone through */
+	SYSFS_STAT_LINK_HITS,		/* SYSFS_OPT_LINK_CACHE lookups */
+	SYSFS_STAT_LINK_MISSES,
+	SYSFS_STAT_ATTR_HITS,		/* attributes found already read */
+	SYSFS_STAT_ATTR_MISSES,
+	SYSFS_STAT_ALLOCS,		/* objects, list nodes and values */
+	SYSFS_STAT_LIST_INSERTS,
+	SYSFS_STAT_LIST_SORTS,		/* sorts and sorted merges */
+	SYSFS_STAT_MAX
+};
+
+#define SYSFS_STAT_SYSCALLS	(SYSFS_STAT_READLINK + 1)
+#define SYSFS_STAT_BUCKETS	32
+
+struct sysfs_stats {
+	unsigned long long count[SYSFS_STAT_MAX];
+	unsigned long long latency[SYSFS_STAT_SYSCALLS][SYSFS_STAT_BUCKETS];
+};
+
 enum sysfs_attribute_method {
 	SYSFS_METHOD_SHOW =	0x01,	/* attr can be read by user */
 	SYSFS_METHOD_STORE =	0x02,	/* attr can be changed by user */
@@ -66,6 +135,13 @@ struct sysfs_attribute {
 	char *value;
 	unsigned short len;			/* value length */
 	enum sysfs_attribute_method method;	/* show and store */
+
+	/* Private: for internal use only */
+	int fd;				/* valid while bufsize != 0 */
+	char *rbuf;			/* spare value buffer for held reads */
+	size_t bufsize;			/* size of value and rbuf, 0 if not held */
+	struct sysfs_arena *arena;
+	size_t capacity;		/* size of an arena value's buffer */
 };
 
 struct sysfs_driver {
@@ -77,6 +153,8 @@ struct sysfs_driver {
 	/* Private: for internal use only */
 	struct sysfs_module *module;
 	struct dlist *devices;
+	struct sysfs_attr_index *attrindex;
+	struct sysfs_arena *arena;
 };
 
 struct sysfs_device {
@@ -92,6 +170,8 @@ struct sysfs_device {
 	struct sysfs_device *parent;
 	/* NOTE - we still don't populate this */
 	struct dlist *children;
+	struct sysfs_attr_index *attrindex;
+	struct sysfs_arena *arena;
 };
 
 struct sysfs_bus {
@@ -102,6 +182,7 @@ struct sysfs_bus {
 	/* Private: for internal use only */
 	struct dlist *drivers;
 	struct dlist *devices;
+	struct sysfs_arena *arena;
 };
 
 struct sysfs_class_device {
@@ -113,6 +194,8 @@ struct sysfs_class_device {
 	/* Private: for internal use only */
 	struct sysfs_class_device *parent;
 	struct sysfs_device *sysdevice;		/* NULL if virtual */
+	struct sysfs_attr_index *attrindex;
+	struct sysfs_arena *arena;
 };
 
 struct sysfs_class {
@@ -122,6 +205,7 @@ struct sysfs_class {
 
 	/* Private: for internal use only */
 	struct dlist *devices;
+	struct sysfs_arena *arena;
 };
 
 struct sysfs_module {
@@ -130,6 +214,123 @@ struct sysfs_module {
 	struct dlist *attrlist;
 	struct dlist *parmlist;
 	struct dlist *sections;
+
+	/* Private: for internal use only */
+	struct sysfs_attr_index *attrindex;
+	struct sysfs_arena *arena;
+};
+
+/*
+ * Compact, read-only device tree snapshot, see sysfs_open_compact_tree().
+ * Strings are sized to fit, names are shared between all the devices
+ * and attributes that use them, and an attribute's path is its device's
+ * path plus its name. Everything is freed with the tree.
+ */
+struct sysfs_compact_tree;
+
+struct sysfs_compact_attr {
+	const char *name;
+	char *value;			/* NULL if not read (yet) */
+	unsigned short len;		/* value length */
+	unsigned short method;		/* enum sysfs_attribute_method */
+};
+
+struct sysfs_compact_device {
+	const char *name;
+	const char *path;
+	const char *bus;
+	const char *driver_name;
+	const char *subsystem;
+	struct sysfs_compact_device *parent;
+	struct sysfs_compact_device *children;	/* first child, by name */
+	struct sysfs_compact_device *next;	/* next sibling */
+	struct sysfs_compact_attr *attrs;	/* sorted by name */
+	unsigned int nattrs;
+
+	/* Private: for internal use only */
+	struct sysfs_compact_tree *tree;
+};
+
+/*
+ * Array of the elements of a libsysfs list, in the list's name order,
+ * see sysfs_open_vector(). The elements are the list's own.
+ */
+struct sysfs_vector {
+	void **data;
+	unsigned int count;
+};
+
+#define sysfs_vector_for_each(vec, i, elem) \
+	for ((i) = 0; (i) < (vec)->count && ((elem) = (vec)->data[i], 1); \
+		(i)++)
+
+/* one value for sysfs_write_attributes() to store */
+struct sysfs_write_request {
+	struct sysfs_attribute *attr;
+	const char *value;
+	size_t len;
+	int status;			/* SYSFS_WRITE_DONE, _SAME or _FAILED */
+	int error;			/* errno, with SYSFS_WRITE_FAILED */
+};
+
+/*
+ * Which entries the *_matching() calls read, see sysfs_filter_match():
+ * those whose name matches glob, if there is one, and is in names, if
+ * there are any. The rest are left unopened.
+ */
+struct sysfs_filter {
+	const char *glob;		/* fnmatch() pattern, NULL for any */
+	const char * const *names;	/* NULL terminated, NULL for any */
+};
+
+/* opaque set of attribute names, see sysfs_open_projection() */
+struct sysfs_projection;
+
+/*
+ * The projected attributes of every device of a bus or class, see
+ * sysfs_project_bus(). Values are stored a column at a time and are
+ * NULL where an attribute couldn't be read.
+ */
+struct sysfs_table {
+	unsigned int nrows;
+	unsigned int ncols;
+	const char **rows;		/* device names, sorted */
+	const char **columns;		/* attribute names, as projected */
+	const char **values;		/* ncols columns of nrows values */
+	unsigned short *lens;		/* value lengths, laid out the same */
+
+	/* Private: for internal use only */
+	char *names;
+	char *data;
+};
+
+#define sysfs_table_value(table, row, col) \
+	((table)->values[(size_t)(col) * (table)->nrows + (row)])
+#define sysfs_table_len(table, row, col) \
+	((table)->lens[(size_t)(col) * (table)->nrows + (row)])
+
+/*
+ * A kernel uevent, as passed to sysfs_watch_bus() and sysfs_watch_class()
+ * callbacks. Paths are full sysfs paths, strings not in the event empty.
+ */
+struct sysfs_watch;
+
+/* attributes waited on for sysfs_notify(), see sysfs_watch_attribute() */
+struct sysfs_attr_watch;
+
+/* opaque reverse indexes of the links between devices, drivers, modules */
+struct sysfs_topology;
+
+/* opaque publisher of snapshots for other processes, see sysfs_open_view() */
+struct sysfs_view;
+
+struct sysfs_uevent {
+	char action[SYSFS_NAME_LEN];		/* add, remove, bind... */
+	char devpath[SYSFS_PATH_MAX];
+	char devpath_old[SYSFS_PATH_MAX];	/* set for move */
+	char subsystem[SYSFS_NAME_LEN];
+	char driver[SYSFS_NAME_LEN];
+	unsigned long long seqnum;
 };
 
 #ifdef __cplusplus
@@ -146,17 +347,52 @@ extern int sysfs_path_is_dir(const char *path);
 extern int sysfs_path_is_link(const char *path);
 extern int sysfs_path_is_file(const char *path);
 extern int sysfs_get_link(const char *path, char *target, size_t len);
+extern void sysfs_flush_link_cache(void);
 extern struct dlist *sysfs_open_directory_list(const char *path);
 extern struct dlist *sysfs_open_link_list(const char *path);
 extern void sysfs_close_list(struct dlist *list);
+extern unsigned int sysfs_set_options(unsigned int options);
+extern unsigned int sysfs_get_options(void);
+extern unsigned int sysfs_set_threads(unsigned int threads);
+extern unsigned int sysfs_get_threads(void);
+extern struct sysfs_context *sysfs_open_context(const char *root);
+extern void sysfs_close_context(struct sysfs_context *ctx);
+extern struct sysfs_context *sysfs_use_context(struct sysfs_context *ctx);
+extern int sysfs_refresh_context(void);
+extern unsigned long long sysfs_get_generation(void);
+extern void sysfs_get_stats(struct sysfs_stats *stats);
+extern void sysfs_reset_stats(void);
+extern const char *sysfs_stat_name(enum sysfs_stat stat);
+extern int sysfs_filter_match(const struct sysfs_filter *filter,
+		const char *name);
 
 /* sysfs directory and file access */
 extern void sysfs_close_attribute(struct sysfs_attribute *sysattr);
 extern struct sysfs_attribute *sysfs_open_attribute(const char *path);
 extern int sysfs_read_attribute(struct sysfs_attribute *sysattr);
+extern char *sysfs_get_attribute_value(struct sysfs_attribute *sysattr);
+extern int sysfs_read_attributes(struct sysfs_attribute **attrs, int count);
+extern char *sysfs_read_attribute_data(struct sysfs_attribute *sysattr,
+		size_t *size);
+extern void *sysfs_map_attribute(struct sysfs_attribute *sysattr,
+		int writable, size_t *size);
+extern void sysfs_unmap_attribute(void *addr, size_t size);
+extern int sysfs_hold_attribute(struct sysfs_attribute *sysattr);
+extern void sysfs_release_attribute(struct sysfs_attribute *sysattr);
 extern int sysfs_write_attribute(struct sysfs_attribute *sysattr,
 		const char *new_value, size_t len);
+extern int sysfs_write_attributes(struct sysfs_write_request *reqs,
+		int count, unsigned int flags);
 extern struct sysfs_device *sysfs_read_dir_subdirs(const char *path);
+extern struct sysfs_attr_watch *sysfs_open_attr_watch(void);
+extern void sysfs_close_attr_watch(struct sysfs_attr_watch *watch);
+extern int sysfs_watch_attribute(struct sysfs_attr_watch *watch,
+		struct sysfs_attribute *sysattr);
+extern int sysfs_unwatch_attribute(struct sysfs_attr_watch *watch,
+		struct sysfs_attribute *sysattr);
+/* errors[i] is 0 if changed[i]'s value changed, the read's errno if not */
+extern int sysfs_read_attr_watch(struct sysfs_attr_watch *watch, int timeout,
+		struct sysfs_attribute **changed, int *errors, int max);
 /* sysfs driver access */
 extern void sysfs_close_driver(struct sysfs_driver *driver);
 extern struct sysfs_driver *sysfs_open_driver
@@ -165,6 +401,8 @@ extern struct sysfs_driver *sysfs_open_driver_path(const char *path);
 extern struct sysfs_attribute *sysfs_get_driver_attr
 	(struct sysfs_driver *drv, const char *name);
 extern struct dlist *sysfs_get_driver_attributes(struct sysfs_driver *drv);
+extern struct dlist *sysfs_get_driver_attributes_matching
+	(struct sysfs_driver *drv, const struct sysfs_filter *filter);
 extern struct dlist *sysfs_get_driver_devices(struct sysfs_driver *drv);
 extern struct sysfs_module *sysfs_get_driver_module(struct sysfs_driver *drv);
 
@@ -181,6 +419,18 @@ extern struct sysfs_attribute *sysfs_get_device_attr
 	(struct sysfs_device *dev, const char *name);
 extern struct dlist *sysfs_get_device_attributes
 	(struct sysfs_device *dev);
+extern struct dlist *sysfs_get_device_attributes_matching
+	(struct sysfs_device *dev, const struct sysfs_filter *filter);
+
+/* compact device tree access */
+extern struct sysfs_compact_tree *sysfs_open_compact_tree(const char *path);
+extern void sysfs_close_compact_tree(struct sysfs_compact_tree *tree);
+extern struct sysfs_compact_device *sysfs_get_compact_root
+	(struct sysfs_compact_tree *tree);
+extern struct sysfs_compact_attr *sysfs_get_compact_attr
+	(struct sysfs_compact_device *dev, const char *name);
+extern char *sysfs_get_compact_value(struct sysfs_compact_device *dev,
+		struct sysfs_compact_attr *attr);
 
 /* generic sysfs class access */
 extern void sysfs_close_class_device(struct sysfs_class_device *dev);
@@ -194,6 +444,8 @@ extern struct sysfs_attribute *sysfs_get_classdev_attr
 	(struct sysfs_class_device *clsdev, const char *name);
 extern struct dlist *sysfs_get_classdev_attributes
 	(struct sysfs_class_device *clsdev);
+extern struct dlist *sysfs_get_classdev_attributes_matching
+	(struct sysfs_class_device *clsdev, const struct sysfs_filter *filter);
 extern struct sysfs_device *sysfs_get_classdev_device
 	(struct sysfs_class_device *clsdev);
 extern void sysfs_close_class(struct sysfs_class *cls);
@@ -201,17 +453,70 @@ extern struct sysfs_class *sysfs_open_class(const char *name);
 extern struct sysfs_class_device *sysfs_get_class_device
 	(struct sysfs_class *cls, const char *name);
 extern struct dlist *sysfs_get_class_devices(struct sysfs_class *cls);
+extern struct dlist *sysfs_get_class_devices_matching
+	(struct sysfs_class *cls, const struct sysfs_filter *filter);
 
 /* generic sysfs bus access */
 extern void sysfs_close_bus(struct sysfs_bus *bus);
 extern struct sysfs_bus *sysfs_open_bus(const char *name);
 extern struct dlist *sysfs_get_bus_devices(struct sysfs_bus *bus);
+extern struct dlist *sysfs_get_bus_devices_matching
+	(struct sysfs_bus *bus, const struct sysfs_filter *filter);
 extern struct dlist *sysfs_get_bus_drivers(struct sysfs_bus *bus);
+extern struct dlist *sysfs_get_bus_drivers_matching
+	(struct sysfs_bus *bus, const struct sysfs_filter *filter);
 extern struct sysfs_device *sysfs_get_bus_device
 	(struct sysfs_bus *bus, const char *id);
 extern struct sysfs_driver *sysfs_get_bus_driver
 	(struct sysfs_bus *bus, const char *drvname);
 
+/* one pass visitors, opening one entry at a time */
+extern int sysfs_bus_foreach_device(struct sysfs_bus *bus,
+		int (*fn)(struct sysfs_device *dev, void *data), void *data);
+extern int sysfs_bus_foreach_driver(struct sysfs_bus *bus,
+		int (*fn)(struct sysfs_driver *drv, void *data), void *data);
+extern int sysfs_driver_foreach_device(struct sysfs_driver *drv,
+		int (*fn)(struct sysfs_device *dev, void *data), void *data);
+extern int sysfs_class_foreach_device(struct sysfs_class *cls,
+		int (*fn)(struct sysfs_class_device *cdev, void *data),
+		void *data);
+extern int sysfs_foreach_directory(const char *path,
+		int (*fn)(const char *name, void *data), void *data);
+
+/* uevent driven updates of open buses and classes */
+extern struct sysfs_watch *sysfs_open_watch(void);
+extern void sysfs_close_watch(struct sysfs_watch *watch);
+extern int sysfs_watch_bus(struct sysfs_watch *watch, struct sysfs_bus *bus,
+		void (*callback)(const struct sysfs_uevent *event,
+			void *entry, void *data), void *data);
+extern int sysfs_watch_class(struct sysfs_watch *watch,
+		struct sysfs_class *cls,
+		void (*callback)(const struct sysfs_uevent *event,
+			void *entry, void *data), void *data);
+extern int sysfs_unwatch(struct sysfs_watch *watch, void *obj);
+extern int sysfs_get_watch_fd(struct sysfs_watch *watch);
+extern int sysfs_read_watch(struct sysfs_watch *watch, int timeout);
+
+/* who is tied to whom, looked up the other way from sysfs' links */
+extern struct sysfs_topology *sysfs_open_topology(void);
+extern void sysfs_close_topology(struct sysfs_topology *topo);
+extern int sysfs_update_topology(struct sysfs_topology *topo,
+		const struct sysfs_uevent *event);
+extern const char **sysfs_topology_class_devices
+	(struct sysfs_topology *topo, const char *devpath);
+extern const char *sysfs_topology_device(struct sysfs_topology *topo,
+		const char *cdevpath);
+extern const char *sysfs_topology_class_device(struct sysfs_topology *topo,
+		const char *path);
+extern const char *sysfs_topology_driver(struct sysfs_topology *topo,
+		const char *devpath);
+extern const char **sysfs_topology_driver_devices
+	(struct sysfs_topology *topo, const char *drvpath);
+extern const char *sysfs_topology_module(struct sysfs_topology *topo,
+		const char *drvpath);
+extern const char **sysfs_topology_module_drivers
+	(struct sysfs_topology *topo, const char *modpath);
+
 /* generic sysfs module access */
 extern void sysfs_close_module(struct sysfs_module *module);
 extern struct sysfs_module *sysfs_open_module_path(const char *path);
@@ -219,6 +524,8 @@ extern struct sysfs_module *sysfs_open_module(const char *name);
 extern struct dlist *sysfs_get_module_parms(struct sysfs_module *module);
 extern struct dlist *sysfs_get_module_sections(struct sysfs_module *module);
 extern struct dlist *sysfs_get_module_attributes(struct sysfs_module *module);
+extern struct dlist *sysfs_get_module_attributes_matching
+	(struct sysfs_module *module, const struct sysfs_filter *filter);
 extern struct sysfs_attribute *sysfs_get_module_attr
 	(struct sysfs_module *module, const char *name);
 extern struct sysfs_attribute *sysfs_get_module_parm
@@ -226,6 +533,42 @@ extern struct sysfs_attribute *sysfs_get_module_parm
 extern struct sysfs_attribute *sysfs_get_module_section
 	(struct sysfs_module *module, const char *section);
 
+/* sorted array views of lists */
+extern struct sysfs_vector *sysfs_open_vector(struct dlist *list);
+extern void sysfs_close_vector(struct sysfs_vector *vec);
+extern void *sysfs_vector_find(struct sysfs_vector *vec, const char *name);
+extern struct sysfs_vector *sysfs_open_bus_device_vector
+	(struct sysfs_bus *bus);
+extern struct sysfs_vector *sysfs_open_bus_driver_vector
+	(struct sysfs_bus *bus);
+extern struct sysfs_vector *sysfs_open_driver_device_vector
+	(struct sysfs_driver *drv);
+extern struct sysfs_vector *sysfs_open_class_device_vector
+	(struct sysfs_class *cls);
+extern struct sysfs_vector *sysfs_open_device_attr_vector
+	(struct sysfs_device *dev);
+extern struct sysfs_vector *sysfs_open_driver_attr_vector
+	(struct sysfs_driver *drv);
+extern struct sysfs_vector *sysfs_open_classdev_attr_vector
+	(struct sysfs_class_device *clsdev);
+extern struct sysfs_vector *sysfs_open_module_attr_vector
+	(struct sysfs_module *module);
+
+/* reading chosen attributes of a bus or class's devices into a table */
+extern struct sysfs_projection *sysfs_open_projection(const char **names);
+extern void sysfs_close_projection(struct sysfs_projection *proj);
+extern struct sysfs_table *sysfs_project_bus(struct sysfs_bus *bus,
+		struct sysfs_projection *proj);
+extern struct sysfs_table *sysfs_project_class(struct sysfs_class *cls,
+		struct sysfs_projection *proj);
+extern void sysfs_close_table(struct sysfs_table *table);
+
+/* snapshot files, which SYSFS_PATH can name in place of a sysfs mount */
+extern int sysfs_write_snapshot(const char *file, const char **dirs);
+extern struct sysfs_view *sysfs_open_view(const char *file, const char **dirs);
+extern int sysfs_publish_view(struct sysfs_view *view);
+extern void sysfs_close_view(struct sysfs_view *view);
+
 /**
  * sort_list: sorter function to keep list elements sorted in alphabetical
  * 	order. Just does a strncmp as you can see :)
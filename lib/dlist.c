@@ -28,7 +28,8 @@
 
 */
 #include <stdlib.h>
-#include "dlist.h"
+#include "libsysfs.h"
+#include "sysfs.h"
 
 /*
  * Return pointer to node at marker.
@@ -94,13 +95,24 @@ inline void *_dlist_mark_move(Dlist *list,int direction)
 
 /*
  * Create new linked list to store nodes of datasize.
+ * Inside a libsysfs arena the list and its nodes come from the arena and
+ * are never freed on their own, nor is the data handed to del_func.
  * return null if list cannot be created.
  */
 Dlist *dlist_new(size_t datasize)
 {
   Dlist *list=NULL;
-  if((list=malloc(sizeof(Dlist))))
+  struct sysfs_arena *arena=arena_current();
+  if(arena)
+    list=arena_alloc(arena,sizeof(Dlist));
+  else
+    {
+      list=malloc(sizeof(Dlist));
+      stats_count(SYSFS_STAT_ALLOCS,1);
+    }
+  if(list)
     {
+      list->arena=arena;
       list->marker=NULL;
       list->count=0L;
       list->data_size=datasize;
@@ -152,8 +164,10 @@ void dlist_delete(Dlist *list,int direction)
 	corpse->prev->next=corpse->next;
       if(corpse->next!=NULL) //should be impossible
 	corpse->next->prev=corpse->prev;
-      list->del_func(corpse->data);
       list->count--;
+      if(list->arena)
+	return;
+      list->del_func(corpse->data);
       free(corpse);
     }
 }
@@ -172,8 +186,16 @@ void *dlist_insert(Dlist *list,void *data,int direction)
     return(NULL);
   if(list->marker==NULL) //in case the marker ends up unset
     list->marker=list->head;
-  if((new_node=malloc(sizeof(DL_node))))
+  if(list->arena)
+    new_node=arena_alloc(list->arena,sizeof(DL_node));
+  else
+    {
+      new_node=malloc(sizeof(DL_node));
+      stats_count(SYSFS_STAT_ALLOCS,1);
+    }
+  if(new_node)
     {
+      stats_count(SYSFS_STAT_LIST_INSERTS,1);
       new_node->data=data;
       new_node->prev=NULL;
       new_node->next=NULL;
@@ -272,7 +294,8 @@ void *_dlist_remove(Dlist *list,DL_node *killme,int direction)
       if(killme->next !=NULL)
 	killme->next->prev=killme->prev;
       list->count--;
-      free(killme);
+      if(!list->arena)
+	free(killme);
       return(killer_data);
     }
   else
@@ -396,7 +419,8 @@ void dlist_destroy(Dlist *list)
       while (dlist_mark(list)) {
 	      dlist_delete(list,1);
       }
-      free(list);
+      if(!list->arena)
+	free(list);
     }
 }
 
@@ -555,6 +579,7 @@ void dlist_sort_custom(struct dlist *list, int (*compare)(void *, void *))
 	if(list->count<2)
       		return;
 
+  stats_count(SYSFS_STAT_LIST_SORTS,1);
   dlist_start(list);
   templist = dlist_new(list->data_size);
 
@@ -601,6 +626,35 @@ void dlist_sort_custom(struct dlist *list, int (*compare)(void *, void *))
   dlist_destroy(templist);
 }
 
+/*
+ * Merge the elements of batch into list, which must already be in compare
+ * order. The batch is mergesorted on its own and then merged into list in
+ * a single pass, so adding k elements to a list of n costs O(k log k + n)
+ * compare calls instead of the O(k * n) of repeated dlist_unshift_sorted().
+ * Elements of list compare before equal elements of batch.
+ * The (now empty) batch is destroyed.
+ * NOTE: changes the mark pointer of list
+ */
+void dlist_merge_sorted(struct dlist *list, struct dlist *batch,
+			int (*compare)(void *, void *))
+{
+  struct dl_node *pos;
+
+  if(list==NULL || batch==NULL)
+    return;
+  dlist_sort_custom(batch,compare);
+  pos=(list->head->next!=NULL) ? list->head->next : list->head;
+  while(batch->count>0)
+    {
+      while(pos!=list->head && compare(pos->data,batch->head->next->data)<=0)
+	pos=pos->next;
+      // direction false inserts before the marker, before head is append
+      list->marker=pos;
+      dlist_move(batch,list,batch->head->next,0);
+    }
+  dlist_destroy(batch);
+}
+
 /*
  * The dlist_filter_sort() function scans the list, calling
  * filter() on each list entry. Entries for which filter()
@@ -627,7 +681,7 @@ void dlist_filter_sort(struct dlist *list, int (*filter) (void *),
 		if (!filter(nodepointer->data)) {
 			temp = nodepointer->next;
 			data = _dlist_remove(list, nodepointer, 0);
-			if(data)
+			if(data && !list->arena)
 				list->del_func(data);
 			nodepointer = temp;
 		}
@@ -46,11 +46,145 @@ do { \
 	strncat(to, from, max - strlen(to)-1); \
 } while (0)
 
-extern struct sysfs_attribute *get_attribute(void *dev, const char *name);
-extern struct dlist *read_dir_subdirs(const char *path);
-extern struct dlist *read_dir_links(const char *path);
-extern struct dlist *get_dev_attributes_list(void *dev);
+extern struct sysfs_attribute *get_attribute(void *dev,
+		struct sysfs_attr_index **idx, const char *name);
+extern struct dlist *read_dir_subdirs(const char *path,
+		const struct sysfs_filter *filter);
+extern struct dlist *read_dir_links(const char *path,
+		const struct sysfs_filter *filter);
+extern struct dlist *get_dev_attributes_list(void *dev,
+		struct sysfs_attr_index **idx, const struct sysfs_filter *filter);
+extern void sysfs_close_attr_index(struct sysfs_attr_index *idx);
 extern struct dlist *get_attributes_list(struct dlist *alist, const char *path);
+extern int read_device_children(struct sysfs_device *dev);
+extern int parallel_device_tree(struct sysfs_device *root,
+		unsigned int threads);
+extern int held_attribute_buffer(struct sysfs_attribute *sysattr);
+extern void held_attribute_update(struct sysfs_attribute *sysattr,
+		size_t length);
+extern int read_held_attribute(struct sysfs_attribute *sysattr);
+extern int uring_read_attributes(struct sysfs_attribute **attrs, int count,
+		int *failed);
+struct sysfs_uring;
+extern void uring_free(struct sysfs_uring *ring);
+extern struct sysfs_uring *context_take_uring(void);
+extern void context_put_uring(struct sysfs_uring *ring);
+extern int store_value(struct sysfs_attribute *sysattr, const char *new_value,
+		size_t len, unsigned int flags);
+extern void cache_value(struct sysfs_attribute *sysattr, const char *new_value,
+		size_t length);
+extern const char *root_relative(const char *path);
+extern int root_stat(const char *path, struct stat *astats, int nofollow);
+extern int root_open(const char *path, int flags);
+extern ssize_t root_readlink(const char *path, char *buf, size_t len);
+extern int read_link(const char *path, char *target, size_t len);
+extern int cached_link(const char *path, char *target, size_t len);
+/* a directory read with root_readdir(), live or from a snapshot */
+struct root_dir;
+extern struct root_dir *root_opendir(const char *path);
+extern struct root_dir *root_fdopendir(int fd);
+extern struct dirent *root_readdir(struct root_dir *dir);
+extern void root_closedir(struct root_dir *dir);
+extern int dirent_is_dir(struct root_dir *dir, struct dirent *dirent);
+extern int dirent_is_link(struct root_dir *dir, struct dirent *dirent);
+extern int dirent_is_file(struct root_dir *dir, struct dirent *dirent);
+extern int root_contents(const char *path, const char **data, size_t *len);
+extern ssize_t read_whole(int fd, char **buf, size_t *size, size_t max);
+extern struct sysfs_context *context_in_use(void);
+extern struct sysfs_stats *context_stats(unsigned int options);
+extern void stats_count(enum sysfs_stat stat, unsigned long long n);
+extern unsigned long long stats_begin(void);
+extern void stats_end(enum sysfs_stat stat, unsigned long long start);
+struct link_cache;
+extern struct link_cache *context_links(void);
+extern struct link_cache *link_cache_new(void);
+extern void link_cache_free(struct link_cache *cache);
+struct snapshot;
+extern struct snapshot *snapshot_load(const char *file, const char *root);
+extern void snapshot_close(struct snapshot *snap);
+extern int snapshot_stat(struct snapshot *snap, const char *rel,
+		struct stat *astats, int nofollow);
+extern int snapshot_open(struct snapshot *snap, const char *rel, int flags);
+extern ssize_t snapshot_readlink(struct snapshot *snap, const char *rel,
+		char *buf, size_t len);
+extern const char *snapshot_contents(struct snapshot *snap, const char *rel,
+		size_t *len);
+extern int snapshot_opendir(struct snapshot *snap, const char *rel,
+		unsigned int *first, unsigned int *count);
+extern const char *snapshot_entry_name(struct snapshot *snap, unsigned int i);
+extern int snapshot_entry_mode(struct snapshot *snap, unsigned int i,
+		int follow, mode_t *mode);
+extern unsigned long long snapshot_generation(struct snapshot *snap);
+extern int snapshot_stale(struct snapshot *snap);
+extern int view_check(const void *map, size_t size);
+extern unsigned long long view_generation(const void *map);
+extern int view_current(const void *map, const char *file, char *path,
+		size_t len, unsigned long long *generation);
+extern struct sysfs_arena *arena_new(void);
+extern void arena_adopt(struct sysfs_arena *arena, struct sysfs_arena *child);
+extern void *arena_alloc(struct sysfs_arena *arena, size_t size);
+extern void arena_release(struct sysfs_arena *arena);
+extern int arena_hold(struct sysfs_arena *arena, struct sysfs_attribute *attr);
+extern struct sysfs_arena *arena_current(void);
+extern struct sysfs_arena *arena_enter(struct sysfs_arena *arena);
+extern void arena_leave(struct sysfs_arena *prev);
+extern struct sysfs_arena *arena_begin(void);
+extern void arena_end(struct sysfs_arena *arena, void *root);
+extern void arena_put(struct sysfs_arena *arena, void *obj);
+extern void *arena_calloc(size_t nmemb, size_t size);
+extern void arena_free(void *ptr);
+
+/*
+ * Comparators for dlist_sort_custom()/dlist_merge_sorted(): plain strcmp()
+ * order on the name at the start of every libsysfs struct, or on a bare
+ * name string. sort_names_before() is the dlist_unshift_sorted() flavour
+ * for single inserts into a list kept in the same order.
+ */
+static inline int sort_names(void *a, void *b)
+{
+	return strcmp(((struct sysfs_attribute *)a)->name,
+			((struct sysfs_attribute *)b)->name);
+}
+
+static inline int sort_names_before(void *new_elem, void *old_elem)
+{
+	return sort_names(new_elem, old_elem) < 0 ? 1 : 0;
+}
+
+static inline int sort_strings(void *a, void *b)
+{
+	return strcmp((char *)a, (char *)b);
+}
+
+/* FNV-1a hash of a name, for the attribute index and string interning */
+static inline unsigned int name_hash(const char *name)
+{
+	unsigned int h = 2166136261u;
+
+	while (*name) {
+		h ^= (unsigned char)*name++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/*
+ * merge_name_list: fold an unsorted batch of libsysfs structs into list,
+ * or sort the batch into place as the list if there is none yet.
+ * Returns the resulting list.
+ */
+static inline struct dlist *merge_name_list(struct dlist *list,
+		struct dlist *batch)
+{
+	if (!batch)
+		return list;
+	if (!list) {
+		dlist_sort_custom(batch, sort_names);
+		return batch;
+	}
+	dlist_merge_sorted(list, batch, sort_names);
+	return list;
+}
 
 /* Debugging */
 #ifdef DEBUG
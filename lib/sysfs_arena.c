@@ -0,0 +1,275 @@
+/*
+ * sysfs_arena.c
+ *
+ * Bump allocator backing SYSFS_OPT_ARENA object graphs for libsysfs
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#include "libsysfs.h"
+#include "sysfs.h"
+
+/* bytes carved out of the heap at a time */
+#define ARENA_CHUNK_SIZE	65536
+/* every allocation is rounded up to this */
+#define ARENA_ALIGN		16
+#define arena_round(size)	(((size) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t used;
+	size_t size;
+	/* keeps data ARENA_ALIGN aligned on 64-bit */
+	size_t pad;
+	char data[];
+};
+
+struct arena_hold {
+	struct arena_hold *next;
+	struct sysfs_attribute *attr;
+};
+
+struct sysfs_arena {
+	struct arena_chunk *chunks;	/* first one is being carved */
+	struct arena_hold *holds;	/* attributes that may have an fd open */
+	void *root;			/* object whose close releases us */
+	struct sysfs_arena *adopted;	/* released along with this one */
+	struct sysfs_arena *sibling;	/* next on our adopter's list */
+};
+
+/* arena new objects come from, per thread while building a graph */
+static __thread struct sysfs_arena *current_arena;
+
+static struct arena_chunk *arena_new_chunk(size_t size)
+{
+	struct arena_chunk *chunk;
+
+	chunk = malloc(sizeof(struct arena_chunk) + size);
+	stats_count(SYSFS_STAT_ALLOCS, 1);
+	if (!chunk) {
+		dprintf("malloc failed\n");
+		return NULL;
+	}
+	chunk->next = NULL;
+	chunk->used = 0;
+	chunk->size = size;
+	return chunk;
+}
+
+/**
+ * arena_new: create an empty arena
+ * returns the arena with success and NULL with error.
+ */
+struct sysfs_arena *arena_new(void)
+{
+	struct sysfs_arena *arena;
+
+	arena = calloc(1, sizeof(struct sysfs_arena));
+	if (!arena)
+		dprintf("calloc failed\n");
+	return arena;
+}
+
+/**
+ * arena_alloc: carve zeroed memory out of an arena
+ * @arena: arena to allocate from
+ * @size: bytes wanted
+ * returns the memory with success and NULL with error. It is only
+ *	given back when the whole arena is released.
+ */
+void *arena_alloc(struct sysfs_arena *arena, size_t size)
+{
+	struct arena_chunk *chunk;
+	void *mem;
+
+	size = arena_round(size);
+	chunk = arena->chunks;
+	if (!chunk || chunk->size - chunk->used < size) {
+		if (size > ARENA_CHUNK_SIZE / 4) {
+			/*
+			 * Big one: give it a chunk of its own behind the
+			 * current one, which still has room for small stuff
+			 */
+			chunk = arena_new_chunk(size);
+			if (!chunk)
+				return NULL;
+			if (arena->chunks) {
+				chunk->next = arena->chunks->next;
+				arena->chunks->next = chunk;
+			} else
+				arena->chunks = chunk;
+		} else {
+			chunk = arena_new_chunk(ARENA_CHUNK_SIZE);
+			if (!chunk)
+				return NULL;
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+		}
+	}
+	mem = chunk->data + chunk->used;
+	chunk->used += size;
+	memset(mem, 0, size);
+	return mem;
+}
+
+/**
+ * arena_release: give back everything allocated from arena, and the arena
+ *	itself, closing any attribute still held by its objects.
+ */
+void arena_release(struct sysfs_arena *arena)
+{
+	struct arena_chunk *chunk, *next;
+	struct arena_hold *hold;
+	struct sysfs_arena *child;
+
+	if (!arena)
+		return;
+	while ((child = arena->adopted) != NULL) {
+		arena->adopted = child->sibling;
+		arena_release(child);
+	}
+	for (hold = arena->holds; hold; hold = hold->next)
+		if (hold->attr->bufsize != 0) {
+			close(hold->attr->fd);
+			hold->attr->bufsize = 0;
+		}
+	for (chunk = arena->chunks; chunk; chunk = next) {
+		next = chunk->next;
+		free(chunk);
+	}
+	free(arena);
+}
+
+/**
+ * arena_adopt: have child released along with arena, for threads that
+ *	each need an arena of their own to build parts of one object graph
+ */
+void arena_adopt(struct sysfs_arena *arena, struct sysfs_arena *child)
+{
+	child->sibling = arena->adopted;
+	arena->adopted = child;
+}
+
+/**
+ * arena_hold: have arena close a held attribute's fd when it is released
+ * returns 0 with success and -1 with error.
+ */
+int arena_hold(struct sysfs_arena *arena, struct sysfs_attribute *attr)
+{
+	struct arena_hold *hold;
+
+	hold = arena_alloc(arena, sizeof(struct arena_hold));
+	if (!hold)
+		return -1;
+	hold->attr = attr;
+	hold->next = arena->holds;
+	arena->holds = hold;
+	return 0;
+}
+
+/**
+ * arena_current: arena new objects are currently allocated from, or NULL
+ */
+struct sysfs_arena *arena_current(void)
+{
+	return current_arena;
+}
+
+/**
+ * arena_enter: allocate new objects from arena until arena_leave()
+ * @arena: arena to switch to, NULL for the heap
+ * returns the arena that was current, to hand back to arena_leave().
+ */
+struct sysfs_arena *arena_enter(struct sysfs_arena *arena)
+{
+	struct sysfs_arena *prev = current_arena;
+
+	current_arena = arena;
+	return prev;
+}
+
+/**
+ * arena_leave: go back to the arena that was current before arena_enter()
+ */
+void arena_leave(struct sysfs_arena *prev)
+{
+	current_arena = prev;
+}
+
+/**
+ * arena_begin: start a new arena for a root object if SYSFS_OPT_ARENA is
+ *	set and no arena is current already, making it current.
+ * returns the new arena, or NULL if the object goes on the heap (or in an
+ *	arena that is already current).
+ */
+struct sysfs_arena *arena_begin(void)
+{
+	struct sysfs_arena *arena;
+
+	if (!(sysfs_get_options() & SYSFS_OPT_ARENA) || current_arena)
+		return NULL;
+	arena = arena_new();
+	if (arena)
+		current_arena = arena;
+	return arena;
+}
+
+/**
+ * arena_end: finish building the root object of an arena_begin() arena
+ * @arena: arena returned by arena_begin()
+ * @root: the object built, or NULL if that failed and arena can go
+ */
+void arena_end(struct sysfs_arena *arena, void *root)
+{
+	if (!arena)
+		return;
+	current_arena = NULL;
+	if (root)
+		arena->root = root;
+	else
+		arena_release(arena);
+}
+
+/**
+ * arena_put: close an object allocated from arena, which is only done for
+ *	the object at the root of it, by releasing the whole arena.
+ */
+void arena_put(struct sysfs_arena *arena, void *obj)
+{
+	if (arena && arena->root == obj)
+		arena_release(arena);
+}
+
+/**
+ * arena_calloc: calloc() from the current arena, or the heap outside one
+ */
+void *arena_calloc(size_t nmemb, size_t size)
+{
+	if (current_arena)
+		return arena_alloc(current_arena, nmemb * size);
+	stats_count(SYSFS_STAT_ALLOCS, 1);
+	return calloc(nmemb, size);
+}
+
+/**
+ * arena_free: free() for arena_calloc() memory, a no-op inside an arena
+ */
+void arena_free(void *ptr)
+{
+	if (!current_arena)
+		free(ptr);
+}
@@ -20,15 +20,11 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  *
  */
+#include <limits.h>
+#include <sys/mman.h>
 #include "libsysfs.h"
 #include "sysfs.h"
 
-static int sort_char(void *new, void *old)
-{
-	return ((strncmp((char *)new, (char *)old,
-			strlen((char *)new))) < 0 ? 1 : 0);
-}
-
 /**
  * sysfs_del_name: free function for sysfs_open_subsystem_list
  * @name: memory area to be freed
@@ -63,6 +59,129 @@ static int attr_name_equal(void *a, void *b)
 	return 0;
 }
 
+/*
+ * Open-addressed (linear probing) hash of attribute names, kept next to an
+ * object's attrlist so that name lookups don't have to walk the dlist. The
+ * dlist remains the owner of the attributes and defines iteration order;
+ * the index only holds references to them.
+ */
+#define ATTR_INDEX_MIN_SIZE	16
+
+struct attr_index_slot {
+	unsigned int hash;
+	struct sysfs_attribute *attr;
+};
+
+struct sysfs_attr_index {
+	unsigned int size;		/* number of slots, a power of 2 */
+	unsigned int count;		/* number of slots in use */
+	struct attr_index_slot slots[];
+};
+
+static struct sysfs_attr_index *alloc_attr_index(unsigned int size)
+{
+	struct sysfs_attr_index *idx;
+
+	idx = (struct sysfs_attr_index *)arena_calloc(1, sizeof(*idx) +
+			size * sizeof(struct attr_index_slot));
+	if (idx)
+		idx->size = size;
+	return idx;
+}
+
+/* Insert without growing - caller makes sure there is a free slot */
+static void attr_index_place(struct sysfs_attr_index *idx,
+		unsigned int hash, struct sysfs_attribute *attr)
+{
+	unsigned int i = hash & (idx->size - 1);
+
+	while (idx->slots[i].attr)
+		i = (i + 1) & (idx->size - 1);
+	idx->slots[i].hash = hash;
+	idx->slots[i].attr = attr;
+	idx->count++;
+}
+
+/**
+ * attr_index_insert: adds attribute to the index, creating or growing it
+ * 	as necessary
+ * @idx: index to add to, *idx may be NULL
+ * @attr: attribute to add
+ * returns 0 on success and -1 on error
+ */
+static int attr_index_insert(struct sysfs_attr_index **idx,
+		struct sysfs_attribute *attr)
+{
+	struct sysfs_attr_index *old = *idx, *new;
+	unsigned int i;
+
+	if (!old || (old->count + 1) * 4 > old->size * 3) {
+		new = alloc_attr_index(old ? old->size * 2 :
+						ATTR_INDEX_MIN_SIZE);
+		if (!new)
+			return -1;
+		if (old) {
+			for (i = 0; i < old->size; i++)
+				if (old->slots[i].attr)
+					attr_index_place(new,
+						old->slots[i].hash,
+						old->slots[i].attr);
+			arena_free(old);
+		}
+		*idx = new;
+	}
+	attr_index_place(*idx, name_hash(attr->name), attr);
+	return 0;
+}
+
+/**
+ * attr_index_find: looks up attribute by name
+ * @idx: index to search
+ * @name: attribute name
+ * returns sysfs_attribute if found, NULL otherwise
+ */
+static struct sysfs_attribute *attr_index_find(struct sysfs_attr_index *idx,
+		const char *name)
+{
+	unsigned int hash = name_hash(name);
+	unsigned int i = hash & (idx->size - 1);
+
+	while (idx->slots[i].attr) {
+		if (idx->slots[i].hash == hash &&
+				strcmp(idx->slots[i].attr->name, name) == 0)
+			return idx->slots[i].attr;
+		i = (i + 1) & (idx->size - 1);
+	}
+	return NULL;
+}
+
+/**
+ * sysfs_close_attr_index: frees an attribute index, the attributes
+ * 	themselves belong to the attrlist and are left alone
+ * @idx: index to free
+ */
+void sysfs_close_attr_index(struct sysfs_attr_index *idx)
+{
+	free(idx);
+}
+
+/**
+ * find_attribute: looks for an attribute already on attrlist
+ * @alist: list of attributes
+ * @idx: name index for alist, NULL if it has none
+ * @name: attribute name
+ */
+static struct sysfs_attribute *find_attribute(struct dlist *alist,
+		struct sysfs_attr_index *idx, const char *name)
+{
+	if (!alist)
+		return NULL;
+	if (idx)
+		return attr_index_find(idx, name);
+	return (struct sysfs_attribute *)dlist_find_custom(alist,
+			(void *)name, attr_name_equal);
+}
+
 /**
  * sysfs_close_attribute: closes and cleans up attribute
  * @sysattr: attribute to close.
@@ -70,6 +189,9 @@ static int attr_name_equal(void *a, void *b)
 void sysfs_close_attribute(struct sysfs_attribute *sysattr)
 {
 	if (sysattr) {
+		sysfs_release_attribute(sysattr);
+		if (sysattr->arena)
+			return;
 		if (sysattr->value)
 			free(sysattr->value);
 		free(sysattr);
@@ -82,8 +204,34 @@ void sysfs_close_attribute(struct sysfs_attribute *sysattr)
  */
 static struct sysfs_attribute *alloc_attribute(void)
 {
-	return (struct sysfs_attribute *)
-			calloc(1, sizeof(struct sysfs_attribute));
+	struct sysfs_attribute *sysattr;
+
+	sysattr = (struct sysfs_attribute *)
+			arena_calloc(1, sizeof(struct sysfs_attribute));
+	if (sysattr)
+		sysattr->arena = arena_current();
+	return sysattr;
+}
+
+/**
+ * attr_buffer: allocate a zeroed value buffer for an attribute, from the
+ *	arena the attribute lives in if it has one
+ * returns the buffer with success and NULL with error.
+ */
+static char *attr_buffer(struct sysfs_attribute *sysattr, size_t size)
+{
+	if (sysattr->arena)
+		return (char *)arena_alloc(sysattr->arena, size);
+	return (char *)calloc(1, size);
+}
+
+/**
+ * attr_buffer_free: free an attr_buffer(), arena ones go with the arena
+ */
+static void attr_buffer_free(struct sysfs_attribute *sysattr, char *buf)
+{
+	if (!sysattr->arena)
+		free(buf);
 }
 
 /**
@@ -112,10 +260,10 @@ struct sysfs_attribute *sysfs_open_attribute(const char *path)
 		return NULL;
 	}
 	safestrcpy(sysattr->path, path);
-	if ((stat(sysattr->path, &fileinfo)) != 0) {
+	if ((root_stat(sysattr->path, &fileinfo, 0)) != 0) {
 		dprintf("Stat failed: No such attribute?\n");
 		sysattr->method = 0;
-		free(sysattr);
+		sysfs_close_attribute(sysattr);
 		sysattr = NULL;
 	} else {
 		if (fileinfo.st_mode & S_IRUSR)
@@ -127,6 +275,303 @@ struct sysfs_attribute *sysfs_open_attribute(const char *path)
 	return sysattr;
 }
 
+/**
+ * sysfs_hold_attribute: keep attribute open for repeated reads
+ * @sysattr: attribute to hold
+ *
+ * Until sysfs_release_attribute() or sysfs_close_attribute(),
+ * sysfs_read_attribute() re-reads the held file with pread() into
+ * preallocated buffers instead of opening it and allocating each time.
+ * The buffers take a page, the file's size or the value it has, whichever
+ * is biggest, and grow when a value comes that fills them.
+ * returns 0 with success and -1 with error.
+ */
+int sysfs_hold_attribute(struct sysfs_attribute *sysattr)
+{
+	struct stat stats;
+	size_t bufsize;
+	char *vbuf;
+	int fd;
+
+	if (!sysattr) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (sysattr->bufsize)
+		return 0;
+	if (!(sysattr->method & SYSFS_METHOD_SHOW)) {
+		dprintf("Show method not supported for attribute %s\n",
+			sysattr->path);
+		errno = EACCES;
+		return -1;
+	}
+	if ((fd = root_open(sysattr->path, O_RDONLY)) < 0) {
+		dprintf("Error opening attribute %s\n", sysattr->path);
+		return -1;
+	}
+	bufsize = getpagesize();
+	if (!fstat(fd, &stats) && stats.st_size > (off_t)bufsize)
+		bufsize = stats.st_size < USHRT_MAX ? stats.st_size : USHRT_MAX;
+	if (sysattr->value && (size_t)sysattr->len > bufsize)
+		bufsize = sysattr->len;
+	bufsize++;
+	if (sysattr->value && sysattr->arena) {
+		vbuf = attr_buffer(sysattr, bufsize);
+		if (!vbuf) {
+			dprintf("calloc failed\n");
+			close(fd);
+			return -1;
+		}
+		memcpy(vbuf, sysattr->value, sysattr->len + 1);
+		sysattr->value = vbuf;
+		sysattr->capacity = bufsize;
+	} else if (sysattr->value) {
+		vbuf = (char *)realloc(sysattr->value, bufsize);
+		if (!vbuf) {
+			dprintf("realloc failed\n");
+			close(fd);
+			return -1;
+		}
+		sysattr->value = vbuf;
+	}
+	sysattr->rbuf = attr_buffer(sysattr, bufsize);
+	if (!sysattr->rbuf) {
+		dprintf("calloc failed\n");
+		close(fd);
+		return -1;
+	}
+	/* the arena closes it if the attribute isn't released before */
+	if (sysattr->arena && arena_hold(sysattr->arena, sysattr)) {
+		dprintf("calloc failed\n");
+		close(fd);
+		sysattr->rbuf = NULL;
+		return -1;
+	}
+	sysattr->fd = fd;
+	sysattr->bufsize = bufsize;
+	return 0;
+}
+
+/**
+ * sysfs_release_attribute: close an attribute held open with
+ *	sysfs_hold_attribute(), its value is kept
+ * @sysattr: attribute to release
+ */
+void sysfs_release_attribute(struct sysfs_attribute *sysattr)
+{
+	if (sysattr && sysattr->bufsize) {
+		close(sysattr->fd);
+		attr_buffer_free(sysattr, sysattr->rbuf);
+		sysattr->rbuf = NULL;
+		sysattr->bufsize = 0;
+	}
+}
+
+/**
+ * held_attribute_buffer: make sure a held attribute has its spare buffer
+ * @sysattr: held attribute
+ * returns 0 with success and -1 with error.
+ */
+int held_attribute_buffer(struct sysfs_attribute *sysattr)
+{
+	if (!sysattr->rbuf) {
+		sysattr->rbuf = attr_buffer(sysattr, sysattr->bufsize);
+		if (!sysattr->rbuf) {
+			dprintf("calloc failed\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * held_attribute_grow: make a held attribute's buffers twice as big, for
+ *	a value that filled them
+ * @sysattr: held attribute
+ * returns 0 with success and -1 with error, with the buffers as they were.
+ */
+static int held_attribute_grow(struct sysfs_attribute *sysattr)
+{
+	size_t bufsize, valsize;
+	char *rbuf, *vbuf;
+
+	bufsize = (sysattr->bufsize - 1) * 2;
+	if (bufsize > USHRT_MAX)
+		bufsize = USHRT_MAX;
+	bufsize++;
+	/* a value written with cache_value() may have outgrown the buffer */
+	valsize = sysattr->value && (size_t)sysattr->len >= bufsize ?
+		(size_t)sysattr->len + 1 : bufsize;
+	rbuf = attr_buffer(sysattr, bufsize);
+	if (!rbuf) {
+		dprintf("calloc failed\n");
+		return -1;
+	}
+	if (!sysattr->value)
+		vbuf = NULL;
+	else if (sysattr->arena) {
+		vbuf = attr_buffer(sysattr, valsize);
+		if (vbuf) {
+			memcpy(vbuf, sysattr->value, sysattr->len + 1);
+			sysattr->capacity = valsize;
+		}
+	} else
+		vbuf = (char *)realloc(sysattr->value, valsize);
+	if (sysattr->value && !vbuf) {
+		dprintf("Error growing the buffers of %s\n", sysattr->path);
+		attr_buffer_free(sysattr, rbuf);
+		return -1;
+	}
+	sysattr->value = vbuf;
+	attr_buffer_free(sysattr, sysattr->rbuf);
+	sysattr->rbuf = rbuf;
+	sysattr->bufsize = bufsize;
+	return 0;
+}
+
+/**
+ * held_attribute_update: take length bytes read into a held attribute's
+ *	spare buffer as its value, swapping buffers if the value changed
+ * @sysattr: held attribute
+ * @length: bytes read into sysattr->rbuf
+ */
+void held_attribute_update(struct sysfs_attribute *sysattr, size_t length)
+{
+	char *vbuf;
+
+	sysattr->rbuf[length] = '\0';
+	if (sysattr->value && sysattr->len == length &&
+			!(memcmp(sysattr->value, sysattr->rbuf, length)))
+		return;
+
+	vbuf = sysattr->value;
+	sysattr->value = sysattr->rbuf;
+	sysattr->rbuf = vbuf;
+	sysattr->len = length;
+}
+
+/**
+ * read_held_attribute: pread() a held attribute into its spare buffer,
+ *	growing the buffers for as long as the value fills them
+ * @sysattr: attribute to read
+ * returns 0 with success and -1 with error.
+ */
+int read_held_attribute(struct sysfs_attribute *sysattr)
+{
+	unsigned long long start;
+	ssize_t length;
+
+	if (held_attribute_buffer(sysattr))
+		return -1;
+	for (;;) {
+		start = stats_begin();
+		length = pread(sysattr->fd, sysattr->rbuf,
+				sysattr->bufsize - 1, 0);
+		stats_end(SYSFS_STAT_READ, start);
+		if (length < 0) {
+			dprintf("Error reading from attribute %s\n",
+					sysattr->path);
+			return -1;
+		}
+		stats_count(SYSFS_STAT_BYTES_READ, length);
+		if ((size_t)length < sysattr->bufsize - 1 ||
+		    sysattr->bufsize > USHRT_MAX)
+			break;
+		if (held_attribute_grow(sysattr))
+			return -1;
+	}
+	held_attribute_update(sysattr, length);
+	return 0;
+}
+
+/**
+ * read_whole: read() fd from where it is to end of file, or max bytes,
+ *	into *buf, growing it from *size as needed. sysfs hands over as
+ *	much as fits, up to a page, in each read(). So one that comes up
+ *	shorter than both is the end of the file, and only those that
+ *	don't need another read() to tell.
+ * @fd: file to read
+ * @buf: malloc()ed buffer of *size + 1 bytes, may be replaced
+ * @size: room in *buf, not counting the nul that ends the data
+ * @max: most bytes to read
+ * returns the number of bytes read with success and -1 with error.
+ */
+ssize_t read_whole(int fd, char **buf, size_t *size, size_t max)
+{
+	size_t length = 0, newsize, pgsize = getpagesize();
+	unsigned long long start;
+	ssize_t count;
+	char *nbuf;
+
+	for (;;) {
+		start = stats_begin();
+		count = read(fd, *buf + length, *size - length);
+		stats_end(SYSFS_STAT_READ, start);
+		if (count < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		stats_count(SYSFS_STAT_BYTES_READ, count);
+		length += count;
+		if (count == 0 || length >= max ||
+				(length < *size && (size_t)count < pgsize))
+			break;
+		if (length < *size)
+			continue;
+		newsize = *size > max / 2 ? max : *size * 2;
+		nbuf = (char *)realloc(*buf, newsize + 1);
+		if (!nbuf) {
+			dprintf("realloc failed\n");
+			return -1;
+		}
+		*buf = nbuf;
+		*size = newsize;
+	}
+	(*buf)[length] = '\0';
+	return length;
+}
+
+/**
+ * read_path: read_whole() the file at path or, with a snapshot standing
+ *	in for sysfs, copy it straight out of that
+ * returns the number of bytes read with success and -1 with error.
+ */
+static ssize_t read_path(const char *path, char **buf, size_t *size,
+		size_t max)
+{
+	const char *data;
+	size_t length;
+	ssize_t count;
+	char *nbuf;
+	int fd, ret;
+
+	ret = root_contents(path, &data, &length);
+	if (ret < 0)
+		return -1;
+	if (ret == 0) {
+		if (length > max)
+			length = max;
+		if (length > *size) {
+			nbuf = (char *)realloc(*buf, length + 1);
+			if (!nbuf) {
+				dprintf("realloc failed\n");
+				return -1;
+			}
+			*buf = nbuf;
+			*size = length;
+		}
+		memcpy(*buf, data, length);
+		(*buf)[length] = '\0';
+		return length;
+	}
+	if ((fd = root_open(path, O_RDONLY)) < 0)
+		return -1;
+	count = read_whole(fd, buf, size, max);
+	close(fd);
+	return count;
+}
+
 /**
  * sysfs_read_attribute: reads value from attribute
  * @sysattr: attribute to read
@@ -137,8 +582,7 @@ int sysfs_read_attribute(struct sysfs_attribute *sysattr)
 	char *fbuf = NULL;
 	char *vbuf = NULL;
 	ssize_t length = 0;
-	long pgsize = 0;
-	int fd;
+	size_t size;
 
 	if (!sysattr) {
 		errno = EINVAL;
@@ -150,35 +594,60 @@ int sysfs_read_attribute(struct sysfs_attribute *sysattr)
 		errno = EACCES;
 		return -1;
 	}
-	pgsize = getpagesize();
-	fbuf = (char *)calloc(1, pgsize+1);
+	if (sysattr->bufsize)
+		return read_held_attribute(sysattr);
+
+	/*
+	 * Asking for a byte more than a page gets any text attribute in
+	 * one read(). Binary ones can be bigger and take as many as they
+	 * need, up to what len can hold.
+	 */
+	size = getpagesize() + 1;
+	fbuf = (char *)calloc(1, size+1);
 	if (!fbuf) {
 		dprintf("calloc failed\n");
 		return -1;
 	}
-	if ((fd = open(sysattr->path, O_RDONLY)) < 0) {
-		dprintf("Error reading attribute %s\n", sysattr->path);
-		free(fbuf);
-		return -1;
-	}
-	length = read(fd, fbuf, pgsize);
+	stats_count(SYSFS_STAT_ALLOCS, 1);
+	length = read_path(sysattr->path, &fbuf, &size, USHRT_MAX);
 	if (length < 0) {
 		dprintf("Error reading from attribute %s\n", sysattr->path);
-		close(fd);
 		free(fbuf);
 		return -1;
 	}
 	if (sysattr->len > 0) {
 		if ((sysattr->len == length) &&
-				(!(strncmp(sysattr->value, fbuf, length)))) {
-			close(fd);
+				(!(memcmp(sysattr->value, fbuf, length)))) {
 			free(fbuf);
 			return 0;
 		}
-		free(sysattr->value);
+		attr_buffer_free(sysattr, sysattr->value);
 	}
 	sysattr->len = length;
-	close(fd);
+	if (sysattr->arena) {
+		/*
+		 * arena memory is only given back with the arena, so the
+		 * value is copied into the buffer it has while it fits and
+		 * into a new one only when it grows
+		 */
+		if (!sysattr->value || (size_t)length >= sysattr->capacity) {
+			vbuf = attr_buffer(sysattr, length+1);
+			if (!vbuf) {
+				dprintf("calloc failed\n");
+				free(fbuf);
+				sysattr->value = NULL;
+				sysattr->len = 0;
+				sysattr->capacity = 0;
+				return -1;
+			}
+			sysattr->value = vbuf;
+			sysattr->capacity = length+1;
+		}
+		memcpy(sysattr->value, fbuf, length);
+		sysattr->value[length] = '\0';
+		free(fbuf);
+		return 0;
+	}
 	vbuf = (char *)realloc(fbuf, length+1);
 	if (!vbuf) {
 		dprintf("realloc failed\n");
@@ -190,6 +659,178 @@ int sysfs_read_attribute(struct sysfs_attribute *sysattr)
 	return 0;
 }
 
+/**
+ * sysfs_get_attribute_value: returns the attribute's value, reading it
+ *	first if it hasn't been read yet (see SYSFS_OPT_LAZY_ATTRS)
+ * @sysattr: attribute whose value is needed
+ * returns value with success and NULL with error.
+ */
+char *sysfs_get_attribute_value(struct sysfs_attribute *sysattr)
+{
+	if (!sysattr) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (!sysattr->value && sysfs_read_attribute(sysattr))
+		return NULL;
+	return sysattr->value;
+}
+
+/* bytes read at a time when a binary attribute doesn't say its size */
+#define ATTR_DATA_CHUNK		65536
+
+/**
+ * sysfs_read_attribute_data: reads the whole of an attribute, however big,
+ *	leaving its value alone. Meant for binary attributes that don't
+ *	fit in the value, such as a PCI device's rom or a monitor's edid.
+ * @sysattr: attribute to read
+ * @size: set to the number of bytes read
+ * returns a malloc()ed buffer with the data and a nul after it, to be
+ *	free()d by the caller, with success and NULL with error.
+ */
+char *sysfs_read_attribute_data(struct sysfs_attribute *sysattr, size_t *size)
+{
+	struct stat stats;
+	char *buf;
+	size_t bufsize = ATTR_DATA_CHUNK;
+	ssize_t length;
+	int fd;
+
+	if (!sysattr || !size) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (!(sysattr->method & SYSFS_METHOD_SHOW)) {
+		dprintf("Show method not supported for attribute %s\n",
+			sysattr->path);
+		errno = EACCES;
+		return NULL;
+	}
+	if ((fd = root_open(sysattr->path, O_RDONLY)) < 0) {
+		dprintf("Error reading attribute %s\n", sysattr->path);
+		return NULL;
+	}
+	/*
+	 * Binary attributes mostly know their size, so the whole of it
+	 * comes in one read() with a byte to spare to see it end.
+	 */
+	if (!fstat(fd, &stats) && stats.st_size > 0)
+		bufsize = stats.st_size + 1;
+	buf = (char *)malloc(bufsize + 1);
+	if (!buf) {
+		dprintf("malloc failed\n");
+		close(fd);
+		return NULL;
+	}
+	length = read_whole(fd, &buf, &bufsize, SSIZE_MAX);
+	close(fd);
+	if (length < 0) {
+		dprintf("Error reading from attribute %s\n", sysattr->path);
+		free(buf);
+		return NULL;
+	}
+	*size = length;
+	return buf;
+}
+
+/**
+ * sysfs_map_attribute: mmap()s an attribute that supports it, such as a
+ *	PCI device's resource files
+ * @sysattr: attribute to map
+ * @writable: map it for writing as well as reading
+ * @size: set to the size of the mapping
+ * returns the mapping with success and NULL with error.
+ */
+void *sysfs_map_attribute(struct sysfs_attribute *sysattr, int writable,
+		size_t *size)
+{
+	struct stat stats;
+	void *addr;
+	int fd;
+
+	if (!sysattr || !size) {
+		errno = EINVAL;
+		return NULL;
+	}
+	fd = root_open(sysattr->path, writable ? O_RDWR : O_RDONLY);
+	if (fd < 0) {
+		dprintf("Error opening attribute %s\n", sysattr->path);
+		return NULL;
+	}
+	if (fstat(fd, &stats) || stats.st_size <= 0) {
+		dprintf("Attribute %s has no size to map\n", sysattr->path);
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	addr = mmap(NULL, stats.st_size, writable ? PROT_READ | PROT_WRITE :
+			PROT_READ, MAP_SHARED, fd, 0);
+	/* the mapping keeps the file open */
+	close(fd);
+	if (addr == MAP_FAILED) {
+		dprintf("Error mapping attribute %s\n", sysattr->path);
+		return NULL;
+	}
+	*size = stats.st_size;
+	return addr;
+}
+
+/**
+ * sysfs_unmap_attribute: undoes sysfs_map_attribute()
+ * @addr: mapping returned
+ * @size: size returned with it
+ */
+void sysfs_unmap_attribute(void *addr, size_t size)
+{
+	if (addr)
+		munmap(addr, size);
+}
+
+/**
+ * sysfs_read_attributes: refresh the values of a set of attributes
+ * @attrs: array of attributes to read, each listed once
+ * @count: number of attributes in attrs
+ *
+ * Attributes are held open (see sysfs_hold_attribute()) so the next
+ * call only has to read them again. Held reads are submitted together
+ * through io_uring where the kernel supports it, on a ring the context
+ * keeps from one call to the next, and done with pread() otherwise.
+ * An attribute that can't be held, e.g. when out of file descriptors,
+ * is read the usual way.
+ * returns 0 with success and -1 if any attribute could not be read.
+ */
+int sysfs_read_attributes(struct sysfs_attribute **attrs, int count)
+{
+	struct sysfs_attribute **held;
+	int i, nheld = 0, failed = 0;
+
+	if (!attrs || count < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	held = (struct sysfs_attribute **)
+			calloc(count + 1, sizeof(struct sysfs_attribute *));
+	if (!held) {
+		dprintf("calloc failed\n");
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		if (!attrs[i]) {
+			errno = EINVAL;
+			failed++;
+		} else if (!sysfs_hold_attribute(attrs[i]) &&
+				!held_attribute_buffer(attrs[i]))
+			held[nheld++] = attrs[i];
+		else if (sysfs_read_attribute(attrs[i]))
+			failed++;
+	}
+	for (i = uring_read_attributes(held, nheld, &failed); i < nheld; i++)
+		if (read_held_attribute(held[i]))
+			failed++;
+	free(held);
+	return failed ? -1 : 0;
+}
+
 /**
  * sysfs_write_attribute: write value to the attribute
  * @sysattr: attribute to write
@@ -200,6 +841,7 @@ int sysfs_read_attribute(struct sysfs_attribute *sysattr)
 int sysfs_write_attribute(struct sysfs_attribute *sysattr,
 		const char *new_value, size_t len)
 {
+	unsigned long long start;
 	int fd;
 	int length;
 
@@ -233,12 +875,14 @@ int sysfs_write_attribute(struct sysfs_attribute *sysattr,
 	 * open O_WRONLY since some attributes have no "read" but only
 	 * "write" permission
 	 */
-	if ((fd = open(sysattr->path, O_WRONLY)) < 0) {
+	if ((fd = root_open(sysattr->path, O_WRONLY)) < 0) {
 		dprintf("Error reading attribute %s\n", sysattr->path);
 		return -1;
 	}
 
+	start = stats_begin();
 	length = write(fd, new_value, len);
+	stats_end(SYSFS_STAT_WRITE, start);
 	if (length < 0) {
 		dprintf("Error writing to the attribute %s - invalid value?\n",
 			sysattr->name);
@@ -252,41 +896,151 @@ int sysfs_write_attribute(struct sysfs_attribute *sysattr,
 		 * restore the old value if one available
 		 */
 		if (sysattr->method & SYSFS_METHOD_SHOW) {
+			start = stats_begin();
 			length = write(fd, sysattr->value, sysattr->len);
+			stats_end(SYSFS_STAT_WRITE, start);
 			close(fd);
 			return -1;
 		}
 	}
 
-	/*
-	 * Validate length that has been copied. Alloc appropriate area
-	 * in sysfs_attribute. Verify first if the attribute supports reading
-	 * (show method). If it does not, do not bother
-	 */
+	cache_value(sysattr, new_value, length);
+
+	close(fd);
+	return 0;
+}
+
+/**
+ * store_value: writes new_value to an attribute the way flags (see
+ *	sysfs_write_attributes()) say, touching nothing of the attribute
+ *	but its file, so attributes can be stored from several threads
+ * @sysattr: attribute to write
+ * @new_value: value to write
+ * @len: length of new_value
+ * @flags: SYSFS_WRITE_* flags
+ * returns 0 when written, 1 when the attribute already had the value and
+ *	-1 with error.
+ */
+int store_value(struct sysfs_attribute *sysattr, const char *new_value,
+		size_t len, unsigned int flags)
+{
+	unsigned long long start;
+	const char *old = NULL;
+	char *fbuf = NULL;
+	size_t oldlen = 0, size;
+	ssize_t length;
+	int fd, ret = 0;
+
+	if (!(sysattr->method & SYSFS_METHOD_STORE)) {
+		dprintf ("Store method not supported for attribute %s\n",
+			sysattr->path);
+		errno = EACCES;
+		return -1;
+	}
 	if (sysattr->method & SYSFS_METHOD_SHOW) {
-		if (length != sysattr->len) {
-			sysattr->value = (char *)realloc
-				(sysattr->value, length);
-			sysattr->len = length;
-			safestrcpymax(sysattr->value, new_value, length);
-		} else {
-			/*"length" of the new value is same as old one */
-			safestrcpymax(sysattr->value, new_value, length);
+		if (flags & SYSFS_WRITE_REREAD) {
+			size = getpagesize() + 1;
+			fbuf = (char *)calloc(1, size + 1);
+			if (!fbuf) {
+				dprintf("calloc failed\n");
+				return -1;
+			}
+			stats_count(SYSFS_STAT_ALLOCS, 1);
+			length = read_path(sysattr->path, &fbuf, &size,
+					USHRT_MAX);
+			if (length < 0) {
+				dprintf("Error reading attribute %s\n",
+						sysattr->path);
+				free(fbuf);
+				return -1;
+			}
+			old = fbuf;
+			oldlen = length;
+		} else if ((flags & SYSFS_WRITE_CACHED) && sysattr->value) {
+			old = sysattr->value;
+			oldlen = sysattr->len;
+		}
+		if (old && oldlen == len && !memcmp(old, new_value, len)) {
+			free(fbuf);
+			return 1;
 		}
 	}
 
+	if ((fd = root_open(sysattr->path, O_WRONLY)) < 0) {
+		dprintf("Error opening attribute %s\n", sysattr->path);
+		free(fbuf);
+		return -1;
+	}
+	start = stats_begin();
+	length = write(fd, new_value, len);
+	stats_end(SYSFS_STAT_WRITE, start);
+	if (length < 0) {
+		dprintf("Error writing to the attribute %s - invalid value?\n",
+			sysattr->name);
+		ret = -1;
+	} else if ((size_t)length != len) {
+		dprintf("Could not write %zd bytes to attribute %s\n",
+					len, sysattr->name);
+		if (old && !(flags & SYSFS_WRITE_NO_RESTORE)) {
+			start = stats_begin();
+			length = write(fd, old, oldlen);
+			stats_end(SYSFS_STAT_WRITE, start);
+		}
+		errno = EIO;
+		ret = -1;
+	}
 	close(fd);
-	return 0;
+	free(fbuf);
+	return ret;
 }
 
 /**
- * add_attribute_to_list: open and add attribute at path to given dlist
- * @list: dlist attribute is to be added
+ * cache_value: keep a value just written as the attribute's own, if it
+ *	can be read back at all
+ * @sysattr: attribute written
+ * @new_value: value written
+ * @length: length of new_value
+ */
+void cache_value(struct sysfs_attribute *sysattr, const char *new_value,
+		size_t length)
+{
+	char *vbuf;
+
+	if (!(sysattr->method & SYSFS_METHOD_SHOW))
+		return;
+	/*
+	 * a held attribute's buffer is already page sized, others just fit
+	 * their value; arena ones are never realloc()ed, but replaced once
+	 * the value outgrows the buffer
+	 */
+	if (!sysattr->value || (sysattr->bufsize ? length >= sysattr->bufsize :
+				sysattr->arena ? length >= sysattr->capacity :
+				length > sysattr->len)) {
+		if (sysattr->arena)
+			vbuf = attr_buffer(sysattr, length + 1);
+		else
+			vbuf = (char *)realloc(sysattr->value, length + 1);
+		if (!vbuf) {
+			dprintf("Error allocating the value of %s\n",
+					sysattr->path);
+			return;
+		}
+		sysattr->value = vbuf;
+		if (sysattr->arena)
+			sysattr->capacity = length + 1;
+	}
+	memcpy(sysattr->value, new_value, length);
+	sysattr->value[length] = '\0';
+	sysattr->len = length;
+}
+
+/**
+ * open_read_attribute: open attribute at path and read its value, unless
+ *	SYSFS_OPT_LAZY_ATTRS defers that to sysfs_get_attribute_value()
  * @path: path to attribute
- * returns pointer to attr added with success and NULL with error.
+ * returns pointer to attr with success and NULL with error.
  */
-static struct sysfs_attribute *add_attribute_to_list(struct dlist *alist,
-							const char *path)
+static struct sysfs_attribute *open_read_attribute(const char *path)
 {
 	struct sysfs_attribute *attr;
 
@@ -295,118 +1049,164 @@ static struct sysfs_attribute *add_attribute_to_list(struct dlist *alist,
 		dprintf("Error opening attribute %s\n",	path);
 		return NULL;
 	}
-	if (attr->method & SYSFS_METHOD_SHOW) {
+	if ((attr->method & SYSFS_METHOD_SHOW) &&
+			!(sysfs_get_options() & SYSFS_OPT_LAZY_ATTRS)) {
 		if (sysfs_read_attribute(attr)) {
 			dprintf("Error reading attribute %s\n",	path);
 			sysfs_close_attribute(attr);
 			return NULL;
 		}
 	}
+	return attr;
+}
 
-	if (!alist) {
-		alist = dlist_new_with_delete
+/**
+ * attach_attributes: merge a batch of attributes into dev's attrlist
+ * @dev: device the attributes belong to
+ * @idx: name index kept with dev's attrlist
+ * @batch: unsorted list of attributes, consumed on success
+ * returns 0 with success and -1 with error, batch is left to the
+ * caller on error.
+ */
+static int attach_attributes(void *dev, struct sysfs_attr_index **idx,
+		struct dlist *batch)
+{
+	struct sysfs_attribute *attr;
+	int newlist = 0;
+
+	if (!((struct sysfs_device *)dev)->attrlist) {
+		((struct sysfs_device *)dev)->attrlist = dlist_new_with_delete
 			(sizeof(struct sysfs_attribute), sysfs_del_attribute);
+		if (!((struct sysfs_device *)dev)->attrlist) {
+			dprintf("Error creating list\n");
+			return -1;
+		}
+		newlist = 1;
 	}
-	dlist_unshift_sorted(alist, attr, sort_list);
-	return attr;
+
+	/*
+	 * The index is only ever started along with a new list, so it
+	 * always covers every attribute on the list. If it can't be
+	 * kept up to date, drop it and fall back to walking the list.
+	 */
+	if (newlist || *idx) {
+		dlist_for_each_data(batch, attr, struct sysfs_attribute) {
+			if (attr_index_insert(idx, attr)) {
+				dprintf("Error indexing attribute %s\n",
+						attr->path);
+				sysfs_close_attr_index(*idx);
+				*idx = NULL;
+				break;
+			}
+		}
+	}
+	dlist_merge_sorted(((struct sysfs_device *)dev)->attrlist,
+			batch, sort_names);
+	return 0;
 }
 
 /**
  * add_attribute: open and add attribute at path to given directory
  * @dev: device whose attribute is to be added
+ * @idx: name index kept with dev's attrlist
  * @path: path to attribute
  * returns pointer to attr added with success and NULL with error.
  */
-static struct sysfs_attribute *add_attribute(void *dev, const char *path)
+static struct sysfs_attribute *add_attribute(void *dev,
+		struct sysfs_attr_index **idx, const char *path)
 {
 	struct sysfs_attribute *attr;
+	struct dlist *batch;
 
-	attr = sysfs_open_attribute(path);
-	if (!attr) {
-		dprintf("Error opening attribute %s\n",	path);
+	attr = open_read_attribute(path);
+	if (!attr)
 		return NULL;
-	}
-	if (attr->method & SYSFS_METHOD_SHOW) {
-		if (sysfs_read_attribute(attr)) {
-			dprintf("Error reading attribute %s\n",	path);
-			sysfs_close_attribute(attr);
-			return NULL;
-		}
-	}
 
-	if (!((struct sysfs_device *)dev)->attrlist) {
-		((struct sysfs_device *)dev)->attrlist = dlist_new_with_delete
-			(sizeof(struct sysfs_attribute), sysfs_del_attribute);
+	batch = dlist_new_with_delete(sizeof(struct sysfs_attribute),
+			sysfs_del_attribute);
+	if (!batch) {
+		dprintf("Error creating list\n");
+		sysfs_close_attribute(attr);
+		return NULL;
+	}
+	dlist_push(batch, attr);
+	if (attach_attributes(dev, idx, batch)) {
+		dlist_destroy(batch);
+		return NULL;
 	}
-	dlist_unshift_sorted(((struct sysfs_device *)dev)->attrlist,
-			attr, sort_list);
-
 	return attr;
 }
 
 /*
  * get_attribute - given a sysfs_* struct and a name, return the
  * sysfs_attribute corresponding to "name"
+ * @idx: name index kept with dev's attrlist
  * returns sysfs_attribute on success and NULL on error
  */
-struct sysfs_attribute *get_attribute(void *dev, const char *name)
+struct sysfs_attribute *get_attribute(void *dev,
+		struct sysfs_attr_index **idx, const char *name)
 {
 	struct sysfs_attribute *cur = NULL;
 	char path[SYSFS_PATH_MAX];
 
-	if (!dev || !name) {
+	if (!dev || !idx || !name) {
 		errno = EINVAL;
 		return NULL;
 	}
 
-	if (((struct sysfs_device *)dev)->attrlist) {
-		/* check if attr is already in the list */
-		cur = (struct sysfs_attribute *)dlist_find_custom
-			((((struct sysfs_device *)dev)->attrlist),
-			 	(void *)name, attr_name_equal);
-		if (cur)
-			return cur;
-	}
-	safestrcpymax(path, ((struct sysfs_device *)dev)->path,
-			SYSFS_PATH_MAX);
-	safestrcatmax(path, "/", SYSFS_PATH_MAX);
-	safestrcatmax(path, name, SYSFS_PATH_MAX);
-	if (!sysfs_path_is_file(path))
-		cur = add_attribute((void *)dev, path);
+	/* check if attr is already in the list */
+	cur = find_attribute(((struct sysfs_device *)dev)->attrlist,
+			*idx, name);
+	stats_count(cur ? SYSFS_STAT_ATTR_HITS : SYSFS_STAT_ATTR_MISSES, 1);
+	if (!cur) {
+		safestrcpymax(path, ((struct sysfs_device *)dev)->path,
+				SYSFS_PATH_MAX);
+		safestrcatmax(path, "/", SYSFS_PATH_MAX);
+		safestrcatmax(path, name, SYSFS_PATH_MAX);
+		if (!sysfs_path_is_file(path))
+			cur = add_attribute((void *)dev, idx, path);
+	}
+
+	/* an attribute listed lazily gets its value on lookup by name */
+	if (cur && (cur->method & SYSFS_METHOD_SHOW) &&
+			!sysfs_get_attribute_value(cur)) {
+		dprintf("Error reading attribute %s\n", cur->path);
+		return NULL;
+	}
 	return cur;
 }
 
 /**
  * read_dir_links: grabs links in a specific directory
  * @sysdir: sysfs directory to read
+ * @filter: which links to list, NULL for all
  * returns list of link names with success and NULL with error.
  */
-struct dlist *read_dir_links(const char *path)
+struct dlist *read_dir_links(const char *path,
+		const struct sysfs_filter *filter)
 {
-	DIR *dir = NULL;
+	struct root_dir *dir = NULL;
 	struct dirent *dirent = NULL;
-	char file_path[SYSFS_PATH_MAX], *linkname;
+	char *linkname;
 	struct dlist *linklist = NULL;
 
 	if (!path) {
 		errno = EINVAL;
 		return NULL;
 	}
-	dir = opendir(path);
+	dir = root_opendir(path);
 	if (!dir) {
 		dprintf("Error opening directory %s\n", path);
 		return NULL;
 	}
-	while ((dirent = readdir(dir)) != NULL) {
+	while ((dirent = root_readdir(dir)) != NULL) {
 		if (0 == strcmp(dirent->d_name, "."))
 			 continue;
 		if (0 == strcmp(dirent->d_name, ".."))
 			continue;
-		memset(file_path, 0, SYSFS_PATH_MAX);
-		safestrcpy(file_path, path);
-		safestrcat(file_path, "/");
-		safestrcat(file_path, dirent->d_name);
-		if (!sysfs_path_is_link(file_path)) {
+		if (sysfs_filter_match(filter, dirent->d_name))
+			continue;
+		if (!dirent_is_link(dir, dirent)) {
 			if (!linklist) {
 				linklist = dlist_new_with_delete
 					(SYSFS_NAME_LEN, sysfs_del_name);
@@ -415,12 +1215,14 @@ struct dlist *read_dir_links(const char *path)
 					return NULL;
 				}
 			}
-			linkname = (char *)calloc(1, SYSFS_NAME_LEN);
+			linkname = (char *)arena_calloc(1, SYSFS_NAME_LEN);
 			safestrcpymax(linkname, dirent->d_name, SYSFS_NAME_LEN);
-			dlist_unshift_sorted(linklist, linkname, sort_char);
+			dlist_push(linklist, linkname);
 		}
 	}
-	closedir(dir);
+	root_closedir(dir);
+	if (linklist)
+		dlist_sort_custom(linklist, sort_strings);
 	return linklist;
 }
 
@@ -441,7 +1243,7 @@ int add_subdirectory(struct sysfs_device *dev, char *path)
 		dev->children = dlist_new_with_delete(
 			sizeof(struct sysfs_device), sysfs_close_dev_tree);
 
-	dlist_unshift_sorted(dev->children, newdev, sort_list);
+	dlist_push(dev->children, newdev);
 	return 0;
 }
 
@@ -452,7 +1254,7 @@ int add_subdirectory(struct sysfs_device *dev, char *path)
  */
 struct sysfs_device *sysfs_read_dir_subdirs(const char *path)
 {
-	DIR *dir = NULL;
+	struct root_dir *dir = NULL;
 	struct dirent *dirent = NULL;
 	char file_path[SYSFS_PATH_MAX];
 	struct sysfs_device *dev = NULL;
@@ -464,58 +1266,60 @@ struct sysfs_device *sysfs_read_dir_subdirs(const char *path)
 
 	dev = sysfs_open_device_path(path);
 
-	dir = opendir(path);
+	dir = root_opendir(path);
 	if (!dir) {
 		dprintf("Error opening directory %s\n", path);
 		return NULL;
 	}
-	while ((dirent = readdir(dir)) != NULL) {
+	while ((dirent = root_readdir(dir)) != NULL) {
 		if (0 == strcmp(dirent->d_name, "."))
 			 continue;
 		if (0 == strcmp(dirent->d_name, ".."))
 			continue;
-		memset(file_path, 0, SYSFS_PATH_MAX);
+		if (dirent_is_dir(dir, dirent))
+			continue;
 		safestrcpy(file_path, path);
 		safestrcat(file_path, "/");
 		safestrcat(file_path, dirent->d_name);
-		if (!sysfs_path_is_dir(file_path))
-			add_subdirectory(dev, file_path);
+		add_subdirectory(dev, file_path);
 	}
-	closedir(dir);
+	root_closedir(dir);
+	if (dev->children)
+		dlist_sort_custom(dev->children, sort_names);
 	return dev;
 }
 
 /**
  * read_dir_subdirs: grabs subdirs in a specific directory
  * @sysdir: sysfs directory to read
+ * @filter: which subdirs to list, NULL for all
  * returns list of directory names with success and NULL with error.
  */
-struct dlist *read_dir_subdirs(const char *path)
+struct dlist *read_dir_subdirs(const char *path,
+		const struct sysfs_filter *filter)
 {
-	DIR *dir = NULL;
+	struct root_dir *dir = NULL;
 	struct dirent *dirent = NULL;
-	char file_path[SYSFS_PATH_MAX], *dir_name;
+	char *dir_name;
 	struct dlist *dirlist = NULL;
 
 	if (!path) {
 		errno = EINVAL;
 		return NULL;
 	}
-	dir = opendir(path);
+	dir = root_opendir(path);
 	if (!dir) {
 		dprintf("Error opening directory %s\n", path);
 		return NULL;
 	}
-	while ((dirent = readdir(dir)) != NULL) {
+	while ((dirent = root_readdir(dir)) != NULL) {
 		if (0 == strcmp(dirent->d_name, "."))
 			 continue;
 		if (0 == strcmp(dirent->d_name, ".."))
 			continue;
-		memset(file_path, 0, SYSFS_PATH_MAX);
-		safestrcpy(file_path, path);
-		safestrcat(file_path, "/");
-		safestrcat(file_path, dirent->d_name);
-		if (!sysfs_path_is_dir(file_path)) {
+		if (sysfs_filter_match(filter, dirent->d_name))
+			continue;
+		if (!dirent_is_dir(dir, dirent)) {
 			if (!dirlist) {
 				dirlist = dlist_new_with_delete
 					(SYSFS_NAME_LEN, sysfs_del_name);
@@ -524,12 +1328,14 @@ struct dlist *read_dir_subdirs(const char *path)
 					return NULL;
 				}
 			}
-			dir_name = (char *)calloc(1, SYSFS_NAME_LEN);
+			dir_name = (char *)arena_calloc(1, SYSFS_NAME_LEN);
 			safestrcpymax(dir_name, dirent->d_name, SYSFS_NAME_LEN);
-			dlist_unshift_sorted(dirlist, dir_name, sort_char);
+			dlist_push(dirlist, dir_name);
 		}
 	}
-	closedir(dir);
+	root_closedir(dir);
+	if (dirlist)
+		dlist_sort_custom(dirlist, sort_strings);
 	return dirlist;
 }
 
@@ -540,8 +1346,10 @@ struct dlist *read_dir_subdirs(const char *path)
  */
 struct dlist *get_attributes_list(struct dlist *alist, const char *path)
 {
-	DIR *dir = NULL;
+	struct root_dir *dir = NULL;
 	struct dirent *dirent = NULL;
+	struct sysfs_attribute *attr;
+	struct dlist *batch = NULL;
 	char file_path[SYSFS_PATH_MAX];
 
 	if (!path) {
@@ -549,84 +1357,99 @@ struct dlist *get_attributes_list(struct dlist *alist, const char *path)
 		return NULL;
 	}
 
-	dir = opendir(path);
+	dir = root_opendir(path);
 	if (!dir) {
 		dprintf("Error opening directory %s\n", path);
 		return NULL;
 	}
-	while ((dirent = readdir(dir)) != NULL) {
+	while ((dirent = root_readdir(dir)) != NULL) {
 		if (0 == strcmp(dirent->d_name, "."))
 			 continue;
 		if (0 == strcmp(dirent->d_name, ".."))
 			continue;
-		memset(file_path, 0, SYSFS_PATH_MAX);
-		safestrcpy(file_path, path);
-		safestrcat(file_path, "/");
-		safestrcat(file_path, dirent->d_name);
-		if (!sysfs_path_is_file(file_path)) {
-			if (!alist) {
-				alist = dlist_new_with_delete
+		if (!dirent_is_file(dir, dirent)) {
+			if (!batch) {
+				batch = dlist_new_with_delete
 					(sizeof(struct sysfs_attribute),
 							sysfs_del_attribute);
-				if (!alist) {
+				if (!batch) {
 					dprintf("Error creating list\n");
+					root_closedir(dir);
 					return NULL;
 				}
 			}
-			add_attribute_to_list(alist, file_path);
+			safestrcpy(file_path, path);
+			safestrcat(file_path, "/");
+			safestrcat(file_path, dirent->d_name);
+			attr = open_read_attribute(file_path);
+			if (attr)
+				dlist_push(batch, attr);
 		}
 	}
-	closedir(dir);
-	return alist;
+	root_closedir(dir);
+	return merge_name_list(alist, batch);
 }
 
 /**
  * get_dev_attributes_list: build a list of attributes for the given device
  * @dev: devices whose attributes list is required
+ * @idx: name index kept with dev's attrlist
+ * @filter: which attributes to add to the list, NULL for all
  * returns dlist of attributes on success and NULL on failure
  */
-struct dlist *get_dev_attributes_list(void *dev)
+struct dlist *get_dev_attributes_list(void *dev,
+		struct sysfs_attr_index **idx, const struct sysfs_filter *filter)
 {
-	DIR *dir = NULL;
+	struct root_dir *dir = NULL;
 	struct dirent *dirent = NULL;
-	struct sysfs_attribute *attr = NULL;
+	struct sysfs_attribute *attr;
+	struct dlist *batch = NULL;
 	char file_path[SYSFS_PATH_MAX], path[SYSFS_PATH_MAX];
 
-	if (!dev) {
+	if (!dev || !idx) {
 		errno = EINVAL;
 		return NULL;
 	}
 	memset(path, 0, SYSFS_PATH_MAX);
 	safestrcpy(path, ((struct sysfs_device *)dev)->path);
-	dir = opendir(path);
+	dir = root_opendir(path);
 	if (!dir) {
 		dprintf("Error opening directory %s\n", path);
 		return NULL;
 	}
-	while ((dirent = readdir(dir)) != NULL) {
+	while ((dirent = root_readdir(dir)) != NULL) {
 		if (0 == strcmp(dirent->d_name, "."))
 			 continue;
 		if (0 == strcmp(dirent->d_name, ".."))
 			continue;
-		memset(file_path, 0, SYSFS_PATH_MAX);
+		if (sysfs_filter_match(filter, dirent->d_name))
+			continue;
+		/* check if attr is already in the list */
+		if (find_attribute(((struct sysfs_device *)dev)->attrlist,
+					*idx, dirent->d_name))
+			continue;
+		if (dirent_is_file(dir, dirent))
+			continue;
 		safestrcpy(file_path, path);
 		safestrcat(file_path, "/");
 		safestrcat(file_path, dirent->d_name);
-		if (!sysfs_path_is_file(file_path)) {
-			if (((struct sysfs_device *)dev)->attrlist) {
-				/* check if attr is already in the list */
-				attr = (struct sysfs_attribute *)
-				dlist_find_custom
-				((((struct sysfs_device *)dev)->attrlist),
-			 	(void *)dirent->d_name, attr_name_equal);
-				if (attr)
-					continue;
-				else
-					add_attribute(dev, file_path);
-			} else
-				attr = add_attribute(dev, file_path);
+		attr = open_read_attribute(file_path);
+		if (!attr)
+			continue;
+		if (!batch) {
+			batch = dlist_new_with_delete
+				(sizeof(struct sysfs_attribute),
+						sysfs_del_attribute);
+			if (!batch) {
+				dprintf("Error creating list\n");
+				sysfs_close_attribute(attr);
+				break;
+			}
 		}
+		dlist_push(batch, attr);
 	}
-	closedir(dir);
+	root_closedir(dir);
+	if (batch && attach_attributes(dev, idx, batch))
+		dlist_destroy(batch);
 	return ((struct sysfs_device *)dev)->attrlist;
 }
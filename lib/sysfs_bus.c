@@ -57,6 +57,10 @@ static int name_equal(void *a, void *b)
 void sysfs_close_bus(struct sysfs_bus *bus)
 {
 	if (bus) {
+		if (bus->arena) {
+			arena_put(bus->arena, bus);
+			return;
+		}
 		if (bus->attrlist)
 			dlist_destroy(bus->attrlist);
 		if (bus->devices)
@@ -73,7 +77,12 @@ void sysfs_close_bus(struct sysfs_bus *bus)
  */
 static struct sysfs_bus *alloc_bus(void)
 {
-	return (struct sysfs_bus *)calloc(1, sizeof(struct sysfs_bus));
+	struct sysfs_bus *bus;
+
+	bus = (struct sysfs_bus *)arena_calloc(1, sizeof(struct sysfs_bus));
+	if (bus)
+		bus->arena = arena_current();
+	return bus;
 }
 
 /**
@@ -83,8 +92,25 @@ static struct sysfs_bus *alloc_bus(void)
  */
 struct dlist *sysfs_get_bus_devices(struct sysfs_bus *bus)
 {
+	return sysfs_get_bus_devices_matching(bus, NULL);
+}
+
+/**
+ * sysfs_get_bus_devices_matching: gets the devices on a bus whose names
+ *	a filter lets through
+ * @bus: bus to get devices for
+ * @filter: which devices to open, NULL for all
+ * Links under the bus's devices directory are checked by name as it is
+ * read, before anything is opened. The bus's own list is returned, and
+ * so also holds any devices opened before.
+ * returns dlist of devices with success and NULL with failure
+ */
+struct dlist *sysfs_get_bus_devices_matching(struct sysfs_bus *bus,
+		const struct sysfs_filter *filter)
+{
+	struct sysfs_arena *prev;
 	struct sysfs_device *dev;
-	struct dlist *linklist;
+	struct dlist *linklist, *batch = NULL;
 	char path[SYSFS_PATH_MAX], devpath[SYSFS_PATH_MAX];
 	char target[SYSFS_PATH_MAX];
 	char *curlink;
@@ -98,7 +124,8 @@ struct dlist *sysfs_get_bus_devices(struct sysfs_bus *bus)
 	safestrcat(path, "/");
 	safestrcat(path, SYSFS_DEVICES_NAME);
 
-	linklist = read_dir_links(path);
+	prev = arena_enter(bus->arena);
+	linklist = read_dir_links(path, filter);
 	if (linklist) {
 		dlist_for_each_data(linklist, curlink, char) {
 			if (bus->devices) {
@@ -121,14 +148,16 @@ struct dlist *sysfs_get_bus_devices(struct sysfs_bus *bus)
 								target);
 				continue;
 			}
-			if (!bus->devices)
-				bus->devices = dlist_new_with_delete
+			if (!batch)
+				batch = dlist_new_with_delete
 					(sizeof(struct sysfs_device),
 					 		sysfs_close_dev);
-			dlist_unshift_sorted(bus->devices, dev, sort_list);
+			dlist_push(batch, dev);
 		}
 		sysfs_close_list(linklist);
+		bus->devices = merge_name_list(bus->devices, batch);
 	}
+	arena_leave(prev);
 	return (bus->devices);
 }
 
@@ -139,8 +168,22 @@ struct dlist *sysfs_get_bus_devices(struct sysfs_bus *bus)
  */
 struct dlist *sysfs_get_bus_drivers(struct sysfs_bus *bus)
 {
+	return sysfs_get_bus_drivers_matching(bus, NULL);
+}
+
+/**
+ * sysfs_get_bus_drivers_matching: gets the drivers on a bus whose names
+ *	a filter lets through
+ * @bus: bus to get drivers for
+ * @filter: which drivers to open, NULL for all
+ * returns dlist of drivers with success and NULL with failure
+ */
+struct dlist *sysfs_get_bus_drivers_matching(struct sysfs_bus *bus,
+		const struct sysfs_filter *filter)
+{
+	struct sysfs_arena *prev;
 	struct sysfs_driver *drv;
-	struct dlist *dirlist;
+	struct dlist *dirlist, *batch = NULL;
 	char path[SYSFS_PATH_MAX], drvpath[SYSFS_PATH_MAX];
 	char *curdir;
 
@@ -153,7 +196,8 @@ struct dlist *sysfs_get_bus_drivers(struct sysfs_bus *bus)
 	safestrcat(path, "/");
 	safestrcat(path, SYSFS_DRIVERS_NAME);
 
-	dirlist = read_dir_subdirs(path);
+	prev = arena_enter(bus->arena);
+	dirlist = read_dir_subdirs(path, filter);
 	if (dirlist) {
 		dlist_for_each_data(dirlist, curdir, char) {
 			if (bus->drivers) {
@@ -172,23 +216,28 @@ struct dlist *sysfs_get_bus_drivers(struct sysfs_bus *bus)
 								drvpath);
 				continue;
 			}
-			if (!bus->drivers)
-				bus->drivers = dlist_new_with_delete
+			if (!batch)
+				batch = dlist_new_with_delete
 					(sizeof(struct sysfs_driver),
 					 		sysfs_close_drv);
-			dlist_unshift_sorted(bus->drivers, drv, sort_list);
+			dlist_push(batch, drv);
 		}
 		sysfs_close_list(dirlist);
+		bus->drivers = merge_name_list(bus->drivers, batch);
 	}
+	arena_leave(prev);
 	return (bus->drivers);
 }
 
 /**
  * sysfs_open_bus: opens specific bus and all its devices on system
+ *	With SYSFS_OPT_ARENA the bus, and everything later read through
+ *	it, comes from an arena that sysfs_close_bus() releases in one go.
  * returns sysfs_bus structure with success or NULL with error.
  */
 struct sysfs_bus *sysfs_open_bus(const char *name)
 {
+	struct sysfs_arena *arena;
 	struct sysfs_bus *bus;
 	char buspath[SYSFS_PATH_MAX];
 
@@ -211,9 +260,11 @@ struct sysfs_bus *sysfs_open_bus(const char *name)
 		dprintf("Invalid path to bus: %s\n", buspath);
 		return NULL;
 	}
+	arena = arena_begin();
 	bus = alloc_bus();
 	if (!bus) {
 		dprintf("calloc failed\n");
+		arena_end(arena, NULL);
 		return NULL;
 	}
 	safestrcpy(bus->name, name);
@@ -221,8 +272,10 @@ struct sysfs_bus *sysfs_open_bus(const char *name)
 	if (sysfs_remove_trailing_slash(bus->path)) {
 		dprintf("Incorrect path to bus %s\n", bus->path);
 		sysfs_close_bus(bus);
+		arena_end(arena, NULL);
 		return NULL;
 	}
+	arena_end(arena, bus);
 
 	return bus;
 }
@@ -236,6 +289,7 @@ struct sysfs_bus *sysfs_open_bus(const char *name)
 struct sysfs_device *sysfs_get_bus_device(struct sysfs_bus *bus,
 		const char *id)
 {
+	struct sysfs_arena *prev;
 	struct sysfs_device *dev = NULL;
 	char devpath[SYSFS_PATH_MAX], target[SYSFS_PATH_MAX];
 
@@ -259,18 +313,20 @@ struct sysfs_device *sysfs_get_bus_device(struct sysfs_bus *bus,
 		dprintf("No such device %s on bus %s?\n", id, bus->name);
 		return NULL;
 	}
+	prev = arena_enter(bus->arena);
 	if (!sysfs_get_link(devpath, target, SYSFS_PATH_MAX)) {
 		dev = sysfs_open_device_path(target);
-		if (!dev) {
-			dprintf("Error opening device at %s\n", target);
-			return NULL;
-		}
-		if (!bus->devices)
-			bus->devices = dlist_new_with_delete
+		if (dev) {
+			if (!bus->devices)
+				bus->devices = dlist_new_with_delete
 					(sizeof(struct sysfs_device),
 					 		sysfs_close_dev);
-		dlist_unshift_sorted(bus->devices, dev, sort_list);
+			dlist_unshift_sorted(bus->devices, dev,
+					sort_names_before);
+		} else
+			dprintf("Error opening device at %s\n", target);
 	}
+	arena_leave(prev);
 	return dev;
 }
 
@@ -283,6 +339,7 @@ struct sysfs_device *sysfs_get_bus_device(struct sysfs_bus *bus,
 struct sysfs_driver *sysfs_get_bus_driver(struct sysfs_bus *bus,
 		const char *drvname)
 {
+	struct sysfs_arena *prev;
 	struct sysfs_driver *drv;
 	char drvpath[SYSFS_PATH_MAX];
 
@@ -302,16 +359,17 @@ struct sysfs_driver *sysfs_get_bus_driver(struct sysfs_bus *bus,
 	safestrcat(drvpath, SYSFS_DRIVERS_NAME);
 	safestrcat(drvpath, "/");
 	safestrcat(drvpath, drvname);
+	prev = arena_enter(bus->arena);
 	drv = sysfs_open_driver_path(drvpath);
-	if (!drv) {
-		dprintf("Error opening driver at %s\n", drvpath);
-		return NULL;
-	}
-	if (!bus->drivers)
-		bus->drivers = dlist_new_with_delete
+	if (drv) {
+		if (!bus->drivers)
+			bus->drivers = dlist_new_with_delete
 				(sizeof(struct sysfs_driver),
 				 		sysfs_close_drv);
-	dlist_unshift_sorted(bus->drivers, drv, sort_list);
+		dlist_unshift_sorted(bus->drivers, drv, sort_names_before);
+	} else
+		dprintf("Error opening driver at %s\n", drvpath);
+	arena_leave(prev);
 	return drv;
 }
 
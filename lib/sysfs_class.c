@@ -30,12 +30,15 @@
 void sysfs_close_class_device(struct sysfs_class_device *dev)
 {
 	if (dev) {
+		if (dev->arena)
+			return;
 		if (dev->parent)
 			sysfs_close_class_device(dev->parent);
 		if (dev->sysdevice)
 			sysfs_close_device(dev->sysdevice);
 		if (dev->attrlist)
 			dlist_destroy(dev->attrlist);
+		sysfs_close_attr_index(dev->attrindex);
 		free(dev);
 	}
 }
@@ -52,6 +55,10 @@ static void sysfs_close_cls_dev(void *dev)
 void sysfs_close_class(struct sysfs_class *cls)
 {
 	if (cls) {
+		if (cls->arena) {
+			arena_put(cls->arena, cls);
+			return;
+		}
 		if (cls->devices)
 			dlist_destroy(cls->devices);
 		if (cls->attrlist)
@@ -91,7 +98,12 @@ static int cdev_name_equal(void *a, void *b)
 
 static struct sysfs_class *alloc_class(void)
 {
-	return (struct sysfs_class *) calloc(1, sizeof(struct sysfs_class));
+	struct sysfs_class *cls;
+
+	cls = (struct sysfs_class *)arena_calloc(1, sizeof(struct sysfs_class));
+	if (cls)
+		cls->arena = arena_current();
+	return cls;
 }
 
 /**
@@ -102,7 +114,9 @@ static struct sysfs_class_device *alloc_class_device(void)
 {
 	struct sysfs_class_device *dev;
 
-	dev = calloc(1, sizeof(struct sysfs_class_device));
+	dev = arena_calloc(1, sizeof(struct sysfs_class_device));
+	if (dev)
+		dev->arena = arena_current();
 	return dev;
 }
 
@@ -151,7 +165,7 @@ static void set_classdev_classname(struct sysfs_class_device *cdev)
 		strcpy(link, cdev->path);
 		strcat(link, "/subsystem");
 		sysfs_get_link(link, name, SYSFS_PATH_MAX);
-		if (lstat(name, &stats))
+		if (root_stat(name, &stats, 1))
 			safestrcpy(cdev->classname, SYSFS_UNKNOWN);
 		else {
 			c = strrchr(name, '/');
@@ -232,6 +246,7 @@ struct sysfs_class_device *sysfs_get_classdev_parent
 				(struct sysfs_class_device *clsdev)
 {
 	char abs_path[SYSFS_PATH_MAX], tmp_path[SYSFS_PATH_MAX];
+	struct sysfs_arena *prev;
 	char *c;
 
 	if (!clsdev) {
@@ -260,7 +275,9 @@ struct sysfs_class_device *sysfs_get_classdev_parent
 		return NULL;
 	}
 
+	prev = arena_enter(clsdev->arena);
 	clsdev->parent = sysfs_open_class_device_path(abs_path);
+	arena_leave(prev);
 
 	return clsdev->parent;
 }
@@ -351,11 +368,17 @@ struct sysfs_class_device *sysfs_open_class_device
 struct sysfs_attribute *sysfs_get_classdev_attr
 		(struct sysfs_class_device *clsdev, const char *name)
 {
+	struct sysfs_arena *prev;
+	struct sysfs_attribute *attr;
+
 	if (!clsdev || !name) {
 		errno = EINVAL;
 		return NULL;
 	}
-	return get_attribute(clsdev, (char *)name);
+	prev = arena_enter(clsdev->arena);
+	attr = get_attribute(clsdev, &clsdev->attrindex, (char *)name);
+	arena_leave(prev);
+	return attr;
 }
 
 /**
@@ -365,11 +388,31 @@ struct sysfs_attribute *sysfs_get_classdev_attr
  */
 struct dlist *sysfs_get_classdev_attributes(struct sysfs_class_device *clsdev)
 {
+	return sysfs_get_classdev_attributes_matching(clsdev, NULL);
+}
+
+/**
+ * sysfs_get_classdev_attributes_matching: gets list of classdev
+ *	attributes, opening only those a filter lets through
+ * @clsdev: class device whose attributes list is needed
+ * @filter: which attributes to open, NULL for all
+ * returns dlist of attributes on success or NULL on error
+ */
+struct dlist *sysfs_get_classdev_attributes_matching
+		(struct sysfs_class_device *clsdev,
+		 const struct sysfs_filter *filter)
+{
+	struct sysfs_arena *prev;
+	struct dlist *attrlist;
+
 	if (!clsdev) {
 		errno = EINVAL;
 		return NULL;
 	}
-	return get_dev_attributes_list(clsdev);
+	prev = arena_enter(clsdev->arena);
+	attrlist = get_dev_attributes_list(clsdev, &clsdev->attrindex, filter);
+	arena_leave(prev);
+	return attrlist;
 }
 
 /**
@@ -382,6 +425,7 @@ struct sysfs_device *sysfs_get_classdev_device
 		(struct sysfs_class_device *clsdev)
 {
 	char linkpath[SYSFS_PATH_MAX], devpath[SYSFS_PATH_MAX];
+	struct sysfs_arena *prev;
 
 	if (!clsdev) {
 		errno = EINVAL;
@@ -394,20 +438,23 @@ struct sysfs_device *sysfs_get_classdev_device
 	memset(linkpath, 0, SYSFS_PATH_MAX);
 	safestrcpy(linkpath, clsdev->path);
 	safestrcat(linkpath, "/device");
-	if (!sysfs_path_is_link(linkpath)) {
-		memset(devpath, 0, SYSFS_PATH_MAX);
-		if (!sysfs_get_link(linkpath, devpath, SYSFS_PATH_MAX))
-			clsdev->sysdevice = sysfs_open_device_path(devpath);
-	}
+	memset(devpath, 0, SYSFS_PATH_MAX);
+	prev = arena_enter(clsdev->arena);
+	if (!sysfs_get_link(linkpath, devpath, SYSFS_PATH_MAX))
+		clsdev->sysdevice = sysfs_open_device_path(devpath);
+	arena_leave(prev);
 	return clsdev->sysdevice;
 }
 
 /**
  * sysfs_open_class: opens specific class and all its devices on system
+ *	With SYSFS_OPT_ARENA the class, and everything later read through
+ *	it, comes from an arena that sysfs_close_class() releases in one go.
  * returns sysfs_class structure with success or NULL with error.
  */
 struct sysfs_class *sysfs_open_class(const char *name)
 {
+	struct sysfs_arena *arena;
 	struct sysfs_class *cls = NULL;
 	char *c, classpath[SYSFS_PATH_MAX];
 
@@ -439,9 +486,11 @@ done:
 		return NULL;
 	}
 
+	arena = arena_begin();
 	cls = alloc_class();
 	if (cls == NULL) {
 		dprintf("calloc failed\n");
+		arena_end(arena, NULL);
 		return NULL;
 	}
 	safestrcpy(cls->name, name);
@@ -449,8 +498,10 @@ done:
 	if ((sysfs_remove_trailing_slash(cls->path)) != 0) {
 		dprintf("Invalid path to class device %s\n", cls->path);
 		sysfs_close_class(cls);
+		arena_end(arena, NULL);
 		return NULL;
 	}
+	arena_end(arena, cls);
 
 	return cls;
 }
@@ -466,6 +517,7 @@ struct sysfs_class_device *sysfs_get_class_device(struct sysfs_class *cls,
 		const char *name)
 {
 	char path[SYSFS_PATH_MAX];
+	struct sysfs_arena *prev;
 	struct sysfs_class_device *cdev = NULL;
 
 	if (!cls || !name) {
@@ -483,17 +535,18 @@ struct sysfs_class_device *sysfs_get_class_device(struct sysfs_class *cls,
 	safestrcpy(path, cls->path);
 	safestrcat(path, "/");
 	safestrcat(path, name);
+	prev = arena_enter(cls->arena);
 	cdev = sysfs_open_class_device_path(path);
-	if (!cdev) {
-		dprintf("Error opening class device at %s\n", path);
-		return NULL;
-	}
-	if (!cls->devices)
-		cls->devices = dlist_new_with_delete
-			(sizeof(struct sysfs_class_device),
-				 sysfs_close_cls_dev);
+	if (cdev) {
+		if (!cls->devices)
+			cls->devices = dlist_new_with_delete
+				(sizeof(struct sysfs_class_device),
+					 sysfs_close_cls_dev);
 
-	dlist_unshift_sorted(cls->devices, cdev, sort_list);
+		dlist_unshift_sorted(cls->devices, cdev, sort_names_before);
+	} else
+		dprintf("Error opening class device at %s\n", path);
+	arena_leave(prev);
 	return cdev;
 }
 
@@ -504,6 +557,7 @@ static void add_cdevs_to_classlist(struct sysfs_class *cls, struct dlist *list)
 {
 	char path[SYSFS_PATH_MAX], *cdev_name;
 	struct sysfs_class_device *cdev = NULL;
+	struct dlist *batch = NULL;
 
 	if (cls == NULL || list == NULL)
 		return;
@@ -521,14 +575,14 @@ static void add_cdevs_to_classlist(struct sysfs_class *cls, struct dlist *list)
 		safestrcat(path, cdev_name);
 		cdev = sysfs_open_class_device_path(path);
 		if (cdev) {
-			if (!cls->devices)
-				cls->devices = dlist_new_with_delete
+			if (!batch)
+				batch = dlist_new_with_delete
 				(sizeof(struct sysfs_class_device),
 				 sysfs_close_cls_dev);
-			dlist_unshift_sorted(cls->devices, cdev,
-					sort_list);
+			dlist_push(batch, cdev);
 		}
 	}
+	cls->devices = merge_name_list(cls->devices, batch);
 }
 
 /**
@@ -538,31 +592,52 @@ static void add_cdevs_to_classlist(struct sysfs_class *cls, struct dlist *list)
  * Returns a dlist of sysfs_class_device * on success and NULL on failure
  */
 struct dlist *sysfs_get_class_devices(struct sysfs_class *cls)
+{
+	return sysfs_get_class_devices_matching(cls, NULL);
+}
+
+/**
+ * sysfs_get_class_devices_matching: get the class devices in the given
+ *	class that a filter lets through
+ * @cls: sysfs_class whose devices list is needed
+ * @filter: which class devices to open, NULL for all
+ *
+ * Names are checked as the class directory is read, so the work done
+ * goes with the number of matches rather than the size of the class.
+ * The list returned is the class's own, and so also holds any class
+ * devices opened before.
+ * Returns a dlist of sysfs_class_device * on success and NULL on failure
+ */
+struct dlist *sysfs_get_class_devices_matching(struct sysfs_class *cls,
+		const struct sysfs_filter *filter)
 {
 	char path[SYSFS_PATH_MAX];
+	struct sysfs_arena *prev;
 	struct dlist *dirlist, *linklist;
 
 	if (!cls) {
 		errno = EINVAL;
 		return NULL;
 	}
+	prev = arena_enter(cls->arena);
 
 	/*
 	 * Post linux-2.6.14, we have nested classes and links under
 	 * /sys/class/xxx/. are also valid class devices
 	 */
 	safestrcpy(path, cls->path);
-	dirlist = read_dir_subdirs(path);
+	dirlist = read_dir_subdirs(path, filter);
 	if (dirlist) {
 		add_cdevs_to_classlist(cls, dirlist);
 		sysfs_close_list(dirlist);
 	}
 
-	linklist = read_dir_links(path);
+	linklist = read_dir_links(path, filter);
 	if (linklist) {
 		add_cdevs_to_classlist(cls, linklist);
 		sysfs_close_list(linklist);
 	}
+	arena_leave(prev);
 
 	return cls->devices;
 }
@@ -0,0 +1,544 @@
+/*
+ * sysfs_compact.c
+ *
+ * Compact device tree snapshots for libsysfs
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#include "libsysfs.h"
+#include "sysfs.h"
+
+#include <limits.h>
+
+/* first size of the string table, grown at 3/4 full */
+#define COMPACT_STRINGS_MIN	256
+
+struct sysfs_compact_tree {
+	struct sysfs_arena *arena;	/* tree, devices, attrs and strings */
+	struct sysfs_compact_device *root;
+};
+
+/* state that is only needed while a tree is being read in */
+struct compact_build {
+	struct sysfs_compact_tree *tree;
+	const char **strings;		/* interned strings, open addressed */
+	unsigned int nstrings;
+	unsigned int size;
+	char *path;			/* path of the device being read */
+	size_t pathlen;
+	size_t pathsize;
+	char *rbuf;			/* attribute read buffer */
+	size_t rbufsize;
+};
+
+static int compact_attr_cmp(const void *a, const void *b)
+{
+	return strcmp(((const struct sysfs_compact_attr *)a)->name,
+			((const struct sysfs_compact_attr *)b)->name);
+}
+
+static int compact_name_cmp(const void *a, const void *b)
+{
+	return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/**
+ * arena_strdup: copy len bytes of str, NUL terminated, into the arena
+ */
+static char *arena_strdup(struct sysfs_arena *arena, const char *str,
+		size_t len)
+{
+	char *copy;
+
+	copy = (char *)arena_alloc(arena, len + 1);
+	if (copy)
+		memcpy(copy, str, len);
+	return copy;
+}
+
+/**
+ * intern: returns the tree's single copy of str, adding it if need be
+ * @build: tree being read in
+ * @str: string to look up
+ * returns the interned string with success and NULL with error.
+ */
+static const char *intern(struct compact_build *build, const char *str)
+{
+	const char **old = build->strings;
+	unsigned int hash, i, oldsize = build->size;
+	const char *copy;
+
+	if (!old || (build->nstrings + 1) * 4 > build->size * 3) {
+		build->size = old ? oldsize * 2 : COMPACT_STRINGS_MIN;
+		build->strings = (const char **)calloc(build->size,
+				sizeof(const char *));
+		if (!build->strings) {
+			dprintf("calloc failed\n");
+			build->strings = old;
+			build->size = oldsize;
+			return NULL;
+		}
+		for (i = 0; i < oldsize; i++) {
+			if (!old[i])
+				continue;
+			hash = name_hash(old[i]) & (build->size - 1);
+			while (build->strings[hash])
+				hash = (hash + 1) & (build->size - 1);
+			build->strings[hash] = old[i];
+		}
+		free(old);
+	}
+
+	hash = name_hash(str) & (build->size - 1);
+	while (build->strings[hash]) {
+		if (strcmp(build->strings[hash], str) == 0)
+			return build->strings[hash];
+		hash = (hash + 1) & (build->size - 1);
+	}
+	copy = arena_strdup(build->tree->arena, str, strlen(str));
+	if (!copy)
+		return NULL;
+	build->strings[hash] = copy;
+	build->nstrings++;
+	return copy;
+}
+
+/**
+ * path_push: append "/name" to the build path
+ * returns the previous path length with success and -1 with error.
+ */
+static ssize_t path_push(struct compact_build *build, const char *name)
+{
+	size_t len = strlen(name), oldlen = build->pathlen;
+	char *path;
+
+	if (oldlen + len + 2 > build->pathsize) {
+		path = (char *)realloc(build->path, oldlen + len + 2 + PATH_MAX);
+		if (!path) {
+			dprintf("realloc failed\n");
+			return -1;
+		}
+		build->path = path;
+		build->pathsize = oldlen + len + 2 + PATH_MAX;
+	}
+	build->path[oldlen] = '/';
+	memcpy(build->path + oldlen + 1, name, len + 1);
+	build->pathlen = oldlen + len + 1;
+	return oldlen;
+}
+
+static void path_pop(struct compact_build *build, size_t len)
+{
+	build->pathlen = len;
+	build->path[len] = '\0';
+}
+
+/**
+ * link_name: name a device's link points at, like "driver" -> its driver
+ * @fd: device directory
+ * @link: name of the link
+ * @fallback: returned if there is no such link
+ */
+static const char *link_name(struct compact_build *build, int fd,
+		const char *link, const char *fallback)
+{
+	char target[PATH_MAX], *c;
+	ssize_t length;
+	const char *name;
+
+	length = readlinkat(fd, link, target, sizeof(target) - 1);
+	if (length <= 0)
+		return fallback;
+	target[length] = '\0';
+	while (length > 1 && target[length - 1] == '/')
+		target[--length] = '\0';
+	c = strrchr(target, '/');
+	name = intern(build, c ? c + 1 : target);
+	return name ? name : fallback;
+}
+
+/**
+ * read_compact_value: read an attribute through fd into the tree's arena
+ * returns 0 with success and -1 with error.
+ */
+static int read_compact_value(struct sysfs_compact_tree *tree,
+		struct sysfs_compact_attr *attr, int fd, char *buf,
+		size_t bufsize)
+{
+	unsigned long long start;
+	ssize_t length;
+
+	start = stats_begin();
+	length = read(fd, buf, bufsize);
+	stats_end(SYSFS_STAT_READ, start);
+	if (length < 0)
+		return -1;
+	stats_count(SYSFS_STAT_BYTES_READ, length);
+	if (attr->value && attr->len == length &&
+			!(memcmp(attr->value, buf, length)))
+		return 0;
+	attr->value = arena_strdup(tree->arena, buf, length);
+	if (!attr->value) {
+		attr->len = 0;
+		return -1;
+	}
+	attr->len = length;
+	return 0;
+}
+
+static struct sysfs_compact_device *read_compact_device(
+		struct compact_build *build, struct sysfs_compact_device *parent,
+		int fd, const char *name);
+
+/**
+ * read_compact_children: read in the subdirectories of dev as its
+ *	children, in name order
+ * @names: subdirectory names, sorted here
+ */
+static void read_compact_children(struct compact_build *build,
+		struct sysfs_compact_device *dev, int fd, const char **names,
+		unsigned int count)
+{
+	struct sysfs_compact_device *child, **tail = &dev->children;
+	unsigned long long start;
+	unsigned int i;
+	ssize_t len;
+	int childfd;
+
+	qsort(names, count, sizeof(const char *), compact_name_cmp);
+	for (i = 0; i < count; i++) {
+		len = path_push(build, names[i]);
+		if (len < 0)
+			return;
+		start = stats_begin();
+		childfd = openat(fd, names[i],
+				O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		stats_end(SYSFS_STAT_OPEN, start);
+		if (childfd < 0) {
+			dprintf("Error opening device at %s\n", build->path);
+			path_pop(build, len);
+			continue;
+		}
+		child = read_compact_device(build, dev, childfd, names[i]);
+		path_pop(build, len);
+		if (child) {
+			*tail = child;
+			tail = &child->next;
+		}
+	}
+}
+
+/**
+ * read_compact_device: read the device at the build path and its children
+ * @parent: device the new one is a child of, NULL for the root
+ * @fd: directory of the device, closed here
+ * @name: device name
+ * returns the device with success and NULL with error.
+ */
+static struct sysfs_compact_device *read_compact_device(
+		struct compact_build *build, struct sysfs_compact_device *parent,
+		int fd, const char *name)
+{
+	struct sysfs_compact_tree *tree = build->tree;
+	struct sysfs_compact_device *dev;
+	struct sysfs_compact_attr *attrs = NULL, *tmp;
+	const char **names = NULL, **ntmp;
+	unsigned int nattrs = 0, asize = 0, nnames = 0, nsize = 0;
+	struct dirent *dirent;
+	struct stat astats;
+	struct root_dir *dir;
+	unsigned long long start;
+	int afd, ret;
+
+	dev = (struct sysfs_compact_device *)arena_alloc(tree->arena,
+			sizeof(struct sysfs_compact_device));
+	if (!dev) {
+		close(fd);
+		return NULL;
+	}
+	dev->tree = tree;
+	dev->parent = parent;
+	dev->name = intern(build, name);
+	dev->path = arena_strdup(tree->arena, build->path, build->pathlen);
+	if (!dev->name || !dev->path) {
+		close(fd);
+		return NULL;
+	}
+	/* same defaults as sysfs_open_device_path() */
+	dev->bus = link_name(build, fd, SYSFS_BUS_NAME, "");
+	dev->driver_name = link_name(build, fd, "driver", SYSFS_UNKNOWN);
+	dev->subsystem = link_name(build, fd, "subsystem", SYSFS_UNKNOWN);
+
+	dir = root_fdopendir(fd);
+	if (!dir) {
+		dprintf("Error opening directory %s\n", dev->path);
+		close(fd);
+		return dev;
+	}
+	while ((dirent = root_readdir(dir)) != NULL) {
+		if (0 == strcmp(dirent->d_name, "."))
+			continue;
+		if (0 == strcmp(dirent->d_name, ".."))
+			continue;
+		if (!dirent_is_dir(dir, dirent)) {
+			if (nnames == nsize) {
+				nsize = nsize ? nsize * 2 : 16;
+				ntmp = (const char **)realloc(names,
+						nsize * sizeof(const char *));
+				if (!ntmp) {
+					dprintf("realloc failed\n");
+					break;
+				}
+				names = ntmp;
+			}
+			names[nnames] = intern(build, dirent->d_name);
+			if (names[nnames])
+				nnames++;
+			continue;
+		}
+		if (dirent_is_file(dir, dirent))
+			continue;
+		if (nattrs == asize) {
+			asize = asize ? asize * 2 : 32;
+			tmp = (struct sysfs_compact_attr *)realloc(attrs,
+				asize * sizeof(struct sysfs_compact_attr));
+			if (!tmp) {
+				dprintf("realloc failed\n");
+				break;
+			}
+			attrs = tmp;
+		}
+		tmp = &attrs[nattrs];
+		memset(tmp, 0, sizeof(struct sysfs_compact_attr));
+		tmp->name = intern(build, dirent->d_name);
+		if (!tmp->name)
+			continue;
+		start = stats_begin();
+		ret = fstatat(fd, dirent->d_name, &astats, AT_SYMLINK_NOFOLLOW);
+		stats_end(SYSFS_STAT_STAT, start);
+		if (ret)
+			continue;
+		if (astats.st_mode & S_IRUSR)
+			tmp->method |= SYSFS_METHOD_SHOW;
+		if (astats.st_mode & S_IWUSR)
+			tmp->method |= SYSFS_METHOD_STORE;
+		if (!(tmp->method & SYSFS_METHOD_SHOW) ||
+				(sysfs_get_options() & SYSFS_OPT_LAZY_ATTRS)) {
+			nattrs++;
+			continue;
+		}
+		/* as with the legacy lists, unreadable attributes are left out */
+		start = stats_begin();
+		afd = openat(fd, dirent->d_name, O_RDONLY | O_CLOEXEC);
+		stats_end(SYSFS_STAT_OPEN, start);
+		if (afd < 0)
+			continue;
+		if (read_compact_value(tree, tmp, afd, build->rbuf,
+					build->rbufsize))
+			dprintf("Error reading attribute %s/%s\n", dev->path,
+					tmp->name);
+		else
+			nattrs++;
+		close(afd);
+	}
+
+	if (nattrs) {
+		qsort(attrs, nattrs, sizeof(struct sysfs_compact_attr),
+				compact_attr_cmp);
+		dev->attrs = (struct sysfs_compact_attr *)arena_alloc
+			(tree->arena, nattrs * sizeof(struct sysfs_compact_attr));
+		if (dev->attrs) {
+			memcpy(dev->attrs, attrs,
+				nattrs * sizeof(struct sysfs_compact_attr));
+			dev->nattrs = nattrs;
+		}
+	}
+	free(attrs);
+	if (nnames)
+		read_compact_children(build, dev, fd, names, nnames);
+	free(names);
+	root_closedir(dir);
+	return dev;
+}
+
+/**
+ * sysfs_open_compact_tree: read the device tree at path, like
+ *	sysfs_open_device_tree() does with all the attributes listed, into
+ *	a compact read-only snapshot
+ * @path: sysfs path to the root device
+ * returns the tree with success and NULL with error.
+ */
+struct sysfs_compact_tree *sysfs_open_compact_tree(const char *path)
+{
+	struct sysfs_arena *arena;
+	struct compact_build build;
+	const char *name;
+	int fd;
+
+	if (!path) {
+		errno = EINVAL;
+		return NULL;
+	}
+	arena = arena_new();
+	if (!arena)
+		return NULL;
+	memset(&build, 0, sizeof(struct compact_build));
+	build.tree = (struct sysfs_compact_tree *)arena_alloc(arena,
+			sizeof(struct sysfs_compact_tree));
+	if (!build.tree)
+		goto fail;
+	build.tree->arena = arena;
+	build.pathlen = strlen(path);
+	build.pathsize = build.pathlen + PATH_MAX;
+	build.path = (char *)malloc(build.pathsize);
+	build.rbufsize = getpagesize();
+	build.rbuf = (char *)malloc(build.rbufsize);
+	if (!build.path || !build.rbuf) {
+		dprintf("malloc failed\n");
+		goto fail;
+	}
+	memcpy(build.path, path, build.pathlen + 1);
+	while (build.pathlen > 1 && build.path[build.pathlen - 1] == '/')
+		build.path[--build.pathlen] = '\0';
+	name = strrchr(build.path, '/');
+	name = name ? name + 1 : build.path;
+
+	fd = root_open(build.path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd < 0) {
+		dprintf("Error opening root device at %s\n", path);
+		goto fail;
+	}
+	build.tree->root = read_compact_device(&build, NULL, fd, name);
+	if (!build.tree->root)
+		goto fail;
+	free(build.strings);
+	free(build.path);
+	free(build.rbuf);
+	return build.tree;
+
+fail:
+	free(build.strings);
+	free(build.path);
+	free(build.rbuf);
+	arena_release(arena);
+	return NULL;
+}
+
+/**
+ * sysfs_close_compact_tree: free a tree and everything in it
+ */
+void sysfs_close_compact_tree(struct sysfs_compact_tree *tree)
+{
+	if (tree)
+		arena_release(tree->arena);
+}
+
+/**
+ * sysfs_get_compact_root: returns the device at the root of tree
+ */
+struct sysfs_compact_device *sysfs_get_compact_root
+		(struct sysfs_compact_tree *tree)
+{
+	if (!tree) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return tree->root;
+}
+
+/**
+ * sysfs_get_compact_value: returns attr's value, reading it first if it
+ *	hasn't been read yet (see SYSFS_OPT_LAZY_ATTRS)
+ * @dev: device attr belongs to
+ * @attr: attribute whose value is needed
+ * returns value with success and NULL with error.
+ */
+char *sysfs_get_compact_value(struct sysfs_compact_device *dev,
+		struct sysfs_compact_attr *attr)
+{
+	size_t pathlen, namelen;
+	char *path, *buf;
+	int fd, ret;
+
+	if (!dev || !attr) {
+		errno = EINVAL;
+		return NULL;
+	}
+	if (attr->value)
+		return attr->value;
+	if (!(attr->method & SYSFS_METHOD_SHOW)) {
+		dprintf("Show method not supported for attribute %s\n",
+				attr->name);
+		errno = EACCES;
+		return NULL;
+	}
+	pathlen = strlen(dev->path);
+	namelen = strlen(attr->name);
+	path = (char *)malloc(pathlen + namelen + 2 + getpagesize());
+	if (!path) {
+		dprintf("malloc failed\n");
+		return NULL;
+	}
+	memcpy(path, dev->path, pathlen);
+	path[pathlen] = '/';
+	memcpy(path + pathlen + 1, attr->name, namelen + 1);
+	buf = path + pathlen + namelen + 2;
+
+	fd = root_open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		dprintf("Error reading attribute %s\n", path);
+		free(path);
+		return NULL;
+	}
+	ret = read_compact_value(dev->tree, attr, fd, buf, getpagesize());
+	close(fd);
+	if (ret)
+		dprintf("Error reading from attribute %s\n", path);
+	free(path);
+	return ret ? NULL : attr->value;
+}
+
+/**
+ * sysfs_get_compact_attr: searches dev's attributes by name
+ * @dev: device to look through
+ * @name: attribute name to get
+ * returns the attribute, its value read if it can be, with success and
+ *	NULL with error.
+ */
+struct sysfs_compact_attr *sysfs_get_compact_attr
+		(struct sysfs_compact_device *dev, const char *name)
+{
+	struct sysfs_compact_attr key, *attr;
+
+	if (!dev || !name) {
+		errno = EINVAL;
+		return NULL;
+	}
+	key.name = name;
+	attr = (struct sysfs_compact_attr *)bsearch(&key, dev->attrs,
+			dev->nattrs, sizeof(struct sysfs_compact_attr),
+			compact_attr_cmp);
+	if (!attr) {
+		errno = ENOENT;
+		return NULL;
+	}
+	if ((attr->method & SYSFS_METHOD_SHOW) &&
+			!sysfs_get_compact_value(dev, attr))
+		return NULL;
+	return attr;
+}
@@ -39,12 +39,10 @@ static int get_dev_driver(struct sysfs_device *dev)
 	memset(devpath, 0, SYSFS_PATH_MAX);
 	safestrcpymax(path, dev->path, SYSFS_PATH_MAX);
 	safestrcatmax(path, "/driver", SYSFS_PATH_MAX);
-	if (!sysfs_path_is_link(path)) {
-		if (!sysfs_get_link(path, devpath, SYSFS_PATH_MAX)) {
-			if (!sysfs_get_name_from_path(devpath,
-					dev->driver_name, SYSFS_NAME_LEN))
-				return 0;
-		}
+	if (!sysfs_get_link(path, devpath, SYSFS_PATH_MAX)) {
+		if (!sysfs_get_name_from_path(devpath,
+				dev->driver_name, SYSFS_NAME_LEN))
+			return 0;
 	}
 	return -1;
 }
@@ -68,12 +66,10 @@ int sysfs_get_device_bus(struct sysfs_device *dev)
 	memset(devpath, 0, SYSFS_PATH_MAX);
 	safestrcpymax(path, dev->path, SYSFS_PATH_MAX);
 	safestrcatmax(path, "/bus", SYSFS_PATH_MAX);
-	if (!sysfs_path_is_link(path)) {
-		if (!sysfs_get_link(path, devpath, SYSFS_PATH_MAX)) {
-			if (!sysfs_get_name_from_path(devpath,
-					dev->bus, SYSFS_NAME_LEN))
-				return 0;
-		}
+	if (!sysfs_get_link(path, devpath, SYSFS_PATH_MAX)) {
+		if (!sysfs_get_name_from_path(devpath,
+				dev->bus, SYSFS_NAME_LEN))
+			return 0;
 	}
 	return -1;
 }
@@ -94,12 +90,10 @@ static int get_dev_subsystem(struct sysfs_device *dev)
 	memset(devpath, 0, SYSFS_PATH_MAX);
 	safestrcpymax(path, dev->path, SYSFS_PATH_MAX);
 	safestrcatmax(path, "/subsystem", SYSFS_PATH_MAX);
-	if (!sysfs_path_is_link(path)) {
-		if (!sysfs_get_link(path, devpath, SYSFS_PATH_MAX)) {
-			if (!sysfs_get_name_from_path(devpath,
-					dev->subsystem, SYSFS_NAME_LEN))
-				return 0;
-		}
+	if (!sysfs_get_link(path, devpath, SYSFS_PATH_MAX)) {
+		if (!sysfs_get_name_from_path(devpath,
+				dev->subsystem, SYSFS_NAME_LEN))
+			return 0;
 	}
 	return -1;
 }
@@ -119,13 +113,13 @@ void sysfs_close_dev_tree(void *dev)
 void sysfs_close_device_tree(struct sysfs_device *devroot)
 {
 	if (devroot) {
-		if (devroot->children) {
-			struct sysfs_device *child = NULL;
-
-			dlist_for_each_data(devroot->children, child,
-					struct sysfs_device)
-				sysfs_close_device_tree(child);
+		if (devroot->arena) {
+			arena_put(devroot->arena, devroot);
+			return;
 		}
+		/* the list closes each child's subtree as it goes */
+		if (devroot->children)
+			dlist_destroy(devroot->children);
 		devroot->children = NULL;
 		sysfs_close_device(devroot);
 	}
@@ -138,12 +132,17 @@ void sysfs_close_device_tree(struct sysfs_device *devroot)
 void sysfs_close_device(struct sysfs_device *dev)
 {
 	if (dev) {
+		if (dev->arena) {
+			arena_put(dev->arena, dev);
+			return;
+		}
 		if (dev->parent)
 			sysfs_close_device(dev->parent);
 		if (dev->children && dev->children->count)
 			dlist_destroy(dev->children);
 		if (dev->attrlist)
 			dlist_destroy(dev->attrlist);
+		sysfs_close_attr_index(dev->attrindex);
 		free(dev);
 	}
 }
@@ -154,7 +153,13 @@ void sysfs_close_device(struct sysfs_device *dev)
  */
 static struct sysfs_device *alloc_device(void)
 {
-	return (struct sysfs_device *) calloc(1, sizeof(struct sysfs_device));
+	struct sysfs_device *dev;
+
+	dev = (struct sysfs_device *)
+			arena_calloc(1, sizeof(struct sysfs_device));
+	if (dev)
+		dev->arena = arena_current();
+	return dev;
 }
 
 /**
@@ -213,48 +218,92 @@ struct sysfs_device *sysfs_open_device_path(const char *path)
 	return dev;
 }
 
+/**
+ * read_device_children: opens every subdirectory of dev as a child device
+ *	on dev->children, in name order, without going any further down
+ * @dev: device whose children to open
+ * returns 0 with success and -1 with error.
+ */
+int read_device_children(struct sysfs_device *dev)
+{
+	struct sysfs_device *child;
+	struct dlist *dirlist;
+	char path[SYSFS_PATH_MAX];
+	char *name;
+
+	dirlist = read_dir_subdirs(dev->path, NULL);
+	if (!dirlist)
+		return 0;
+	/* dirlist is sorted, so the children arrive in order */
+	dlist_for_each_data(dirlist, name, char) {
+		safestrcpy(path, dev->path);
+		safestrcat(path, "/");
+		safestrcat(path, name);
+		child = sysfs_open_device_path(path);
+		if (!child) {
+			dprintf("Error opening device at %s\n", path);
+			sysfs_close_list(dirlist);
+			return -1;
+		}
+		if (!dev->children)
+			dev->children = dlist_new_with_delete
+				(sizeof(struct sysfs_device),
+				 sysfs_close_dev_tree);
+		dlist_push(dev->children, child);
+	}
+	sysfs_close_list(dirlist);
+	return 0;
+}
+
+/**
+ * read_device_tree: opens all the devices below dev, each just once
+ * returns 0 with success and -1 with error.
+ */
+static int read_device_tree(struct sysfs_device *dev)
+{
+	struct sysfs_device *child;
+
+	if (read_device_children(dev))
+		return -1;
+	if (dev->children)
+		dlist_for_each_data(dev->children, child, struct sysfs_device)
+			if (read_device_tree(child))
+				return -1;
+	return 0;
+}
+
 /**
  * sysfs_open_device_tree: opens root device and all of its children,
- *	creating a tree of devices. Only opens children.
+ *	creating a tree of devices. Only opens children. The tree is read
+ *	by sysfs_set_threads() threads.
+ *	With SYSFS_OPT_ARENA the whole tree, and everything later read
+ *	through it, comes from an arena that sysfs_close_device_tree()
+ *	releases in one go.
  * @path: sysfs path to devices
  * returns struct sysfs_device and its children with success or NULL with
  *	error.
  */
 struct sysfs_device *sysfs_open_device_tree(const char *path)
 {
-	struct sysfs_device *rootdev = NULL, *new = NULL;
-	struct sysfs_device *cur = NULL;
-	struct sysfs_device *devlist;
+	struct sysfs_arena *arena;
+	struct sysfs_device *rootdev;
 
 	if (path == NULL) {
 		errno = EINVAL;
 		return NULL;
 	}
+	arena = arena_begin();
 	rootdev = sysfs_open_device_path(path);
-	if (rootdev == NULL) {
+	if (rootdev == NULL)
 		dprintf("Error opening root device at %s\n", path);
-		return NULL;
-	}
-
-	devlist = sysfs_read_dir_subdirs(path);
-        if (devlist->children) {
-		dlist_for_each_data(devlist->children, cur,
-				struct sysfs_device) {
-			new = sysfs_open_device_tree(cur->path);
-			if (new == NULL) {
-				dprintf("Error opening device tree at %s\n",
-						cur->path);
-				sysfs_close_device_tree(rootdev);
-				return NULL;
-			}
-			if (rootdev->children == NULL)
-				rootdev->children = dlist_new_with_delete
-					(sizeof(struct sysfs_device),
-					sysfs_close_dev_tree);
-			dlist_unshift_sorted(rootdev->children, new, sort_list);
-		}
-	}
-
+	else if (sysfs_get_threads() > 1 ?
+			parallel_device_tree(rootdev, sysfs_get_threads()) :
+			read_device_tree(rootdev)) {
+		dprintf("Error opening device tree at %s\n", path);
+		sysfs_close_device_tree(rootdev);
+		rootdev = NULL;
+	}
+	arena_end(arena, rootdev);
 	return rootdev;
 }
 
@@ -267,11 +316,17 @@ struct sysfs_device *sysfs_open_device_tree(const char *path)
 struct sysfs_attribute *sysfs_get_device_attr(struct sysfs_device *dev,
 						const char *name)
 {
+	struct sysfs_arena *prev;
+	struct sysfs_attribute *attr;
+
 	if (!dev || !name) {
 		errno = EINVAL;
 		return NULL;
 	}
-	return get_attribute(dev, (char *)name);
+	prev = arena_enter(dev->arena);
+	attr = get_attribute(dev, &dev->attrindex, (char *)name);
+	arena_leave(prev);
+	return attr;
 }
 
 /**
@@ -281,11 +336,31 @@ struct sysfs_attribute *sysfs_get_device_attr(struct sysfs_device *dev,
  */
 struct dlist *sysfs_get_device_attributes(struct sysfs_device *dev)
 {
+	return sysfs_get_device_attributes_matching(dev, NULL);
+}
+
+/**
+ * sysfs_get_device_attributes_matching: gets list of device attributes,
+ *	opening only those a filter lets through
+ * @dev: device whose attributes list is needed
+ * @filter: which attributes to open, NULL for all
+ * The list is the device's own, so attributes got earlier stay in it.
+ * returns dlist of attributes on success or NULL on error
+ */
+struct dlist *sysfs_get_device_attributes_matching(struct sysfs_device *dev,
+		const struct sysfs_filter *filter)
+{
+	struct sysfs_arena *prev;
+	struct dlist *attrlist;
+
 	if (!dev) {
 		errno = EINVAL;
 		return NULL;
 	}
-	return get_dev_attributes_list(dev);
+	prev = arena_enter(dev->arena);
+	attrlist = get_dev_attributes_list(dev, &dev->attrindex, filter);
+	arena_leave(prev);
+	return attrlist;
 }
 
 /**
@@ -374,6 +449,7 @@ struct sysfs_device *sysfs_open_device(const char *bus,	const char *bus_id)
 struct sysfs_device *sysfs_get_device_parent(struct sysfs_device *dev)
 {
 	char ppath[SYSFS_PATH_MAX], dpath[SYSFS_PATH_MAX], *tmp;
+	struct sysfs_arena *prev;
 
 	if (!dev) {
 		errno = EINVAL;
@@ -414,7 +490,9 @@ struct sysfs_device *sysfs_get_device_parent(struct sysfs_device *dev)
 		return NULL;
 	}
 
+	prev = arena_enter(dev->arena);
 	dev->parent = sysfs_open_device_path(ppath);
+	arena_leave(prev);
 	if (!dev->parent) {
 		dprintf("Error opening device %s's parent at %s\n",
 					dev->bus_id, ppath);
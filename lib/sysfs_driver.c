@@ -35,10 +35,13 @@ static void sysfs_close_driver_device(void *device)
 void sysfs_close_driver(struct sysfs_driver *driver)
 {
 	if (driver) {
+		if (driver->arena)
+			return;
 		if (driver->devices)
 			dlist_destroy(driver->devices);
 		if (driver->attrlist)
 			dlist_destroy(driver->attrlist);
+		sysfs_close_attr_index(driver->attrindex);
 		if (driver->module)
 			sysfs_close_module(driver->module);
 		free(driver);
@@ -51,7 +54,13 @@ void sysfs_close_driver(struct sysfs_driver *driver)
  */
 static struct sysfs_driver *alloc_driver(void)
 {
-	return (struct sysfs_driver *)calloc(1, sizeof(struct sysfs_driver));
+	struct sysfs_driver *driver;
+
+	driver = (struct sysfs_driver *)
+			arena_calloc(1, sizeof(struct sysfs_driver));
+	if (driver)
+		driver->arena = arena_current();
+	return driver;
 }
 
 /**
@@ -92,11 +101,17 @@ static int get_driver_bus(struct sysfs_driver *drv)
 struct sysfs_attribute *sysfs_get_driver_attr(struct sysfs_driver *drv,
 						const char *name)
 {
+	struct sysfs_arena *prev;
+	struct sysfs_attribute *attr;
+
 	if (!drv || !name) {
 		errno = EINVAL;
 		return NULL;
 	}
-	return get_attribute(drv, (char *)name);
+	prev = arena_enter(drv->arena);
+	attr = get_attribute(drv, &drv->attrindex, (char *)name);
+	arena_leave(prev);
+	return attr;
 }
 
 /**
@@ -106,11 +121,30 @@ struct sysfs_attribute *sysfs_get_driver_attr(struct sysfs_driver *drv,
  */
 struct dlist *sysfs_get_driver_attributes(struct sysfs_driver *drv)
 {
+	return sysfs_get_driver_attributes_matching(drv, NULL);
+}
+
+/**
+ * sysfs_get_driver_attributes_matching: gets list of driver attributes
+ *	a filter lets through
+ * @drv: driver whose attributes list is needed
+ * @filter: which attributes to open, NULL for all
+ * returns dlist of attributes on success or NULL on error
+ */
+struct dlist *sysfs_get_driver_attributes_matching(struct sysfs_driver *drv,
+		const struct sysfs_filter *filter)
+{
+	struct sysfs_arena *prev;
+	struct dlist *attrlist;
+
 	if (!drv) {
 		errno = EINVAL;
 		return NULL;
 	}
-	return get_dev_attributes_list(drv);
+	prev = arena_enter(drv->arena);
+	attrlist = get_dev_attributes_list(drv, &drv->attrindex, filter);
+	arena_leave(prev);
+	return attrlist;
 }
 
 /**
@@ -137,7 +171,7 @@ struct sysfs_driver *sysfs_open_driver_path(const char *path)
 	}
 	if (sysfs_get_name_from_path(path, driver->name, SYSFS_NAME_LEN)) {
 		dprintf("Error getting driver name from path\n");
-		free(driver);
+		sysfs_close_driver(driver);
 		return NULL;
 	}
 	safestrcpy(driver->path, path);
@@ -217,22 +251,17 @@ struct sysfs_driver *sysfs_open_driver(const char *bus_name,
 }
 
 /**
- * sysfs_get_driver_devices: gets list of devices that use the driver
+ * get_driver_devices: reads in the devices that use the driver
  * @drv: sysfs_driver whose device list is needed
  * Returns dlist of struct sysfs_device on success and NULL on failure
  */
-struct dlist *sysfs_get_driver_devices(struct sysfs_driver *drv)
+static struct dlist *get_driver_devices(struct sysfs_driver *drv)
 {
 	char *ln = NULL;
-	struct dlist *linklist = NULL;
+	struct dlist *linklist = NULL, *batch = NULL;
 	struct sysfs_device *dev = NULL;
 
-	if (!drv) {
-		errno = EINVAL;
-		return NULL;
-	}
-
-	linklist = read_dir_links(drv->path);
+	linklist = read_dir_links(drv->path, NULL);
 	if (linklist) {
 		dlist_for_each_data(linklist, ln, char) {
 
@@ -243,25 +272,49 @@ struct dlist *sysfs_get_driver_devices(struct sysfs_driver *drv)
 			if (!dev) {
 				dprintf("Error opening driver's device\n");
 				sysfs_close_list(linklist);
+				if (batch)
+					dlist_destroy(batch);
 				return NULL;
 			}
-			if (!drv->devices) {
-				drv->devices = dlist_new_with_delete
+			if (!batch) {
+				batch = dlist_new_with_delete
 					(sizeof(struct sysfs_device),
 					 sysfs_close_driver_device);
-				if (!drv->devices) {
+				if (!batch) {
 					dprintf("Error creating device list\n");
+					sysfs_close_device(dev);
 					sysfs_close_list(linklist);
 					return NULL;
 				}
 			}
-			dlist_unshift_sorted(drv->devices, dev, sort_list);
+			dlist_push(batch, dev);
 		}
 		sysfs_close_list(linklist);
+		drv->devices = merge_name_list(drv->devices, batch);
 	}
 	return drv->devices;
 }
 
+/**
+ * sysfs_get_driver_devices: gets list of devices that use the driver
+ * @drv: sysfs_driver whose device list is needed
+ * Returns dlist of struct sysfs_device on success and NULL on failure
+ */
+struct dlist *sysfs_get_driver_devices(struct sysfs_driver *drv)
+{
+	struct sysfs_arena *prev;
+	struct dlist *devices;
+
+	if (!drv) {
+		errno = EINVAL;
+		return NULL;
+	}
+	prev = arena_enter(drv->arena);
+	devices = get_driver_devices(drv);
+	arena_leave(prev);
+	return devices;
+}
+
 /**
  * sysfs_get_driver_module: gets the module being used by this driver
  * @drv: sysfs_driver whose "module" is needed
@@ -270,6 +323,7 @@ struct dlist *sysfs_get_driver_devices(struct sysfs_driver *drv)
 struct sysfs_module *sysfs_get_driver_module(struct sysfs_driver *drv)
 {
 	char path[SYSFS_PATH_MAX], mod_path[SYSFS_PATH_MAX];
+	struct sysfs_arena *prev;
 
 	if (!drv) {
 		errno = EINVAL;
@@ -280,10 +334,10 @@ struct sysfs_module *sysfs_get_driver_module(struct sysfs_driver *drv)
 	safestrcpy(path, drv->path);
 	safestrcat(path, "/");
 	safestrcat(path, SYSFS_MODULE_NAME);
-	if (!sysfs_path_is_link(path)) {
-		memset(mod_path, 0, SYSFS_PATH_MAX);
-		if (!sysfs_get_link(path, mod_path, SYSFS_PATH_MAX))
-			drv->module = sysfs_open_module_path(mod_path);
-	}
+	memset(mod_path, 0, SYSFS_PATH_MAX);
+	prev = arena_enter(drv->arena);
+	if (!sysfs_get_link(path, mod_path, SYSFS_PATH_MAX))
+		drv->module = sysfs_open_module_path(mod_path);
+	arena_leave(prev);
 	return drv->module;
 }
@@ -0,0 +1,306 @@
+/*
+ * sysfs_foreach.c
+ *
+ * One pass visitors over buses, classes and drivers for libsysfs
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#include "libsysfs.h"
+#include "sysfs.h"
+
+/*
+ * The sysfs_*_foreach_*() calls read their directory once, opening each
+ * entry as readdir() comes to it and closing it again when the visitor is
+ * done with it. Nothing is added to the lists of the bus, class or driver
+ * gone through, and whatever is in them isn't used, so a scan holds one
+ * entry at a time however many there are. Entries are opened on the heap
+ * even with SYSFS_OPT_ARENA set, for them to be freed one at a time.
+ */
+#define ENTRY_DIR	0x01
+#define ENTRY_LINK	0x02
+
+struct visit {
+	char path[SYSFS_PATH_MAX];	/* directory being read */
+	const char *bus;		/* for a driver's devices */
+	int (*device)(struct sysfs_device *dev, void *data);
+	int (*driver)(struct sysfs_driver *drv, void *data);
+	int (*classdev)(struct sysfs_class_device *cdev, void *data);
+	int (*name)(const char *name, void *data);
+	void *data;
+};
+
+/**
+ * visit_entries: calls fn for every entry of v->path of the types wanted
+ * returns 0 when done or stopped and -1 with error.
+ */
+static int visit_entries(struct visit *v, int types,
+		int (*fn)(struct visit *v, const char *name))
+{
+	struct dirent *dirent;
+	struct root_dir *dir;
+	int ret = 0;
+
+	dir = root_opendir(v->path);
+	if (!dir) {
+		dprintf("Error opening directory %s\n", v->path);
+		return -1;
+	}
+	while (!ret && (dirent = root_readdir(dir)) != NULL) {
+		if (!strcmp(dirent->d_name, ".") ||
+		    !strcmp(dirent->d_name, ".."))
+			continue;
+		if (!(((types & ENTRY_DIR) && !dirent_is_dir(dir, dirent)) ||
+		    ((types & ENTRY_LINK) && !dirent_is_link(dir, dirent))))
+			continue;
+		ret = fn(v, dirent->d_name);
+	}
+	root_closedir(dir);
+	return ret < 0 ? -1 : 0;
+}
+
+/**
+ * visited: what to do after a visitor returned ret for an entry
+ * returns 0 to go on, 1 to stop and -1 with error.
+ */
+static int visited(int ret)
+{
+	if (ret < 0)
+		return -1;
+	return (ret & SYSFS_VISIT_STOP) ? 1 : 0;
+}
+
+static int visit_device_path(struct visit *v, const char *path)
+{
+	struct sysfs_arena *prev;
+	struct sysfs_device *dev;
+	int ret;
+
+	prev = arena_enter(NULL);
+	dev = sysfs_open_device_path(path);
+	arena_leave(prev);
+	if (!dev) {
+		dprintf("Error opening device at %s\n", path);
+		return 0;
+	}
+	ret = v->device(dev, v->data);
+	if (ret < 0 || !(ret & SYSFS_VISIT_KEEP))
+		sysfs_close_device(dev);
+	return visited(ret);
+}
+
+static int visit_bus_device(struct visit *v, const char *name)
+{
+	char devpath[SYSFS_PATH_MAX], target[SYSFS_PATH_MAX];
+
+	safestrcpy(devpath, v->path);
+	safestrcat(devpath, "/");
+	safestrcat(devpath, name);
+	if (sysfs_get_link(devpath, target, SYSFS_PATH_MAX)) {
+		dprintf("Error getting link - %s\n", devpath);
+		return 0;
+	}
+	return visit_device_path(v, target);
+}
+
+static int visit_bus_driver(struct visit *v, const char *name)
+{
+	char drvpath[SYSFS_PATH_MAX];
+	struct sysfs_arena *prev;
+	struct sysfs_driver *drv;
+	int ret;
+
+	safestrcpy(drvpath, v->path);
+	safestrcat(drvpath, "/");
+	safestrcat(drvpath, name);
+	prev = arena_enter(NULL);
+	drv = sysfs_open_driver_path(drvpath);
+	arena_leave(prev);
+	if (!drv) {
+		dprintf("Error opening driver at %s\n", drvpath);
+		return 0;
+	}
+	ret = v->driver(drv, v->data);
+	if (ret < 0 || !(ret & SYSFS_VISIT_KEEP))
+		sysfs_close_driver(drv);
+	return visited(ret);
+}
+
+static int visit_driver_device(struct visit *v, const char *name)
+{
+	struct sysfs_arena *prev;
+	struct sysfs_device *dev;
+	int ret;
+
+	/* as get_driver_devices() skips it */
+	if (!strncmp(name, SYSFS_MODULE_NAME, strlen(name)))
+		return 0;
+	prev = arena_enter(NULL);
+	dev = sysfs_open_device(v->bus, name);
+	arena_leave(prev);
+	if (!dev) {
+		dprintf("Error opening driver's device %s\n", name);
+		return 0;
+	}
+	ret = v->device(dev, v->data);
+	if (ret < 0 || !(ret & SYSFS_VISIT_KEEP))
+		sysfs_close_device(dev);
+	return visited(ret);
+}
+
+static int visit_class_device(struct visit *v, const char *name)
+{
+	char path[SYSFS_PATH_MAX];
+	struct sysfs_class_device *cdev;
+	struct sysfs_arena *prev;
+	int ret;
+
+	safestrcpy(path, v->path);
+	safestrcat(path, "/");
+	safestrcat(path, name);
+	prev = arena_enter(NULL);
+	cdev = sysfs_open_class_device_path(path);
+	arena_leave(prev);
+	if (!cdev) {
+		dprintf("Error opening class device at %s\n", path);
+		return 0;
+	}
+	ret = v->classdev(cdev, v->data);
+	if (ret < 0 || !(ret & SYSFS_VISIT_KEEP))
+		sysfs_close_class_device(cdev);
+	return visited(ret);
+}
+
+static int visit_name(struct visit *v, const char *name)
+{
+	return visited(v->name(name, v->data));
+}
+
+/**
+ * sysfs_bus_foreach_device: opens each device on a bus in turn and
+ *	passes it to fn
+ * @bus: bus to go through
+ * @fn: visitor, returning 0 or SYSFS_VISIT_* flags, or -1 to stop with error
+ * @data: passed to fn
+ * returns 0 with success and -1 with error.
+ */
+int sysfs_bus_foreach_device(struct sysfs_bus *bus,
+		int (*fn)(struct sysfs_device *dev, void *data), void *data)
+{
+	struct visit v;
+
+	if (!bus || !fn) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(&v, 0, sizeof(struct visit));
+	safestrcpy(v.path, bus->path);
+	safestrcat(v.path, "/");
+	safestrcat(v.path, SYSFS_DEVICES_NAME);
+	v.device = fn;
+	v.data = data;
+	return visit_entries(&v, ENTRY_LINK, visit_bus_device);
+}
+
+/**
+ * sysfs_bus_foreach_driver: opens each driver on a bus in turn and
+ *	passes it to fn
+ * returns 0 with success and -1 with error.
+ */
+int sysfs_bus_foreach_driver(struct sysfs_bus *bus,
+		int (*fn)(struct sysfs_driver *drv, void *data), void *data)
+{
+	struct visit v;
+
+	if (!bus || !fn) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(&v, 0, sizeof(struct visit));
+	safestrcpy(v.path, bus->path);
+	safestrcat(v.path, "/");
+	safestrcat(v.path, SYSFS_DRIVERS_NAME);
+	v.driver = fn;
+	v.data = data;
+	return visit_entries(&v, ENTRY_DIR, visit_bus_driver);
+}
+
+/**
+ * sysfs_driver_foreach_device: opens each device bound to a driver in
+ *	turn and passes it to fn
+ * returns 0 with success and -1 with error.
+ */
+int sysfs_driver_foreach_device(struct sysfs_driver *drv,
+		int (*fn)(struct sysfs_device *dev, void *data), void *data)
+{
+	struct visit v;
+
+	if (!drv || !fn) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(&v, 0, sizeof(struct visit));
+	safestrcpy(v.path, drv->path);
+	v.bus = drv->bus;
+	v.device = fn;
+	v.data = data;
+	return visit_entries(&v, ENTRY_LINK, visit_driver_device);
+}
+
+/**
+ * sysfs_class_foreach_device: opens each device of a class in turn and
+ *	passes it to fn
+ * returns 0 with success and -1 with error.
+ */
+int sysfs_class_foreach_device(struct sysfs_class *cls,
+		int (*fn)(struct sysfs_class_device *cdev, void *data),
+		void *data)
+{
+	struct visit v;
+
+	if (!cls || !fn) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(&v, 0, sizeof(struct visit));
+	safestrcpy(v.path, cls->path);
+	v.classdev = fn;
+	v.data = data;
+	/* nested classes have directories, the rest links */
+	return visit_entries(&v, ENTRY_DIR | ENTRY_LINK, visit_class_device);
+}
+
+/**
+ * sysfs_foreach_directory: passes the name of each directory under path
+ *	to fn, as sysfs_open_directory_list() would list them
+ * returns 0 with success and -1 with error.
+ */
+int sysfs_foreach_directory(const char *path,
+		int (*fn)(const char *name, void *data), void *data)
+{
+	struct visit v;
+
+	if (!path || !fn) {
+		errno = EINVAL;
+		return -1;
+	}
+	memset(&v, 0, sizeof(struct visit));
+	safestrcpy(v.path, path);
+	v.name = fn;
+	v.data = data;
+	return visit_entries(&v, ENTRY_DIR, visit_name);
+}
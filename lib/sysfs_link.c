@@ -0,0 +1,278 @@
+/*
+ * sysfs_link.c
+ *
+ * Resolved symbolic link cache for libsysfs
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "libsysfs.h"
+#include "sysfs.h"
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/*
+ * With SYSFS_OPT_LINK_CACHE set, every path sysfs_get_link() is asked
+ * about is remembered along with what it resolved to, or the errno it
+ * failed with. sysfs_path_is_link() stays an lstat() either way: a link
+ * that doesn't resolve is still a link. Failures are worth keeping:
+ * resolving a relative link checks each directory above it isn't a link
+ * itself, and those directories are the same for every device below
+ * them, as are the missing "driver" links of unbound devices.
+ *
+ * Nothing ever goes stale by itself, so long running users that care
+ * about hotplug must call sysfs_flush_link_cache().
+ *
+ * Every context has a cache of its own, the default context this static
+ * one, each with a lock for the threads working in it.
+ */
+struct link_entry {
+	struct link_entry *next;
+	unsigned int hash;
+	int error;		/* 0 if path is a link resolving to target */
+	char *target;
+	char path[];
+};
+
+#define LINK_CACHE_MIN_BUCKETS	256
+
+struct link_cache {
+	struct link_entry **buckets;
+	size_t nbuckets;
+	size_t count;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t lock;
+#endif
+};
+
+#ifdef HAVE_PTHREAD_H
+static struct link_cache default_links = {
+	NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER
+};
+#define link_cache_lock(c)	pthread_mutex_lock(&(c)->lock)
+#define link_cache_unlock(c)	pthread_mutex_unlock(&(c)->lock)
+#else
+static struct link_cache default_links;
+#define link_cache_lock(c)	do { } while (0)
+#define link_cache_unlock(c)	do { } while (0)
+#endif
+
+/* the cache of the calling thread's context */
+static struct link_cache *link_cache(void)
+{
+	struct link_cache *cache = context_links();
+
+	return cache ? cache : &default_links;
+}
+
+/**
+ * link_cache_new: sets up an empty link cache for a context
+ * returns the cache with success and NULL with error.
+ */
+struct link_cache *link_cache_new(void)
+{
+	struct link_cache *cache;
+
+	cache = (struct link_cache *)calloc(1, sizeof(struct link_cache));
+	if (!cache)
+		return NULL;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_init(&cache->lock, NULL);
+#endif
+	return cache;
+}
+
+static void link_flush(struct link_cache *cache)
+{
+	struct link_entry *entry, *next;
+	size_t i;
+
+	for (i = 0; i < cache->nbuckets; i++) {
+		for (entry = cache->buckets[i]; entry; entry = next) {
+			next = entry->next;
+			free(entry);
+		}
+	}
+	free(cache->buckets);
+	cache->buckets = NULL;
+	cache->nbuckets = 0;
+	cache->count = 0;
+}
+
+/**
+ * link_cache_free: frees a cache from link_cache_new() and all in it
+ */
+void link_cache_free(struct link_cache *cache)
+{
+	if (!cache)
+		return;
+	link_flush(cache);
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_destroy(&cache->lock);
+#endif
+	free(cache);
+}
+
+static struct link_entry *link_find(struct link_cache *cache,
+		const char *path, unsigned int hash)
+{
+	struct link_entry *entry;
+
+	if (!cache->buckets)
+		return NULL;
+	for (entry = cache->buckets[hash & (cache->nbuckets - 1)]; entry;
+			entry = entry->next)
+		if (entry->hash == hash && !strcmp(entry->path, path))
+			return entry;
+	return NULL;
+}
+
+/* doubles the table once it averages two entries a bucket */
+static void link_grow(struct link_cache *cache)
+{
+	struct link_entry **buckets, *entry, *next;
+	size_t nbuckets, i;
+
+	if (cache->buckets && cache->count < cache->nbuckets * 2)
+		return;
+	nbuckets = cache->buckets ? cache->nbuckets * 2 :
+			LINK_CACHE_MIN_BUCKETS;
+	buckets = (struct link_entry **)calloc(nbuckets,
+			sizeof(struct link_entry *));
+	if (!buckets) {
+		/* just longer chains */
+		dprintf("calloc failed\n");
+		return;
+	}
+	for (i = 0; i < cache->nbuckets; i++) {
+		for (entry = cache->buckets[i]; entry; entry = next) {
+			next = entry->next;
+			entry->next = buckets[entry->hash & (nbuckets - 1)];
+			buckets[entry->hash & (nbuckets - 1)] = entry;
+		}
+	}
+	free(cache->buckets);
+	cache->buckets = buckets;
+	cache->nbuckets = nbuckets;
+}
+
+static void link_insert(struct link_cache *cache, const char *path,
+		unsigned int hash, const char *target, int error)
+{
+	struct link_entry *entry;
+	size_t plen = strlen(path) + 1;
+	size_t tlen = error ? 0 : strlen(target) + 1;
+
+	link_grow(cache);
+	if (!cache->buckets)
+		return;
+	/* another thread may have got there first */
+	if (link_find(cache, path, hash))
+		return;
+	entry = (struct link_entry *)malloc(sizeof(struct link_entry) +
+			plen + tlen);
+	if (!entry) {
+		dprintf("malloc failed\n");
+		return;
+	}
+	entry->hash = hash;
+	entry->error = error;
+	memcpy(entry->path, path, plen);
+	entry->target = NULL;
+	if (!error) {
+		entry->target = entry->path + plen;
+		memcpy(entry->target, target, tlen);
+	}
+	entry->next = cache->buckets[hash & (cache->nbuckets - 1)];
+	cache->buckets[hash & (cache->nbuckets - 1)] = entry;
+	cache->count++;
+}
+
+/**
+ * cached_link: sysfs_get_link() through the link cache
+ * @path: symbolic link's path
+ * @target: where to put the resolved link, may be path itself
+ * @len: size of target
+ * returns 0 with success and -1 with errno set on error, as
+ *	read_link() did when path was first looked up.
+ */
+int cached_link(const char *path, char *target, size_t len)
+{
+	char key[SYSFS_PATH_MAX], resolved[SYSFS_PATH_MAX];
+	struct link_cache *cache = link_cache();
+	struct link_entry *entry;
+	unsigned int hash;
+	int error;
+
+	/* path may be target, and is needed after it's been written */
+	safestrcpy(key, path);
+	hash = name_hash(key);
+
+	link_cache_lock(cache);
+	entry = link_find(cache, key, hash);
+	stats_count(entry ? SYSFS_STAT_LINK_HITS : SYSFS_STAT_LINK_MISSES, 1);
+	if (entry) {
+		error = entry->error;
+		if (!error)
+			safestrcpymax(target, entry->target, len);
+		link_cache_unlock(cache);
+		if (error) {
+			errno = error;
+			return -1;
+		}
+		return 0;
+	}
+	link_cache_unlock(cache);
+
+	/*
+	 * Unlocked: resolving comes back here for the directories above
+	 * key. Two threads may both resolve it, the first one in wins.
+	 */
+	if (read_link(key, resolved, sizeof(resolved)))
+		error = errno ? errno : EINVAL;
+	else
+		error = 0;
+
+	link_cache_lock(cache);
+	link_insert(cache, key, hash, resolved, error);
+	link_cache_unlock(cache);
+
+	if (error) {
+		errno = error;
+		return -1;
+	}
+	safestrcpymax(target, resolved, len);
+	return 0;
+}
+
+/**
+ * sysfs_flush_link_cache: forgets every link resolved in the current
+ *	context with SYSFS_OPT_LINK_CACHE set, for after devices have come
+ *	or gone.
+ */
+void sysfs_flush_link_cache(void)
+{
+	struct link_cache *cache = link_cache();
+
+	link_cache_lock(cache);
+	link_flush(cache);
+	link_cache_unlock(cache);
+}
@@ -51,8 +51,11 @@ void sysfs_close_module(struct sysfs_module *module)
 	 * this single call
 	 */
 	if (module != NULL) {
+		if (module->arena)
+			return;
 		if (module->attrlist != NULL)
 			dlist_destroy(module->attrlist);
+		sysfs_close_attr_index(module->attrindex);
 		if (module->parmlist != NULL)
 			dlist_destroy(module->parmlist);
 		if (module->sections != NULL)
@@ -67,7 +70,13 @@ void sysfs_close_module(struct sysfs_module *module)
  */
 static struct sysfs_module *alloc_module(void)
 {
-	return (struct sysfs_module *)calloc(1, sizeof(struct sysfs_module));
+	struct sysfs_module *mod;
+
+	mod = (struct sysfs_module *)
+			arena_calloc(1, sizeof(struct sysfs_module));
+	if (mod)
+		mod->arena = arena_current();
+	return mod;
 }
 
 /**
@@ -163,11 +172,30 @@ struct sysfs_module *sysfs_open_module(const char *name)
  */
 struct dlist *sysfs_get_module_attributes(struct sysfs_module *module)
 {
+	return sysfs_get_module_attributes_matching(module, NULL);
+}
+
+/**
+ * sysfs_get_module_attributes_matching: like sysfs_get_module_attributes(),
+ *	without opening the attributes filter doesn't let through
+ * @module: sysfs_module for which attributes are needed
+ * @filter: which attributes to open, NULL for all
+ * returns a dlist of attributes if exists, NULL otherwise
+ */
+struct dlist *sysfs_get_module_attributes_matching(struct sysfs_module *module,
+		const struct sysfs_filter *filter)
+{
+	struct sysfs_arena *prev;
+	struct dlist *attrlist;
+
 	if (module == NULL) {
 		errno = EINVAL;
 		return NULL;
 	}
-	return get_dev_attributes_list(module);
+	prev = arena_enter(module->arena);
+	attrlist = get_dev_attributes_list(module, &module->attrindex, filter);
+	arena_leave(prev);
+	return attrlist;
 }
 
 /**
@@ -179,12 +207,18 @@ struct dlist *sysfs_get_module_attributes(struct sysfs_module *module)
 struct sysfs_attribute *sysfs_get_module_attr
 		(struct sysfs_module *module, const char *name)
 {
+	struct sysfs_arena *prev;
+	struct sysfs_attribute *attr;
+
 	if (module == NULL || name == NULL) {
 		errno = EINVAL;
 		return NULL;
 	}
 
-	return get_attribute(module, (char *)name);
+	prev = arena_enter(module->arena);
+	attr = get_attribute(module, &module->attrindex, (char *)name);
+	arena_leave(prev);
+	return attr;
 }
 
 /**
@@ -195,6 +229,8 @@ struct sysfs_attribute *sysfs_get_module_attr
 struct dlist *sysfs_get_module_parms(struct sysfs_module *module)
 {
 	char ppath[SYSFS_PATH_MAX];
+	struct sysfs_arena *prev;
+	struct dlist *parms;
 
 	if (module == NULL) {
 		errno = EINVAL;
@@ -205,7 +241,10 @@ struct dlist *sysfs_get_module_parms(struct sysfs_module *module)
 	safestrcat(ppath,"/");
 	safestrcat(ppath, SYSFS_MOD_PARM_NAME);
 
-	return (get_attributes_list(module->parmlist, ppath));
+	prev = arena_enter(module->arena);
+	parms = get_attributes_list(module->parmlist, ppath);
+	arena_leave(prev);
+	return parms;
 }
 
 /**
@@ -216,6 +255,8 @@ struct dlist *sysfs_get_module_parms(struct sysfs_module *module)
 struct dlist *sysfs_get_module_sections(struct sysfs_module *module)
 {
 	char ppath[SYSFS_PATH_MAX];
+	struct sysfs_arena *prev;
+	struct dlist *sections;
 
 	if (module == NULL) {
 		errno = EINVAL;
@@ -227,7 +268,10 @@ struct dlist *sysfs_get_module_sections(struct sysfs_module *module)
 	safestrcat(ppath,"/");
 	safestrcat(ppath, SYSFS_MOD_SECT_NAME);
 
-	return (get_attributes_list(module->sections, ppath));
+	prev = arena_enter(module->arena);
+	sections = get_attributes_list(module->sections, ppath);
+	arena_leave(prev);
+	return sections;
 }
 
 /**
@@ -240,6 +284,7 @@ struct sysfs_attribute *sysfs_get_module_parm
 		(struct sysfs_module *module, const char *parm)
 {
 	struct dlist *parm_list = NULL;
+	struct sysfs_attribute *attr;
 
 	if (module == NULL || parm == NULL) {
 		errno = EINVAL;
@@ -250,8 +295,12 @@ struct sysfs_attribute *sysfs_get_module_parm
 	if (parm_list == NULL)
 		return NULL;
 
-	return (struct sysfs_attribute *)dlist_find_custom(parm_list,
+	attr = (struct sysfs_attribute *)dlist_find_custom(parm_list,
 		(void *)parm, mod_name_equal);
+	if (attr && (attr->method & SYSFS_METHOD_SHOW) &&
+			!sysfs_get_attribute_value(attr))
+		return NULL;
+	return attr;
 }
 
 /**
@@ -264,6 +313,7 @@ struct sysfs_attribute *sysfs_get_module_section
 		(struct sysfs_module *module, const char *section)
 {
 	struct dlist *sect_list = NULL;
+	struct sysfs_attribute *attr;
 
 	if (module == NULL || section == NULL) {
 		errno = EINVAL;
@@ -274,6 +324,10 @@ struct sysfs_attribute *sysfs_get_module_section
 	if (sect_list == NULL)
 		return NULL;
 
-	return (struct sysfs_attribute *)dlist_find_custom(sect_list,
+	attr = (struct sysfs_attribute *)dlist_find_custom(sect_list,
 		(void *)section, mod_name_equal);
+	if (attr && (attr->method & SYSFS_METHOD_SHOW) &&
+			!sysfs_get_attribute_value(attr))
+		return NULL;
+	return attr;
 }
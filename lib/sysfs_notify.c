@@ -0,0 +1,311 @@
+/*
+ * sysfs_notify.c
+ *
+ * Waiting for attributes to change, for libsysfs
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "libsysfs.h"
+#include "sysfs.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+
+/*
+ * Attributes whose driver calls sysfs_notify() wake poll() with
+ * POLLPRI|POLLERR on every change, until they're read again. Watched
+ * attributes are held, so that read is a pread() on the fd that's
+ * waited on, and a wake-up only counts as a change if that read's value
+ * differs, which held reads already check for before swapping buffers.
+ */
+struct attr_watch_entry {
+	struct sysfs_attribute *attr;
+	int held;		/* held by the watch, released with it */
+	int polled;		/* still in the epoll set */
+};
+
+struct sysfs_attr_watch {
+	int epfd;
+	struct attr_watch_entry *entries;
+	size_t count, size;
+	struct epoll_event *events;
+	int nevents;
+};
+
+static struct attr_watch_entry *find_watched(struct sysfs_attr_watch *watch,
+		struct sysfs_attribute *attr)
+{
+	size_t i;
+
+	for (i = 0; i < watch->count; i++)
+		if (watch->entries[i].attr == attr)
+			return &watch->entries[i];
+	return NULL;
+}
+
+static void forget_entry(struct sysfs_attr_watch *watch,
+		struct attr_watch_entry *entry)
+{
+	if (entry->polled)
+		epoll_ctl(watch->epfd, EPOLL_CTL_DEL, entry->attr->fd, NULL);
+	if (entry->held)
+		sysfs_release_attribute(entry->attr);
+}
+
+/**
+ * sysfs_open_attr_watch: creates an empty set of attributes to wait on
+ * returns struct sysfs_attr_watch with success and NULL with error.
+ */
+struct sysfs_attr_watch *sysfs_open_attr_watch(void)
+{
+	struct sysfs_attr_watch *watch;
+
+	watch = (struct sysfs_attr_watch *)
+			calloc(1, sizeof(struct sysfs_attr_watch));
+	if (!watch) {
+		dprintf("calloc failed\n");
+		return NULL;
+	}
+	watch->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (watch->epfd < 0) {
+		dprintf("Error creating epoll instance\n");
+		free(watch);
+		return NULL;
+	}
+	return watch;
+}
+
+/**
+ * sysfs_close_attr_watch: stops waiting on every attribute of watch,
+ *	releasing those it held, and frees it
+ */
+void sysfs_close_attr_watch(struct sysfs_attr_watch *watch)
+{
+	size_t i;
+
+	if (!watch)
+		return;
+	for (i = 0; i < watch->count; i++)
+		forget_entry(watch, &watch->entries[i]);
+	close(watch->epfd);
+	free(watch->entries);
+	free(watch->events);
+	free(watch);
+}
+
+/**
+ * sysfs_watch_attribute: adds an attribute to wait on, holding it open
+ *	and reading its current value
+ * @watch: set to add to
+ * @sysattr: attribute to watch, must stay open until unwatched
+ * returns 0 with success and -1 with error.
+ */
+int sysfs_watch_attribute(struct sysfs_attr_watch *watch,
+		struct sysfs_attribute *sysattr)
+{
+	struct attr_watch_entry *entry, *entries;
+	struct epoll_event event;
+	size_t size;
+
+	if (!watch || !sysattr) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (find_watched(watch, sysattr))
+		return 0;
+	if (watch->count == watch->size) {
+		size = watch->size ? watch->size * 2 : 16;
+		entries = (struct attr_watch_entry *)realloc(watch->entries,
+				size * sizeof(struct attr_watch_entry));
+		if (!entries) {
+			dprintf("realloc failed\n");
+			return -1;
+		}
+		watch->entries = entries;
+		watch->size = size;
+	}
+	entry = &watch->entries[watch->count];
+	memset(entry, 0, sizeof(struct attr_watch_entry));
+	entry->attr = sysattr;
+	if (!sysattr->bufsize) {
+		if (sysfs_hold_attribute(sysattr))
+			return -1;
+		entry->held = 1;
+	}
+	/* reading is what arms the next notification */
+	if (sysfs_read_attribute(sysattr)) {
+		forget_entry(watch, entry);
+		return -1;
+	}
+	memset(&event, 0, sizeof(struct epoll_event));
+	event.events = EPOLLPRI | EPOLLERR;
+	event.data.ptr = sysattr;
+	if (epoll_ctl(watch->epfd, EPOLL_CTL_ADD, sysattr->fd, &event)) {
+		dprintf("Error watching attribute %s\n", sysattr->path);
+		forget_entry(watch, entry);
+		return -1;
+	}
+	entry->polled = 1;
+	watch->count++;
+	return 0;
+}
+
+/**
+ * sysfs_unwatch_attribute: stops waiting on an attribute, releasing it if
+ *	sysfs_watch_attribute() was what held it
+ * returns 0 with success and -1 if it wasn't being watched.
+ */
+int sysfs_unwatch_attribute(struct sysfs_attr_watch *watch,
+		struct sysfs_attribute *sysattr)
+{
+	struct attr_watch_entry *entry;
+
+	if (!watch || !sysattr) {
+		errno = EINVAL;
+		return -1;
+	}
+	entry = find_watched(watch, sysattr);
+	if (!entry) {
+		errno = ENOENT;
+		return -1;
+	}
+	forget_entry(watch, entry);
+	*entry = watch->entries[--watch->count];
+	return 0;
+}
+
+/**
+ * sysfs_read_attr_watch: waits for watched attributes to be notified and
+ *	reads those that were again
+ * @watch: set to wait on
+ * @timeout: milliseconds to wait, -1 for ever and 0 not at all
+ * @changed: filled in with the attributes whose value changed, and with
+ *	errors those that could not be read
+ * @errors: set alongside changed, 0 for an attribute whose value changed
+ *	and the errno of the read for one that failed; with NULL, those
+ *	that failed are left out of changed
+ * @max: room in changed and errors
+ * returns the number of attributes in changed with success, 0 if none
+ *	changed before timeout, and -1 with error.
+ */
+int sysfs_read_attr_watch(struct sysfs_attr_watch *watch, int timeout,
+		struct sysfs_attribute **changed, int *errors, int max)
+{
+	struct attr_watch_entry *entry;
+	struct sysfs_attribute *sysattr;
+	struct epoll_event *events;
+	char *oldvalue;
+	int i, nready, error, count = 0;
+
+	if (!watch || !changed || max <= 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (watch->nevents < max) {
+		events = (struct epoll_event *)realloc(watch->events,
+				max * sizeof(struct epoll_event));
+		if (!events) {
+			dprintf("realloc failed\n");
+			return -1;
+		}
+		watch->events = events;
+		watch->nevents = max;
+	}
+	do
+		nready = epoll_wait(watch->epfd, watch->events, max, timeout);
+	while (nready < 0 && errno == EINTR);
+	if (nready < 0)
+		return -1;
+
+	for (i = 0; i < nready; i++) {
+		sysattr = (struct sysfs_attribute *)watch->events[i].data.ptr;
+		oldvalue = sysattr->value;
+		if (sysfs_read_attribute(sysattr)) {
+			/*
+			 * Gone with its device: it would wake us for ever,
+			 * so stop waiting on it and let the caller know.
+			 */
+			dprintf("Error reading watched attribute %s\n",
+					sysattr->path);
+			error = errno;
+			entry = find_watched(watch, sysattr);
+			if (entry && entry->polled) {
+				epoll_ctl(watch->epfd, EPOLL_CTL_DEL,
+						sysattr->fd, NULL);
+				entry->polled = 0;
+			}
+			if (errors) {
+				errors[count] = error ? error : EIO;
+				changed[count++] = sysattr;
+			}
+		} else if (sysattr->value != oldvalue) {
+			if (errors)
+				errors[count] = 0;
+			changed[count++] = sysattr;
+		}
+	}
+	return count;
+}
+
+#else
+
+struct sysfs_attr_watch *sysfs_open_attr_watch(void)
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+void sysfs_close_attr_watch(struct sysfs_attr_watch *watch)
+{
+	(void)watch;
+}
+
+int sysfs_watch_attribute(struct sysfs_attr_watch *watch,
+		struct sysfs_attribute *sysattr)
+{
+	(void)watch;
+	(void)sysattr;
+	errno = ENOSYS;
+	return -1;
+}
+
+int sysfs_unwatch_attribute(struct sysfs_attr_watch *watch,
+		struct sysfs_attribute *sysattr)
+{
+	(void)watch;
+	(void)sysattr;
+	errno = ENOSYS;
+	return -1;
+}
+
+int sysfs_read_attr_watch(struct sysfs_attr_watch *watch, int timeout,
+		struct sysfs_attribute **changed, int *errors, int max)
+{
+	(void)watch;
+	(void)timeout;
+	(void)changed;
+	(void)errors;
+	(void)max;
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif
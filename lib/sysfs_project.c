@@ -0,0 +1,401 @@
+/*
+ * sysfs_project.c
+ *
+ * Attribute projections of buses and classes for libsysfs
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <limits.h>
+#include "libsysfs.h"
+#include "sysfs.h"
+
+/*
+ * A projection is the set of attribute names a caller wants from every
+ * device of a bus or class, checked once. sysfs_project_bus() and
+ * sysfs_project_class() list the devices, sort them by name and read
+ * just those attributes of each, opening each device's directory once
+ * and the attributes relative to it, without any sysfs_device or
+ * sysfs_attribute being set up. The values land in a table stored a
+ * column at a time, all of its strings in two buffers.
+ */
+struct sysfs_projection {
+	unsigned int count;
+	char **names;			/* count names, in the caller's order */
+};
+
+/* a growing run of nul terminated strings, addressed by offset */
+struct pool {
+	char *buf;
+	size_t len;
+	size_t size;
+};
+
+#define NO_VALUE	((size_t)-1)
+
+/**
+ * projection_name_ok: checks an attribute name is a path below a device
+ *	directory, which may go through subdirectories but not up or out
+ */
+static int projection_name_ok(const char *name)
+{
+	const char *p = name;
+	size_t len;
+
+	if (!*name || *name == '/' || strlen(name) >= SYSFS_PATH_MAX)
+		return 0;
+	while (*p) {
+		len = strcspn(p, "/");
+		if (len == 0 || (len == 1 && p[0] == '.') ||
+				(len == 2 && p[0] == '.' && p[1] == '.'))
+			return 0;
+		p += len;
+		if (*p == '/' && !*++p)
+			return 0;
+	}
+	return 1;
+}
+
+/**
+ * sysfs_open_projection: checks and keeps a set of attribute names for
+ *	sysfs_project_bus() and sysfs_project_class()
+ * @names: NULL terminated attribute names, relative to a device's
+ *	directory, each there once
+ * returns the projection with success and NULL with error.
+ */
+struct sysfs_projection *sysfs_open_projection(const char **names)
+{
+	struct sysfs_projection *proj;
+	unsigned int count, i, j;
+	size_t size;
+	char *p;
+
+	if (!names || !names[0]) {
+		errno = EINVAL;
+		return NULL;
+	}
+	size = sizeof(struct sysfs_projection);
+	for (count = 0; names[count]; count++) {
+		if (!projection_name_ok(names[count])) {
+			dprintf("Invalid attribute name %s\n", names[count]);
+			errno = EINVAL;
+			return NULL;
+		}
+		for (j = 0; j < count; j++) {
+			if (!strcmp(names[j], names[count])) {
+				errno = EINVAL;
+				return NULL;
+			}
+		}
+		size += sizeof(char *) + strlen(names[count]) + 1;
+	}
+	proj = (struct sysfs_projection *)calloc(1, size);
+	if (!proj)
+		return NULL;
+	proj->count = count;
+	proj->names = (char **)(proj + 1);
+	p = (char *)(proj->names + count);
+	for (i = 0; i < count; i++) {
+		proj->names[i] = p;
+		strcpy(p, names[i]);
+		p += strlen(p) + 1;
+	}
+	return proj;
+}
+
+/**
+ * sysfs_close_projection: frees a projection; tables made with it are
+ *	left alone
+ */
+void sysfs_close_projection(struct sysfs_projection *proj)
+{
+	free(proj);
+}
+
+/**
+ * pool_add: copies len bytes of s, and a nul, to the end of the pool
+ * returns the offset of the copy with success and NO_VALUE with error.
+ */
+static size_t pool_add(struct pool *pool, const char *s, size_t len)
+{
+	size_t off = pool->len, newsize;
+	char *nbuf;
+
+	if (pool->len + len + 1 > pool->size) {
+		newsize = pool->size ? pool->size * 2 : 4096;
+		while (newsize < pool->len + len + 1)
+			newsize *= 2;
+		nbuf = (char *)realloc(pool->buf, newsize);
+		if (!nbuf)
+			return NO_VALUE;
+		pool->buf = nbuf;
+		pool->size = newsize;
+	}
+	memcpy(pool->buf + off, s, len);
+	pool->buf[off + len] = '\0';
+	pool->len += len + 1;
+	return off;
+}
+
+static int compare_rows(const void *a, const void *b)
+{
+	return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/**
+ * read_column: reads one projected attribute of the device at devpath
+ * @dirfd: the device's directory, opened on first use, or -1
+ * @buf: read buffer of *size + 1 bytes, may be replaced
+ * returns the value's length with success and -1 with error.
+ */
+static ssize_t read_column(const char *devpath, int *dirfd, const char *name,
+		char **buf, size_t *size)
+{
+	char path[SYSFS_PATH_MAX];
+	unsigned long long start;
+	const char *data;
+	size_t len;
+	ssize_t count;
+	int fd, ret, flags = O_RDONLY;
+
+	safestrcpy(path, devpath);
+	safestrcat(path, "/");
+	safestrcat(path, name);
+	ret = root_contents(path, &data, &len);
+	if (ret < 0)
+		return -1;
+	if (ret == 0) {
+		/* the snapshot's copy, no need for the directory */
+		if (len > USHRT_MAX)
+			len = USHRT_MAX;
+		if (len > *size) {
+			char *nbuf = (char *)realloc(*buf, len + 1);
+
+			if (!nbuf)
+				return -1;
+			*buf = nbuf;
+			*size = len;
+		}
+		memcpy(*buf, data, len);
+		return len;
+	}
+	if (*dirfd < 0) {
+#ifdef O_PATH
+		flags = O_PATH;
+#endif
+#ifdef O_DIRECTORY
+		flags |= O_DIRECTORY;
+#endif
+#ifdef O_CLOEXEC
+		flags |= O_CLOEXEC;
+#endif
+		*dirfd = root_open(devpath, flags);
+		if (*dirfd < 0)
+			return -1;
+	}
+	flags = O_RDONLY;
+#ifdef O_CLOEXEC
+	flags |= O_CLOEXEC;
+#endif
+	start = stats_begin();
+	fd = openat(*dirfd, name, flags);
+	stats_end(SYSFS_STAT_OPEN, start);
+	if (fd < 0)
+		return -1;
+	count = read_whole(fd, buf, size, USHRT_MAX);
+	close(fd);
+	return count;
+}
+
+/**
+ * project_dir: fills a table with the projected attributes of every
+ *	entry of path of the wanted type
+ * @links: whether entries are links, or also directories
+ * returns the table with success and NULL with error.
+ */
+static struct sysfs_table *project_dir(const char *path, int links,
+		struct sysfs_projection *proj)
+{
+	char devpath[SYSFS_PATH_MAX];
+	struct sysfs_table *table;
+	struct pool names = { NULL, 0, 0 }, values = { NULL, 0, 0 };
+	struct root_dir *dir;
+	struct dirent *dirent;
+	unsigned int nrows = 0, row, col, i;
+	size_t cells, cell, *offs = NULL, size;
+	char *buf = NULL, *p;
+	ssize_t len;
+	int dirfd, err = ENOMEM;
+
+	table = (struct sysfs_table *)calloc(1, sizeof(struct sysfs_table));
+	if (!table)
+		return NULL;
+	table->ncols = proj->count;
+	for (col = 0; col < proj->count; col++)
+		if (pool_add(&names, proj->names[col],
+				strlen(proj->names[col])) == NO_VALUE)
+			goto fail;
+
+	dir = root_opendir(path);
+	if (!dir) {
+		dprintf("Error opening directory %s\n", path);
+		err = errno;
+		goto fail;
+	}
+	while ((dirent = root_readdir(dir)) != NULL) {
+		if (!strcmp(dirent->d_name, ".") ||
+		    !strcmp(dirent->d_name, ".."))
+			continue;
+		/* the dirent_is_*() calls return 0 for a match */
+		if (dirent_is_link(dir, dirent) &&
+		    (links || dirent_is_dir(dir, dirent)))
+			continue;
+		if (pool_add(&names, dirent->d_name,
+				strlen(dirent->d_name)) == NO_VALUE) {
+			root_closedir(dir);
+			goto fail;
+		}
+		nrows++;
+	}
+	root_closedir(dir);
+	table->nrows = nrows;
+
+	/* the names are all in, so pointers into them stay put */
+	table->columns = (const char **)calloc(proj->count + nrows + 1,
+					sizeof(char *));
+	if (!table->columns)
+		goto fail;
+	table->rows = table->columns + proj->count;
+	p = names.buf;
+	for (i = 0; i < proj->count + nrows; i++) {
+		table->columns[i] = p;
+		p += strlen(p) + 1;
+	}
+	qsort(table->rows, nrows, sizeof(char *), compare_rows);
+
+	cells = (size_t)nrows * proj->count;
+	offs = (size_t *)calloc(cells + 1, sizeof(size_t));
+	table->values = (const char **)calloc(cells + 1, sizeof(char *));
+	table->lens = (unsigned short *)calloc(cells + 1,
+					sizeof(unsigned short));
+	size = getpagesize() + 1;
+	buf = (char *)malloc(size + 1);
+	if (!offs || !table->values || !table->lens || !buf)
+		goto fail;
+	for (row = 0; row < nrows; row++) {
+		safestrcpy(devpath, path);
+		safestrcat(devpath, "/");
+		safestrcat(devpath, table->rows[row]);
+		dirfd = -1;
+		for (col = 0; col < proj->count; col++) {
+			cell = (size_t)col * nrows + row;
+			len = read_column(devpath, &dirfd, proj->names[col],
+					&buf, &size);
+			if (len < 0) {
+				dprintf("Error reading %s of %s\n",
+					proj->names[col], devpath);
+				offs[cell] = NO_VALUE;
+				continue;
+			}
+			offs[cell] = pool_add(&values, buf, len);
+			if (offs[cell] == NO_VALUE) {
+				if (dirfd >= 0)
+					close(dirfd);
+				goto fail;
+			}
+			table->lens[cell] = len;
+		}
+		if (dirfd >= 0)
+			close(dirfd);
+	}
+	for (cell = 0; cell < cells; cell++)
+		if (offs[cell] != NO_VALUE)
+			table->values[cell] = values.buf + offs[cell];
+	free(offs);
+	free(buf);
+	table->names = names.buf;
+	table->data = values.buf;
+	return table;
+
+fail:
+	free(offs);
+	free(buf);
+	free(names.buf);
+	free(values.buf);
+	free(table->columns);
+	free(table->values);
+	free(table->lens);
+	free(table);
+	errno = err;
+	return NULL;
+}
+
+/**
+ * sysfs_project_bus: reads the projected attributes of every device on
+ *	a bus into a table
+ * @bus: bus whose devices to read
+ * @proj: attributes to read, from sysfs_open_projection()
+ * returns the table with success and NULL with error.
+ */
+struct sysfs_table *sysfs_project_bus(struct sysfs_bus *bus,
+		struct sysfs_projection *proj)
+{
+	char path[SYSFS_PATH_MAX];
+
+	if (!bus || !proj) {
+		errno = EINVAL;
+		return NULL;
+	}
+	safestrcpy(path, bus->path);
+	safestrcat(path, "/");
+	safestrcat(path, SYSFS_DEVICES_NAME);
+	return project_dir(path, 1, proj);
+}
+
+/**
+ * sysfs_project_class: reads the projected attributes of every device
+ *	of a class into a table
+ * returns the table with success and NULL with error.
+ */
+struct sysfs_table *sysfs_project_class(struct sysfs_class *cls,
+		struct sysfs_projection *proj)
+{
+	if (!cls || !proj) {
+		errno = EINVAL;
+		return NULL;
+	}
+	/* nested classes have directories, the rest links */
+	return project_dir(cls->path, 0, proj);
+}
+
+/**
+ * sysfs_close_table: frees a table and all the strings in it
+ */
+void sysfs_close_table(struct sysfs_table *table)
+{
+	if (!table)
+		return;
+	free(table->columns);
+	free(table->values);
+	free(table->lens);
+	free(table->names);
+	free(table->data);
+	free(table);
+}
@@ -0,0 +1,1108 @@
+/*
+ * sysfs_snapshot.c
+ *
+ * Binary snapshots of a sysfs tree for libsysfs
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "libsysfs.h"
+#include "sysfs.h"
+#include <stdint.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/*
+ * A snapshot is one file: a header, then every directory, link and file
+ * of the tree as a fixed size entry, then their names, then the contents
+ * of the files and the targets of the links. Entries are laid out
+ * breadth first, so the children of a directory are next to each other,
+ * sorted by name to be looked up with a binary search. The first entry
+ * is the root, the directory SYSFS_PATH names.
+ *
+ * Everything is in the byte order of the machine that wrote it, and the
+ * file is mapped and used as it is, so reading one on a machine of the
+ * other byte order is refused rather than converted.
+ */
+#define SNAPSHOT_MAGIC		"SYSFSNAP"
+#define SNAPSHOT_VERSION	1
+#define SNAPSHOT_ORDER		0x01020304
+
+/* most the contents of any one file are kept to */
+#define SNAPSHOT_MAX_DATA	(1024 * 1024)
+/* links followed in one lookup before giving up with ELOOP */
+#define SNAPSHOT_MAX_LINKS	32
+
+struct snapshot_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t order;		/* SNAPSHOT_ORDER as it was written */
+	uint32_t count;		/* entries, the root first */
+	uint32_t names_size;
+	uint64_t data_size;
+};
+
+struct snapshot_entry {
+	uint32_t name;		/* offset of its name in the names */
+	uint32_t parent;
+	uint32_t child;		/* first child of a directory */
+	uint32_t nchildren;
+	uint32_t mode;		/* st_mode */
+	uint32_t error;		/* errno reading it failed with, or 0 */
+	uint64_t size;		/* st_size */
+	uint64_t data;		/* offset of its contents or target */
+	uint64_t length;
+};
+
+/* a snapshot mapped for a context to read in place of sysfs */
+struct snapshot {
+	const char *root;	/* path it stands in for */
+	size_t rootlen;
+	void *map;
+	size_t size;
+	const struct snapshot_entry *entries;
+	uint32_t count;
+	const char *names;
+	const char *data;
+	void *view;		/* the view it was found through, or NULL */
+	size_t viewsize;
+	unsigned long long generation;	/* the view's when it was found */
+};
+
+/* times the snapshot a view names may be replaced before it's loaded */
+#define VIEW_LOAD_TRIES		10
+
+#define entry_name(snap, i)	((snap)->names + (snap)->entries[i].name)
+
+/**
+ * snapshot_check: makes sure every offset in a snapshot stays inside it
+ *	and the entries make up a tree, so lookups needn't check again
+ * returns 0 if it's sound and -1 otherwise.
+ */
+static int snapshot_check(const char *map, size_t size)
+{
+	const struct snapshot_header *hdr = (const struct snapshot_header *)map;
+	const struct snapshot_entry *entries, *entry;
+	const char *names, *name;
+	uint64_t offset;
+	uint32_t i, j;
+
+	if (size < sizeof(struct snapshot_header) ||
+	    memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != SNAPSHOT_VERSION || hdr->order != SNAPSHOT_ORDER ||
+	    hdr->count == 0 || hdr->names_size == 0)
+		return -1;
+	offset = sizeof(struct snapshot_header) +
+		(uint64_t)hdr->count * sizeof(struct snapshot_entry);
+	if (offset + hdr->names_size + hdr->data_size != size)
+		return -1;
+	names = map + offset;
+	if (names[hdr->names_size - 1] != '\0')
+		return -1;
+	entries = (const struct snapshot_entry *)(map +
+			sizeof(struct snapshot_header));
+	if (!S_ISDIR(entries->mode))
+		return -1;
+	for (i = 0, entry = entries; i < hdr->count; i++, entry++) {
+		if (entry->name >= hdr->names_size || entry->parent >= hdr->count)
+			return -1;
+		name = names + entry->name;
+		if (!memchr(name, '\0', NAME_MAX + 1))
+			return -1;
+		/* children come after their parent, and have no other */
+		if (entry->nchildren && (!S_ISDIR(entry->mode) ||
+		    entry->child <= i || entry->child >= hdr->count ||
+		    entry->nchildren > hdr->count - entry->child))
+			return -1;
+		for (j = 0; j < entry->nchildren; j++)
+			if (entries[entry->child + j].parent != i)
+				return -1;
+		if (entry->data > hdr->data_size ||
+		    entry->length > hdr->data_size - entry->data)
+			return -1;
+		if (S_ISLNK(entry->mode) && entry->length >= PATH_MAX)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * map_file: maps the whole of file read only
+ * @owner: set to the file's owner, if not NULL
+ * returns the map with success and NULL with error.
+ */
+static char *map_file(const char *file, size_t *size, int flags,
+		uid_t *owner)
+{
+	struct stat stats;
+	char *map;
+	int fd;
+
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+	if (fstat(fd, &stats)) {
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, stats.st_size, PROT_READ, flags, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+	*size = stats.st_size;
+	if (owner)
+		*owner = stats.st_uid;
+	return map;
+}
+
+/**
+ * owner_check: tells views and snapshots that can be trusted, being
+ *	root's or the caller's own, from those anyone else put there
+ * returns 0 if a file owned by owner can be trusted and -1, with EPERM,
+ *	if not.
+ */
+static int owner_check(uid_t owner)
+{
+	if (owner == 0 || owner == getuid() || owner == geteuid())
+		return 0;
+	errno = EPERM;
+	return -1;
+}
+
+/**
+ * new_snapshot: sets up a snapshot read from the size bytes at map, which
+ *	it takes over, after making sure it is one
+ * returns the snapshot with success and NULL with error, map unmapped.
+ */
+static struct snapshot *new_snapshot(char *map, size_t size,
+		const char *root)
+{
+	const struct snapshot_header *hdr;
+	struct snapshot *snap;
+
+	if (snapshot_check(map, size)) {
+		munmap(map, size);
+		errno = EINVAL;
+		return NULL;
+	}
+	snap = (struct snapshot *)calloc(1, sizeof(struct snapshot));
+	if (!snap) {
+		munmap(map, size);
+		return NULL;
+	}
+	hdr = (const struct snapshot_header *)map;
+	snap->map = map;
+	snap->size = size;
+	snap->root = root;
+	snap->rootlen = strlen(root);
+	snap->entries = (const struct snapshot_entry *)(map +
+			sizeof(struct snapshot_header));
+	snap->count = hdr->count;
+	snap->names = (const char *)(snap->entries + hdr->count);
+	snap->data = snap->names + hdr->names_size;
+	return snap;
+}
+
+/**
+ * load_view: loads the snapshot the view at file names just now, keeping
+ *	the view mapped to tell when a newer one is published
+ * returns the snapshot with success and NULL with error.
+ */
+static struct snapshot *load_view(const char *file, const char *root)
+{
+	struct snapshot *snap;
+	char path[PATH_MAX];
+	unsigned long long generation;
+	size_t size, viewsize;
+	char *view, *map;
+	uid_t owner;
+	int tries, err;
+
+	view = map_file(file, &viewsize, MAP_SHARED, &owner);
+	if (!view)
+		return NULL;
+	if (owner_check(owner)) {
+		dprintf("View %s isn't root's or ours\n", file);
+		munmap(view, viewsize);
+		return NULL;
+	}
+	for (tries = 0; tries < VIEW_LOAD_TRIES; tries++) {
+		if (view_current(view, file, path, sizeof(path), &generation))
+			break;
+		map = map_file(path, &size, MAP_PRIVATE, &owner);
+		if (!map) {
+			/* published over and removed before it was opened */
+			if (errno == ENOENT &&
+			    view_generation(view) != generation)
+				continue;
+			break;
+		}
+		if (owner_check(owner)) {
+			dprintf("Snapshot %s isn't root's or ours\n", path);
+			munmap(map, size);
+			break;
+		}
+		snap = new_snapshot(map, size, root);
+		if (!snap) {
+			dprintf("%s is not a sysfs snapshot\n", path);
+			break;
+		}
+		snap->view = view;
+		snap->viewsize = viewsize;
+		snap->generation = generation;
+		return snap;
+	}
+	if (tries == VIEW_LOAD_TRIES)
+		errno = EAGAIN;
+	err = errno;
+	dprintf("Error loading view %s\n", file);
+	munmap(view, viewsize);
+	errno = err;
+	return NULL;
+}
+
+/**
+ * snapshot_load: maps the snapshot at file, or the one the view at file
+ *	names, to stand in for the sysfs tree below root, a string that has
+ *	to last as long as it does
+ * returns the snapshot with success and NULL with error.
+ */
+struct snapshot *snapshot_load(const char *file, const char *root)
+{
+	struct snapshot *snap;
+	size_t size;
+	char *map;
+
+	map = map_file(file, &size, MAP_PRIVATE, NULL);
+	if (!map)
+		return NULL;
+	if (!view_check(map, size)) {
+		munmap(map, size);
+		return load_view(file, root);
+	}
+	snap = new_snapshot(map, size, root);
+	if (!snap)
+		dprintf("%s is not a sysfs snapshot\n", file);
+	return snap;
+}
+
+/**
+ * snapshot_generation: the generation of the view a snapshot was found
+ *	through, 0 if it wasn't
+ */
+unsigned long long snapshot_generation(struct snapshot *snap)
+{
+	return snap && snap->view ? snap->generation : 0;
+}
+
+/**
+ * snapshot_stale: tells whether a newer snapshot has been published to the
+ *	view a snapshot was found through
+ * returns 1 if so and 0 if not, or if it wasn't found through a view.
+ */
+int snapshot_stale(struct snapshot *snap)
+{
+	return snap && snap->view &&
+		view_generation(snap->view) != snap->generation;
+}
+
+/**
+ * snapshot_close: unmaps a snapshot
+ */
+void snapshot_close(struct snapshot *snap)
+{
+	if (!snap)
+		return;
+	munmap(snap->map, snap->size);
+	if (snap->view)
+		munmap(snap->view, snap->viewsize);
+	free(snap);
+}
+
+/**
+ * find_child: binary search of a directory's children for name
+ * returns the child's index, or -1 if it has none of that name.
+ */
+static int find_child(struct snapshot *snap, uint32_t dir, const char *name)
+{
+	const struct snapshot_entry *entry = &snap->entries[dir];
+	uint32_t lo = entry->child, hi = entry->child + entry->nchildren, mid;
+	int cmp;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = strcmp(name, entry_name(snap, mid));
+		if (cmp == 0)
+			return mid;
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return -1;
+}
+
+static int lookup(struct snapshot *snap, uint32_t at, const char *path,
+		int follow, int depth);
+
+/**
+ * follow_link: finds the entry the link at index link points at
+ * returns its index with success and -1 with error.
+ */
+static int follow_link(struct snapshot *snap, uint32_t link, int depth)
+{
+	const struct snapshot_entry *entry = &snap->entries[link];
+	char target[PATH_MAX];
+
+	if (depth >= SNAPSHOT_MAX_LINKS) {
+		errno = ELOOP;
+		return -1;
+	}
+	memcpy(target, snap->data + entry->data, entry->length);
+	target[entry->length] = '\0';
+	if (target[0] != '/')
+		return lookup(snap, entry->parent, target, 1, depth + 1);
+	/* absolute targets only make sense below the root */
+	if (strncmp(target, snap->root, snap->rootlen) ||
+	    (target[snap->rootlen] != '/' &&
+	     target[snap->rootlen] != '\0')) {
+		errno = ENOENT;
+		return -1;
+	}
+	return lookup(snap, 0, target + snap->rootlen, 1, depth + 1);
+}
+
+/**
+ * lookup: finds the entry path names, relative to the directory at,
+ *	following the links on the way and, with follow, any it ends at
+ * returns the entry's index with success and -1 with error.
+ */
+static int lookup(struct snapshot *snap, uint32_t at, const char *path,
+		int follow, int depth)
+{
+	char name[NAME_MAX + 1];
+	const char *end;
+	size_t len;
+	int i;
+
+	for (;;) {
+		while (*path == '/')
+			path++;
+		if (*path == '\0')
+			return at;
+		for (end = path; *end && *end != '/'; end++)
+			;
+		len = end - path;
+		if (len == 1 && path[0] == '.') {
+			path = end;
+			continue;
+		}
+		if (len == 2 && path[0] == '.' && path[1] == '.') {
+			at = snap->entries[at].parent;
+			path = end;
+			continue;
+		}
+		if (len > NAME_MAX) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		if (!S_ISDIR(snap->entries[at].mode)) {
+			errno = ENOTDIR;
+			return -1;
+		}
+		memcpy(name, path, len);
+		name[len] = '\0';
+		i = find_child(snap, at, name);
+		if (i < 0) {
+			errno = ENOENT;
+			return -1;
+		}
+		path = end;
+		while (*path == '/')
+			path++;
+		if (S_ISLNK(snap->entries[i].mode) &&
+		    (follow || *path || *end == '/')) {
+			i = follow_link(snap, i, depth);
+			if (i < 0)
+				return -1;
+		}
+		at = i;
+	}
+}
+
+static void entry_stat(struct snapshot *snap, uint32_t i,
+		struct stat *astats)
+{
+	const struct snapshot_entry *entry = &snap->entries[i];
+
+	memset(astats, 0, sizeof(struct stat));
+	astats->st_ino = i + 1;
+	astats->st_mode = entry->mode;
+	astats->st_nlink = S_ISDIR(entry->mode) ? 2 : 1;
+	astats->st_size = entry->size;
+	astats->st_blksize = getpagesize();
+}
+
+/**
+ * snapshot_stat: stat() or, with nofollow, lstat() the entry at the
+ *	path rel, relative to the root
+ */
+int snapshot_stat(struct snapshot *snap, const char *rel,
+		struct stat *astats, int nofollow)
+{
+	int i = lookup(snap, 0, rel, !nofollow, 0);
+
+	if (i < 0)
+		return -1;
+	entry_stat(snap, i, astats);
+	return 0;
+}
+
+/**
+ * snapshot_entry_mode: the st_mode of the entry at index i or, with
+ *	follow and a link there, of what it points at
+ */
+int snapshot_entry_mode(struct snapshot *snap, unsigned int i, int follow,
+		mode_t *mode)
+{
+	int at = i;
+
+	if (i >= snap->count) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (follow && S_ISLNK(snap->entries[i].mode)) {
+		at = follow_link(snap, i, 0);
+		if (at < 0)
+			return -1;
+	}
+	*mode = snap->entries[at].mode;
+	return 0;
+}
+
+/**
+ * snapshot_contents: the contents of the file at rel, as they are in the
+ *	mapping
+ * @len: set to their length
+ * returns them with success and NULL with error.
+ */
+const char *snapshot_contents(struct snapshot *snap, const char *rel,
+		size_t *len)
+{
+	const struct snapshot_entry *entry;
+	int i = lookup(snap, 0, rel, 1, 0);
+
+	if (i < 0)
+		return NULL;
+	entry = &snap->entries[i];
+	if (S_ISDIR(entry->mode)) {
+		errno = EISDIR;
+		return NULL;
+	}
+	if (entry->error) {
+		errno = entry->error;
+		return NULL;
+	}
+	*len = entry->length;
+	return snap->data + entry->data;
+}
+
+/**
+ * snapshot_readlink: readlink() the link at rel
+ * returns the length of the target with success and -1 with error.
+ */
+ssize_t snapshot_readlink(struct snapshot *snap, const char *rel, char *buf,
+		size_t len)
+{
+	const struct snapshot_entry *entry;
+	int i = lookup(snap, 0, rel, 0, 0);
+
+	if (i < 0)
+		return -1;
+	entry = &snap->entries[i];
+	if (!S_ISLNK(entry->mode)) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (len > entry->length)
+		len = entry->length;
+	memcpy(buf, snap->data + entry->data, len);
+	return len;
+}
+
+/**
+ * snapshot_open: open() the file at rel for reading. The fd is of an
+ *	unlinked copy of its contents, for the callers that read() and
+ *	pread() it like any sysfs file.
+ * returns the fd with success and -1 with error.
+ */
+int snapshot_open(struct snapshot *snap, const char *rel, int flags)
+{
+	const char *data;
+	size_t len, done;
+	ssize_t n;
+	int fd = -1;
+
+	if ((flags & O_ACCMODE) != O_RDONLY) {
+		errno = EROFS;
+		return -1;
+	}
+	data = snapshot_contents(snap, rel, &len);
+	if (!data) {
+		/* reads of directories go through root_opendir() */
+		if (errno == EISDIR)
+			errno = ENOTSUP;
+		return -1;
+	}
+#ifdef __NR_memfd_create
+	fd = syscall(__NR_memfd_create, "sysfs-snapshot",
+			(flags & O_CLOEXEC) ? 1 : 0);
+#endif
+	if (fd < 0) {
+		char tmp[] = "/tmp/sysfs-snapshot-XXXXXX";
+
+		fd = mkstemp(tmp);
+		if (fd < 0)
+			return -1;
+		unlink(tmp);
+		if (flags & O_CLOEXEC)
+			fcntl(fd, F_SETFD, FD_CLOEXEC);
+	}
+	for (done = 0; done < len; done += n) {
+		n = write(fd, data + done, len - done);
+		if (n < 0) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			close(fd);
+			return -1;
+		}
+	}
+	lseek(fd, 0, SEEK_SET);
+	return fd;
+}
+
+/**
+ * snapshot_opendir: finds the entries of the directory at rel
+ * @first: set to the index of its first entry
+ * @count: set to the number it has
+ * returns 0 with success and -1 with error.
+ */
+int snapshot_opendir(struct snapshot *snap, const char *rel,
+		unsigned int *first, unsigned int *count)
+{
+	int i = lookup(snap, 0, rel, 1, 0);
+
+	if (i < 0)
+		return -1;
+	if (!S_ISDIR(snap->entries[i].mode)) {
+		errno = ENOTDIR;
+		return -1;
+	}
+	*first = snap->entries[i].child;
+	*count = snap->entries[i].nchildren;
+	return 0;
+}
+
+/**
+ * snapshot_entry_name: the name of the entry at index i
+ */
+const char *snapshot_entry_name(struct snapshot *snap, unsigned int i)
+{
+	return entry_name(snap, i);
+}
+
+/*
+ * Writing one: the tree is read into snap_nodes first, then numbered
+ * breadth first and written out a section at a time.
+ */
+struct snap_node {
+	struct snap_node **children;
+	unsigned int nchildren;
+	unsigned int csize;
+	uint32_t index;
+	uint32_t mode;
+	uint32_t error;
+	uint64_t size;
+	char *data;
+	size_t length;
+	char name[];
+};
+
+struct snap_build {
+	char path[PATH_MAX];
+	size_t pathlen;
+	struct snap_node **order;	/* every node, breadth first */
+	uint32_t count;
+	uint32_t osize;
+	char *names;
+	size_t nlen;
+	size_t nsize;
+	uint32_t *hash;			/* offsets of names + 1, 0 if free */
+	size_t hsize;
+	size_t hcount;
+};
+
+static void free_node(struct snap_node *node)
+{
+	unsigned int i;
+
+	for (i = 0; i < node->nchildren; i++)
+		free_node(node->children[i]);
+	free(node->children);
+	free(node->data);
+	free(node);
+}
+
+/*
+ * Files that are there to be mapped, that poke the hardware when read,
+ * such as PCI I/O port BARs and expansion ROMs, or that do something,
+ * such as zram's hot_add making a device, are listed but left empty.
+ */
+static int skip_contents(const char *name)
+{
+	if (!strcmp(name, "rom") || !strcmp(name, "vpd") ||
+	    !strcmp(name, "hot_add"))
+		return 1;
+	return !strncmp(name, "resource", 8) && isdigit((unsigned char)name[8]);
+}
+
+/**
+ * read_contents: reads up to SNAPSHOT_MAX_DATA bytes of the file at
+ *	build->path into node, or notes why it couldn't be
+ */
+static void read_contents(struct snap_build *build, struct snap_node *node)
+{
+	size_t size = getpagesize();
+	ssize_t n;
+	char *tmp;
+	int fd;
+
+	if (!(node->mode & S_IRUSR) || skip_contents(node->name)) {
+		node->error = EACCES;
+		return;
+	}
+	fd = root_open(build->path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		node->error = errno;
+		return;
+	}
+	node->data = (char *)malloc(size);
+	while (node->data) {
+		n = read(fd, node->data + node->length, size - node->length);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			node->error = errno;
+			node->length = 0;
+			break;
+		}
+		if (n == 0)
+			break;
+		node->length += n;
+		if (node->length == SNAPSHOT_MAX_DATA)
+			break;
+		if (node->length < size)
+			continue;
+		size = size * 2 < SNAPSHOT_MAX_DATA ? size * 2 :
+				SNAPSHOT_MAX_DATA;
+		tmp = (char *)realloc(node->data, size);
+		if (!tmp) {
+			node->error = ENOMEM;
+			node->length = 0;
+			break;
+		}
+		node->data = tmp;
+	}
+	if (!node->data)
+		node->error = ENOMEM;
+	close(fd);
+}
+
+/**
+ * add_child: appends a child to a directory's node
+ * returns 0 with success and -1 with error.
+ */
+static int add_child(struct snap_node *dir, struct snap_node *node)
+{
+	struct snap_node **tmp;
+
+	if (dir->nchildren == dir->csize) {
+		dir->csize = dir->csize ? dir->csize * 2 : 16;
+		tmp = (struct snap_node **)realloc(dir->children,
+				dir->csize * sizeof(struct snap_node *));
+		if (!tmp)
+			return -1;
+		dir->children = tmp;
+	}
+	dir->children[dir->nchildren++] = node;
+	return 0;
+}
+
+/**
+ * read_node: reads whatever is at build->path, and all below it
+ * returns its node with success and NULL with error.
+ */
+static struct snap_node *read_node(struct snap_build *build,
+		const char *name)
+{
+	struct snap_node *node, *child;
+	struct root_dir *dir;
+	struct dirent *dirent;
+	size_t pathlen = build->pathlen, len;
+	struct stat astats;
+	char target[PATH_MAX];
+	ssize_t n;
+
+	if (root_stat(build->path, &astats, 1))
+		return NULL;
+	node = (struct snap_node *)calloc(1, sizeof(struct snap_node) +
+			strlen(name) + 1);
+	if (!node)
+		return NULL;
+	strcpy(node->name, name);
+	node->mode = astats.st_mode;
+	node->size = astats.st_size;
+	if (S_ISREG(astats.st_mode)) {
+		read_contents(build, node);
+		return node;
+	}
+	if (S_ISLNK(astats.st_mode)) {
+		n = root_readlink(build->path, target, sizeof(target) - 1);
+		if (n < 0) {
+			node->error = errno;
+			return node;
+		}
+		node->data = (char *)malloc(n ? n : 1);
+		if (!node->data) {
+			free(node);
+			return NULL;
+		}
+		memcpy(node->data, target, n);
+		node->length = n;
+		return node;
+	}
+	if (!S_ISDIR(astats.st_mode))
+		return node;
+
+	dir = root_opendir(build->path);
+	if (!dir) {
+		node->error = errno;
+		return node;
+	}
+	while ((dirent = root_readdir(dir)) != NULL) {
+		if (!strcmp(dirent->d_name, ".") ||
+		    !strcmp(dirent->d_name, ".."))
+			continue;
+		len = strlen(dirent->d_name);
+		if (pathlen + len + 2 > sizeof(build->path))
+			continue;
+		build->path[pathlen] = '/';
+		memcpy(build->path + pathlen + 1, dirent->d_name, len + 1);
+		build->pathlen = pathlen + len + 1;
+		child = read_node(build, dirent->d_name);
+		build->pathlen = pathlen;
+		build->path[pathlen] = '\0';
+		if (!child)
+			continue;
+		if (add_child(node, child)) {
+			free_node(child);
+			root_closedir(dir);
+			free_node(node);
+			return NULL;
+		}
+	}
+	root_closedir(dir);
+	return node;
+}
+
+/**
+ * add_name: adds name to the names being built, once however many
+ *	entries have it
+ * returns its offset with success and -1 with error.
+ */
+static int64_t add_name(struct snap_build *build, const char *name)
+{
+	size_t len = strlen(name) + 1, i, j, size;
+	uint32_t *hash, offset;
+	char *tmp;
+
+	if (build->hcount * 2 >= build->hsize) {
+		/* grow the hash before it gets half full */
+		size = build->hsize ? build->hsize * 2 : 4096;
+		hash = (uint32_t *)calloc(size, sizeof(uint32_t));
+		if (!hash)
+			return -1;
+		for (i = 0; i < build->hsize; i++) {
+			if (!build->hash[i])
+				continue;
+			j = name_hash(build->names + build->hash[i] - 1);
+			for (j &= size - 1; hash[j]; j = (j + 1) & (size - 1))
+				;
+			hash[j] = build->hash[i];
+		}
+		free(build->hash);
+		build->hash = hash;
+		build->hsize = size;
+	}
+	for (i = name_hash(name) & (build->hsize - 1); build->hash[i];
+	     i = (i + 1) & (build->hsize - 1))
+		if (!strcmp(build->names + build->hash[i] - 1, name))
+			return build->hash[i] - 1;
+
+	if (build->nlen + len > UINT32_MAX - 1) {
+		errno = EFBIG;
+		return -1;
+	}
+	if (build->nlen + len > build->nsize) {
+		size = build->nsize ? build->nsize * 2 : 65536;
+		while (size < build->nlen + len)
+			size *= 2;
+		tmp = (char *)realloc(build->names, size);
+		if (!tmp)
+			return -1;
+		build->names = tmp;
+		build->nsize = size;
+	}
+	offset = build->nlen;
+	memcpy(build->names + offset, name, len);
+	build->nlen += len;
+	build->hash[i] = offset + 1;
+	build->hcount++;
+	return offset;
+}
+
+static int node_cmp(const void *a, const void *b)
+{
+	return strcmp((*(struct snap_node * const *)a)->name,
+			(*(struct snap_node * const *)b)->name);
+}
+
+/**
+ * number_nodes: lays the tree out breadth first in build->order
+ * returns 0 with success and -1 with error.
+ */
+static int number_nodes(struct snap_build *build, struct snap_node *root)
+{
+	struct snap_node **tmp, *node;
+	uint32_t i, j;
+
+	build->osize = 1024;
+	build->order = (struct snap_node **)malloc(build->osize *
+			sizeof(struct snap_node *));
+	if (!build->order)
+		return -1;
+	build->order[0] = root;
+	build->count = 1;
+	for (i = 0; i < build->count; i++) {
+		node = build->order[i];
+		node->index = i;
+		if (!node->nchildren)
+			continue;
+		qsort(node->children, node->nchildren,
+				sizeof(struct snap_node *), node_cmp);
+		while (build->count + node->nchildren > build->osize) {
+			if (build->osize > UINT32_MAX / 2) {
+				errno = EFBIG;
+				return -1;
+			}
+			build->osize *= 2;
+			tmp = (struct snap_node **)realloc(build->order,
+				build->osize * sizeof(struct snap_node *));
+			if (!tmp)
+				return -1;
+			build->order = tmp;
+		}
+		for (j = 0; j < node->nchildren; j++)
+			build->order[build->count++] = node->children[j];
+	}
+	return 0;
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+	const char *p = (const char *)buf;
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(fd, p, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/**
+ * write_snapshot: writes the numbered tree out to fd
+ * returns 0 with success and -1 with error.
+ */
+static int write_snapshot(struct snap_build *build, int fd)
+{
+	struct snapshot_header hdr;
+	struct snapshot_entry *entries;
+	struct snap_node *node;
+	uint64_t data = 0;
+	int64_t name;
+	uint32_t i, j;
+	int ret = -1;
+
+	entries = (struct snapshot_entry *)calloc(build->count,
+			sizeof(struct snapshot_entry));
+	if (!entries)
+		return -1;
+	if (add_name(build, "") < 0)
+		goto out;
+	for (i = 0; i < build->count; i++) {
+		node = build->order[i];
+		name = add_name(build, node->name);
+		if (name < 0)
+			goto out;
+		entries[i].name = name;
+		entries[i].mode = node->mode;
+		entries[i].error = node->error;
+		entries[i].size = node->size;
+		entries[i].data = data;
+		entries[i].length = node->length;
+		data += node->length;
+		if (!node->nchildren)
+			continue;
+		entries[i].child = node->children[0]->index;
+		entries[i].nchildren = node->nchildren;
+		for (j = 0; j < node->nchildren; j++)
+			entries[node->children[j]->index].parent = i;
+	}
+
+	memset(&hdr, 0, sizeof(struct snapshot_header));
+	memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+	hdr.version = SNAPSHOT_VERSION;
+	hdr.order = SNAPSHOT_ORDER;
+	hdr.count = build->count;
+	hdr.names_size = build->nlen;
+	hdr.data_size = data;
+	if (write_all(fd, &hdr, sizeof(hdr)) ||
+	    write_all(fd, entries, build->count *
+		    sizeof(struct snapshot_entry)) ||
+	    write_all(fd, build->names, build->nlen))
+		goto out;
+	for (i = 0; i < build->count; i++) {
+		node = build->order[i];
+		if (node->length && write_all(fd, node->data, node->length))
+			goto out;
+	}
+	ret = 0;
+out:
+	free(entries);
+	return ret;
+}
+
+/**
+ * sysfs_write_snapshot: writes the sysfs tree, or the parts of it
+ *	listed, to a snapshot file that SYSFS_PATH can name later
+ * @file: where to write it, replaced once the snapshot is complete
+ * @dirs: NULL terminated names of the directories below the sysfs root
+ *	to take, or NULL for "devices", "bus", "class", "module" and
+ *	"block"
+ * returns 0 with success and -1 with error.
+ */
+int sysfs_write_snapshot(const char *file, const char **dirs)
+{
+	static const char *default_dirs[] = {
+		SYSFS_DEVICES_NAME, SYSFS_BUS_NAME, SYSFS_CLASS_NAME,
+		SYSFS_MODULE_NAME, SYSFS_BLOCK_NAME, NULL
+	};
+	struct snap_node *root, *node;
+	struct snap_build build;
+	char *tmp = NULL;
+	size_t len;
+	int fd, ret = -1, err;
+
+	if (!file) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (!dirs)
+		dirs = default_dirs;
+	root = (struct snap_node *)calloc(1, sizeof(struct snap_node) + 1);
+	if (!root)
+		return -1;
+	root->mode = S_IFDIR | 0755;
+	memset(&build, 0, sizeof(struct snap_build));
+	if (sysfs_get_mnt_path(build.path, sizeof(build.path)))
+		goto out;
+	len = strlen(build.path);
+	for (; *dirs; dirs++) {
+		if (len + strlen(*dirs) + 2 > sizeof(build.path))
+			continue;
+		build.path[len] = '/';
+		strcpy(build.path + len + 1, *dirs);
+		build.pathlen = strlen(build.path);
+		node = read_node(&build, *dirs);
+		build.path[len] = '\0';
+		if (!node) {
+			dprintf("Error reading %s/%s\n", build.path, *dirs);
+			continue;
+		}
+		if (add_child(root, node)) {
+			free_node(node);
+			goto out;
+		}
+	}
+	if (number_nodes(&build, root))
+		goto out;
+
+	tmp = (char *)malloc(strlen(file) + 8);
+	if (!tmp)
+		goto out;
+	strcpy(tmp, file);
+	strcat(tmp, ".XXXXXX");
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		dprintf("Error creating %s\n", tmp);
+		goto out;
+	}
+	fchmod(fd, 0644);
+	ret = write_snapshot(&build, fd);
+	if (close(fd))
+		ret = -1;
+	if (!ret && rename(tmp, file))
+		ret = -1;
+	if (ret) {
+		dprintf("Error writing %s\n", tmp);
+		err = errno;
+		unlink(tmp);
+		errno = err;
+	}
+out:
+	err = errno;
+	free(tmp);
+	free(build.order);
+	free(build.names);
+	free(build.hash);
+	free_node(root);
+	errno = err;
+	return ret;
+}
@@ -0,0 +1,164 @@
+/*
+ * sysfs_stats.c
+ *
+ * Counters of the work libsysfs does
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#include <time.h>
+
+#include "libsysfs.h"
+#include "sysfs.h"
+
+/*
+ * Each context keeps its own counters, and threads sharing a context add
+ * to them at once, so they go up with relaxed atomic adds: nothing is
+ * ordered by them, they only must not lose counts. With SYSFS_OPT_STATS
+ * off the hooks cost a test of the options and nothing else.
+ */
+
+static const char *stat_names[SYSFS_STAT_MAX] = {
+	[SYSFS_STAT_OPEN] = "open",
+	[SYSFS_STAT_READ] = "read",
+	[SYSFS_STAT_WRITE] = "write",
+	[SYSFS_STAT_STAT] = "stat",
+	[SYSFS_STAT_READLINK] = "readlink",
+	[SYSFS_STAT_BYTES_READ] = "bytes_read",
+	[SYSFS_STAT_DIRENTS] = "dirents",
+	[SYSFS_STAT_LINK_HITS] = "link_hits",
+	[SYSFS_STAT_LINK_MISSES] = "link_misses",
+	[SYSFS_STAT_ATTR_HITS] = "attr_hits",
+	[SYSFS_STAT_ATTR_MISSES] = "attr_misses",
+	[SYSFS_STAT_ALLOCS] = "allocs",
+	[SYSFS_STAT_LIST_INSERTS] = "list_inserts",
+	[SYSFS_STAT_LIST_SORTS] = "list_sorts",
+};
+
+static unsigned long long now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * stats_count: adds n to a counter of the calling thread's context, if
+ *	it has SYSFS_OPT_STATS set
+ */
+void stats_count(enum sysfs_stat stat, unsigned long long n)
+{
+	struct sysfs_stats *stats = context_stats(SYSFS_OPT_STATS);
+
+	if (stats)
+		__atomic_fetch_add(&stats->count[stat], n, __ATOMIC_RELAXED);
+}
+
+/**
+ * stats_begin: the time a system call is made at, for stats_end(), or 0
+ *	when the calling thread's context does not time them
+ */
+unsigned long long stats_begin(void)
+{
+	if (!context_stats(SYSFS_OPT_STATS | SYSFS_OPT_LATENCY))
+		return 0;
+	return now();
+}
+
+/**
+ * stats_end: counts a system call made, putting how long it took since
+ *	start in its histogram when start is not 0. Leaves errno alone, so
+ *	it can go between the call and the check of what it returned.
+ */
+void stats_end(enum sysfs_stat stat, unsigned long long start)
+{
+	struct sysfs_stats *stats = context_stats(SYSFS_OPT_STATS);
+	unsigned long long ns;
+	unsigned int bucket = 0;
+	int saved = errno;
+
+	if (!stats)
+		return;
+	__atomic_fetch_add(&stats->count[stat], 1, __ATOMIC_RELAXED);
+	if (start && stat < SYSFS_STAT_SYSCALLS) {
+		ns = now();
+		ns = ns > start ? ns - start : 0;
+		while (ns > 1 && bucket < SYSFS_STAT_BUCKETS - 1) {
+			ns >>= 1;
+			bucket++;
+		}
+		__atomic_fetch_add(&stats->latency[stat][bucket], 1,
+				__ATOMIC_RELAXED);
+	}
+	errno = saved;
+}
+
+/**
+ * sysfs_get_stats: copies what the calling thread's context has counted
+ *	since it was opened or sysfs_reset_stats() was last called
+ * @stats: where to copy the counters to
+ */
+void sysfs_get_stats(struct sysfs_stats *stats)
+{
+	struct sysfs_stats *cur = context_stats(0);
+	unsigned int i, j;
+
+	if (!stats) {
+		errno = EINVAL;
+		return;
+	}
+	for (i = 0; i < SYSFS_STAT_MAX; i++)
+		stats->count[i] = __atomic_load_n(&cur->count[i],
+				__ATOMIC_RELAXED);
+	for (i = 0; i < SYSFS_STAT_SYSCALLS; i++)
+		for (j = 0; j < SYSFS_STAT_BUCKETS; j++)
+			stats->latency[i][j] = __atomic_load_n(
+					&cur->latency[i][j], __ATOMIC_RELAXED);
+}
+
+/**
+ * sysfs_reset_stats: sets the calling thread's context's counters back
+ *	to 0
+ */
+void sysfs_reset_stats(void)
+{
+	struct sysfs_stats *cur = context_stats(0);
+	unsigned int i, j;
+
+	for (i = 0; i < SYSFS_STAT_MAX; i++)
+		__atomic_store_n(&cur->count[i], 0, __ATOMIC_RELAXED);
+	for (i = 0; i < SYSFS_STAT_SYSCALLS; i++)
+		for (j = 0; j < SYSFS_STAT_BUCKETS; j++)
+			__atomic_store_n(&cur->latency[i][j], 0,
+					__ATOMIC_RELAXED);
+}
+
+/**
+ * sysfs_stat_name: name of a counter, for printing
+ * @stat: the counter
+ * returns the name, or NULL if stat is no counter
+ */
+const char *sysfs_stat_name(enum sysfs_stat stat)
+{
+	if ((unsigned int)stat >= SYSFS_STAT_MAX) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return stat_names[stat];
+}
@@ -0,0 +1,681 @@
+/*
+ * sysfs_topology.c
+ *
+ * Reverse indexes of how devices, class devices, drivers and modules
+ * are tied together
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "libsysfs.h"
+#include "sysfs.h"
+
+/*
+ * sysfs only links one way: a class device to its device, a driver to
+ * its devices and module. Going the other way means opening everything
+ * on the other side, so a topology reads all the links once, into hash
+ * maps from each path to the sorted paths it's tied to, kept both ways
+ * so every question is one lookup and every uevent a few. All keys and
+ * values are full sysfs paths, as the sysfs_* structs hold them.
+ */
+struct topo_entry {
+	struct topo_entry *next;
+	unsigned int hash;
+	unsigned int count;
+	unsigned int size;
+	char **values;		/* count sorted paths, then NULL */
+	char key[];
+};
+
+#define TOPO_MIN_BUCKETS	256
+
+struct topo_map {
+	struct topo_entry **buckets;
+	size_t nbuckets;
+	size_t count;
+};
+
+struct sysfs_topology {
+	char root[SYSFS_PATH_MAX];
+	struct topo_map classdevs;	/* device -> its class devices */
+	struct topo_map device;		/* class device -> its device */
+	struct topo_map classdev;	/* class device's own dir -> it */
+	struct topo_map classdir;	/* class device -> its own dir */
+	struct topo_map driver;		/* device -> its driver */
+	struct topo_map devices;	/* driver -> its devices */
+	struct topo_map module;		/* driver -> its module */
+	struct topo_map drivers;	/* module -> its drivers */
+};
+
+static struct topo_entry *map_find(struct topo_map *map, const char *key)
+{
+	struct topo_entry *entry;
+	unsigned int hash;
+
+	if (!map->buckets)
+		return NULL;
+	hash = name_hash(key);
+	for (entry = map->buckets[hash & (map->nbuckets - 1)]; entry;
+			entry = entry->next)
+		if (entry->hash == hash && !strcmp(entry->key, key))
+			return entry;
+	return NULL;
+}
+
+/* doubles the table once it averages two entries a bucket */
+static void map_grow(struct topo_map *map)
+{
+	struct topo_entry **buckets, *entry, *next;
+	size_t nbuckets, i;
+
+	if (map->buckets && map->count < map->nbuckets * 2)
+		return;
+	nbuckets = map->buckets ? map->nbuckets * 2 : TOPO_MIN_BUCKETS;
+	buckets = (struct topo_entry **)calloc(nbuckets,
+			sizeof(struct topo_entry *));
+	if (!buckets) {
+		/* just longer chains */
+		dprintf("calloc failed\n");
+		return;
+	}
+	for (i = 0; i < map->nbuckets; i++) {
+		for (entry = map->buckets[i]; entry; entry = next) {
+			next = entry->next;
+			entry->next = buckets[entry->hash & (nbuckets - 1)];
+			buckets[entry->hash & (nbuckets - 1)] = entry;
+		}
+	}
+	free(map->buckets);
+	map->buckets = buckets;
+	map->nbuckets = nbuckets;
+}
+
+static void entry_free(struct topo_entry *entry)
+{
+	unsigned int i;
+
+	for (i = 0; i < entry->count; i++)
+		free(entry->values[i]);
+	free(entry->values);
+	free(entry);
+}
+
+/**
+ * map_add: ties value to key, keeping key's values sorted
+ * returns 0 with success and -1 with error.
+ */
+static int map_add(struct topo_map *map, const char *key, const char *value)
+{
+	struct topo_entry *entry;
+	unsigned int i, size;
+	size_t klen;
+	char **values;
+	int cmp = 1;
+
+	entry = map_find(map, key);
+	if (!entry) {
+		map_grow(map);
+		if (!map->buckets)
+			return -1;
+		klen = strlen(key) + 1;
+		entry = (struct topo_entry *)calloc(1,
+				sizeof(struct topo_entry) + klen);
+		if (!entry) {
+			dprintf("calloc failed\n");
+			return -1;
+		}
+		memcpy(entry->key, key, klen);
+		entry->hash = name_hash(key);
+		entry->next = map->buckets[entry->hash & (map->nbuckets - 1)];
+		map->buckets[entry->hash & (map->nbuckets - 1)] = entry;
+		map->count++;
+	}
+	for (i = 0; i < entry->count; i++) {
+		cmp = strcmp(entry->values[i], value);
+		if (cmp >= 0)
+			break;
+	}
+	if (!cmp)
+		return 0;
+	if (entry->count + 1 >= entry->size) {
+		size = entry->size ? entry->size * 2 : 2;
+		values = (char **)realloc(entry->values,
+				size * sizeof(char *));
+		if (!values) {
+			dprintf("realloc failed\n");
+			return -1;
+		}
+		entry->values = values;
+		entry->size = size;
+	}
+	memmove(&entry->values[i + 1], &entry->values[i],
+			(entry->count - i) * sizeof(char *));
+	entry->values[i] = strdup(value);
+	if (!entry->values[i]) {
+		memmove(&entry->values[i], &entry->values[i + 1],
+				(entry->count - i) * sizeof(char *));
+		entry->values[entry->count] = NULL;
+		return -1;
+	}
+	entry->values[++entry->count] = NULL;
+	return 0;
+}
+
+/**
+ * map_drop: unties key from everything, or from value only if not NULL
+ */
+static void map_drop(struct topo_map *map, const char *key, const char *value)
+{
+	struct topo_entry *entry, **prev;
+	unsigned int hash, i;
+
+	if (!map->buckets)
+		return;
+	hash = name_hash(key);
+	for (prev = &map->buckets[hash & (map->nbuckets - 1)]; *prev;
+			prev = &(*prev)->next)
+		if ((*prev)->hash == hash && !strcmp((*prev)->key, key))
+			break;
+	entry = *prev;
+	if (!entry)
+		return;
+	if (value) {
+		for (i = 0; i < entry->count; i++) {
+			if (!strcmp(entry->values[i], value)) {
+				free(entry->values[i]);
+				memmove(&entry->values[i],
+					&entry->values[i + 1],
+					(entry->count - i) * sizeof(char *));
+				entry->count--;
+				break;
+			}
+		}
+		if (entry->count)
+			return;
+	}
+	*prev = entry->next;
+	map->count--;
+	entry_free(entry);
+}
+
+static void map_free(struct topo_map *map)
+{
+	struct topo_entry *entry, *next;
+	size_t i;
+
+	for (i = 0; i < map->nbuckets; i++) {
+		for (entry = map->buckets[i]; entry; entry = next) {
+			next = entry->next;
+			entry_free(entry);
+		}
+	}
+	free(map->buckets);
+	memset(map, 0, sizeof(struct topo_map));
+}
+
+static const char **map_values(struct topo_map *map, const char *key)
+{
+	struct topo_entry *entry = map_find(map, key);
+
+	return entry && entry->count ? (const char **)entry->values : NULL;
+}
+
+static const char *map_value(struct topo_map *map, const char *key)
+{
+	struct topo_entry *entry = map_find(map, key);
+
+	return entry && entry->count ? entry->values[0] : NULL;
+}
+
+/*
+ * Ties one path to another both ways, the first to just the one, and
+ * unties them again. The key of one map is then always a value of the
+ * other, so dropping it there has it to hand.
+ */
+static void untie(struct topo_map *one, const char *key,
+		struct topo_map *many);
+
+static int tie(struct topo_map *one, const char *key, struct topo_map *many,
+		const char *value)
+{
+	untie(one, key, many);
+	if (map_add(one, key, value))
+		return -1;
+	if (map_add(many, value, key)) {
+		map_drop(one, key, NULL);
+		return -1;
+	}
+	return 0;
+}
+
+static void untie(struct topo_map *one, const char *key, struct topo_map *many)
+{
+	const char *value = map_value(one, key);
+
+	if (value)
+		map_drop(many, value, key);
+	map_drop(one, key, NULL);
+}
+
+/* unties every value of key in many from key */
+static void untie_all(struct topo_map *many, const char *key,
+		struct topo_map *one)
+{
+	struct topo_entry *entry = map_find(many, key);
+	unsigned int i;
+
+	if (!entry)
+		return;
+	for (i = 0; i < entry->count; i++)
+		map_drop(one, entry->values[i], NULL);
+	map_drop(many, key, NULL);
+}
+
+/* path of the link name under dir resolved into target, 0 with success */
+static int link_under(const char *dir, const char *name, char *target)
+{
+	char path[SYSFS_PATH_MAX];
+
+	safestrcpy(path, dir);
+	safestrcat(path, "/");
+	safestrcat(path, name);
+	return sysfs_get_link(path, target, SYSFS_PATH_MAX);
+}
+
+/**
+ * scan_class_device: ties the class device at path to its device
+ * returns 0 with success and -1 with error.
+ */
+static int scan_class_device(struct sysfs_topology *topo, const char *path)
+{
+	char target[SYSFS_PATH_MAX];
+
+	/* nested classes and old style class devices aren't links */
+	if (!sysfs_path_is_link(path) &&
+			!sysfs_get_link(path, target, SYSFS_PATH_MAX) &&
+			tie(&topo->classdir, path, &topo->classdev, target))
+		return -1;
+	if (!link_under(path, "device", target) &&
+			tie(&topo->device, path, &topo->classdevs, target))
+		return -1;
+	return 0;
+}
+
+/**
+ * scan_driver: ties the driver at path to its module and devices
+ * returns 0 with success and -1 with error.
+ */
+static int scan_driver(struct sysfs_topology *topo, const char *path)
+{
+	char target[SYSFS_PATH_MAX];
+	struct dlist *linklist;
+	char *ln;
+	int ret = 0;
+
+	linklist = read_dir_links(path, NULL);
+	if (!linklist)
+		return 0;
+	dlist_for_each_data(linklist, ln, char) {
+		if (link_under(path, ln, target))
+			continue;
+		if (!strcmp(ln, SYSFS_MODULE_NAME))
+			ret = tie(&topo->module, path, &topo->drivers, target);
+		else
+			ret = tie(&topo->driver, target, &topo->devices, path);
+		if (ret)
+			break;
+	}
+	sysfs_close_list(linklist);
+	return ret;
+}
+
+/**
+ * scan_device: ties the device at path to its driver, and the driver to
+ *	its module if that's not known yet
+ * returns 0 with success and -1 with error.
+ */
+static int scan_device(struct sysfs_topology *topo, const char *path)
+{
+	char driver[SYSFS_PATH_MAX], module[SYSFS_PATH_MAX];
+
+	if (link_under(path, "driver", driver))
+		return 0;
+	if (tie(&topo->driver, path, &topo->devices, driver))
+		return -1;
+	if (!map_find(&topo->module, driver) &&
+			!link_under(driver, SYSFS_MODULE_NAME, module))
+		return tie(&topo->module, driver, &topo->drivers, module);
+	return 0;
+}
+
+/**
+ * scan_subdirs: calls scan on path/<subdir>[/under] for each subdir
+ * returns 0 with success and -1 with error.
+ */
+static int scan_subdirs(struct sysfs_topology *topo, const char *path,
+		const char *under,
+		int (*scan)(struct sysfs_topology *, const char *))
+{
+	char subpath[SYSFS_PATH_MAX];
+	struct dlist *dirlist;
+	char *name;
+	int ret = 0;
+
+	dirlist = read_dir_subdirs(path, NULL);
+	if (!dirlist)
+		return 0;
+	dlist_for_each_data(dirlist, name, char) {
+		safestrcpy(subpath, path);
+		safestrcat(subpath, "/");
+		safestrcat(subpath, name);
+		if (under) {
+			safestrcat(subpath, "/");
+			safestrcat(subpath, under);
+		}
+		if (scan(topo, subpath)) {
+			ret = -1;
+			break;
+		}
+	}
+	sysfs_close_list(dirlist);
+	return ret;
+}
+
+/* the class devices of the class at path, links and directories */
+static int scan_class(struct sysfs_topology *topo, const char *path)
+{
+	char cdev[SYSFS_PATH_MAX];
+	struct dlist *linklist;
+	char *ln;
+	int ret = 0;
+
+	if (scan_subdirs(topo, path, NULL, scan_class_device))
+		return -1;
+	linklist = read_dir_links(path, NULL);
+	if (!linklist)
+		return 0;
+	dlist_for_each_data(linklist, ln, char) {
+		safestrcpy(cdev, path);
+		safestrcat(cdev, "/");
+		safestrcat(cdev, ln);
+		ret = scan_class_device(topo, cdev);
+		if (ret)
+			break;
+	}
+	sysfs_close_list(linklist);
+	return ret;
+}
+
+/* the drivers of the bus at path */
+static int scan_bus(struct sysfs_topology *topo, const char *path)
+{
+	return scan_subdirs(topo, path, NULL, scan_driver);
+}
+
+/**
+ * sysfs_open_topology: reads how the devices, class devices, drivers and
+ *	modules on the system are tied to each other, in one pass over the
+ *	classes and buses
+ * returns the topology with success and NULL with error.
+ */
+struct sysfs_topology *sysfs_open_topology(void)
+{
+	struct sysfs_topology *topo;
+	char path[SYSFS_PATH_MAX];
+
+	topo = (struct sysfs_topology *)calloc(1,
+			sizeof(struct sysfs_topology));
+	if (!topo) {
+		dprintf("calloc failed\n");
+		return NULL;
+	}
+	if (sysfs_get_mnt_path(topo->root, SYSFS_PATH_MAX)) {
+		dprintf("Sysfs not supported on this system\n");
+		free(topo);
+		return NULL;
+	}
+	safestrcpy(path, topo->root);
+	safestrcat(path, "/");
+	safestrcat(path, SYSFS_CLASS_NAME);
+	if (scan_subdirs(topo, path, NULL, scan_class))
+		goto error;
+	safestrcpy(path, topo->root);
+	safestrcat(path, "/");
+	safestrcat(path, SYSFS_BUS_NAME);
+	if (scan_subdirs(topo, path, SYSFS_DRIVERS_NAME, scan_bus))
+		goto error;
+	return topo;
+
+error:
+	sysfs_close_topology(topo);
+	return NULL;
+}
+
+/**
+ * sysfs_close_topology: frees a topology and every path in it
+ */
+void sysfs_close_topology(struct sysfs_topology *topo)
+{
+	if (!topo)
+		return;
+	map_free(&topo->classdevs);
+	map_free(&topo->device);
+	map_free(&topo->classdev);
+	map_free(&topo->classdir);
+	map_free(&topo->driver);
+	map_free(&topo->devices);
+	map_free(&topo->module);
+	map_free(&topo->drivers);
+	free(topo);
+}
+
+/* untie a class device at path, going by the class device's own dir */
+static void forget_class_device(struct sysfs_topology *topo, const char *path)
+{
+	untie(&topo->device, path, &topo->classdevs);
+	untie(&topo->classdir, path, &topo->classdev);
+}
+
+/**
+ * sysfs_update_topology: brings a topology up to date with a uevent, as
+ *	sysfs_read_watch() passes them to callbacks
+ * @topo: topology to update
+ * @event: uevent that came in
+ * returns 0 with success and -1 with error.
+ */
+int sysfs_update_topology(struct sysfs_topology *topo,
+		const struct sysfs_uevent *event)
+{
+	char path[SYSFS_PATH_MAX];
+	const char *cdev, *name;
+	int gone;
+
+	if (!topo || !event || !event->devpath[0]) {
+		errno = EINVAL;
+		return -1;
+	}
+	gone = !strcmp(event->action, "remove");
+
+	if (!strcmp(event->subsystem, SYSFS_MODULE_NAME)) {
+		if (gone)
+			untie_all(&topo->drivers, event->devpath,
+					&topo->module);
+		return 0;
+	}
+	if (!strcmp(event->subsystem, SYSFS_DRIVERS_NAME)) {
+		untie_all(&topo->devices, event->devpath, &topo->driver);
+		untie(&topo->module, event->devpath, &topo->drivers);
+		return gone ? 0 : scan_driver(topo, event->devpath);
+	}
+
+	if (event->devpath_old[0]) {
+		cdev = map_value(&topo->classdev, event->devpath_old);
+		if (cdev) {
+			safestrcpy(path, cdev);
+			forget_class_device(topo, path);
+		}
+		untie_all(&topo->classdevs, event->devpath_old,
+				&topo->device);
+		untie(&topo->driver, event->devpath_old, &topo->devices);
+	}
+
+	/* class devices are known by their dir, their link may be gone */
+	cdev = map_value(&topo->classdev, event->devpath);
+	if (cdev) {
+		safestrcpy(path, cdev);
+		forget_class_device(topo, path);
+	} else {
+		name = strrchr(event->devpath, '/');
+		safestrcpy(path, topo->root);
+		safestrcat(path, "/");
+		safestrcat(path, SYSFS_CLASS_NAME);
+		safestrcat(path, "/");
+		safestrcat(path, event->subsystem);
+		if (!event->subsystem[0] || !name || sysfs_path_is_dir(path))
+			path[0] = '\0';
+		else
+			safestrcat(path, name);
+	}
+	if (path[0])
+		return gone ? 0 : scan_class_device(topo, path);
+
+	untie(&topo->driver, event->devpath, &topo->devices);
+	if (gone) {
+		untie_all(&topo->classdevs, event->devpath, &topo->device);
+		return 0;
+	}
+	return scan_device(topo, event->devpath);
+}
+
+/**
+ * sysfs_topology_class_devices: class devices of a device
+ * @topo: topology to look in
+ * @devpath: path of the device
+ * returns the NULL terminated, sorted class device paths, NULL if there
+ *	are none.
+ */
+const char **sysfs_topology_class_devices(struct sysfs_topology *topo,
+		const char *devpath)
+{
+	if (!topo || !devpath) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return map_values(&topo->classdevs, devpath);
+}
+
+/**
+ * sysfs_topology_device: device a class device belongs to
+ * @topo: topology to look in
+ * @cdevpath: path of the class device, under the class
+ * returns the device path, NULL if it has none.
+ */
+const char *sysfs_topology_device(struct sysfs_topology *topo,
+		const char *cdevpath)
+{
+	if (!topo || !cdevpath) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return map_value(&topo->device, cdevpath);
+}
+
+/**
+ * sysfs_topology_class_device: class device whose own directory path is
+ * @topo: topology to look in
+ * @path: path of a directory under the devices
+ * returns the class device's path, under its class, NULL if path isn't
+ *	a class device.
+ */
+const char *sysfs_topology_class_device(struct sysfs_topology *topo,
+		const char *path)
+{
+	if (!topo || !path) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return map_value(&topo->classdev, path);
+}
+
+/**
+ * sysfs_topology_driver: driver bound to a device
+ * @topo: topology to look in
+ * @devpath: path of the device
+ * returns the driver's path, NULL if there's none bound.
+ */
+const char *sysfs_topology_driver(struct sysfs_topology *topo,
+		const char *devpath)
+{
+	if (!topo || !devpath) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return map_value(&topo->driver, devpath);
+}
+
+/**
+ * sysfs_topology_driver_devices: devices bound to a driver
+ * @topo: topology to look in
+ * @drvpath: path of the driver
+ * returns the NULL terminated, sorted device paths, NULL if there are
+ *	none.
+ */
+const char **sysfs_topology_driver_devices(struct sysfs_topology *topo,
+		const char *drvpath)
+{
+	if (!topo || !drvpath) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return map_values(&topo->devices, drvpath);
+}
+
+/**
+ * sysfs_topology_module: module a driver comes with
+ * @topo: topology to look in
+ * @drvpath: path of the driver
+ * returns the module's path, NULL if the driver is built in.
+ */
+const char *sysfs_topology_module(struct sysfs_topology *topo,
+		const char *drvpath)
+{
+	if (!topo || !drvpath) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return map_value(&topo->module, drvpath);
+}
+
+/**
+ * sysfs_topology_module_drivers: drivers of a module
+ * @topo: topology to look in
+ * @modpath: path of the module
+ * returns the NULL terminated, sorted driver paths, NULL if there are
+ *	none.
+ */
+const char **sysfs_topology_module_drivers(struct sysfs_topology *topo,
+		const char *modpath)
+{
+	if (!topo || !modpath) {
+		errno = EINVAL;
+		return NULL;
+	}
+	return map_values(&topo->drivers, modpath);
+}
@@ -0,0 +1,294 @@
+/*
+ * sysfs_tree.c
+ *
+ * Multi-threaded device tree reading for libsysfs
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "libsysfs.h"
+#include "sysfs.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+
+/*
+ * Every worker keeps a queue of devices whose children still have to be
+ * opened. It works LIFO off the tail of its own queue, so it goes depth
+ * first through the part of the tree it has, and steals FIFO from the
+ * head of the others, which is where the biggest untouched subtrees are.
+ * Each device is expanded by exactly one worker, so its children list is
+ * built by one thread only and comes out sorted as read_dir_subdirs()
+ * returns them.
+ */
+struct tree_queue {
+	pthread_mutex_t lock;
+	struct sysfs_device **devs;
+	size_t head, tail, size;
+};
+
+struct tree_walk;
+
+struct tree_worker {
+	struct tree_walk *walk;
+	struct tree_queue queue;
+	struct sysfs_arena *arena;	/* NULL unless SYSFS_OPT_ARENA */
+	unsigned int id;
+	pthread_t thread;
+};
+
+struct tree_walk {
+	struct tree_worker *workers;
+	unsigned int nworkers;
+	struct sysfs_context *context;	/* the caller's, for every worker */
+	pthread_mutex_t lock;		/* protects the counts */
+	pthread_cond_t wake;		/* work was queued, or all is done */
+	unsigned long queued;		/* devices waiting on some queue */
+	unsigned long busy;		/* devices being expanded */
+	int failed;
+};
+
+static int queue_push(struct tree_queue *queue, struct sysfs_device *dev)
+{
+	struct sysfs_device **devs;
+	size_t size;
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->tail == queue->size) {
+		if (queue->head) {
+			memmove(queue->devs, queue->devs + queue->head,
+				(queue->tail - queue->head) *
+				sizeof(struct sysfs_device *));
+			queue->tail -= queue->head;
+			queue->head = 0;
+		} else {
+			size = queue->size ? queue->size * 2 : 64;
+			devs = (struct sysfs_device **)realloc(queue->devs,
+					size * sizeof(struct sysfs_device *));
+			if (!devs) {
+				dprintf("realloc failed\n");
+				pthread_mutex_unlock(&queue->lock);
+				return -1;
+			}
+			queue->devs = devs;
+			queue->size = size;
+		}
+	}
+	queue->devs[queue->tail++] = dev;
+	pthread_mutex_unlock(&queue->lock);
+	return 0;
+}
+
+static struct sysfs_device *queue_take(struct tree_queue *queue, int steal)
+{
+	struct sysfs_device *dev = NULL;
+
+	pthread_mutex_lock(&queue->lock);
+	if (queue->head < queue->tail) {
+		if (steal)
+			dev = queue->devs[queue->head++];
+		else
+			dev = queue->devs[--queue->tail];
+		if (queue->head == queue->tail)
+			queue->head = queue->tail = 0;
+	}
+	pthread_mutex_unlock(&queue->lock);
+	return dev;
+}
+
+/**
+ * walk_push: queue dev on worker's queue for its children to be read
+ * returns 0 with success and -1 with error.
+ */
+static int walk_push(struct tree_worker *worker, struct sysfs_device *dev)
+{
+	struct tree_walk *walk = worker->walk;
+
+	/* counted first, so nobody can take it before it's counted */
+	pthread_mutex_lock(&walk->lock);
+	walk->queued++;
+	pthread_cond_signal(&walk->wake);
+	pthread_mutex_unlock(&walk->lock);
+	if (queue_push(&worker->queue, dev)) {
+		pthread_mutex_lock(&walk->lock);
+		walk->queued--;
+		pthread_mutex_unlock(&walk->lock);
+		__atomic_store_n(&walk->failed, 1, __ATOMIC_RELAXED);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * walk_take: next device for worker, off its own queue or stolen
+ */
+static struct sysfs_device *walk_take(struct tree_worker *worker)
+{
+	struct tree_walk *walk = worker->walk;
+	struct sysfs_device *dev;
+	unsigned int i;
+
+	dev = queue_take(&worker->queue, 0);
+	for (i = 1; !dev && i < walk->nworkers; i++)
+		dev = queue_take(&walk->workers[(worker->id + i) %
+				walk->nworkers].queue, 1);
+	if (dev) {
+		pthread_mutex_lock(&walk->lock);
+		walk->queued--;
+		walk->busy++;
+		pthread_mutex_unlock(&walk->lock);
+	}
+	return dev;
+}
+
+static void *tree_worker_run(void *arg)
+{
+	struct tree_worker *worker = (struct tree_worker *)arg;
+	struct tree_walk *walk = worker->walk;
+	struct sysfs_device *dev, *child;
+	struct sysfs_context *prevctx;
+	struct sysfs_arena *prev;
+	int done;
+
+	prevctx = sysfs_use_context(walk->context);
+	prev = arena_enter(worker->arena);
+	for (;;) {
+		dev = walk_take(worker);
+		if (!dev) {
+			pthread_mutex_lock(&walk->lock);
+			while (!walk->queued && walk->busy)
+				pthread_cond_wait(&walk->wake, &walk->lock);
+			done = !walk->queued && !walk->busy;
+			pthread_mutex_unlock(&walk->lock);
+			if (done)
+				break;
+			continue;
+		}
+
+		/* after an error the rest of the queue is just drained */
+		if (!__atomic_load_n(&walk->failed, __ATOMIC_RELAXED)) {
+			if (read_device_children(dev)) {
+				__atomic_store_n(&walk->failed, 1,
+						__ATOMIC_RELAXED);
+			} else if (dev->children) {
+				dlist_for_each_data(dev->children, child,
+						struct sysfs_device)
+					if (walk_push(worker, child))
+						break;
+			}
+		}
+
+		pthread_mutex_lock(&walk->lock);
+		walk->busy--;
+		if (!walk->busy && !walk->queued)
+			pthread_cond_broadcast(&walk->wake);
+		pthread_mutex_unlock(&walk->lock);
+	}
+	arena_leave(prev);
+	sysfs_use_context(prevctx);
+	return NULL;
+}
+
+/**
+ * parallel_device_tree: opens all the devices below root, each just once,
+ *	with up to threads threads including the calling one
+ * returns 0 with success and -1 with error.
+ */
+int parallel_device_tree(struct sysfs_device *root, unsigned int threads)
+{
+	struct sysfs_arena *arena = arena_current();
+	struct tree_walk walk;
+	struct tree_worker *worker;
+	unsigned int i, started;
+
+	memset(&walk, 0, sizeof(struct tree_walk));
+	walk.workers = (struct tree_worker *)calloc(threads,
+			sizeof(struct tree_worker));
+	if (!walk.workers) {
+		dprintf("calloc failed\n");
+		return -1;
+	}
+	pthread_mutex_init(&walk.lock, NULL);
+	pthread_cond_init(&walk.wake, NULL);
+	walk.nworkers = threads;
+	walk.context = context_in_use();
+	for (i = 0; i < threads; i++) {
+		worker = &walk.workers[i];
+		worker->walk = &walk;
+		worker->id = i;
+		pthread_mutex_init(&worker->queue.lock, NULL);
+	}
+
+	/*
+	 * Arenas aren't thread safe, so with SYSFS_OPT_ARENA every other
+	 * worker adds to one of its own that goes with the caller's.
+	 * Workers that don't get started just leave their queues empty.
+	 */
+	walk.workers[0].arena = arena;
+	/* queued before anyone starts, or they would find nothing to do */
+	if (walk_push(&walk.workers[0], root))
+		threads = 1;
+	for (started = 1; started < threads; started++) {
+		worker = &walk.workers[started];
+		if (arena) {
+			worker->arena = arena_new();
+			if (!worker->arena)
+				break;
+			arena_adopt(arena, worker->arena);
+		}
+		if (pthread_create(&worker->thread, NULL, tree_worker_run,
+					worker)) {
+			dprintf("Error starting tree worker\n");
+			break;
+		}
+	}
+
+	tree_worker_run(&walk.workers[0]);
+	for (i = 1; i < started; i++)
+		pthread_join(walk.workers[i].thread, NULL);
+
+	for (i = 0; i < walk.nworkers; i++) {
+		free(walk.workers[i].queue.devs);
+		pthread_mutex_destroy(&walk.workers[i].queue.lock);
+	}
+	pthread_cond_destroy(&walk.wake);
+	pthread_mutex_destroy(&walk.lock);
+	free(walk.workers);
+	return walk.failed ? -1 : 0;
+}
+
+#else
+
+/* no threads to be had, read the tree in the calling thread */
+int parallel_device_tree(struct sysfs_device *root, unsigned int threads)
+{
+	struct sysfs_device *child;
+
+	(void)threads;
+	if (read_device_children(root))
+		return -1;
+	if (root->children)
+		dlist_for_each_data(root->children, child, struct sysfs_device)
+			if (parallel_device_tree(child, threads))
+				return -1;
+	return 0;
+}
+
+#endif
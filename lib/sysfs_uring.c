@@ -0,0 +1,342 @@
+/*
+ * sysfs_uring.c
+ *
+ * Batched attribute reads through io_uring for libsysfs
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "libsysfs.h"
+#include "sysfs.h"
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(__NR_io_uring_setup)
+
+/* most reads in flight at once, also the size of the ring */
+#define SYSFS_URING_ENTRIES	256
+
+/* failed waits for the reads of a batch before they're given up on */
+#define SYSFS_URING_DRAIN_TRIES	8
+
+/*
+ * A context keeps the ring it last read with, so polling the same
+ * attributes tick after tick sets one up only the first time. A thread
+ * takes the ring out of the context while it reads and puts it back
+ * after; another thread reading in the same context meanwhile finds none
+ * and sets up one of its own, of which only one is kept. A ring that may
+ * still have reads in flight or queued is never put back.
+ */
+
+struct sysfs_uring {
+	int fd;
+	void *sq_ring, *cq_ring;
+	size_t sq_size, cq_size, sqes_size;
+	struct io_uring_sqe *sqes;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+	unsigned entries;
+};
+
+/**
+ * uring_free: tears down a ring, cancelling whatever it still has in
+ *	flight
+ */
+void uring_free(struct sysfs_uring *ring)
+{
+	if (!ring)
+		return;
+	if (ring->sqes)
+		munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_size);
+	if (ring->sq_ring)
+		munmap(ring->sq_ring, ring->sq_size);
+	if (ring->fd >= 0)
+		close(ring->fd);
+	free(ring);
+}
+
+/**
+ * uring_open: set up an io_uring with room for entries reads
+ * @entries: number of submission queue entries wanted
+ * returns the ring with success and NULL if io_uring isn't available.
+ */
+static struct sysfs_uring *uring_open(unsigned entries)
+{
+	struct io_uring_params params;
+	struct sysfs_uring *ring;
+	char *sq, *cq;
+
+	ring = (struct sysfs_uring *)calloc(1, sizeof(struct sysfs_uring));
+	if (!ring)
+		return NULL;
+	memset(&params, 0, sizeof(struct io_uring_params));
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0) {
+		dprintf("io_uring_setup failed\n");
+		free(ring);
+		return NULL;
+	}
+	ring->entries = params.sq_entries;
+	ring->sq_size = params.sq_off.array +
+			params.sq_entries * sizeof(unsigned);
+	ring->cq_size = params.cq_off.cqes +
+			params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_size > ring->sq_size)
+			ring->sq_size = ring->cq_size;
+		ring->cq_size = ring->sq_size;
+	}
+	ring->sq_ring = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED) {
+		ring->sq_ring = NULL;
+		goto fail;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP)
+		ring->cq_ring = ring->sq_ring;
+	else {
+		ring->cq_ring = mmap(NULL, ring->cq_size,
+				PROT_READ | PROT_WRITE,	MAP_SHARED |
+				MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED) {
+			ring->cq_ring = NULL;
+			goto fail;
+		}
+	}
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto fail;
+	}
+
+	sq = (char *)ring->sq_ring;
+	cq = (char *)ring->cq_ring;
+	ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+	ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+	ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+	ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+	ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+	ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+	return ring;
+
+fail:
+	dprintf("io_uring mmap failed\n");
+	uring_free(ring);
+	return NULL;
+}
+
+/**
+ * uring_submit: hand everything queued on the ring to the kernel
+ * returns 0 with success and -1 with error.
+ */
+static int uring_submit(struct sysfs_uring *ring)
+{
+	unsigned pending;
+
+	for (;;) {
+		pending = *ring->sq_tail -
+			__atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+		if (pending == 0)
+			return 0;
+		if (syscall(__NR_io_uring_enter, ring->fd, pending, 0, 0,
+					NULL, 0) < 0 && errno != EINTR) {
+			dprintf("io_uring_enter failed\n");
+			return -1;
+		}
+	}
+}
+
+/**
+ * uring_wait: get the next completion, waiting for it if need be
+ * returns the completion with success and NULL with error.
+ */
+static struct io_uring_cqe *uring_wait(struct sysfs_uring *ring)
+{
+	unsigned head = *ring->cq_head;
+
+	while (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		if (syscall(__NR_io_uring_enter, ring->fd, 0, 1,
+				IORING_ENTER_GETEVENTS, NULL, 0) < 0 &&
+				errno != EINTR) {
+			dprintf("io_uring_enter failed\n");
+			return NULL;
+		}
+	}
+	return &ring->cqes[head & *ring->cq_mask];
+}
+
+/**
+ * uring_reap: applies the completion the ring has next to the attribute
+ *	it was for, and moves past it
+ */
+static void uring_reap(struct sysfs_uring *ring, struct io_uring_cqe *cqe,
+		struct sysfs_attribute **attrs, int *failed)
+{
+	struct sysfs_attribute *attr = attrs[cqe->user_data];
+
+	stats_count(SYSFS_STAT_READ, 1);
+	if (cqe->res >= 0 && (size_t)cqe->res < attr->bufsize - 1) {
+		stats_count(SYSFS_STAT_BYTES_READ, cqe->res);
+		held_attribute_update(attr, cqe->res);
+	} else if (cqe->res >= 0 || cqe->res == -EINVAL) {
+		/*
+		 * a value that filled the buffer may go on past it, and
+		 * kernels without IORING_OP_READ say EINVAL: both are read
+		 * again with pread(), growing the buffers as need be
+		 */
+		if (cqe->res >= 0)
+			stats_count(SYSFS_STAT_BYTES_READ, cqe->res);
+		if (read_held_attribute(attr))
+			(*failed)++;
+	} else {
+		dprintf("Error reading from attribute %s\n", attr->path);
+		errno = -cqe->res;
+		(*failed)++;
+	}
+	__atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * uring_drain: reaps the left reads of a batch whose wait failed, as far
+ *	as the kernel lets it
+ * returns 0 if every one was reaped and -1 if some may still be in
+ *	flight, each of those counted in *failed.
+ */
+static int uring_drain(struct sysfs_uring *ring, unsigned left,
+		struct sysfs_attribute **attrs, int *failed)
+{
+	struct io_uring_cqe *cqe;
+	int tries = 0;
+
+	while (left > 0) {
+		cqe = uring_wait(ring);
+		if (!cqe) {
+			if (++tries == SYSFS_URING_DRAIN_TRIES) {
+				*failed += left;
+				return -1;
+			}
+			continue;
+		}
+		uring_reap(ring, cqe, attrs, failed);
+		left--;
+	}
+	return 0;
+}
+
+/**
+ * uring_read_attributes: read a set of held attributes through io_uring
+ * @attrs: held attributes with spare buffers to read
+ * @count: number of attributes in attrs
+ * @failed: incremented for every attribute that could not be read
+ * returns the number of attributes dealt with, starting from the first.
+ *	The rest, all of them if io_uring isn't available, are left to
+ *	the caller.
+ */
+int uring_read_attributes(struct sysfs_attribute **attrs, int count,
+		int *failed)
+{
+	struct sysfs_uring *ring;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	unsigned head, tail, idx, n, i;
+	int done = 0, broken = 0;
+
+	if (count <= 0)
+		return 0;
+	ring = context_take_uring();
+	if (!ring)
+		ring = uring_open(SYSFS_URING_ENTRIES);
+	if (!ring)
+		return 0;
+
+	while (done < count && !broken) {
+		n = count - done;
+		if (n > ring->entries)
+			n = ring->entries;
+
+		head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+		tail = *ring->sq_tail;
+		for (i = 0; i < n; i++) {
+			idx = tail & *ring->sq_mask;
+			sqe = &ring->sqes[idx];
+			memset(sqe, 0, sizeof(struct io_uring_sqe));
+			sqe->opcode = IORING_OP_READ;
+			sqe->fd = attrs[done + i]->fd;
+			sqe->addr = (unsigned long)attrs[done + i]->rbuf;
+			sqe->len = attrs[done + i]->bufsize - 1;
+			sqe->off = 0;
+			sqe->user_data = done + i;
+			ring->sq_array[idx] = idx;
+			tail++;
+		}
+		__atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+		if (uring_submit(ring)) {
+			/* only reap what the kernel took, and leave the rest */
+			n = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) -
+				head;
+			broken = 1;
+		}
+
+		for (i = 0; i < n; i++) {
+			cqe = uring_wait(ring);
+			if (!cqe) {
+				uring_drain(ring, n - i, attrs, failed);
+				broken = 1;
+				break;
+			}
+			uring_reap(ring, cqe, attrs, failed);
+		}
+		done += n;
+	}
+	if (broken)
+		uring_free(ring);
+	else
+		context_put_uring(ring);
+	return done;
+}
+
+#else
+
+int uring_read_attributes(struct sysfs_attribute **attrs, int count,
+		int *failed)
+{
+	(void)attrs;
+	(void)count;
+	(void)failed;
+	return 0;
+}
+
+void uring_free(struct sysfs_uring *ring)
+{
+	(void)ring;
+}
+
+#endif
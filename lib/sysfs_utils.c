@@ -20,8 +20,329 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  *
  */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
 #include "libsysfs.h"
 #include "sysfs.h"
+#include <fnmatch.h>
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/*
+ * Everything the library keeps from one call to the next hangs off a
+ * context: the sysfs root, the options, the thread count and the link
+ * cache. Each thread works in the context it last passed to
+ * sysfs_use_context(), or in the default one until it does.
+ *
+ * The root is resolved when a context is set up, and for the default
+ * context once per process: SYSFS_PATH if it is set, SYSFS_MNT_PATH
+ * otherwise. A directory fd on it lets lookups under the root go through
+ * the *at() calls instead of walking the whole path. When the root is a
+ * snapshot file instead, lookups under it go to the snapshot and there
+ * is no fd. A view names a snapshot that is replaced now and then, and
+ * the context keeps the one it found until sysfs_refresh_context().
+ */
+struct sysfs_context {
+	char root[SYSFS_PATH_MAX];
+	size_t rootlen;
+	int rootfd;
+	struct snapshot *snapshot;
+	unsigned int options;
+	unsigned int threads;
+	struct link_cache *links;	/* NULL for the default context's */
+	struct sysfs_uring *uring;	/* kept for sysfs_read_attributes() */
+	struct sysfs_stats stats;	/* kept with SYSFS_OPT_STATS */
+};
+
+static struct sysfs_context default_context = {
+	.rootfd = -1,
+	.threads = 1,
+};
+#ifdef HAVE_PTHREAD_H
+static pthread_once_t default_context_once = PTHREAD_ONCE_INIT;
+#else
+static int default_context_done;
+#endif
+/* NULL while the thread is in the default context */
+static __thread struct sysfs_context *current_context;
+
+/**
+ * open_root: points ctx at the sysfs root at path
+ * returns 0 with success and -1 with error.
+ */
+static int open_root(struct sysfs_context *ctx, const char *path)
+{
+	struct stat astats;
+	int flags = O_RDONLY;
+
+	safestrcpy(ctx->root, path);
+	sysfs_remove_trailing_slash(ctx->root);
+	ctx->rootlen = strlen(ctx->root);
+	if (ctx->rootlen == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (!stat(ctx->root, &astats) && S_ISREG(astats.st_mode)) {
+		ctx->snapshot = snapshot_load(ctx->root, ctx->root);
+		if (!ctx->snapshot) {
+			dprintf("Error loading snapshot %s\n", ctx->root);
+			return -1;
+		}
+		return 0;
+	}
+#ifdef O_PATH
+	flags = O_PATH;
+#endif
+#ifdef O_DIRECTORY
+	flags |= O_DIRECTORY;
+#endif
+#ifdef O_CLOEXEC
+	flags |= O_CLOEXEC;
+#endif
+	ctx->rootfd = open(ctx->root, flags);
+	if (ctx->rootfd < 0) {
+		dprintf("Error opening sysfs root %s\n", ctx->root);
+		return -1;
+	}
+	return 0;
+}
+
+static const char *default_root(void)
+{
+	const char *sysfs_path_env;
+
+	/* possible overrride of real mount path */
+	sysfs_path_env = getenv(SYSFS_PATH_ENV);
+	return sysfs_path_env ? sysfs_path_env : SYSFS_MNT_PATH;
+}
+
+static void init_default_context(void)
+{
+	/* without a root, paths are just used as they are */
+	open_root(&default_context, default_root());
+}
+
+/**
+ * get_context: the context the calling thread is in
+ */
+static struct sysfs_context *get_context(void)
+{
+	if (current_context)
+		return current_context;
+#ifdef HAVE_PTHREAD_H
+	pthread_once(&default_context_once, init_default_context);
+#else
+	if (!default_context_done) {
+		init_default_context();
+		default_context_done = 1;
+	}
+#endif
+	return &default_context;
+}
+
+/**
+ * context_in_use: the context the calling thread is in, NULL for the
+ *	default one, for threads the library starts to carry on in
+ */
+struct sysfs_context *context_in_use(void)
+{
+	return current_context;
+}
+
+/**
+ * context_stats: the counters of the calling thread's context, if all of
+ *	options are set in it, NULL otherwise
+ */
+struct sysfs_stats *context_stats(unsigned int options)
+{
+	struct sysfs_context *ctx = get_context();
+
+	return (ctx->options & options) == options ? &ctx->stats : NULL;
+}
+
+/**
+ * context_links: the link cache of the calling thread's context, NULL
+ *	for the default context's
+ */
+struct link_cache *context_links(void)
+{
+	return get_context()->links;
+}
+
+/**
+ * context_take_uring: takes the io_uring kept in the calling thread's
+ *	context out of it, NULL if there is none or another thread has it
+ */
+struct sysfs_uring *context_take_uring(void)
+{
+	return __atomic_exchange_n(&get_context()->uring, NULL,
+			__ATOMIC_ACQUIRE);
+}
+
+/**
+ * context_put_uring: keeps ring in the calling thread's context for the
+ *	next read, freeing it if the context has one already
+ */
+void context_put_uring(struct sysfs_uring *ring)
+{
+	struct sysfs_uring *none = NULL;
+
+	if (!__atomic_compare_exchange_n(&get_context()->uring, &none, ring,
+				0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		uring_free(ring);
+}
+
+/**
+ * sysfs_open_context: sets up a context with its own root, options and
+ *	caches, for sysfs_use_context()
+ * @root: sysfs mount point, or a snapshot file, to work under; NULL for
+ *	what the default context uses
+ * returns the context with success and NULL with error.
+ */
+struct sysfs_context *sysfs_open_context(const char *root)
+{
+	struct sysfs_context *ctx;
+	int err;
+
+	ctx = (struct sysfs_context *)calloc(1, sizeof(struct sysfs_context));
+	if (!ctx)
+		return NULL;
+	ctx->rootfd = -1;
+	ctx->threads = 1;
+	ctx->links = link_cache_new();
+	if (!ctx->links || open_root(ctx, root ? root : default_root())) {
+		err = errno;
+		link_cache_free(ctx->links);
+		free(ctx);
+		errno = err;
+		return NULL;
+	}
+	return ctx;
+}
+
+/**
+ * sysfs_close_context: frees a context from sysfs_open_context(). No
+ *	thread may still be using it, and the calling thread is put back
+ *	in the default context if it was.
+ */
+void sysfs_close_context(struct sysfs_context *ctx)
+{
+	if (!ctx || ctx == &default_context)
+		return;
+	if (current_context == ctx)
+		current_context = NULL;
+	if (ctx->rootfd >= 0)
+		close(ctx->rootfd);
+	snapshot_close(ctx->snapshot);
+	link_cache_free(ctx->links);
+	uring_free(ctx->uring);
+	free(ctx);
+}
+
+/**
+ * sysfs_use_context: makes ctx the calling thread's context
+ * @ctx: context from sysfs_open_context(), or NULL for the default one
+ * Returns the context the thread was in, NULL for the default one
+ */
+struct sysfs_context *sysfs_use_context(struct sysfs_context *ctx)
+{
+	struct sysfs_context *prev = current_context;
+
+	current_context = ctx == &default_context ? NULL : ctx;
+	return prev;
+}
+
+/**
+ * sysfs_refresh_context: moves the current context on to the snapshot
+ *	last published to the view it reads, if that's newer than the one it
+ *	has. No other thread may be using the context meanwhile, and what
+ *	was opened from the old snapshot can't be read any further.
+ * returns 1 if it moved on, 0 if there was nothing newer or the root
+ *	isn't a view, and -1 with error, the old snapshot then kept.
+ */
+int sysfs_refresh_context(void)
+{
+	struct sysfs_context *ctx = get_context();
+	struct snapshot *snap;
+
+	if (!snapshot_stale(ctx->snapshot))
+		return 0;
+	snap = snapshot_load(ctx->root, ctx->root);
+	if (!snap) {
+		dprintf("Error reloading view %s\n", ctx->root);
+		return -1;
+	}
+	snapshot_close(ctx->snapshot);
+	ctx->snapshot = snap;
+	sysfs_flush_link_cache();
+	return 1;
+}
+
+/**
+ * sysfs_get_generation: the generation of the snapshot the current
+ *	context reads, 0 if its root isn't a view
+ */
+unsigned long long sysfs_get_generation(void)
+{
+	return snapshot_generation(get_context()->snapshot);
+}
+
+/**
+ * sysfs_set_options: set the SYSFS_OPT_* options of the current context
+ * @options: new set of options
+ * Returns the previous set of options
+ */
+unsigned int sysfs_set_options(unsigned int options)
+{
+	struct sysfs_context *ctx = get_context();
+	unsigned int old = ctx->options;
+
+	ctx->options = options;
+	/* what was cached can't be trusted the next time it's turned on */
+	if ((old & SYSFS_OPT_LINK_CACHE) && !(options & SYSFS_OPT_LINK_CACHE))
+		sysfs_flush_link_cache();
+	return old;
+}
+
+/**
+ * sysfs_get_options: get the current SYSFS_OPT_* options
+ */
+unsigned int sysfs_get_options(void)
+{
+	return get_context()->options;
+}
+
+/**
+ * sysfs_set_threads: set how many threads sysfs_open_device_tree() reads
+ *	the tree with
+ * @threads: thread count, 1 reads it serially in the calling thread and
+ *	0 uses one thread per online CPU
+ * Returns the previous thread count
+ */
+unsigned int sysfs_set_threads(unsigned int threads)
+{
+	struct sysfs_context *ctx = get_context();
+	unsigned int old = ctx->threads;
+	long cpus;
+
+	if (threads == 0) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? (unsigned int)cpus : 1;
+	}
+	ctx->threads = threads;
+	return old;
+}
+
+/**
+ * sysfs_get_threads: get the thread count set with sysfs_set_threads()
+ */
+unsigned int sysfs_get_threads(void)
+{
+	return get_context()->threads;
+}
 
 /**
  * sysfs_remove_trailing_slash: Removes any trailing '/' in the given path
@@ -43,6 +364,226 @@ int sysfs_remove_trailing_slash(char *path)
 	return 0;
 }
 
+/**
+ * relative: returns the part of path below ctx's root, "." for the root
+ *	itself, or NULL if path isn't below the root
+ */
+static const char *relative(struct sysfs_context *ctx, const char *path)
+{
+	const char *rel;
+
+	if ((ctx->rootfd < 0 && !ctx->snapshot) ||
+			strncmp(path, ctx->root, ctx->rootlen) != 0 ||
+			(path[ctx->rootlen] != '/' &&
+			 path[ctx->rootlen] != '\0'))
+		return NULL;
+	rel = path + ctx->rootlen;
+	while (*rel == '/')
+		rel++;
+	return *rel ? rel : ".";
+}
+
+/**
+ * root_relative: returns the part of path below the sysfs root, for use
+ *	with the root fd, "." for the root itself, or NULL if path isn't
+ *	below the root
+ * @path: absolute path
+ */
+const char *root_relative(const char *path)
+{
+	return relative(get_context(), path);
+}
+
+/**
+ * root_stat: stat() or, with nofollow, lstat() path, relative to the
+ *	sysfs root fd when it's below the root
+ */
+int root_stat(const char *path, struct stat *astats, int nofollow)
+{
+	struct sysfs_context *ctx = get_context();
+	const char *rel = relative(ctx, path);
+	unsigned long long start;
+	int ret;
+
+	if (rel && ctx->snapshot)
+		return snapshot_stat(ctx->snapshot, rel, astats, nofollow);
+	start = stats_begin();
+	if (rel)
+		ret = fstatat(ctx->rootfd, rel, astats,
+				nofollow ? AT_SYMLINK_NOFOLLOW : 0);
+	else
+		ret = nofollow ? lstat(path, astats) : stat(path, astats);
+	stats_end(SYSFS_STAT_STAT, start);
+	return ret;
+}
+
+/**
+ * root_open: open() path, relative to the sysfs root fd when it's below
+ *	the root
+ */
+int root_open(const char *path, int flags)
+{
+	struct sysfs_context *ctx = get_context();
+	const char *rel = relative(ctx, path);
+	unsigned long long start;
+	int fd;
+
+	if (rel && ctx->snapshot)
+		return snapshot_open(ctx->snapshot, rel, flags);
+	start = stats_begin();
+	if (rel)
+		fd = openat(ctx->rootfd, rel, flags);
+	else
+		fd = open(path, flags);
+	stats_end(SYSFS_STAT_OPEN, start);
+	return fd;
+}
+
+/**
+ * root_readlink: readlink() path, relative to the sysfs root fd when it's
+ *	below the root
+ */
+ssize_t root_readlink(const char *path, char *buf, size_t len)
+{
+	struct sysfs_context *ctx = get_context();
+	const char *rel = relative(ctx, path);
+	unsigned long long start;
+	ssize_t ret;
+
+	if (rel && ctx->snapshot)
+		return snapshot_readlink(ctx->snapshot, rel, buf, len);
+	start = stats_begin();
+	if (rel)
+		ret = readlinkat(ctx->rootfd, rel, buf, len);
+	else
+		ret = readlink(path, buf, len);
+	stats_end(SYSFS_STAT_READLINK, start);
+	return ret;
+}
+
+/**
+ * root_contents: finds the contents of the file at path in the snapshot
+ *	standing in for sysfs
+ * returns 0 with success, 1 if path isn't in a snapshot and is to be
+ *	read, and -1 with error.
+ */
+int root_contents(const char *path, const char **data, size_t *len)
+{
+	struct sysfs_context *ctx = get_context();
+	const char *rel = relative(ctx, path);
+
+	if (!(rel && ctx->snapshot))
+		return 1;
+	*data = snapshot_contents(ctx->snapshot, rel, len);
+	return *data ? 0 : -1;
+}
+
+/*
+ * Directories are read through a root_dir, which is either a DIR or a
+ * run of entries of the snapshot standing in for sysfs.
+ */
+struct root_dir {
+	DIR *dir;			/* NULL for a snapshot directory */
+	struct snapshot *snapshot;
+	unsigned int next;		/* snapshot entry to read next */
+	unsigned int end;
+	struct dirent dirent;
+};
+
+/**
+ * root_opendir: opendir() path, relative to the sysfs root fd when it's
+ *	below the root
+ * returns the directory with success and NULL with error.
+ */
+struct root_dir *root_opendir(const char *path)
+{
+	struct sysfs_context *ctx = get_context();
+	const char *rel = relative(ctx, path);
+	struct root_dir *dir;
+	unsigned int count;
+	int fd;
+
+	if (!(rel && ctx->snapshot)) {
+		fd = root_open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if (fd < 0)
+			return NULL;
+		dir = root_fdopendir(fd);
+		if (!dir)
+			close(fd);
+		return dir;
+	}
+	dir = (struct root_dir *)calloc(1, sizeof(struct root_dir));
+	if (!dir)
+		return NULL;
+	if (snapshot_opendir(ctx->snapshot, rel, &dir->next, &count)) {
+		free(dir);
+		return NULL;
+	}
+	dir->snapshot = ctx->snapshot;
+	dir->end = dir->next + count;
+	return dir;
+}
+
+/**
+ * root_fdopendir: fdopendir() a directory fd, which the root_dir owns
+ *	from then on
+ * returns the directory with success and NULL with error.
+ */
+struct root_dir *root_fdopendir(int fd)
+{
+	struct root_dir *dir;
+
+	dir = (struct root_dir *)calloc(1, sizeof(struct root_dir));
+	if (!dir)
+		return NULL;
+	dir->dir = fdopendir(fd);
+	if (!dir->dir) {
+		free(dir);
+		return NULL;
+	}
+	return dir;
+}
+
+/**
+ * root_readdir: readdir() a root_dir. Snapshot directories have no "."
+ *	or ".." entries, and always fill in d_type.
+ * returns the next entry, or NULL at the end.
+ */
+struct dirent *root_readdir(struct root_dir *dir)
+{
+	struct dirent *dirent;
+	mode_t mode = 0;
+
+	if (dir->dir) {
+		dirent = readdir(dir->dir);
+		if (dirent)
+			stats_count(SYSFS_STAT_DIRENTS, 1);
+		return dirent;
+	}
+	if (dir->next >= dir->end)
+		return NULL;
+	stats_count(SYSFS_STAT_DIRENTS, 1);
+	dir->dirent.d_ino = dir->next + 1;
+	safestrcpy(dir->dirent.d_name, snapshot_entry_name(dir->snapshot,
+			dir->next));
+	snapshot_entry_mode(dir->snapshot, dir->next, 0, &mode);
+#ifdef _DIRENT_HAVE_D_TYPE
+	dir->dirent.d_type = IFTODT(mode);
+#endif
+	dir->next++;
+	return &dir->dirent;
+}
+
+/**
+ * root_closedir: closedir() a root_dir
+ */
+void root_closedir(struct root_dir *dir)
+{
+	if (dir->dir)
+		closedir(dir->dir);
+	free(dir);
+}
+
 /*
  * sysfs_get_mnt_path: Gets the sysfs mount point.
  * @mnt_path: place to put "sysfs" mount point
@@ -51,24 +592,10 @@ int sysfs_remove_trailing_slash(char *path)
  */
 int sysfs_get_mnt_path(char *mnt_path, size_t len)
 {
-	static char sysfs_path[SYSFS_PATH_MAX] = "";
-	const char *sysfs_path_env;
-
 	if (len == 0 || mnt_path == NULL)
 		return -1;
 
-	/* evaluate only at the first call */
-	if (sysfs_path[0] == '\0') {
-		/* possible overrride of real mount path */
-		sysfs_path_env = getenv(SYSFS_PATH_ENV);
-		if (sysfs_path_env != NULL) {
-			safestrcpymax(mnt_path, sysfs_path_env, len);
-			sysfs_remove_trailing_slash(mnt_path);
-			return 0;
-		}
-		safestrcpymax(mnt_path, SYSFS_MNT_PATH, len);
-	}
-
+	safestrcpymax(mnt_path, get_context()->root, len);
 	return 0;
 }
 
@@ -108,28 +635,19 @@ int sysfs_get_name_from_path(const char *path, char *name, size_t len)
 }
 
 /**
- * sysfs_get_link: returns link source
+ * resolve_link: turns the contents of the link at path into the
+ *	absolute path of its target
  * @path: symbolic link's path
- * @target: where to put name
- * @len: size of name
+ * @linkpath: what the link points to, as read from it
+ * @target: where to put the result
+ * @len: size of target
  */
-int sysfs_get_link(const char *path, char *target, size_t len)
+static int resolve_link(const char *path, char *linkpath,
+		char *target, size_t len)
 {
 	char devdir[SYSFS_PATH_MAX];
-	char linkpath[SYSFS_PATH_MAX];
 	char *d, *s;
-	int count;
-
-	if (!path || !target || len == 0) {
-		errno = EINVAL;
-		return -1;
-	}
 
-	count = readlink(path, linkpath, SYSFS_PATH_MAX);
-	if (count < 0)
-		return -1;
-	else
-		linkpath[count] = '\0';
 	/*
 	 * Three cases here:
 	 * 1. relative path => format ../..
@@ -176,16 +694,20 @@ int sysfs_get_link(const char *path, char *target, size_t len)
 					s--;
 			}
 			*(s+1) = '\0';
-			if (*devdir == '\0' || sysfs_path_is_link(devdir))
-				/*
-				 * condition will be true eventually
-				 * because we already know that all
-				 * but the last component of path
-				 * resolve to a directory
-				 */
+			if (*devdir == '\0')
 				break;
-			if (sysfs_get_link(devdir, devdir, SYSFS_PATH_MAX))
+			/*
+			 * reading devdir as a link, through the link cache
+			 * when it's on, fails with EINVAL or ENOENT if it
+			 * isn't one. That will be so eventually because we
+			 * already know that all but the last component of
+			 * path resolve to a directory.
+			 */
+			if (sysfs_get_link(devdir, devdir, SYSFS_PATH_MAX)) {
+				if (errno == EINVAL || errno == ENOENT)
+					break;
 				return -1;
+			}
 			s = devdir + strlen(devdir) - 1;
 		}
 		while (s >= devdir) {
@@ -218,6 +740,42 @@ int sysfs_get_link(const char *path, char *target, size_t len)
 	return 0;
 }
 
+/**
+ * read_link: reads and resolves the link at path, bypassing the link cache
+ * @path: symbolic link's path
+ * @target: where to put name
+ * @len: size of name
+ */
+int read_link(const char *path, char *target, size_t len)
+{
+	char linkpath[SYSFS_PATH_MAX];
+	ssize_t count;
+
+	count = root_readlink(path, linkpath, SYSFS_PATH_MAX - 1);
+	if (count < 0)
+		return -1;
+	linkpath[count] = '\0';
+	return resolve_link(path, linkpath, target, len);
+}
+
+/**
+ * sysfs_get_link: returns link source
+ * @path: symbolic link's path
+ * @target: where to put name
+ * @len: size of name
+ */
+int sysfs_get_link(const char *path, char *target, size_t len)
+{
+	if (!path || !target || len == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (get_context()->options & SYSFS_OPT_LINK_CACHE)
+		return cached_link(path, target, len);
+	return read_link(path, target, len);
+}
+
 /**
  * sysfs_close_list: generic list free routine
  * @list: dlist to free
@@ -240,7 +798,7 @@ struct dlist *sysfs_open_directory_list(const char *path)
 	if (!path)
 		return NULL;
 
-	return (read_dir_subdirs(path));
+	return (read_dir_subdirs(path, NULL));
 }
 
 /**
@@ -254,7 +812,32 @@ struct dlist *sysfs_open_link_list(const char *path)
 	if (!path)
 		return NULL;
 
-	return (read_dir_links(path));
+	return (read_dir_links(path, NULL));
+}
+
+/**
+ * sysfs_filter_match: checks a name against a filter
+ * @filter: filter to check against, NULL letting everything through
+ * @name: entry name to check
+ * Returns 0 if the name matches, 1 otherwise
+ */
+int sysfs_filter_match(const struct sysfs_filter *filter, const char *name)
+{
+	const char * const *cur;
+
+	if (!filter)
+		return 0;
+	if (!name)
+		return 1;
+	if (filter->glob && fnmatch(filter->glob, name, 0))
+		return 1;
+	if (filter->names) {
+		for (cur = filter->names; *cur; cur++)
+			if (!strcmp(*cur, name))
+				return 0;
+		return 1;
+	}
+	return 0;
 }
 
 /**
@@ -270,7 +853,7 @@ int sysfs_path_is_dir(const char *path)
 		errno = EINVAL;
 		return 1;
 	}
-	if ((lstat(path, &astats)) != 0) {
+	if ((root_stat(path, &astats, 1)) != 0) {
 		dprintf("stat() failed\n");
 		return 1;
 	}
@@ -293,7 +876,7 @@ int sysfs_path_is_link(const char *path)
 		errno = EINVAL;
 		return 1;
 	}
-	if ((lstat(path, &astats)) != 0) {
+	if ((root_stat(path, &astats, 1)) != 0) {
 		dprintf("stat() failed\n");
 		return 1;
 	}
@@ -316,7 +899,7 @@ int sysfs_path_is_file(const char *path)
 		errno = EINVAL;
 		return 1;
 	}
-	if ((stat(path, &astats)) != 0) {
+	if ((root_stat(path, &astats, 0)) != 0) {
 		dprintf("stat() failed\n");
 		return 1;
 	}
@@ -326,6 +909,93 @@ int sysfs_path_is_file(const char *path)
 	return 1;
 }
 
+/*
+ * dirent_mode: stat a directory entry relative to the directory it was
+ * read from, saving the full path lookup sysfs_path_is_*() do.
+ */
+static int dirent_mode(struct root_dir *dir, struct dirent *dirent,
+		int flags, mode_t *mode)
+{
+	struct stat astats;
+	unsigned long long start;
+	int ret;
+
+	if (!dir->dir)
+		return snapshot_entry_mode(dir->snapshot, dir->next - 1,
+				!(flags & AT_SYMLINK_NOFOLLOW), mode);
+	start = stats_begin();
+	ret = fstatat(dirfd(dir->dir), dirent->d_name, &astats, flags);
+	stats_end(SYSFS_STAT_STAT, start);
+	if (ret != 0) {
+		dprintf("stat() failed\n");
+		return -1;
+	}
+	*mode = astats.st_mode;
+	return 0;
+}
+
+/**
+ * dirent_is_dir: Check if a directory entry is a directory, same as
+ *	sysfs_path_is_dir() on the entry's path
+ * @dir: directory stream dirent was read from
+ * @dirent: entry to check
+ * Returns 0 if entry is a dir, 1 otherwise
+ */
+int dirent_is_dir(struct root_dir *dir, struct dirent *dirent)
+{
+	mode_t mode;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+	if (dirent->d_type != DT_UNKNOWN)
+		return dirent->d_type == DT_DIR ? 0 : 1;
+#endif
+	if (dirent_mode(dir, dirent, AT_SYMLINK_NOFOLLOW, &mode))
+		return 1;
+	return S_ISDIR(mode) ? 0 : 1;
+}
+
+/**
+ * dirent_is_link: Check if a directory entry is a link, same as
+ *	sysfs_path_is_link() on the entry's path
+ * @dir: directory stream dirent was read from
+ * @dirent: entry to check
+ * Returns 0 if entry is a link, 1 otherwise
+ */
+int dirent_is_link(struct root_dir *dir, struct dirent *dirent)
+{
+	mode_t mode;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+	if (dirent->d_type != DT_UNKNOWN)
+		return dirent->d_type == DT_LNK ? 0 : 1;
+#endif
+	if (dirent_mode(dir, dirent, AT_SYMLINK_NOFOLLOW, &mode))
+		return 1;
+	return S_ISLNK(mode) ? 0 : 1;
+}
+
+/**
+ * dirent_is_file: Check if a directory entry is a regular file, same as
+ *	sysfs_path_is_file() on the entry's path (links are followed)
+ * @dir: directory stream dirent was read from
+ * @dirent: entry to check
+ * Returns 0 if entry is a file, 1 otherwise
+ */
+int dirent_is_file(struct root_dir *dir, struct dirent *dirent)
+{
+	mode_t mode;
+
+#ifdef _DIRENT_HAVE_D_TYPE
+	if (dirent->d_type == DT_REG)
+		return 0;
+	if (dirent->d_type != DT_UNKNOWN && dirent->d_type != DT_LNK)
+		return 1;
+#endif
+	if (dirent_mode(dir, dirent, 0, &mode))
+		return 1;
+	return S_ISREG(mode) ? 0 : 1;
+}
+
 /**
  * my_strncpy -- a safe strncpy
  */
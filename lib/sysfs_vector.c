@@ -0,0 +1,194 @@
+/*
+ * sysfs_vector.c
+ *
+ * Sorted array views of libsysfs lists
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#include "libsysfs.h"
+#include "sysfs.h"
+
+/*
+ * A vector holds the elements of a list in one array, in the list's own
+ * name order, so going through it is an array walk instead of a chase
+ * from node to node, and looking a name up is a binary search. The
+ * elements stay where the list keeps them; the vector only points at
+ * them, and goes with sysfs_close_vector() whoever owns the list.
+ */
+
+static int compare_entries(const void *a, const void *b)
+{
+	return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+/**
+ * sysfs_open_vector: makes a vector of the elements of a libsysfs list
+ * @list: list of libsysfs objects, or of names, to put in it
+ * returns the vector with success and NULL with error.
+ */
+struct sysfs_vector *sysfs_open_vector(struct dlist *list)
+{
+	struct sysfs_vector *vec;
+	struct dl_node *node;
+	unsigned int i = 0;
+	int sorted = 1;
+
+	if (!list) {
+		errno = EINVAL;
+		return NULL;
+	}
+	vec = (struct sysfs_vector *)calloc(1, sizeof(struct sysfs_vector));
+	if (!vec)
+		return NULL;
+	if (list->count) {
+		vec->data = (void **)malloc(list->count * sizeof(void *));
+		if (!vec->data) {
+			free(vec);
+			return NULL;
+		}
+	}
+	/* every element starts with its name, as sort_names() relies on */
+	dlist_for_each_nomark(list, node) {
+		if (i == list->count)
+			break;
+		if (i && strcmp((char *)vec->data[i - 1],
+					(char *)node->data) > 0)
+			sorted = 0;
+		vec->data[i++] = node->data;
+	}
+	vec->count = i;
+	/* lists sorted some other way still have to be searchable */
+	if (!sorted)
+		qsort(vec->data, vec->count, sizeof(void *), compare_entries);
+	return vec;
+}
+
+/**
+ * sysfs_close_vector: frees a vector, leaving its elements alone
+ */
+void sysfs_close_vector(struct sysfs_vector *vec)
+{
+	if (vec) {
+		free(vec->data);
+		free(vec);
+	}
+}
+
+/**
+ * sysfs_vector_find: looks an element up by name
+ * @vec: vector to search
+ * @name: name of the element
+ * returns the element if found, NULL if not or with error.
+ */
+void *sysfs_vector_find(struct sysfs_vector *vec, const char *name)
+{
+	unsigned int lo = 0, hi, mid;
+	int cmp;
+
+	if (!vec || !name) {
+		errno = EINVAL;
+		return NULL;
+	}
+	hi = vec->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = strcmp(name, (char *)vec->data[mid]);
+		if (!cmp)
+			return vec->data[mid];
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return NULL;
+}
+
+/**
+ * sysfs_open_bus_device_vector: vector of the devices on a bus, as
+ *	sysfs_get_bus_devices() lists them
+ * returns the vector with success and NULL with error.
+ */
+struct sysfs_vector *sysfs_open_bus_device_vector(struct sysfs_bus *bus)
+{
+	return sysfs_open_vector(sysfs_get_bus_devices(bus));
+}
+
+/**
+ * sysfs_open_bus_driver_vector: vector of the drivers on a bus
+ * returns the vector with success and NULL with error.
+ */
+struct sysfs_vector *sysfs_open_bus_driver_vector(struct sysfs_bus *bus)
+{
+	return sysfs_open_vector(sysfs_get_bus_drivers(bus));
+}
+
+/**
+ * sysfs_open_driver_device_vector: vector of the devices bound to a driver
+ * returns the vector with success and NULL with error.
+ */
+struct sysfs_vector *sysfs_open_driver_device_vector(struct sysfs_driver *drv)
+{
+	return sysfs_open_vector(sysfs_get_driver_devices(drv));
+}
+
+/**
+ * sysfs_open_class_device_vector: vector of the devices of a class
+ * returns the vector with success and NULL with error.
+ */
+struct sysfs_vector *sysfs_open_class_device_vector(struct sysfs_class *cls)
+{
+	return sysfs_open_vector(sysfs_get_class_devices(cls));
+}
+
+/**
+ * sysfs_open_device_attr_vector: vector of a device's attributes
+ * returns the vector with success and NULL with error.
+ */
+struct sysfs_vector *sysfs_open_device_attr_vector(struct sysfs_device *dev)
+{
+	return sysfs_open_vector(sysfs_get_device_attributes(dev));
+}
+
+/**
+ * sysfs_open_driver_attr_vector: vector of a driver's attributes
+ * returns the vector with success and NULL with error.
+ */
+struct sysfs_vector *sysfs_open_driver_attr_vector(struct sysfs_driver *drv)
+{
+	return sysfs_open_vector(sysfs_get_driver_attributes(drv));
+}
+
+/**
+ * sysfs_open_classdev_attr_vector: vector of a class device's attributes
+ * returns the vector with success and NULL with error.
+ */
+struct sysfs_vector *sysfs_open_classdev_attr_vector
+		(struct sysfs_class_device *clsdev)
+{
+	return sysfs_open_vector(sysfs_get_classdev_attributes(clsdev));
+}
+
+/**
+ * sysfs_open_module_attr_vector: vector of a module's attributes
+ * returns the vector with success and NULL with error.
+ */
+struct sysfs_vector *sysfs_open_module_attr_vector
+		(struct sysfs_module *module)
+{
+	return sysfs_open_vector(sysfs_get_module_attributes(module));
+}
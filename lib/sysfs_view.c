@@ -0,0 +1,370 @@
+/*
+ * sysfs_view.c
+ *
+ * Snapshots published for other processes to read, for libsysfs
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "libsysfs.h"
+#include "sysfs.h"
+#include <stdint.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+
+/*
+ * A view is a small file, best kept on a tmpfs such as /run, that names
+ * the snapshot of sysfs published last. Each snapshot published
+ * is a file of its own next to the view, the view's name with the
+ * generation after it, and is never changed once written: publishing
+ * writes the next one in full, points the view at it and only then
+ * removes the one before, which stays readable for as long as anyone
+ * has it mapped.
+ *
+ * Readers map the view shared and read nothing from it but the name and
+ * generation, which the one publisher changes under a sequence count,
+ * odd while it does: a reader takes a copy, and takes it again if the
+ * count was odd or has moved by the time it's done. Neither side ever
+ * waits on a lock.
+ *
+ * Whoever can write to the view's directory can put a view or snapshot of
+ * their own there, so it's best one only the publisher can write to.
+ * The publisher won't take over a file it doesn't own, and readers only
+ * trust views and snapshots owned by root or by themselves.
+ */
+#define VIEW_MAGIC		"SYSFSVEW"
+#define VIEW_VERSION		1
+#define VIEW_ORDER		0x01020304
+
+/* looks at a view before giving up on a publisher stuck halfway */
+#define VIEW_MAX_TRIES		1000
+
+struct view_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t order;		/* VIEW_ORDER as it was written */
+	uint32_t seq;		/* odd while the rest is being changed */
+	uint32_t pad;
+	uint64_t generation;	/* of the snapshot named, 0 before the first */
+	char name[NAME_MAX + 1];	/* the snapshot, next to the view */
+};
+
+struct sysfs_view {
+	char file[PATH_MAX];
+	const char **dirs;
+	int fd;
+	int lockfd;		/* held while publishing to the view */
+	struct view_header *header;
+	char current[PATH_MAX];	/* snapshot published last, "" if none */
+};
+
+/**
+ * view_check: tells views from other files
+ * returns 0 if the size bytes at map are a view and -1 otherwise.
+ */
+int view_check(const void *map, size_t size)
+{
+	const struct view_header *hdr = (const struct view_header *)map;
+
+	if (size < sizeof(struct view_header) ||
+	    memcmp(hdr->magic, VIEW_MAGIC, sizeof(hdr->magic)) ||
+	    hdr->version != VIEW_VERSION || hdr->order != VIEW_ORDER)
+		return -1;
+	return 0;
+}
+
+/**
+ * view_generation: the generation a mapped view names just now
+ */
+unsigned long long view_generation(const void *map)
+{
+	const struct view_header *hdr = (const struct view_header *)map;
+
+	return __atomic_load_n(&hdr->generation, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * snapshot_path: the path of the snapshot called name, next to file
+ * returns 0 with success and -1 if it doesn't fit in len.
+ */
+static int snapshot_path(const char *file, const char *name, char *path,
+		size_t len)
+{
+	const char *slash = strrchr(file, '/');
+	size_t dirlen = slash ? (size_t)(slash - file) + 1 : 0;
+
+	if (dirlen + strlen(name) + 1 > len) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memcpy(path, file, dirlen);
+	strcpy(path + dirlen, name);
+	return 0;
+}
+
+/**
+ * snapshot_name_check: tells the names of a view's snapshots, its own
+ *	name and a dot and the generation, from any other name a view could
+ *	hold, such as one leading out of the view's directory or its lock
+ * returns 0 if name can be a snapshot of the view at file, -1 if not.
+ */
+static int snapshot_name_check(const char *file, const char *name)
+{
+	const char *base = strrchr(file, '/');
+	size_t len;
+
+	base = base ? base + 1 : file;
+	len = strlen(base);
+	if (strncmp(name, base, len) || name[len] != '.' ||
+	    name[len + 1] == '\0' ||
+	    strspn(name + len + 1, "0123456789") != strlen(name + len + 1))
+		return -1;
+	return 0;
+}
+
+/**
+ * open_own: opens, creating it if need be, a file of the caller's own,
+ *	never following a link to it
+ * @stats: set to the file's
+ * returns the file descriptor with success and -1 with error, EPERM if
+ *	file is someone else's, or not a regular file.
+ */
+static int open_own(const char *file, mode_t mode, struct stat *stats)
+{
+	int fd;
+
+	fd = open(file, O_RDWR | O_CREAT | O_CLOEXEC | O_NOFOLLOW, mode);
+	if (fd < 0) {
+		dprintf("Error opening %s\n", file);
+		return -1;
+	}
+	if (fstat(fd, stats)) {
+		close(fd);
+		return -1;
+	}
+	/* someone else's file, made to be taken for ours, is left be */
+	if (!S_ISREG(stats->st_mode) || stats->st_uid != geteuid()) {
+		dprintf("%s is not a file of our own\n", file);
+		close(fd);
+		errno = EPERM;
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * view_current: finds the snapshot a mapped view names
+ * @map: the view, mapped shared
+ * @file: the view's path
+ * @path: set to the snapshot's path
+ * @generation: set to the snapshot's generation
+ * returns 0 with success and -1 with error, EAGAIN if a publisher never
+ *	finished changing the view, ENOENT if nothing's been published and
+ *	EINVAL if the name it holds isn't one of the view's snapshots.
+ */
+int view_current(const void *map, const char *file, char *path, size_t len,
+		unsigned long long *generation)
+{
+	const struct view_header *hdr = (const struct view_header *)map;
+	char name[NAME_MAX + 1];
+	uint32_t seq;
+	int tries;
+
+	for (tries = 0; tries < VIEW_MAX_TRIES; tries++) {
+		seq = __atomic_load_n(&hdr->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			sched_yield();
+			continue;
+		}
+		*generation = __atomic_load_n(&hdr->generation,
+				__ATOMIC_RELAXED);
+		memcpy(name, hdr->name, sizeof(name));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&hdr->seq, __ATOMIC_RELAXED) != seq)
+			continue;
+		name[NAME_MAX] = '\0';
+		if (*generation == 0 || name[0] == '\0') {
+			errno = ENOENT;
+			return -1;
+		}
+		if (snapshot_name_check(file, name)) {
+			dprintf("View %s names %s, not one of its snapshots\n",
+					file, name);
+			errno = EINVAL;
+			return -1;
+		}
+		return snapshot_path(file, name, path, len);
+	}
+	errno = EAGAIN;
+	return -1;
+}
+
+/**
+ * sysfs_open_view: sets up a view for snapshots of sysfs to be published
+ *	to, and publishes the first
+ * @file: the view, replaced if it's a file of ours but not a view
+ * @dirs: what sysfs_write_snapshot() is to take, kept and used by every
+ *	sysfs_publish_view()
+ * returns the view with success and NULL with error, EWOULDBLOCK if
+ *	another process is publishing to the same view and EPERM if file
+ *	is someone else's, or not a regular file.
+ */
+struct sysfs_view *sysfs_open_view(const char *file, const char **dirs)
+{
+	struct sysfs_view *view;
+	struct stat stats;
+	char lock[PATH_MAX];
+	void *map;
+	int err;
+
+	if (!file || strlen(file) >= PATH_MAX - sizeof(".lock")) {
+		errno = EINVAL;
+		return NULL;
+	}
+	view = (struct sysfs_view *)calloc(1, sizeof(struct sysfs_view));
+	if (!view) {
+		dprintf("calloc failed\n");
+		return NULL;
+	}
+	view->fd = -1;
+	view->lockfd = -1;
+	safestrcpy(view->file, file);
+	view->dirs = dirs;
+
+	/*
+	 * One publisher to a view, and it says so for as long as it runs
+	 * on a lock file of its own: readers can open the view, and with
+	 * it anyone could hold a lock on the view itself.
+	 */
+	snprintf(lock, sizeof(lock), "%s.lock", file);
+	view->lockfd = open_own(lock, 0600, &stats);
+	if (view->lockfd < 0)
+		goto fail;
+	if (flock(view->lockfd, LOCK_EX | LOCK_NB)) {
+		dprintf("View %s is published by another process\n", file);
+		goto fail;
+	}
+	view->fd = open_own(file, 0644, &stats);
+	if (view->fd < 0)
+		goto fail;
+	if (stats.st_size != sizeof(struct view_header) &&
+	    ftruncate(view->fd, sizeof(struct view_header)))
+		goto fail;
+	map = mmap(NULL, sizeof(struct view_header), PROT_READ | PROT_WRITE,
+			MAP_SHARED, view->fd, 0);
+	if (map == MAP_FAILED)
+		goto fail;
+	view->header = (struct view_header *)map;
+
+	/* what a publisher before this one left is taken over */
+	if (view_check(view->header, sizeof(struct view_header)) ||
+	    (view->header->seq & 1)) {
+		memset(view->header, 0, sizeof(struct view_header));
+		memcpy(view->header->magic, VIEW_MAGIC,
+				sizeof(view->header->magic));
+		view->header->version = VIEW_VERSION;
+		view->header->order = VIEW_ORDER;
+	} else if (view->header->name[0] &&
+		   memchr(view->header->name, '\0', NAME_MAX + 1) &&
+		   !snapshot_name_check(file, view->header->name) &&
+		   snapshot_path(file, view->header->name, view->current,
+			   sizeof(view->current)))
+		view->current[0] = '\0';
+
+	if (sysfs_publish_view(view))
+		goto fail;
+	return view;
+
+fail:
+	err = errno;
+	sysfs_close_view(view);
+	errno = err;
+	return NULL;
+}
+
+/**
+ * sysfs_publish_view: writes a new snapshot and points the view at it
+ * returns 0 with success and -1 with error, the view then still naming
+ *	the snapshot published before.
+ */
+int sysfs_publish_view(struct sysfs_view *view)
+{
+	struct view_header *hdr;
+	char path[PATH_MAX], name[NAME_MAX + 1];
+	const char *base;
+	unsigned long long generation;
+	int len;
+
+	if (!view || !view->header) {
+		errno = EINVAL;
+		return -1;
+	}
+	hdr = view->header;
+	generation = hdr->generation + 1;
+	base = strrchr(view->file, '/');
+	base = base ? base + 1 : view->file;
+	len = snprintf(name, sizeof(name), "%s.%llu", base, generation);
+	if (len < 0 || len >= (int)sizeof(name) ||
+	    snapshot_path(view->file, name, path, sizeof(path))) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	if (sysfs_write_snapshot(path, view->dirs)) {
+		dprintf("Error writing snapshot %s\n", path);
+		return -1;
+	}
+
+	__atomic_store_n(&hdr->seq, hdr->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	memset(hdr->name, 0, sizeof(hdr->name));
+	strcpy(hdr->name, name);
+	__atomic_store_n(&hdr->generation, generation, __ATOMIC_RELAXED);
+	__atomic_store_n(&hdr->seq, hdr->seq + 1, __ATOMIC_RELEASE);
+
+	/* readers that have it mapped keep it until they let go */
+	if (view->current[0] && strcmp(view->current, path))
+		unlink(view->current);
+	safestrcpy(view->current, path);
+	return 0;
+}
+
+/**
+ * sysfs_close_view: stops publishing to a view, removing it and the
+ *	snapshot it names. Readers that have them mapped still read them.
+ */
+void sysfs_close_view(struct sysfs_view *view)
+{
+	if (!view)
+		return;
+	if (view->header) {
+		unlink(view->file);
+		munmap(view->header, sizeof(struct view_header));
+	}
+	if (view->current[0])
+		unlink(view->current);
+	if (view->fd >= 0)
+		close(view->fd);
+	/* the lock file stays, so no one locks one about to go */
+	if (view->lockfd >= 0)
+		close(view->lockfd);
+	free(view);
+}
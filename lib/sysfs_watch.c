@@ -0,0 +1,577 @@
+/*
+ * sysfs_watch.c
+ *
+ * Keeps open buses and classes up to date from kernel uevents for libsysfs
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "libsysfs.h"
+#include "sysfs.h"
+
+#ifdef HAVE_LINUX_NETLINK_H
+#include <poll.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#endif
+
+#if defined(HAVE_LINUX_NETLINK_H) && defined(NETLINK_KOBJECT_UEVENT)
+
+/* a uevent is at most a couple of KB of key=value strings */
+#define WATCH_BUF_SIZE		8192
+/* room for bursts, such as a whole USB hub coming or going */
+#define WATCH_RCVBUF_SIZE	(1024 * 1024)
+
+struct watch_target {
+	struct watch_target *next;
+	struct sysfs_bus *bus;		/* exactly one of bus and cls is set */
+	struct sysfs_class *cls;
+	void (*callback)(const struct sysfs_uevent *event, void *entry,
+			void *data);
+	void *data;
+};
+
+struct sysfs_watch {
+	int fd;
+	struct watch_target *targets;
+	char buf[WATCH_BUF_SIZE];
+};
+
+/*
+ * compares names.
+ * @a: name looked for
+ * @b: libsysfs struct, all of which start with their name
+ * returns 1 if a==b->name or 0 not equal
+ */
+static int name_equal(void *a, void *b)
+{
+	if (!a || !b)
+		return 0;
+
+	if (strcmp(((char *)a), ((struct sysfs_device *)b)->name) == 0)
+		return 1;
+
+	return 0;
+}
+
+static void *find_entry(struct dlist *list, const char *name)
+{
+	if (!list)
+		return NULL;
+	return dlist_find_custom(list, (void *)name, name_equal);
+}
+
+/* takes entry off list and closes it */
+static void delete_entry(struct dlist *list, void *entry)
+{
+	void *data;
+
+	if (!list || !entry)
+		return;
+	dlist_for_each_data(list, data, void) {
+		if (data == entry) {
+			dlist_delete(list, 1);
+			return;
+		}
+	}
+}
+
+static void notify(struct watch_target *target, struct sysfs_uevent *event,
+		void *entry)
+{
+	if (target->callback)
+		target->callback(event, entry, target->data);
+}
+
+/* drops the device called name from the device list of bus's drivers */
+static void unbind_device(struct sysfs_bus *bus, const char *name)
+{
+	struct sysfs_driver *drv;
+
+	if (!bus->drivers)
+		return;
+	dlist_for_each_data(bus->drivers, drv, struct sysfs_driver)
+		if (drv->devices)
+			delete_entry(drv->devices,
+					find_entry(drv->devices, name));
+}
+
+/* puts the device called name on the device list of its new driver */
+static void bind_device(struct sysfs_bus *bus, const char *name,
+		const char *driver)
+{
+	struct sysfs_driver *drv;
+	struct sysfs_device *dev;
+
+	drv = (struct sysfs_driver *)find_entry(bus->drivers, driver);
+	if (!drv || !drv->devices || find_entry(drv->devices, name))
+		return;
+	dev = sysfs_open_device(bus->name, name);
+	if (dev)
+		dlist_unshift_sorted(drv->devices, dev, sort_names_before);
+}
+
+static void bus_driver_event(struct watch_target *target,
+		struct sysfs_uevent *event, const char *name)
+{
+	struct sysfs_bus *bus = target->bus;
+	struct sysfs_driver *drv;
+
+	drv = (struct sysfs_driver *)find_entry(bus->drivers, name);
+	if (!strcmp(event->action, "add")) {
+		if (!drv && bus->drivers)
+			drv = sysfs_get_bus_driver(bus, name);
+		notify(target, event, drv);
+	} else if (!strcmp(event->action, "remove")) {
+		notify(target, event, drv);
+		delete_entry(bus->drivers, drv);
+	} else
+		notify(target, event, drv);
+}
+
+static void bus_device_event(struct watch_target *target,
+		struct sysfs_uevent *event, const char *name)
+{
+	struct sysfs_bus *bus = target->bus;
+	struct sysfs_device *dev, *old;
+	char oldname[SYSFS_NAME_LEN];
+
+	dev = (struct sysfs_device *)find_entry(bus->devices, name);
+	if (!strcmp(event->action, "add")) {
+		if (!dev && bus->devices)
+			dev = sysfs_get_bus_device(bus, name);
+		notify(target, event, dev);
+	} else if (!strcmp(event->action, "remove")) {
+		notify(target, event, dev);
+		unbind_device(bus, name);
+		delete_entry(bus->devices, dev);
+	} else if (!strcmp(event->action, "move")) {
+		if (!dev && bus->devices)
+			dev = sysfs_get_bus_device(bus, name);
+		notify(target, event, dev);
+		if (!sysfs_get_name_from_path(event->devpath_old, oldname,
+					SYSFS_NAME_LEN)) {
+			old = (struct sysfs_device *)find_entry(bus->devices,
+					oldname);
+			unbind_device(bus, oldname);
+			if (old != dev)
+				delete_entry(bus->devices, old);
+		}
+	} else if (!strcmp(event->action, "bind")) {
+		if (dev && event->driver[0])
+			safestrcpy(dev->driver_name, event->driver);
+		if (event->driver[0])
+			bind_device(bus, name, event->driver);
+		notify(target, event, dev);
+	} else if (!strcmp(event->action, "unbind")) {
+		if (dev)
+			safestrcpy(dev->driver_name, SYSFS_UNKNOWN);
+		unbind_device(bus, name);
+		notify(target, event, dev);
+	} else
+		notify(target, event, dev);
+}
+
+static void class_event(struct watch_target *target,
+		struct sysfs_uevent *event, const char *name)
+{
+	struct sysfs_class *cls = target->cls;
+	struct sysfs_class_device *cdev, *old;
+	char oldname[SYSFS_NAME_LEN];
+
+	cdev = (struct sysfs_class_device *)find_entry(cls->devices, name);
+	if (!strcmp(event->action, "add")) {
+		if (!cdev && cls->devices)
+			cdev = sysfs_get_class_device(cls, name);
+		notify(target, event, cdev);
+	} else if (!strcmp(event->action, "remove")) {
+		notify(target, event, cdev);
+		delete_entry(cls->devices, cdev);
+	} else if (!strcmp(event->action, "move")) {
+		if (!cdev && cls->devices)
+			cdev = sysfs_get_class_device(cls, name);
+		notify(target, event, cdev);
+		if (!sysfs_get_name_from_path(event->devpath_old, oldname,
+					SYSFS_NAME_LEN)) {
+			old = (struct sysfs_class_device *)
+				find_entry(cls->devices, oldname);
+			if (old != cdev)
+				delete_entry(cls->devices, old);
+		}
+	} else
+		notify(target, event, cdev);
+}
+
+/**
+ * apply_event: brings every watched bus and class event concerns up to
+ *	date, and tells their callbacks about it
+ */
+static void apply_event(struct sysfs_watch *watch, struct sysfs_uevent *event)
+{
+	struct watch_target *target;
+	char name[SYSFS_NAME_LEN], prefix[SYSFS_PATH_MAX];
+
+	if (sysfs_get_name_from_path(event->devpath, name, SYSFS_NAME_LEN))
+		return;
+	/* links may have come, gone or moved with the device */
+	if (strcmp(event->action, "change") &&
+			(sysfs_get_options() & SYSFS_OPT_LINK_CACHE))
+		sysfs_flush_link_cache();
+
+	for (target = watch->targets; target; target = target->next) {
+		if (target->cls) {
+			if (!strcmp(event->subsystem, target->cls->name))
+				class_event(target, event, name);
+			continue;
+		}
+		if (!strcmp(event->subsystem, target->bus->name)) {
+			bus_device_event(target, event, name);
+			continue;
+		}
+		/* drivers are reported at /sys/bus/<bus>/drivers/<driver> */
+		if (strcmp(event->subsystem, SYSFS_DRIVERS_NAME))
+			continue;
+		safestrcpy(prefix, target->bus->path);
+		safestrcat(prefix, "/");
+		safestrcat(prefix, SYSFS_DRIVERS_NAME);
+		safestrcat(prefix, "/");
+		if (!strncmp(event->devpath, prefix, strlen(prefix)))
+			bus_driver_event(target, event, name);
+	}
+}
+
+/**
+ * parse_uevent: fills in event from the kernel's "action@devpath" header
+ *	and the KEY=value strings that follow it
+ * returns 0 with success and -1 if buf isn't a kernel uevent.
+ */
+static int parse_uevent(char *buf, size_t len, struct sysfs_uevent *event)
+{
+	char mnt[SYSFS_PATH_MAX];
+	char *key, *end = buf + len;
+
+	memset(event, 0, sizeof(struct sysfs_uevent));
+	if (!memchr(buf, '@', strnlen(buf, len)))
+		return -1;
+	if (sysfs_get_mnt_path(mnt, SYSFS_PATH_MAX))
+		return -1;
+
+	for (key = buf + strlen(buf) + 1; key < end; key += strlen(key) + 1) {
+		if (!strncmp(key, "ACTION=", 7))
+			safestrcpy(event->action, key + 7);
+		else if (!strncmp(key, "DEVPATH=", 8)) {
+			safestrcpy(event->devpath, mnt);
+			safestrcat(event->devpath, key + 8);
+		} else if (!strncmp(key, "DEVPATH_OLD=", 12)) {
+			safestrcpy(event->devpath_old, mnt);
+			safestrcat(event->devpath_old, key + 12);
+		} else if (!strncmp(key, "SUBSYSTEM=", 10))
+			safestrcpy(event->subsystem, key + 10);
+		else if (!strncmp(key, "DRIVER=", 7))
+			safestrcpy(event->driver, key + 7);
+		else if (!strncmp(key, "SEQNUM=", 7))
+			event->seqnum = strtoull(key + 7, NULL, 10);
+	}
+	if (!event->action[0] || !event->devpath[0])
+		return -1;
+	return 0;
+}
+
+/**
+ * sysfs_open_watch: subscribes to kernel uevents, for sysfs_watch_bus()
+ *	and sysfs_watch_class() to keep what they're given up to date with.
+ * returns struct sysfs_watch with success and NULL with error.
+ */
+struct sysfs_watch *sysfs_open_watch(void)
+{
+	struct sysfs_watch *watch;
+	struct sockaddr_nl addr;
+	int size = WATCH_RCVBUF_SIZE;
+
+	watch = (struct sysfs_watch *)calloc(1, sizeof(struct sysfs_watch));
+	if (!watch) {
+		dprintf("calloc failed\n");
+		return NULL;
+	}
+	watch->fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC |
+			SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+	if (watch->fd < 0) {
+		dprintf("Error opening uevent socket\n");
+		free(watch);
+		return NULL;
+	}
+	/* forcing it past rmem_max needs CAP_NET_ADMIN, else take the max */
+	if (setsockopt(watch->fd, SOL_SOCKET, SO_RCVBUFFORCE, &size,
+				sizeof(size)))
+		setsockopt(watch->fd, SOL_SOCKET, SO_RCVBUF, &size,
+				sizeof(size));
+
+	memset(&addr, 0, sizeof(struct sockaddr_nl));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = 1;	/* the kernel's own, not udev's */
+	if (bind(watch->fd, (struct sockaddr *)&addr,
+				sizeof(struct sockaddr_nl))) {
+		dprintf("Error binding uevent socket\n");
+		close(watch->fd);
+		free(watch);
+		return NULL;
+	}
+	return watch;
+}
+
+/**
+ * sysfs_close_watch: stops watching, leaving the buses and classes watched
+ *	open as they are
+ */
+void sysfs_close_watch(struct sysfs_watch *watch)
+{
+	struct watch_target *target;
+
+	if (!watch)
+		return;
+	while ((target = watch->targets) != NULL) {
+		watch->targets = target->next;
+		free(target);
+	}
+	close(watch->fd);
+	free(watch);
+}
+
+static int add_target(struct sysfs_watch *watch, struct sysfs_bus *bus,
+		struct sysfs_class *cls,
+		void (*callback)(const struct sysfs_uevent *event,
+			void *entry, void *data), void *data)
+{
+	struct watch_target *target, **end;
+
+	target = (struct watch_target *)calloc(1,
+			sizeof(struct watch_target));
+	if (!target) {
+		dprintf("calloc failed\n");
+		return -1;
+	}
+	target->bus = bus;
+	target->cls = cls;
+	target->callback = callback;
+	target->data = data;
+	/* callbacks are called in the order they were added */
+	for (end = &watch->targets; *end; end = &(*end)->next)
+		;
+	*end = target;
+	return 0;
+}
+
+/**
+ * sysfs_watch_bus: keep the device and driver lists of bus up to date
+ * @watch: watch to apply events from
+ * @bus: open bus, not from an SYSFS_OPT_ARENA pool: entries removed
+ *	from one couldn't be given back until the bus is closed
+ * @callback: called for every event on the bus, may be NULL
+ * @data: passed to callback
+ * returns 0 with success and -1 with error.
+ */
+int sysfs_watch_bus(struct sysfs_watch *watch, struct sysfs_bus *bus,
+		void (*callback)(const struct sysfs_uevent *event,
+			void *entry, void *data), void *data)
+{
+	if (!watch || !bus || bus->arena) {
+		errno = EINVAL;
+		return -1;
+	}
+	return add_target(watch, bus, NULL, callback, data);
+}
+
+/**
+ * sysfs_watch_class: keep the device list of cls up to date
+ * @watch: watch to apply events from
+ * @cls: open class, not from an SYSFS_OPT_ARENA pool
+ * @callback: called for every event on the class, may be NULL
+ * @data: passed to callback
+ * returns 0 with success and -1 with error.
+ */
+int sysfs_watch_class(struct sysfs_watch *watch, struct sysfs_class *cls,
+		void (*callback)(const struct sysfs_uevent *event,
+			void *entry, void *data), void *data)
+{
+	if (!watch || !cls || cls->arena) {
+		errno = EINVAL;
+		return -1;
+	}
+	return add_target(watch, NULL, cls, callback, data);
+}
+
+/**
+ * sysfs_unwatch: stop keeping a bus or class watched up to date, which
+ *	has to be done before closing it
+ * @watch: watch it was given to
+ * @obj: struct sysfs_bus or struct sysfs_class
+ * returns 0 with success and -1 if obj wasn't being watched.
+ */
+int sysfs_unwatch(struct sysfs_watch *watch, void *obj)
+{
+	struct watch_target *target, **prev;
+	int found = 0;
+
+	if (!watch || !obj) {
+		errno = EINVAL;
+		return -1;
+	}
+	prev = &watch->targets;
+	while ((target = *prev) != NULL) {
+		if ((void *)target->bus == obj || (void *)target->cls == obj) {
+			*prev = target->next;
+			free(target);
+			found = 1;
+		} else
+			prev = &target->next;
+	}
+	if (!found) {
+		errno = ENOENT;
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * sysfs_get_watch_fd: fd to poll() for POLLIN alongside others, calling
+ *	sysfs_read_watch() with no timeout when it's readable
+ */
+int sysfs_get_watch_fd(struct sysfs_watch *watch)
+{
+	if (!watch) {
+		errno = EINVAL;
+		return -1;
+	}
+	return watch->fd;
+}
+
+/**
+ * sysfs_read_watch: applies every uevent pending, after waiting for one
+ * @watch: watch to read
+ * @timeout: milliseconds to wait for the first event, -1 for ever and 0
+ *	not at all
+ * returns the number of events applied with success, and -1 with error.
+ *	ENOBUFS means events were lost because they weren't read quickly
+ *	enough, and the lists watched may need rescanning.
+ */
+int sysfs_read_watch(struct sysfs_watch *watch, int timeout)
+{
+	struct sysfs_uevent event;
+	struct sockaddr_nl addr;
+	struct pollfd pfd;
+	socklen_t addrlen;
+	ssize_t len;
+	int count = 0;
+
+	if (!watch) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (timeout != 0) {
+		pfd.fd = watch->fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, timeout) < 0)
+			return -1;
+	}
+	for (;;) {
+		addrlen = sizeof(struct sockaddr_nl);
+		len = recvfrom(watch->fd, watch->buf, WATCH_BUF_SIZE - 1, 0,
+				(struct sockaddr *)&addr, &addrlen);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			dprintf("Error reading uevent socket\n");
+			return -1;
+		}
+		/* anything not sent by the kernel itself is ignored */
+		if (addrlen != sizeof(struct sockaddr_nl) || addr.nl_pid != 0)
+			continue;
+		watch->buf[len] = '\0';
+		if (parse_uevent(watch->buf, len, &event))
+			continue;
+		apply_event(watch, &event);
+		count++;
+	}
+	return count;
+}
+
+#else
+
+struct sysfs_watch *sysfs_open_watch(void)
+{
+	errno = ENOSYS;
+	return NULL;
+}
+
+void sysfs_close_watch(struct sysfs_watch *watch)
+{
+	(void)watch;
+}
+
+int sysfs_watch_bus(struct sysfs_watch *watch, struct sysfs_bus *bus,
+		void (*callback)(const struct sysfs_uevent *event,
+			void *entry, void *data), void *data)
+{
+	(void)watch;
+	(void)bus;
+	(void)callback;
+	(void)data;
+	errno = ENOSYS;
+	return -1;
+}
+
+int sysfs_watch_class(struct sysfs_watch *watch, struct sysfs_class *cls,
+		void (*callback)(const struct sysfs_uevent *event,
+			void *entry, void *data), void *data)
+{
+	(void)watch;
+	(void)cls;
+	(void)callback;
+	(void)data;
+	errno = ENOSYS;
+	return -1;
+}
+
+int sysfs_unwatch(struct sysfs_watch *watch, void *obj)
+{
+	(void)watch;
+	(void)obj;
+	errno = ENOSYS;
+	return -1;
+}
+
+int sysfs_get_watch_fd(struct sysfs_watch *watch)
+{
+	(void)watch;
+	errno = ENOSYS;
+	return -1;
+}
+
+int sysfs_read_watch(struct sysfs_watch *watch, int timeout)
+{
+	(void)watch;
+	(void)timeout;
+	errno = ENOSYS;
+	return -1;
+}
+
+#endif
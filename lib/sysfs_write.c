@@ -0,0 +1,258 @@
+/*
+ * sysfs_write.c
+ *
+ * Batched attribute writes for libsysfs
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "libsysfs.h"
+#include "sysfs.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+
+/*
+ * Each value is stored in two goes: store_value() writes the attribute's
+ * file and leaves the sysfs_attribute alone, then cache_value() keeps
+ * what was written as the attribute's value. With SYSFS_WRITE_PARALLEL
+ * the files are written from several threads, and the values are kept
+ * afterwards, in the calling thread, so nothing of an attribute, or of
+ * the arena it may come from, is shared between threads. Requests are
+ * spread by device: all those for one directory go to one thread, in
+ * the order given, since one device's settings often depend on another.
+ */
+
+struct write_entry {
+	const char *path;
+	size_t dirlen;		/* path up to its last '/' */
+	unsigned int index;	/* of the request */
+};
+
+struct write_batch {
+	struct sysfs_write_request *reqs;
+	struct write_entry *entries;	/* sorted by directory */
+	unsigned int *groups;		/* where each directory's entries start */
+	unsigned int ngroups;
+	unsigned int next;		/* next group to take */
+	unsigned int flags;
+	struct sysfs_context *context;	/* the caller's, for every thread */
+};
+
+static int check_request(struct sysfs_write_request *req)
+{
+	if (!req->attr || !req->value || req->len == 0) {
+		req->status = SYSFS_WRITE_FAILED;
+		req->error = EINVAL;
+		return -1;
+	}
+	req->status = SYSFS_WRITE_DONE;
+	req->error = 0;
+	return 0;
+}
+
+static void store_request(struct sysfs_write_request *req, unsigned int flags)
+{
+	int ret;
+
+	ret = store_value(req->attr, req->value, req->len, flags);
+	if (ret < 0) {
+		req->status = SYSFS_WRITE_FAILED;
+		req->error = errno;
+	} else {
+		req->status = ret ? SYSFS_WRITE_SAME : SYSFS_WRITE_DONE;
+		req->error = 0;
+	}
+}
+
+static void cache_request(struct sysfs_write_request *req)
+{
+	if (req->status != SYSFS_WRITE_FAILED)
+		cache_value(req->attr, req->value, req->len);
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+	const struct write_entry *ea = (const struct write_entry *)a;
+	const struct write_entry *eb = (const struct write_entry *)b;
+	size_t len = ea->dirlen < eb->dirlen ? ea->dirlen : eb->dirlen;
+	int ret;
+
+	ret = memcmp(ea->path, eb->path, len);
+	if (!ret && ea->dirlen != eb->dirlen)
+		ret = ea->dirlen < eb->dirlen ? -1 : 1;
+	if (!ret)
+		ret = ea->index < eb->index ? -1 : (ea->index > eb->index);
+	return ret;
+}
+
+/**
+ * store_groups: stores the requests of group after group, until there
+ *	are none left to take
+ */
+static void store_groups(struct write_batch *batch)
+{
+	unsigned int group, i;
+
+	while ((group = __atomic_fetch_add(&batch->next, 1,
+					__ATOMIC_RELAXED)) < batch->ngroups)
+		for (i = batch->groups[group]; i < batch->groups[group + 1];
+				i++)
+			store_request(&batch->reqs[batch->entries[i].index],
+					batch->flags);
+}
+
+#ifdef HAVE_PTHREAD_H
+static void *write_worker_run(void *arg)
+{
+	struct write_batch *batch = (struct write_batch *)arg;
+	struct sysfs_context *prev;
+
+	prev = sysfs_use_context(batch->context);
+	store_groups(batch);
+	sysfs_use_context(prev);
+	return NULL;
+}
+#endif
+
+/**
+ * store_parallel: stores the checked requests a device at a time, on up
+ *	to threads threads including the calling one
+ * returns 0 with success and -1 with error, having stored nothing.
+ */
+static int store_parallel(struct sysfs_write_request *reqs, int count,
+		unsigned int flags, unsigned int threads)
+{
+	struct write_batch batch;
+	const char *slash;
+	unsigned int i, n = 0;
+#ifdef HAVE_PTHREAD_H
+	pthread_t *workers;
+	unsigned int started;
+#endif
+
+	memset(&batch, 0, sizeof(struct write_batch));
+	batch.entries = (struct write_entry *)calloc(count + 1,
+			sizeof(struct write_entry));
+	batch.groups = (unsigned int *)calloc(count + 1,
+			sizeof(unsigned int));
+	if (!batch.entries || !batch.groups) {
+		dprintf("calloc failed\n");
+		free(batch.entries);
+		free(batch.groups);
+		return -1;
+	}
+	for (i = 0; i < (unsigned int)count; i++) {
+		if (reqs[i].status == SYSFS_WRITE_FAILED)
+			continue;
+		batch.entries[n].path = reqs[i].attr->path;
+		slash = strrchr(reqs[i].attr->path, '/');
+		batch.entries[n].dirlen = slash ?
+				(size_t)(slash - reqs[i].attr->path) : 0;
+		batch.entries[n++].index = i;
+	}
+	qsort(batch.entries, n, sizeof(struct write_entry), compare_entries);
+	for (i = 0; i < n; i++)
+		if (!i || batch.entries[i].dirlen !=
+				batch.entries[i - 1].dirlen ||
+				memcmp(batch.entries[i].path,
+					batch.entries[i - 1].path,
+					batch.entries[i].dirlen))
+			batch.groups[batch.ngroups++] = i;
+	batch.groups[batch.ngroups] = n;
+	batch.reqs = reqs;
+	batch.flags = flags;
+	batch.context = context_in_use();
+	if (threads > batch.ngroups)
+		threads = batch.ngroups;
+
+#ifdef HAVE_PTHREAD_H
+	workers = threads > 1 ? (pthread_t *)calloc(threads,
+			sizeof(pthread_t)) : NULL;
+	for (started = 1; workers && started < threads; started++)
+		if (pthread_create(&workers[started], NULL, write_worker_run,
+					&batch)) {
+			dprintf("Error starting write worker\n");
+			break;
+		}
+	/* whatever the workers that didn't start would have done is left here */
+	store_groups(&batch);
+	for (i = 1; workers && i < started; i++)
+		pthread_join(workers[i], NULL);
+	free(workers);
+#else
+	(void)threads;
+	store_groups(&batch);
+#endif
+
+	free(batch.entries);
+	free(batch.groups);
+	return 0;
+}
+
+/**
+ * sysfs_write_attributes: store a set of values
+ * @reqs: what to write where, with each request's status set on return
+ * @count: number of requests in reqs
+ * @flags: SYSFS_WRITE_* flags saying how
+ *
+ * Values are written in order, or with SYSFS_WRITE_PARALLEL in order for
+ * each device, several devices at once. The values written are kept as
+ * the attributes', as with sysfs_write_attribute().
+ * returns 0 with success and -1 if any value could not be stored.
+ */
+int sysfs_write_attributes(struct sysfs_write_request *reqs, int count,
+		unsigned int flags)
+{
+	unsigned int threads = sysfs_get_threads();
+	int i, failed = 0, error = 0;
+
+	if (!reqs || count < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if ((flags & SYSFS_WRITE_PARALLEL) && threads > 1 && count > 1) {
+		for (i = 0; i < count; i++)
+			check_request(&reqs[i]);
+		if (store_parallel(reqs, count, flags, threads))
+			return -1;
+		for (i = 0; i < count; i++)
+			cache_request(&reqs[i]);
+	} else {
+		for (i = 0; i < count; i++) {
+			if (check_request(&reqs[i]))
+				continue;
+			store_request(&reqs[i], flags);
+			cache_request(&reqs[i]);
+		}
+	}
+	for (i = 0; i < count; i++) {
+		if (reqs[i].status != SYSFS_WRITE_FAILED)
+			continue;
+		if (!failed++)
+			error = reqs[i].error;
+	}
+	if (failed) {
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
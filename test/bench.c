@@ -0,0 +1,917 @@
+/*
+ * bench.c
+ *
+ * Benchmarks for libsysfs, on a synthetic sysfs tree of any size
+ *
+ * Copyright (C) IBM Corp. 2003-2005
+ *
+ *      This program is free software; you can redistribute it and/or modify it
+ *      under the terms of the GNU General Public License as published by the
+ *      Free Software Foundation version 2 of the License.
+ *
+ *      This program is distributed in the hope that it will be useful, but
+ *      WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/*
+ * benchlibsysfs builds a tree laid out the way sysfs is under a temporary
+ * directory, points SYSFS_PATH at it and times the library's scans over
+ * it: N buses of M devices each, K attributes a device, every device
+ * bound to one of a few drivers and with F class devices in F classes.
+ * With -r it times an existing tree instead, such as /sys or a snapshot.
+ *
+ * Besides the time each operation takes, it counts the file system calls
+ * and allocations the library makes for it, by standing in for the libc
+ * functions doing them. Those counts don't change from run to run on the
+ * same tree, so they catch scans that start doing more work even where
+ * timings are too noisy to.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef HAVE_DLFCN_H
+#include <dlfcn.h>
+#endif
+
+#include "libsysfs.h"
+
+#define BENCH_CLASSES_MAX	16
+#define BENCH_DRIVERS		4
+
+static unsigned int nbuses = 4;
+static unsigned int ndevices = 256;
+static unsigned int nattrs = 16;
+static unsigned int fanout = 2;
+static unsigned int iterations = 10;
+
+/* what the library has called since the counters were last read */
+static unsigned long syscalls;
+static unsigned long allocs;
+
+#ifdef HAVE_DLFCN_H
+/*
+ * Counting libc stand ins. Only calls made from outside libc come
+ * through these, which is all libsysfs makes itself; the getdents()
+ * under readdir() isn't seen. The benchmark runs in one thread, so the
+ * counters aren't atomic.
+ */
+#define COUNTED 1
+
+static void *real(const char *name)
+{
+	void *fn = dlsym(RTLD_NEXT, name);
+
+	if (!fn) {
+		fprintf(stderr, "benchlibsysfs: no %s in libc\n", name);
+		abort();
+	}
+	return fn;
+}
+
+#define REAL(type, name, args) \
+	static type (*real_##name) args; \
+	if (!real_##name) \
+		real_##name = (type (*) args)real(#name)
+
+int open(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list ap;
+	REAL(int, open, (const char *, int, ...));
+
+	if (flags & O_CREAT) {
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+	syscalls++;
+	return real_open(path, flags, mode);
+}
+
+int openat(int dirfd, const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list ap;
+	REAL(int, openat, (int, const char *, int, ...));
+
+	if (flags & O_CREAT) {
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+	syscalls++;
+	return real_openat(dirfd, path, flags, mode);
+}
+
+int close(int fd)
+{
+	REAL(int, close, (int));
+
+	syscalls++;
+	return real_close(fd);
+}
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+	REAL(ssize_t, read, (int, void *, size_t));
+
+	syscalls++;
+	return real_read(fd, buf, count);
+}
+
+ssize_t pread(int fd, void *buf, size_t count, off_t offset)
+{
+	REAL(ssize_t, pread, (int, void *, size_t, off_t));
+
+	syscalls++;
+	return real_pread(fd, buf, count, offset);
+}
+
+int stat(const char *path, struct stat *buf)
+{
+	REAL(int, stat, (const char *, struct stat *));
+
+	syscalls++;
+	return real_stat(path, buf);
+}
+
+int lstat(const char *path, struct stat *buf)
+{
+	REAL(int, lstat, (const char *, struct stat *));
+
+	syscalls++;
+	return real_lstat(path, buf);
+}
+
+int fstat(int fd, struct stat *buf)
+{
+	REAL(int, fstat, (int, struct stat *));
+
+	syscalls++;
+	return real_fstat(fd, buf);
+}
+
+int fstatat(int dirfd, const char *path, struct stat *buf, int flags)
+{
+	REAL(int, fstatat, (int, const char *, struct stat *, int));
+
+	syscalls++;
+	return real_fstatat(dirfd, path, buf, flags);
+}
+
+ssize_t readlink(const char *path, char *buf, size_t len)
+{
+	REAL(ssize_t, readlink, (const char *, char *, size_t));
+
+	syscalls++;
+	return real_readlink(path, buf, len);
+}
+
+ssize_t readlinkat(int dirfd, const char *path, char *buf, size_t len)
+{
+	REAL(ssize_t, readlinkat, (int, const char *, char *, size_t));
+
+	syscalls++;
+	return real_readlinkat(dirfd, path, buf, len);
+}
+
+/*
+ * dlsym() can itself allocate, before the real allocator is known, so
+ * those first few come out of a static buffer and are never freed.
+ */
+static char early_heap[4096];
+static size_t early_used;
+static int resolving;
+
+static void *early_alloc(size_t size)
+{
+	void *p;
+
+	size = (size + 15) & ~(size_t)15;
+	if (early_used + size > sizeof(early_heap))
+		return NULL;
+	p = early_heap + early_used;
+	early_used += size;
+	return p;
+}
+
+static int early(void *ptr)
+{
+	return (char *)ptr >= early_heap &&
+		(char *)ptr < early_heap + sizeof(early_heap);
+}
+
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+
+static void resolve_allocator(void)
+{
+	resolving = 1;
+	real_malloc = (void *(*)(size_t))real("malloc");
+	real_calloc = (void *(*)(size_t, size_t))real("calloc");
+	real_realloc = (void *(*)(void *, size_t))real("realloc");
+	real_free = (void (*)(void *))real("free");
+	resolving = 0;
+}
+
+void *malloc(size_t size)
+{
+	if (!real_malloc) {
+		if (resolving)
+			return early_alloc(size);
+		resolve_allocator();
+	}
+	allocs++;
+	return real_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if (!real_calloc) {
+		if (resolving)
+			return early_alloc(nmemb * size);	/* zeroed */
+		resolve_allocator();
+	}
+	allocs++;
+	return real_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (!real_realloc)
+		resolve_allocator();
+	allocs++;
+	if (early(ptr)) {
+		size_t left = early_heap + sizeof(early_heap) - (char *)ptr;
+		void *p = real_malloc(size);
+
+		if (p)
+			memcpy(p, ptr, size < left ? size : left);
+		return p;
+	}
+	return real_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+	if (!ptr || early(ptr))
+		return;
+	if (!real_free)
+		resolve_allocator();
+	real_free(ptr);
+}
+#endif /* HAVE_DLFCN_H */
+
+static void print_usage(void)
+{
+	fprintf(stdout, "Usage: benchlibsysfs [-b buses] [-d devices] "
+			"[-a attributes] [-f fanout]\n"
+			"\t\t[-i iterations] [-k] [-r root]\n"
+			"\t-b\tbuses to generate (%u)\n"
+			"\t-d\tdevices on each bus (%u)\n"
+			"\t-a\tattributes of each device (%u)\n"
+			"\t-f\tclass devices, and classes, for each device "
+			"(%u, at most %u)\n"
+			"\t-i\ttimes each operation is repeated (%u)\n"
+			"\t-k\tkeep the generated tree and print where it is\n"
+			"\t-r\ttime the tree at root, a sysfs mount or "
+			"snapshot, instead\n",
+			nbuses, ndevices, nattrs, fanout, BENCH_CLASSES_MAX,
+			iterations);
+}
+
+/*
+ * The generated tree.
+ */
+static char fixture[SYSFS_PATH_MAX];
+
+static int make_dir(const char *fmt, ...)
+	__attribute__ ((format (printf, 1, 2)));
+static int make_file(const char *contents, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+static int make_link(const char *target, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+static void fixture_path(char *path, const char *fmt, va_list ap)
+{
+	size_t len;
+
+	len = snprintf(path, SYSFS_PATH_MAX, "%s/", fixture);
+	vsnprintf(path + len, SYSFS_PATH_MAX - len, fmt, ap);
+}
+
+static int make_dir(const char *fmt, ...)
+{
+	char path[SYSFS_PATH_MAX];
+	va_list ap;
+
+	va_start(ap, fmt);
+	fixture_path(path, fmt, ap);
+	va_end(ap);
+	if (mkdir(path, 0755) && errno != EEXIST) {
+		fprintf(stderr, "Error creating %s: %s\n", path,
+				strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static int make_file(const char *contents, const char *fmt, ...)
+{
+	char path[SYSFS_PATH_MAX];
+	size_t len = strlen(contents);
+	va_list ap;
+	int fd;
+
+	va_start(ap, fmt);
+	fixture_path(path, fmt, ap);
+	va_end(ap);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0 || write(fd, contents, len) != (ssize_t)len) {
+		fprintf(stderr, "Error writing %s: %s\n", path,
+				strerror(errno));
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+static int make_link(const char *target, const char *fmt, ...)
+{
+	char path[SYSFS_PATH_MAX];
+	va_list ap;
+
+	va_start(ap, fmt);
+	fixture_path(path, fmt, ap);
+	va_end(ap);
+	if (symlink(target, path)) {
+		fprintf(stderr, "Error linking %s: %s\n", path,
+				strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * make_device: one device of a bus, with its attributes, links and
+ *	class devices
+ */
+static int make_device(unsigned int bus, unsigned int dev)
+{
+	char name[SYSFS_NAME_LEN], value[SYSFS_NAME_LEN];
+	char target[SYSFS_PATH_MAX];
+	unsigned int i, drv = dev % BENCH_DRIVERS;
+
+	snprintf(name, sizeof(name), "dev%u.%u", bus, dev);
+	if (make_dir("devices/bench%u/%s", bus, name))
+		return -1;
+	for (i = 0; i < nattrs; i++) {
+		snprintf(value, sizeof(value), "%u\n", bus * ndevices + dev + i);
+		if (make_file(value, "devices/bench%u/%s/attr%u",
+					bus, name, i))
+			return -1;
+	}
+	snprintf(value, sizeof(value), "DRIVER=drv%u\n", drv);
+	if (make_file(value, "devices/bench%u/%s/uevent", bus, name))
+		return -1;
+	snprintf(target, sizeof(target), "../../../bus/bench%u", bus);
+	if (make_link(target, "devices/bench%u/%s/subsystem", bus, name))
+		return -1;
+	snprintf(target, sizeof(target), "../../../bus/bench%u/drivers/drv%u",
+			bus, drv);
+	if (make_link(target, "devices/bench%u/%s/driver", bus, name))
+		return -1;
+	snprintf(target, sizeof(target), "../../../devices/bench%u/%s",
+			bus, name);
+	if (make_link(target, "bus/bench%u/devices/%s", bus, name))
+		return -1;
+	snprintf(target, sizeof(target), "../../../../devices/bench%u/%s",
+			bus, name);
+	if (make_link(target, "bus/bench%u/drivers/drv%u/%s", bus, drv, name))
+		return -1;
+
+	for (i = 0; i < fanout; i++) {
+		if (make_dir("devices/bench%u/%s/class%u", bus, name, i) ||
+		    make_dir("devices/bench%u/%s/class%u/c%s", bus, name, i,
+			    name) ||
+		    make_file(name, "devices/bench%u/%s/class%u/c%s/label",
+			    bus, name, i, name) ||
+		    make_file("0\n", "devices/bench%u/%s/class%u/c%s/index",
+			    bus, name, i, name) ||
+		    make_link("../../", "devices/bench%u/%s/class%u/c%s/device",
+			    bus, name, i, name))
+			return -1;
+		snprintf(target, sizeof(target), "../../../../../class/class%u",
+				i);
+		if (make_link(target, "devices/bench%u/%s/class%u/c%s/subsystem",
+					bus, name, i, name))
+			return -1;
+		snprintf(target, sizeof(target),
+				"../../devices/bench%u/%s/class%u/c%s",
+				bus, name, i, name);
+		if (make_link(target, "class/class%u/c%s", i, name))
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * make_fixture: generates the tree under a new temporary directory
+ * returns 0 with success and -1 with error.
+ */
+static int make_fixture(void)
+{
+	unsigned int bus, dev, i;
+	const char *tmp = getenv("TMPDIR");
+
+	snprintf(fixture, sizeof(fixture), "%s/sysfs-bench-XXXXXX",
+			tmp ? tmp : "/tmp");
+	if (!mkdtemp(fixture)) {
+		fprintf(stderr, "Error creating %s: %s\n", fixture,
+				strerror(errno));
+		return -1;
+	}
+	if (make_dir("devices") || make_dir("bus") || make_dir("class") ||
+	    make_dir("module") || make_dir("block"))
+		return -1;
+	for (i = 0; i < fanout; i++)
+		if (make_dir("class/class%u", i))
+			return -1;
+	for (bus = 0; bus < nbuses; bus++) {
+		if (make_dir("devices/bench%u", bus) ||
+		    make_file("", "devices/bench%u/uevent", bus) ||
+		    make_dir("bus/bench%u", bus) ||
+		    make_dir("bus/bench%u/devices", bus) ||
+		    make_dir("bus/bench%u/drivers", bus) ||
+		    make_file("1\n", "bus/bench%u/drivers_autoprobe", bus))
+			return -1;
+		for (i = 0; i < BENCH_DRIVERS; i++)
+			if (make_dir("bus/bench%u/drivers/drv%u", bus, i) ||
+			    make_file("", "bus/bench%u/drivers/drv%u/uevent",
+				    bus, i))
+				return -1;
+		for (dev = 0; dev < ndevices; dev++)
+			if (make_device(bus, dev))
+				return -1;
+	}
+	return 0;
+}
+
+static int remove_entry(const char *path, const struct stat *sb, int flag,
+		struct FTW *ftw)
+{
+	(void)sb;
+	(void)flag;
+	(void)ftw;
+	return remove(path);
+}
+
+static void remove_fixture(void)
+{
+	if (nftw(fixture, remove_entry, 16, FTW_DEPTH | FTW_PHYS))
+		fprintf(stderr, "Error removing %s: %s\n", fixture,
+				strerror(errno));
+}
+
+/*
+ * The operations timed. Each is given the root and returns how many of
+ * whatever it goes through it did, or -1 with error.
+ */
+static char root[SYSFS_PATH_MAX];
+static struct dlist *buses;
+static struct dlist *classes;
+
+static void root_path(char *path, const char *fmt, ...)
+	__attribute__ ((format (printf, 2, 3)));
+
+static void root_path(char *path, const char *fmt, ...)
+{
+	size_t len;
+	va_list ap;
+
+	len = snprintf(path, SYSFS_PATH_MAX, "%s/", root);
+	va_start(ap, fmt);
+	vsnprintf(path + len, SYSFS_PATH_MAX - len, fmt, ap);
+	va_end(ap);
+}
+
+static long bench_bus_devices(void)
+{
+	struct sysfs_bus *bus;
+	char *name;
+	long n = 0;
+
+	dlist_for_each_data(buses, name, char) {
+		bus = sysfs_open_bus(name);
+		if (!bus)
+			return -1;
+		sysfs_get_bus_devices(bus);
+		sysfs_close_bus(bus);
+		n++;
+	}
+	return n;
+}
+
+static long bench_bus_drivers(void)
+{
+	struct sysfs_bus *bus;
+	char *name;
+	long n = 0;
+
+	dlist_for_each_data(buses, name, char) {
+		bus = sysfs_open_bus(name);
+		if (!bus)
+			return -1;
+		sysfs_get_bus_drivers(bus);
+		sysfs_close_bus(bus);
+		n++;
+	}
+	return n;
+}
+
+static long bench_class_devices(void)
+{
+	struct sysfs_class *cls;
+	char *name;
+	long n = 0;
+
+	dlist_for_each_data(classes, name, char) {
+		cls = sysfs_open_class(name);
+		if (!cls)
+			return -1;
+		sysfs_get_class_devices(cls);
+		sysfs_close_class(cls);
+		n++;
+	}
+	return n;
+}
+
+static long bench_device_tree(void)
+{
+	char path[SYSFS_PATH_MAX];
+	struct sysfs_device *tree;
+
+	root_path(path, "%s", SYSFS_DEVICES_NAME);
+	tree = sysfs_open_device_tree(path);
+	if (!tree)
+		return -1;
+	sysfs_close_device_tree(tree);
+	return 1;
+}
+
+/* every attribute of every device of the first bus, one device at a time */
+static long bench_device_attributes(void)
+{
+	struct sysfs_bus *bus;
+	struct sysfs_device *dev, *copy;
+	struct dlist *devices;
+	long n = 0;
+
+	if (!buses->count)
+		return 0;
+	bus = sysfs_open_bus((char *)buses->head->next->data);
+	if (!bus)
+		return -1;
+	devices = sysfs_get_bus_devices(bus);
+	if (devices) {
+		dlist_for_each_data(devices, dev, struct sysfs_device) {
+			copy = sysfs_open_device_path(dev->path);
+			if (!copy)
+				continue;
+			if (sysfs_get_device_attributes(copy))
+				n += copy->attrlist->count;
+			sysfs_close_device(copy);
+		}
+	}
+	sysfs_close_bus(bus);
+	return n;
+}
+
+/* one attribute opened, read and closed for each device of each bus */
+static long bench_attribute_read(void)
+{
+	char path[SYSFS_PATH_MAX];
+	struct sysfs_attribute *attr;
+	struct dlist *devices;
+	char *bus, *dev;
+	long n = 0;
+
+	dlist_for_each_data(buses, bus, char) {
+		root_path(path, "%s/%s/%s", SYSFS_BUS_NAME, bus,
+				SYSFS_DEVICES_NAME);
+		devices = sysfs_open_link_list(path);
+		if (!devices)
+			continue;
+		dlist_for_each_data(devices, dev, char) {
+			root_path(path, "%s/%s/%s/%s/uevent", SYSFS_BUS_NAME,
+					bus, SYSFS_DEVICES_NAME, dev);
+			attr = sysfs_open_attribute(path);
+			if (!attr)
+				continue;
+			if (!sysfs_read_attribute(attr))
+				n++;
+			sysfs_close_attribute(attr);
+		}
+		sysfs_close_list(devices);
+	}
+	return n;
+}
+
+static long bench_project_bus(void)
+{
+	const char *names[] = { "uevent", "attr0", "attr1", NULL };
+	struct sysfs_projection *proj;
+	struct sysfs_table *table;
+	struct sysfs_bus *bus;
+	char *name;
+	long n = 0;
+
+	proj = sysfs_open_projection(names);
+	if (!proj)
+		return -1;
+	dlist_for_each_data(buses, name, char) {
+		bus = sysfs_open_bus(name);
+		if (!bus)
+			continue;
+		table = sysfs_project_bus(bus, proj);
+		if (table)
+			n += table->nrows;
+		sysfs_close_table(table);
+		sysfs_close_bus(bus);
+	}
+	sysfs_close_projection(proj);
+	return n;
+}
+
+/* the names are in one array, not each allocated */
+static void leave_name(void *name)
+{
+	(void)name;
+}
+
+static int sort_by_name(void *a, void *b)
+{
+	return strcmp((char *)a, (char *)b);
+}
+
+static int name_before(void *a, void *b)
+{
+	return strcmp((char *)a, (char *)b) < 0;
+}
+
+static char *names;
+static unsigned int nnames;
+
+/* names in a scrambled but fixed order, as many as there are devices */
+static int make_names(void)
+{
+	unsigned int i, seed = 1;
+
+	nnames = nbuses * ndevices;
+	if (nnames < 1024)
+		nnames = 1024;
+	names = (char *)calloc(nnames, SYSFS_NAME_LEN);
+	if (!names)
+		return -1;
+	for (i = 0; i < nnames; i++) {
+		seed = seed * 1103515245 + 12345;
+		snprintf(names + i * SYSFS_NAME_LEN, SYSFS_NAME_LEN,
+				"dev%08x", seed);
+	}
+	return 0;
+}
+
+static long bench_dlist_sort(void)
+{
+	struct dlist *list;
+	unsigned int i;
+
+	list = dlist_new_with_delete(SYSFS_NAME_LEN, leave_name);
+	if (!list)
+		return -1;
+	for (i = 0; i < nnames; i++)
+		dlist_push(list, names + i * SYSFS_NAME_LEN);
+	dlist_sort_custom(list, sort_by_name);
+	dlist_destroy(list);
+	return nnames;
+}
+
+static long bench_dlist_insert(void)
+{
+	struct dlist *list;
+	unsigned int i, count = nnames > 4096 ? 4096 : nnames;
+
+	list = dlist_new_with_delete(SYSFS_NAME_LEN, leave_name);
+	if (!list)
+		return -1;
+	for (i = 0; i < count; i++)
+		dlist_unshift_sorted(list, names + i * SYSFS_NAME_LEN,
+				name_before);
+	dlist_destroy(list);
+	return count;
+}
+
+struct bench {
+	const char *name;
+	const char *unit;
+	long (*run)(void);
+};
+
+static const struct bench benches[] = {
+	{ "bus_devices", "bus", bench_bus_devices },
+	{ "bus_drivers", "bus", bench_bus_drivers },
+	{ "class_devices", "class", bench_class_devices },
+	{ "device_tree", "tree", bench_device_tree },
+	{ "device_attributes", "attr", bench_device_attributes },
+	{ "attribute_read", "attr", bench_attribute_read },
+	{ "project_bus", "row", bench_project_bus },
+	{ "dlist_sort", "elem", bench_dlist_sort },
+	{ "dlist_insert_sorted", "elem", bench_dlist_insert },
+	{ NULL, NULL, NULL }
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * run_bench: runs one operation iterations times and prints what it cost
+ * returns 0 with success and -1 with error.
+ */
+static int run_bench(const struct bench *b)
+{
+	unsigned long calls, allocated;
+	double start, elapsed;
+	long n, ops = 0;
+	unsigned int i;
+
+	/* a first run to warm the caches up, not counted */
+	if (b->run() < 0) {
+		fprintf(stderr, "%s failed: %s\n", b->name, strerror(errno));
+		return -1;
+	}
+	syscalls = allocs = 0;
+	start = now();
+	for (i = 0; i < iterations; i++) {
+		n = b->run();
+		if (n < 0) {
+			fprintf(stderr, "%s failed: %s\n", b->name,
+					strerror(errno));
+			return -1;
+		}
+		ops += n;
+	}
+	elapsed = now() - start;
+	calls = syscalls;
+	allocated = allocs;
+	if (!ops)
+		ops = 1;
+	fprintf(stdout, "%-20s %-6s %10ld %12.0f %10.3f", b->name, b->unit,
+			ops / iterations, ops / elapsed, elapsed * 1e6 / ops);
+#ifdef COUNTED
+	fprintf(stdout, " %10.1f %10.1f\n", (double)calls / ops,
+			(double)allocated / ops);
+#else
+	(void)calls;
+	(void)allocated;
+	fprintf(stdout, " %10s %10s\n", "-", "-");
+#endif
+	return 0;
+}
+
+static int parse_count(const char *arg, unsigned int *count)
+{
+	char *end;
+	unsigned long val;
+
+	errno = 0;
+	val = strtoul(arg, &end, 10);
+	if (errno || *end || end == arg || val > 1000000) {
+		fprintf(stderr, "Invalid count %s\n", arg);
+		return -1;
+	}
+	*count = val;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct bench *b;
+	char path[SYSFS_PATH_MAX];
+	int opt, keep = 0, retval = 0;
+	const char *existing = NULL;
+
+	while ((opt = getopt(argc, argv, "a:b:d:f:hi:kr:")) != EOF) {
+		switch (opt) {
+		case 'a':
+			if (parse_count(optarg, &nattrs))
+				return 1;
+			break;
+		case 'b':
+			if (parse_count(optarg, &nbuses))
+				return 1;
+			break;
+		case 'd':
+			if (parse_count(optarg, &ndevices))
+				return 1;
+			break;
+		case 'f':
+			if (parse_count(optarg, &fanout))
+				return 1;
+			if (fanout > BENCH_CLASSES_MAX) {
+				print_usage();
+				return 1;
+			}
+			break;
+		case 'i':
+			if (parse_count(optarg, &iterations))
+				return 1;
+			break;
+		case 'k':
+			keep = 1;
+			break;
+		case 'r':
+			existing = optarg;
+			break;
+		case 'h':
+		default:
+			print_usage();
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (optind != argc || !iterations || !nbuses || !ndevices) {
+		print_usage();
+		return 1;
+	}
+
+	if (existing) {
+		snprintf(root, sizeof(root), "%s", existing);
+	} else {
+		if (make_fixture()) {
+			remove_fixture();
+			return 1;
+		}
+		snprintf(root, sizeof(root), "%s", fixture);
+		fprintf(stdout, "%u buses of %u devices, %u attributes each, "
+				"%u class devices each\n",
+				nbuses, ndevices, nattrs, fanout);
+	}
+	/* before anything asks the library where sysfs is */
+	setenv(SYSFS_PATH_ENV, root, 1);
+
+	root_path(path, "%s", SYSFS_BUS_NAME);
+	buses = sysfs_open_directory_list(path);
+	root_path(path, "%s", SYSFS_CLASS_NAME);
+	classes = sysfs_open_directory_list(path);
+	if (!buses || !classes || make_names()) {
+		fprintf(stderr, "Error reading %s\n", root);
+		retval = 1;
+		goto out;
+	}
+
+	fprintf(stdout, "%-20s %-6s %10s %12s %10s %10s %10s\n", "operation",
+			"unit", "units", "units/s", "us/unit", "calls/unit",
+			"allocs/unit");
+	for (b = benches; b->name; b++)
+		if (run_bench(b))
+			retval = 1;
+
+out:
+	sysfs_close_list(buses);
+	sysfs_close_list(classes);
+	free(names);
+	if (!existing) {
+		if (keep)
+			fprintf(stdout, "tree kept at %s\n", fixture);
+		else
+			remove_fixture();
+	}
+	return retval;
+}
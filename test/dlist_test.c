@@ -62,7 +62,9 @@ Simple *simple_maker(int ,char *);
 
 int main (void)
 {
-  Dlist *list;
+  Dlist *list, *batch;
+  unsigned long count;
+  int sorted;
   Simple *s1,*s2,*s3,*stemp;
   Complex *c1,*c2,*c3, *c4, *ctemp, *cfound;
   while(1)
@@ -188,6 +190,31 @@ int main (void)
 	dlist_filter_sort(list, complex_filter, complex_comp);
 	printf("custom filtered and sorted output\n");
 	complex_dump(list);
+      if((batch=dlist_new_with_delete(sizeof(Complex),complex_del))==NULL)
+	{
+	  fprintf(stderr,"ERR dlist_new fail\n");
+	  return(2);
+	}
+      dlist_push(batch,complex_maker(5,5,"five"));
+      dlist_push(batch,complex_maker(0,0,"zero"));
+      dlist_push(batch,complex_maker(3,3,"three again"));
+      count=list->count+batch->count;
+      dlist_merge_sorted(list,batch,complex_comp);
+      printf("merge sorted output\n");
+      complex_dump(list);
+      ctemp=NULL;
+      sorted=1;
+      dlist_for_each_data(list,cfound,Complex)
+	{
+	  if(ctemp!=NULL && complex_comp(ctemp,cfound)>0)
+	    sorted=0;
+	  ctemp=cfound;
+	}
+      if(list->count!=count || !sorted)
+	{
+	  printf("ERROR merge sorted output out of order\n");
+	  return(3);
+	}
       dlist_destroy(list);
     }
   return(0);
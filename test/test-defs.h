@@ -81,6 +81,9 @@ extern int test_sysfs_close_attribute(int flag);
 extern int test_sysfs_open_attribute(int flag);
 extern int test_sysfs_read_attribute(int flag);
 extern int test_sysfs_write_attribute(int flag);
+extern int test_sysfs_read_attributes(int flag);
+extern int test_sysfs_write_attributes(int flag);
+extern int test_sysfs_hold_attribute(int flag);
 extern int test_sysfs_close_driver(int flag);
 extern int test_sysfs_open_driver(int flag);
 extern int test_sysfs_open_driver_path(int flag);
@@ -121,5 +124,11 @@ extern int test_sysfs_get_module_parms(int flag);
 extern int test_sysfs_get_module_sections(int flag);
 extern int test_sysfs_get_module_parm(int flag);
 extern int test_sysfs_get_module_section(int flag);
+extern int test_sysfs_write_snapshot(int flag);
+extern int test_sysfs_close_topology(int flag);
+extern int test_sysfs_open_topology(int flag);
+extern int test_sysfs_topology_device(int flag);
+extern int test_sysfs_topology_class_devices(int flag);
+extern int test_sysfs_topology_driver_devices(int flag);
 
 #endif /* _TESTER_H_ */
@@ -45,6 +45,9 @@ char *function_name[] = {
 	"sysfs_open_attribute",
 	"sysfs_read_attribute",
 	"sysfs_write_attribute",
+	"sysfs_read_attributes",
+	"sysfs_write_attributes",
+	"sysfs_hold_attribute",
 	"sysfs_close_driver",
 	"sysfs_open_driver",
 	"sysfs_open_driver_path",
@@ -83,6 +86,12 @@ char *function_name[] = {
 	"sysfs_get_module_sections",
 	"sysfs_get_module_parm",
 	"sysfs_get_module_section",
+	"sysfs_write_snapshot",
+	"sysfs_close_topology",
+	"sysfs_open_topology",
+	"sysfs_topology_device",
+	"sysfs_topology_class_devices",
+	"sysfs_topology_driver_devices",
 };
 
 int (*func_table[])(int) = {
@@ -100,6 +109,9 @@ int (*func_table[])(int) = {
 	test_sysfs_open_attribute,
 	test_sysfs_read_attribute,
 	test_sysfs_write_attribute,
+	test_sysfs_read_attributes,
+	test_sysfs_write_attributes,
+	test_sysfs_hold_attribute,
 	test_sysfs_close_driver,
 	test_sysfs_open_driver,
 	test_sysfs_open_driver_path,
@@ -138,6 +150,12 @@ int (*func_table[])(int) = {
 	test_sysfs_get_module_sections,
 	test_sysfs_get_module_parm,
 	test_sysfs_get_module_section,
+	test_sysfs_write_snapshot,
+	test_sysfs_close_topology,
+	test_sysfs_open_topology,
+	test_sysfs_topology_device,
+	test_sysfs_topology_class_devices,
+	test_sysfs_topology_driver_devices,
 };
 
 char *dir_paths[] = {
@@ -30,6 +30,11 @@
  * extern int sysfs_read_attribute(struct sysfs_attribute *sysattr);
  * extern int sysfs_write_attribute(struct sysfs_attribute *sysattr,
  * 		const char *new_value, size_t len);
+ * extern int sysfs_read_attributes(struct sysfs_attribute **attrs,
+ * 		int count);
+ * extern int sysfs_write_attributes(struct sysfs_write_request *reqs,
+ * 		int count, unsigned int flags);
+ * extern int sysfs_hold_attribute(struct sysfs_attribute *sysattr);
  ****************************************************************************
  */
 
@@ -316,3 +321,357 @@ int test_sysfs_write_attribute(int flag)
 
 	return 0;
 }
+
+/**
+ * extern int sysfs_read_attributes(struct sysfs_attribute **attrs,
+ * 			int count);
+ *
+ * flag:
+ * 	0:	attrs -> valid, count -> valid
+ * 	1:	attrs -> NULL, count -> valid
+ * 	2:	attrs -> valid, count -> 0
+ * 	3:	attrs -> valid with a NULL entry, count -> valid
+ */
+int test_sysfs_read_attributes(int flag)
+{
+	struct sysfs_attribute *attrs[2] = { NULL, NULL };
+	struct sysfs_attribute *single = NULL;
+	struct sysfs_attribute **list = attrs;
+	int count = 2, ret = 0, i;
+
+	attrs[0] = sysfs_open_attribute(val_file_path);
+	attrs[1] = sysfs_open_attribute(val_write_attr_path);
+	if (attrs[0] == NULL || attrs[1] == NULL) {
+		dbg_print("%s: failed opening attributes at %s and %s\n",
+				__FUNCTION__, val_file_path,
+				val_write_attr_path);
+		goto out;
+	}
+
+	switch (flag) {
+	case 0:
+		break;
+	case 1:
+		list = NULL;
+		break;
+	case 2:
+		count = 0;
+		break;
+	case 3:
+		sysfs_close_attribute(attrs[1]);
+		attrs[1] = NULL;
+		break;
+	default:
+		sysfs_close_attribute(attrs[0]);
+		sysfs_close_attribute(attrs[1]);
+		return -1;
+	}
+	ret = sysfs_read_attributes(list, count);
+
+	switch (flag) {
+	case 0:
+		if (ret != 0) {
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+			break;
+		}
+		/* each value has to be what reading it on its own gives */
+		for (i = 0; i < count; i++) {
+			single = sysfs_open_attribute(attrs[i]->path);
+			if (single == NULL || sysfs_read_attribute(single) ||
+			    single->len != attrs[i]->len ||
+			    memcmp(single->value, attrs[i]->value,
+				    single->len))
+				break;
+			sysfs_close_attribute(single);
+			single = NULL;
+		}
+		if (i < count)
+			dbg_print("%s: FAILED with flag = %d, %s read as "
+					"a batch differs\n", __FUNCTION__,
+					flag, attrs[i]->path);
+		else {
+			dbg_print("%s: SUCCEEDED with flag = %d\n\n",
+						__FUNCTION__, flag);
+			show_attribute(attrs[0]);
+			show_attribute(attrs[1]);
+			dbg_print("\n");
+		}
+		break;
+	case 1:
+		if (ret == 0 || errno != EINVAL)
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else
+			dbg_print("%s: SUCCEEDED with flag = %d\n",
+						__FUNCTION__, flag);
+		break;
+	case 2:
+		if (ret != 0 || attrs[0]->value != NULL)
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else
+			dbg_print("%s: SUCCEEDED with flag = %d\n",
+						__FUNCTION__, flag);
+		break;
+	case 3:
+		/* the other entries are still read */
+		if (ret == 0 || attrs[0]->value == NULL)
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else
+			dbg_print("%s: SUCCEEDED with flag = %d\n",
+						__FUNCTION__, flag);
+		break;
+	default:
+		break;
+	}
+
+out:
+	if (single != NULL)
+		sysfs_close_attribute(single);
+	for (i = 0; i < 2; i++)
+		if (attrs[i] != NULL)
+			sysfs_close_attribute(attrs[i]);
+
+	return 0;
+}
+
+/**
+ * extern int sysfs_write_attributes(struct sysfs_write_request *reqs,
+ * 			int count, unsigned int flags);
+ *
+ * flag:
+ * 	0:	reqs -> valid, value -> current, flags -> 0
+ * 	1:	reqs -> valid, value -> current, flags -> SYSFS_WRITE_REREAD
+ * 	2:	reqs -> valid, value -> current, flags -> SYSFS_WRITE_CACHED
+ * 	3:	reqs -> valid and one without an attribute,
+ * 		flags -> SYSFS_WRITE_PARALLEL with 2 threads
+ * 	4:	reqs -> valid, value -> invalid,
+ * 		flags -> SYSFS_WRITE_REREAD | SYSFS_WRITE_NO_RESTORE
+ * 	5:	reqs -> NULL
+ * 	6:	reqs -> valid, count -> invalid
+ */
+int test_sysfs_write_attributes(int flag)
+{
+	struct sysfs_write_request reqs[2];
+	struct sysfs_attribute *sysattr = NULL;
+	char *old_value = NULL;
+	unsigned int flags = 0, threads = 0;
+	size_t old_len = 0;
+	int count = 1, ret = 0;
+
+	memset(reqs, 0, sizeof(reqs));
+	sysattr = sysfs_open_attribute(val_write_attr_path);
+	if (sysattr == NULL) {
+		dbg_print("%s: failed opening attribute at %s\n",
+				__FUNCTION__, val_write_attr_path);
+		return 0;
+	}
+	if (sysfs_read_attribute(sysattr) != 0) {
+		dbg_print("%s: failed reading attribute at %s\n",
+				__FUNCTION__, val_write_attr_path);
+		sysfs_close_attribute(sysattr);
+		return 0;
+	}
+	old_len = sysattr->len;
+	old_value = calloc(1, old_len + 1);
+	memcpy(old_value, sysattr->value, old_len);
+	reqs[0].attr = sysattr;
+	reqs[0].value = old_value;
+	reqs[0].len = old_len;
+
+	switch (flag) {
+	case 0:
+		break;
+	case 1:
+		flags = SYSFS_WRITE_REREAD;
+		break;
+	case 2:
+		flags = SYSFS_WRITE_CACHED;
+		break;
+	case 3:
+		flags = SYSFS_WRITE_PARALLEL;
+		threads = sysfs_set_threads(2);
+		reqs[1].attr = NULL;
+		reqs[1].value = old_value;
+		reqs[1].len = old_len;
+		count = 2;
+		break;
+	case 4:
+		flags = SYSFS_WRITE_REREAD | SYSFS_WRITE_NO_RESTORE;
+		reqs[0].value = "this should not get copied in the attrib";
+		reqs[0].len = strlen(reqs[0].value);
+		break;
+	case 5:
+		break;
+	case 6:
+		count = -1;
+		break;
+	default:
+		sysfs_close_attribute(sysattr);
+		free(old_value);
+		return -1;
+	}
+	ret = sysfs_write_attributes(flag == 5 ? NULL : reqs, count, flags);
+
+	switch (flag) {
+	case 0:
+		if (ret != 0 || reqs[0].status != SYSFS_WRITE_DONE)
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else {
+			dbg_print("%s: SUCCEEDED with flag = %d\n\n",
+						__FUNCTION__, flag);
+			dbg_print("Attribute at %s now has value %s\n\n",
+					sysattr->path, sysattr->value);
+		}
+		break;
+	case 1:
+	case 2:
+		/* the value is already there, so nothing is written */
+		if (ret != 0 || reqs[0].status != SYSFS_WRITE_SAME)
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else
+			dbg_print("%s: SUCCEEDED with flag = %d\n",
+						__FUNCTION__, flag);
+		break;
+	case 3:
+		if (ret == 0 || reqs[0].status != SYSFS_WRITE_DONE ||
+		    reqs[1].status != SYSFS_WRITE_FAILED ||
+		    reqs[1].error != EINVAL)
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else
+			dbg_print("%s: SUCCEEDED with flag = %d\n",
+						__FUNCTION__, flag);
+		break;
+	case 4:
+		/* the old value is kept, as the kernel still has it */
+		if (ret == 0 || reqs[0].status != SYSFS_WRITE_FAILED ||
+		    sysattr->len != old_len ||
+		    memcmp(sysattr->value, old_value, old_len))
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else
+			dbg_print("%s: SUCCEEDED with flag = %d\n",
+						__FUNCTION__, flag);
+		break;
+	case 5:
+	case 6:
+		if (ret == 0 || errno != EINVAL)
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else
+			dbg_print("%s: SUCCEEDED with flag = %d\n",
+						__FUNCTION__, flag);
+		break;
+	default:
+		break;
+	}
+	if (flag == 3)
+		sysfs_set_threads(threads);
+	sysfs_close_attribute(sysattr);
+	free(old_value);
+
+	return 0;
+}
+
+/**
+ * extern int sysfs_hold_attribute(struct sysfs_attribute *sysattr);
+ *
+ * The held attribute is read on its own and then in a batch, and its
+ * value compared with what was in the file.
+ *
+ * flag:
+ * 	0:	sysattr -> valid
+ * 	1:	sysattr -> valid, value longer than a page
+ * 	2:	sysattr -> NULL
+ */
+int test_sysfs_hold_attribute(int flag)
+{
+	struct sysfs_attribute *sysattr = NULL;
+	char file[SYSFS_PATH_MAX];
+	char *data = NULL;
+	size_t len = 0, i;
+	int ret = 0, fd;
+
+	snprintf(file, SYSFS_PATH_MAX, "/tmp/testlibsysfs.%d.attr",
+			(int)getpid());
+	switch (flag) {
+	case 0:
+		sysattr = sysfs_open_attribute(val_file_path);
+		if (sysattr == NULL || sysfs_read_attribute(sysattr)) {
+			dbg_print("%s: failed reading attribute at %s\n",
+					__FUNCTION__, val_file_path);
+			goto out;
+		}
+		len = sysattr->len;
+		data = calloc(1, len + 1);
+		memcpy(data, sysattr->value, len);
+		break;
+	case 1:
+		/* a regular file stands in for a big binary attribute */
+		len = 2 * getpagesize() + 1000;
+		data = calloc(1, len + 1);
+		for (i = 0; i < len; i++)
+			data[i] = 'a' + i % 26;
+		fd = open(file, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+		if (fd < 0 || write(fd, data, len) != (ssize_t)len) {
+			dbg_print("%s: failed writing %s\n", __FUNCTION__,
+					file);
+			if (fd >= 0)
+				close(fd);
+			goto out;
+		}
+		close(fd);
+		sysattr = sysfs_open_attribute(file);
+		if (sysattr == NULL || sysfs_read_attribute(sysattr)) {
+			dbg_print("%s: failed reading attribute at %s\n",
+					__FUNCTION__, file);
+			goto out;
+		}
+		break;
+	case 2:
+		sysattr = NULL;
+		break;
+	default:
+		return -1;
+	}
+	ret = sysfs_hold_attribute(sysattr);
+
+	switch (flag) {
+	case 0:
+	case 1:
+		if (ret != 0 || sysfs_read_attribute(sysattr) ||
+		    sysattr->len != len || memcmp(sysattr->value, data, len) ||
+		    sysfs_read_attributes(&sysattr, 1) ||
+		    sysattr->len != len || memcmp(sysattr->value, data, len))
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else
+			dbg_print("%s: SUCCEEDED with flag = %d\n",
+						__FUNCTION__, flag);
+		break;
+	case 2:
+		if (ret == 0)
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else
+			dbg_print("%s: SUCCEEDED with flag = %d\n",
+						__FUNCTION__, flag);
+		break;
+	default:
+		break;
+	}
+
+out:
+	if (sysattr != NULL)
+		sysfs_close_attribute(sysattr);
+	if (flag == 1)
+		unlink(file);
+	free(data);
+
+	return 0;
+}
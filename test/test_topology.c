@@ -0,0 +1,366 @@
+/*
+ * test_topology.c
+ *
+ * Tests for topology related functions for the libsysfs testsuite
+ *
+ * Copyright (C) IBM Corp. 2004-2005
+ *
+ *      This program is free software; you can redistribute it and/or modify it
+ *      under the terms of the GNU General Public License as published by the
+ *      Free Software Foundation version 2 of the License.
+ *
+ *      This program is distributed in the hope that it will be useful, but
+ *      WITHOUT ANY WARRANTY; without even the implied warranty of
+ *      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *      General Public License for more details.
+ *
+ *      You should have received a copy of the GNU General Public License along
+ *      with this program; if not, write to the Free Software Foundation, Inc.,
+ *      675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+/**
+ ***************************************************************************
+ * this will test the topology related functions provided by libsysfs.
+ *
+ * extern struct sysfs_topology *sysfs_open_topology(void);
+ * extern void sysfs_close_topology(struct sysfs_topology *topo);
+ * extern const char *sysfs_topology_device(struct sysfs_topology *topo,
+ * 		const char *cdevpath);
+ * extern const char **sysfs_topology_class_devices
+ * 	(struct sysfs_topology *topo, const char *devpath);
+ * extern const char **sysfs_topology_driver_devices
+ * 	(struct sysfs_topology *topo, const char *drvpath);
+ ****************************************************************************
+ */
+
+#include "test-defs.h"
+#include <errno.h>
+
+/* whether path is in the NULL terminated list */
+static int in_list(const char **list, const char *path)
+{
+	for (; list && *list; list++)
+		if (!strcmp(*list, path))
+			return 1;
+	return 0;
+}
+
+/**
+ * extern void sysfs_close_topology(struct sysfs_topology *topo);
+ *
+ * flag:
+ * 	0:	topo -> valid
+ * 	1:	topo -> NULL
+ */
+int test_sysfs_close_topology(int flag)
+{
+	struct sysfs_topology *topo = NULL;
+
+	switch (flag) {
+	case 0:
+		topo = sysfs_open_topology();
+		if (topo == NULL) {
+			dbg_print("%s: failed opening the topology\n",
+					__FUNCTION__);
+			return 0;
+		}
+		break;
+	case 1:
+		topo = NULL;
+		break;
+	default:
+		return -1;
+	}
+	sysfs_close_topology(topo);
+
+	dbg_print("%s: returns void\n", __FUNCTION__);
+
+	return 0;
+}
+
+/**
+ * extern struct sysfs_topology *sysfs_open_topology(void);
+ *
+ * flag:
+ * 	0:	valid
+ */
+int test_sysfs_open_topology(int flag)
+{
+	struct sysfs_topology *topo = NULL;
+
+	switch (flag) {
+	case 0:
+		break;
+	default:
+		return -1;
+	}
+	topo = sysfs_open_topology();
+
+	switch (flag) {
+	case 0:
+		if (topo == NULL)
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else
+			dbg_print("%s: SUCCEEDED with flag = %d\n",
+						__FUNCTION__, flag);
+		break;
+	default:
+		break;
+	}
+	if (topo != NULL)
+		sysfs_close_topology(topo);
+
+	return 0;
+}
+
+/**
+ * extern const char *sysfs_topology_device(struct sysfs_topology *topo,
+ * 		const char *cdevpath);
+ *
+ * flag:
+ * 	0:	topo -> valid, cdevpath -> valid
+ * 	1:	topo -> valid, cdevpath -> invalid
+ * 	2:	topo -> valid, cdevpath -> NULL
+ * 	3:	topo -> NULL, cdevpath -> valid
+ */
+int test_sysfs_topology_device(int flag)
+{
+	struct sysfs_topology *topo = NULL;
+	const char *device = NULL;
+	char *path = NULL;
+	char link[SYSFS_PATH_MAX], target[SYSFS_PATH_MAX];
+
+	topo = sysfs_open_topology();
+	if (topo == NULL) {
+		dbg_print("%s: failed opening the topology\n", __FUNCTION__);
+		return 0;
+	}
+
+	switch (flag) {
+	case 0:
+		path = val_class_dev_path;
+		break;
+	case 1:
+		path = inval_path;
+		break;
+	case 2:
+		path = NULL;
+		break;
+	case 3:
+		path = val_class_dev_path;
+		sysfs_close_topology(topo);
+		topo = NULL;
+		break;
+	default:
+		sysfs_close_topology(topo);
+		return -1;
+	}
+	device = sysfs_topology_device(topo, path);
+
+	switch (flag) {
+	case 0:
+		/* the device has to be where the class device's link goes */
+		snprintf(link, SYSFS_PATH_MAX, "%s/device", val_class_dev_path);
+		if (device == NULL ||
+		    sysfs_get_link(link, target, SYSFS_PATH_MAX) ||
+		    strcmp(device, target))
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else {
+			dbg_print("%s: SUCCEEDED with flag = %d\n\n",
+						__FUNCTION__, flag);
+			dbg_print("Device of %s is %s\n\n",
+					val_class_dev_path, device);
+		}
+		break;
+	case 1:
+	case 2:
+	case 3:
+		if (device != NULL)
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else
+			dbg_print("%s: SUCCEEDED with flag = %d\n",
+						__FUNCTION__, flag);
+		break;
+	default:
+		break;
+	}
+	if (topo != NULL)
+		sysfs_close_topology(topo);
+
+	return 0;
+}
+
+/**
+ * extern const char **sysfs_topology_class_devices
+ * 	(struct sysfs_topology *topo, const char *devpath);
+ *
+ * flag:
+ * 	0:	topo -> valid, devpath -> valid
+ * 	1:	topo -> valid, devpath -> invalid
+ * 	2:	topo -> valid, devpath -> NULL
+ * 	3:	topo -> NULL, devpath -> valid
+ */
+int test_sysfs_topology_class_devices(int flag)
+{
+	struct sysfs_topology *topo = NULL;
+	const char **classdevs = NULL;
+	char *path = NULL;
+	char link[SYSFS_PATH_MAX], target[SYSFS_PATH_MAX];
+
+	snprintf(link, SYSFS_PATH_MAX, "%s/device", val_class_dev_path);
+	if (sysfs_get_link(link, target, SYSFS_PATH_MAX)) {
+		dbg_print("%s: failed reading link at %s\n",
+				__FUNCTION__, link);
+		return 0;
+	}
+	topo = sysfs_open_topology();
+	if (topo == NULL) {
+		dbg_print("%s: failed opening the topology\n", __FUNCTION__);
+		return 0;
+	}
+
+	switch (flag) {
+	case 0:
+		path = target;
+		break;
+	case 1:
+		path = inval_path;
+		break;
+	case 2:
+		path = NULL;
+		break;
+	case 3:
+		path = target;
+		sysfs_close_topology(topo);
+		topo = NULL;
+		break;
+	default:
+		sysfs_close_topology(topo);
+		return -1;
+	}
+	classdevs = sysfs_topology_class_devices(topo, path);
+
+	switch (flag) {
+	case 0:
+		/* the class device the link was read from is among them */
+		if (!in_list(classdevs, val_class_dev_path))
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else {
+			dbg_print("%s: SUCCEEDED with flag = %d\n\n",
+						__FUNCTION__, flag);
+			for (; *classdevs; classdevs++)
+				dbg_print("Class device of %s: %s\n",
+						target, *classdevs);
+			dbg_print("\n");
+		}
+		break;
+	case 1:
+	case 2:
+	case 3:
+		if (classdevs != NULL)
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else
+			dbg_print("%s: SUCCEEDED with flag = %d\n",
+						__FUNCTION__, flag);
+		break;
+	default:
+		break;
+	}
+	if (topo != NULL)
+		sysfs_close_topology(topo);
+
+	return 0;
+}
+
+/**
+ * extern const char **sysfs_topology_driver_devices
+ * 	(struct sysfs_topology *topo, const char *drvpath);
+ *
+ * flag:
+ * 	0:	topo -> valid, drvpath -> valid
+ * 	1:	topo -> valid, drvpath -> invalid
+ * 	2:	topo -> valid, drvpath -> NULL
+ * 	3:	topo -> NULL, drvpath -> valid
+ */
+int test_sysfs_topology_driver_devices(int flag)
+{
+	struct sysfs_topology *topo = NULL;
+	const char **devices = NULL, **dev;
+	const char *driver = NULL;
+	char *path = NULL;
+	char name[SYSFS_NAME_LEN];
+
+	topo = sysfs_open_topology();
+	if (topo == NULL) {
+		dbg_print("%s: failed opening the topology\n", __FUNCTION__);
+		return 0;
+	}
+
+	switch (flag) {
+	case 0:
+		path = val_drv_path;
+		break;
+	case 1:
+		path = inval_path;
+		break;
+	case 2:
+		path = NULL;
+		break;
+	case 3:
+		path = val_drv_path;
+		sysfs_close_topology(topo);
+		topo = NULL;
+		break;
+	default:
+		sysfs_close_topology(topo);
+		return -1;
+	}
+	devices = sysfs_topology_driver_devices(topo, path);
+
+	switch (flag) {
+	case 0:
+		/* val_drv_dev_name is bound, and bound to val_drv_path */
+		for (dev = devices; dev && *dev; dev++)
+			if (!sysfs_get_name_from_path(*dev, name,
+						SYSFS_NAME_LEN) &&
+			    !strcmp(name, val_drv_dev_name))
+				break;
+		if (dev && *dev)
+			driver = sysfs_topology_driver(topo, *dev);
+		if (driver == NULL || strcmp(driver, val_drv_path))
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else {
+			dbg_print("%s: SUCCEEDED with flag = %d\n\n",
+						__FUNCTION__, flag);
+			for (dev = devices; *dev; dev++)
+				dbg_print("Device bound to %s: %s\n",
+						val_drv_path, *dev);
+			dbg_print("\n");
+		}
+		break;
+	case 1:
+	case 2:
+	case 3:
+		if (devices != NULL)
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else
+			dbg_print("%s: SUCCEEDED with flag = %d\n",
+						__FUNCTION__, flag);
+		break;
+	default:
+		break;
+	}
+	if (topo != NULL)
+		sysfs_close_topology(topo);
+
+	return 0;
+}
@@ -35,6 +35,7 @@
  * extern struct dlist *sysfs_open_directory_list(char *name);
  * extern struct dlist *sysfs_open_link_list(char *name);
  * extern void sysfs_close_list(struct dlist *list);
+ * extern int sysfs_write_snapshot(const char *file, const char **dirs);
  *****************************************************************************
  */
 
@@ -626,3 +627,102 @@ int test_sysfs_close_list(int flag)
 
 	return 0;
 }
+
+/**
+ * extern int sysfs_write_snapshot(const char *file, const char **dirs);
+ *
+ * The snapshot is read back through sysfs_open_context() and the value
+ * of val_file_path in it compared with the live one.
+ *
+ * flag:
+ * 	0:	file -> valid, dirs -> valid
+ * 	1:	file -> invalid, dirs -> valid
+ * 	2:	file -> NULL, dirs -> valid
+ */
+int test_sysfs_write_snapshot(int flag)
+{
+	/* where val_file_path and the devices its links lead to are */
+	const char *dirs[] = { "devices", "block", NULL };
+	struct sysfs_attribute *live = NULL, *saved = NULL;
+	struct sysfs_context *ctx = NULL, *old;
+	char file[SYSFS_PATH_MAX];
+	char *path = NULL;
+	int ret = 0;
+
+	snprintf(file, SYSFS_PATH_MAX, "/tmp/testlibsysfs.%d.snap",
+			(int)getpid());
+	switch (flag) {
+	case 0:
+		path = file;
+		break;
+	case 1:
+		path = inval_path;
+		break;
+	case 2:
+		path = NULL;
+		break;
+	default:
+		return -1;
+	}
+	ret = sysfs_write_snapshot(path, dirs);
+
+	switch (flag) {
+	case 0:
+		if (ret != 0) {
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+			break;
+		}
+		live = sysfs_open_attribute(val_file_path);
+		if (live == NULL || sysfs_read_attribute(live)) {
+			dbg_print("%s: failed reading attribute at %s\n",
+					__FUNCTION__, val_file_path);
+			break;
+		}
+		ctx = sysfs_open_context(file);
+		if (ctx == NULL) {
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+			break;
+		}
+		old = sysfs_use_context(ctx);
+		saved = sysfs_open_attribute(val_file_path);
+		if (saved != NULL && sysfs_read_attribute(saved)) {
+			sysfs_close_attribute(saved);
+			saved = NULL;
+		}
+		sysfs_use_context(old);
+		if (saved == NULL || saved->len != live->len ||
+		    memcmp(saved->value, live->value, live->len))
+			dbg_print("%s: FAILED with flag = %d, %s differs "
+					"in the snapshot\n", __FUNCTION__,
+					flag, val_file_path);
+		else {
+			dbg_print("%s: SUCCEEDED with flag = %d\n\n",
+						__FUNCTION__, flag);
+			show_attribute(saved);
+			dbg_print("\n");
+		}
+		break;
+	case 1:
+	case 2:
+		if (ret == 0)
+			dbg_print("%s: FAILED with flag = %d errno = %d\n",
+						__FUNCTION__, flag, errno);
+		else
+			dbg_print("%s: SUCCEEDED with flag = %d\n",
+						__FUNCTION__, flag);
+		break;
+	default:
+		break;
+	}
+	if (saved != NULL)
+		sysfs_close_attribute(saved);
+	if (live != NULL)
+		sysfs_close_attribute(live);
+	sysfs_close_context(ctx);
+	if (flag == 0 && ret == 0)
+		unlink(file);
+
+	return 0;
+}